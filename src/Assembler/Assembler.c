@@ -0,0 +1,333 @@
+/**
+ * @file Assembler.c
+ * @brief Single-pass assembler: turns the text of a program into instruction words.
+ *
+ * The file is mapped into memory and scanned once, byte by byte. Opcodes are looked
+ * up in a perfect hash table (one probe and one compare), operands are converted
+ * while they are scanned, and every error names the line and column it was found at.
+ */
+
+#include "../Headers/Assembler.h"
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    char name[5];          // the mnemonic, "" for a free slot
+    uint8_t opcode;        // the 4 bit opcode
+    bool registerOperand;  // R-type: the second operand is a register
+} OpcodeEntry;
+
+/*
+ * OpcodeHash maps each of the 12 mnemonics to a different slot, so a lookup is one
+ * table read and one compare. The slots were found by trying small multipliers.
+ */
+#define OpcodeHash(first, second, last, length) (((first) * 3 + (second) * 23 + (last) + (length)) & 31)
+
+static const OpcodeEntry opcodeTable[32] = {
+    [6] = {"ADD", 0, true},
+    [1] = {"SUB", 1, true},
+    [25] = {"MUL", 2, true},
+    [13] = {"MOVI", 3, false},
+    [23] = {"BEQZ", 4, false},
+    [18] = {"ANDI", 5, false},
+    [29] = {"EOR", 6, true},
+    [24] = {"BR", 7, true},
+    [31] = {"SAL", 8, false},
+    [5] = {"SAR", 9, false},
+    [21] = {"LDR", 10, false},
+    [26] = {"STR", 11, false},
+};
+
+// The scanner state: the position in the text and the start of the current line
+typedef struct {
+    const char *text;
+    const char *end;
+    const char *position;
+    const char *lineStart;
+    int line;
+    AssemblerError *error;
+} Scanner;
+
+// Function to record an error at a position of the current line; always returns false
+static bool Fail(Scanner *scanner, const char *at, const char *format, ...)
+{
+    if (scanner->error != NULL)
+    {
+        scanner->error->line = scanner->line;
+        scanner->error->column = (int)(at - scanner->lineStart) + 1;
+        va_list arguments;
+        va_start(arguments, format);
+        vsnprintf(scanner->error->message, sizeof(scanner->error->message), format, arguments);
+        va_end(arguments);
+    }
+    return false;
+}
+
+static inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Function to tell whether a character ends a token: white space, a comment or the end of the line
+static inline bool EndsToken(const Scanner *scanner, const char *at)
+{
+    return at == scanner->end || IsSpace(*at) || *at == '\n' || *at == '#' || *at == ';';
+}
+
+// Function to skip spaces and a comment; stops at the newline or the end of the text
+static void SkipBlanks(Scanner *scanner)
+{
+    const char *p = scanner->position;
+    while (p < scanner->end && IsSpace(*p))
+    {
+        p++;
+    }
+    if (p < scanner->end && (*p == '#' || *p == ';'))
+    {
+        const char *newline = memchr(p, '\n', (size_t)(scanner->end - p));
+        p = newline != NULL ? newline : scanner->end;
+    }
+    scanner->position = p;
+}
+
+// Function to tell whether the scanner is at the end of the line (after SkipBlanks)
+static inline bool AtLineEnd(const Scanner *scanner)
+{
+    return scanner->position == scanner->end || *scanner->position == '\n';
+}
+
+// Function to read a decimal number with an optional sign into *value
+static bool ScanNumber(Scanner *scanner, const char *what, int min, int max, int *value)
+{
+    const char *start = scanner->position;
+    const char *p = start;
+    bool negative = false;
+    if (p < scanner->end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == scanner->end || *p < '0' || *p > '9')
+    {
+        return Fail(scanner, start, "expected %s", what);
+    }
+    int number = 0;
+    while (p < scanner->end && *p >= '0' && *p <= '9')
+    {
+        if (number < 1000)
+        {
+            number = number * 10 + (*p - '0');
+        }
+        p++;
+    }
+    if (!EndsToken(scanner, p))
+    {
+        return Fail(scanner, start, "expected %s", what);
+    }
+    number = negative ? -number : number;
+    if (number < min || number > max)
+    {
+        return Fail(scanner, start, "value out of range (%d to %d)", min, max);
+    }
+    scanner->position = p;
+    *value = number;
+    return true;
+}
+
+// Function to read a register name R0 to R63 into *value
+static bool ScanRegister(Scanner *scanner, int *value)
+{
+    const char *start = scanner->position;
+    if (start == scanner->end || *start != 'R')
+    {
+        return Fail(scanner, start, "expected a register (R0 to R63)");
+    }
+    scanner->position++;
+    if (scanner->position < scanner->end && (*scanner->position == '-' || *scanner->position == '+'))
+    {
+        return Fail(scanner, start, "expected a register (R0 to R63)");
+    }
+    if (!ScanNumber(scanner, "a register number", 0, 63, value))
+    {
+        if (scanner->error != NULL)
+        {
+            scanner->error->column = (int)(start - scanner->lineStart) + 1;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Function to assemble the instruction starting at the scanner position (a non-blank line)
+static bool ScanInstruction(Scanner *scanner, uint16_t *instruction)
+{
+    const char *start = scanner->position;
+    const char *p = start;
+    while (!EndsToken(scanner, p))
+    {
+        p++;
+    }
+    size_t length = (size_t)(p - start);
+    const OpcodeEntry *entry = NULL;
+    if (length >= 2 && length <= 4)
+    {
+        entry = &opcodeTable[OpcodeHash((uint8_t)start[0], (uint8_t)start[1], (uint8_t)start[length - 1], length)];
+        if (strlen(entry->name) != length || memcmp(entry->name, start, length) != 0)
+        {
+            entry = NULL;
+        }
+    }
+    if (entry == NULL)
+    {
+        return Fail(scanner, start, "unknown instruction '%.*s'", (int)(length > 16 ? 16 : length), start);
+    }
+    scanner->position = p;
+
+    int operand1;
+    int operand2;
+    SkipBlanks(scanner);
+    if (AtLineEnd(scanner))
+    {
+        return Fail(scanner, scanner->position, "%s needs two operands", entry->name);
+    }
+    if (!ScanRegister(scanner, &operand1))
+    {
+        return false;
+    }
+    SkipBlanks(scanner);
+    if (AtLineEnd(scanner))
+    {
+        return Fail(scanner, scanner->position, "%s needs two operands", entry->name);
+    }
+    if (entry->registerOperand)
+    {
+        if (!ScanRegister(scanner, &operand2))
+        {
+            return false;
+        }
+    }
+    else if (!ScanNumber(scanner, "an immediate", -32, 63, &operand2))
+    {
+        return false;
+    }
+    SkipBlanks(scanner);
+    if (!AtLineEnd(scanner))
+    {
+        return Fail(scanner, scanner->position, "unexpected text after the operands");
+    }
+
+    // Combine the opcode and operands into a 16-bit instruction
+    *instruction = ((entry->opcode & 0b1111) << 12) | ((operand1 & 0b111111) << 6) | (operand2 & 0b111111);
+    return true;
+}
+
+bool Assemble(const char *text, size_t length, uint16_t *program, size_t *count, AssemblerError *error)
+{
+    return AssembleWithLines(text, length, program, NULL, count, error);
+}
+
+bool AssembleWithLines(const char *text, size_t length, uint16_t *program, int *lines, size_t *count, AssemblerError *error)
+{
+    Scanner scanner = {text, text + length, text, text, 1, error};
+    size_t address = 0;
+    *count = 0;
+    while (scanner.position < scanner.end)
+    {
+        SkipBlanks(&scanner);
+        if (!AtLineEnd(&scanner))
+        {
+            if (address == ASSEMBLER_MAX_INSTRUCTIONS)
+            {
+                return Fail(&scanner, scanner.position, "more than %d instructions", ASSEMBLER_MAX_INSTRUCTIONS);
+            }
+            if (!ScanInstruction(&scanner, &program[address]))
+            {
+                return false;
+            }
+            if (lines != NULL)
+            {
+                lines[address] = scanner.line;
+            }
+            address++;
+        }
+        if (scanner.position < scanner.end)
+        {
+            // the newline
+            scanner.position++;
+            scanner.lineStart = scanner.position;
+            scanner.line++;
+        }
+    }
+    *count = address;
+    return true;
+}
+
+const char *MapProgramFile(const char *file_name, size_t *length, AssemblerError *error)
+{
+    *length = 0;
+    int fd = open(file_name, O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (error != NULL)
+        {
+            error->line = 0;
+            error->column = 0;
+            snprintf(error->message, sizeof(error->message), "could not open the file");
+        }
+        return NULL;
+    }
+    if (status.st_size == 0)
+    {
+        close(fd);
+        return ""; // an empty program, nothing to map
+    }
+    const char *text = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        if (error != NULL)
+        {
+            error->line = 0;
+            error->column = 0;
+            snprintf(error->message, sizeof(error->message), "could not map the file");
+        }
+        return NULL;
+    }
+    *length = (size_t)status.st_size;
+    return text;
+}
+
+void UnmapProgramFile(const char *text, size_t length)
+{
+    if (length > 0)
+    {
+        munmap((void *)text, length);
+    }
+}
+
+bool AssembleFile(const char *file_name, uint16_t *program, size_t *count, AssemblerError *error)
+{
+    size_t length;
+    const char *text = MapProgramFile(file_name, &length, error);
+    if (text == NULL)
+    {
+        *count = 0;
+        return false;
+    }
+    bool assembled = Assemble(text, length, program, count, error);
+    UnmapProgramFile(text, length);
+    return assembled;
+}
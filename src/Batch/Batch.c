@@ -0,0 +1,304 @@
+/**
+ * @file Batch.c
+ * @brief Runs a directory of programs on a work-stealing pool of worker threads.
+ */
+
+#include "../Headers/Batch.h"
+#include "../Headers/CPU.h"
+#include "../Headers/Report.h"
+#include "../Headers/Trace.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief One program of the batch and the outcome of its run.
+ */
+typedef struct {
+    char *path;          /**< Path of the assembly file. */
+    EngineResult result; /**< Executed instructions and whether the program ended. */
+    bool failed;         /**< The program was not run, could not be loaded or its output not be written. */
+    AssemblerError error; /**< Why the program could not be loaded (line 0 if it was not an assembler error). */
+} BatchJob;
+
+/**
+ * @brief The programs a worker still has to run: jobs[head] to jobs[tail - 1].
+ *
+ * The owner takes jobs from the tail, thieves from the head.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} WorkQueue;
+
+/**
+ * @brief The state shared by the workers of a batch.
+ */
+typedef struct {
+    BatchJob *jobs;
+    WorkQueue *queues;
+    int workers;
+    const BatchOptions *options;
+} Batch;
+
+/**
+ * @brief The arguments of one worker thread.
+ */
+typedef struct {
+    Batch *batch;
+    int index;
+    uint64_t steals; /**< Jobs this worker took from other workers. */
+} Worker;
+
+// Function to take the next job of the worker's own queue (from the back)
+static bool TakeOwnJob(WorkQueue *queue, size_t *job)
+{
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+    {
+        *job = --queue->tail;
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Function to steal a job from the front of another worker's queue
+static bool StealJob(WorkQueue *queue, size_t *job)
+{
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+    {
+        *job = queue->head++;
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Function to run one program and write its final state next to it
+static void RunJob(CPU *cpu, BatchJob *job, const BatchOptions *options)
+{
+    ResetCPU(cpu);
+    if (!LoadProgram(cpu, job->path, &job->error))
+    {
+        job->failed = true;
+        return;
+    }
+    job->result = RunEngine(cpu, options->engine, options->maxInstructions, options->jitThreshold);
+
+    // <program>.txt is written to <program>.out
+    size_t length = strlen(job->path) - 4;
+    char *outputPath = malloc(length + 5);
+    if (outputPath == NULL)
+    {
+        job->failed = true;
+        return;
+    }
+    memcpy(outputPath, job->path, length);
+    memcpy(outputPath + length, ".out", 5);
+    FILE *output = fopen(outputPath, "w");
+    free(outputPath);
+    if (output == NULL)
+    {
+        job->failed = true;
+        return;
+    }
+    PrintCPUState(cpu, output);
+    job->failed = fclose(output) != 0;
+}
+
+static void *WorkerMain(void *argument)
+{
+    Worker *worker = argument;
+    Batch *batch = worker->batch;
+    CPU *cpu = CreateCPU();
+    if (cpu == NULL)
+    {
+        return NULL; // the other workers steal this worker's share
+    }
+
+    size_t job;
+    for (;;)
+    {
+        if (TakeOwnJob(&batch->queues[worker->index], &job))
+        {
+            RunJob(cpu, &batch->jobs[job], batch->options);
+            continue;
+        }
+        // own queue empty: look for work at the other workers, starting with the next one
+        bool stolen = false;
+        for (int i = 1; i < batch->workers && !stolen; i++)
+        {
+            stolen = StealJob(&batch->queues[(worker->index + i) % batch->workers], &job);
+        }
+        if (!stolen)
+        {
+            break; // queues never grow, so all work is taken
+        }
+        worker->steals++;
+        RunJob(cpu, &batch->jobs[job], batch->options);
+    }
+    DestroyCPU(cpu);
+    return NULL;
+}
+
+static int CompareJobs(const void *a, const void *b)
+{
+    return strcmp(((const BatchJob *)a)->path, ((const BatchJob *)b)->path);
+}
+
+// Function to collect the *.txt files of a directory, sorted by name
+static BatchJob *ListPrograms(const char *directory, size_t *count)
+{
+    DIR *dir = opendir(directory);
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+    size_t capacity = 64;
+    BatchJob *jobs = malloc(capacity * sizeof(BatchJob));
+    *count = 0;
+    struct dirent *entry;
+    while (jobs != NULL && (entry = readdir(dir)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length < 5 || strcmp(entry->d_name + length - 4, ".txt") != 0)
+        {
+            continue;
+        }
+        if (*count == capacity)
+        {
+            capacity *= 2;
+            BatchJob *grown = realloc(jobs, capacity * sizeof(BatchJob));
+            if (grown == NULL)
+            {
+                break;
+            }
+            jobs = grown;
+        }
+        BatchJob *job = &jobs[(*count)++];
+        memset(job, 0, sizeof(*job));
+        job->failed = true; // until a worker ran it
+        job->path = malloc(strlen(directory) + length + 2);
+        if (job->path == NULL)
+        {
+            (*count)--;
+            break;
+        }
+        sprintf(job->path, "%s/%s", directory, entry->d_name);
+    }
+    closedir(dir);
+    if (jobs != NULL)
+    {
+        qsort(jobs, *count, sizeof(BatchJob), CompareJobs);
+    }
+    return jobs;
+}
+
+int RunBatch(const char *directory, const BatchOptions *options)
+{
+    size_t count;
+    BatchJob *jobs = ListPrograms(directory, &count);
+    if (jobs == NULL)
+    {
+        return -1;
+    }
+
+    int workers = options->workers;
+    if (workers <= 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? (int)online : 1;
+    }
+
+    TraceSetLevel(TRACE_LEVEL_OFF);
+    double start = Now();
+
+    // every worker starts with a contiguous share of the sorted programs
+    Batch batch = {jobs, calloc(workers, sizeof(WorkQueue)), workers, options};
+    Worker *pool = calloc(workers, sizeof(Worker));
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    if (batch.queues == NULL || pool == NULL || threads == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < workers; i++)
+    {
+        pthread_mutex_init(&batch.queues[i].lock, NULL);
+        batch.queues[i].head = count * i / workers;
+        batch.queues[i].tail = count * (i + 1) / workers;
+        pool[i].batch = &batch;
+        pool[i].index = i;
+    }
+    int started = 0;
+    for (; started < workers; started++)
+    {
+        if (pthread_create(&threads[started], NULL, WorkerMain, &pool[started]) != 0)
+        {
+            break; // the running workers steal the shares of the missing ones
+        }
+    }
+    if (started == 0)
+    {
+        WorkerMain(&pool[0]);
+    }
+    uint64_t steals = 0;
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < workers; i++)
+    {
+        steals += pool[i].steals;
+        pthread_mutex_destroy(&batch.queues[i].lock);
+    }
+    double seconds = Now() - start;
+
+    int failed = 0;
+    uint64_t instructions = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (jobs[i].failed && jobs[i].error.line > 0)
+        {
+            printf("Error: %s:%d:%d: %s\n", jobs[i].path, jobs[i].error.line, jobs[i].error.column, jobs[i].error.message);
+            failed++;
+        }
+        else if (jobs[i].failed && jobs[i].error.line < 0)
+        {
+            printf("Error: %s: %s\n", jobs[i].path, jobs[i].error.message);
+            failed++;
+        }
+        else if (jobs[i].failed)
+        {
+            printf("Error: %s: could not run the program\n", jobs[i].path);
+            failed++;
+        }
+        else
+        {
+            printf("%s: %llu instructions%s\n", jobs[i].path,
+                   (unsigned long long)jobs[i].result.instructions,
+                   jobs[i].result.halted ? "" : " (instruction limit reached)");
+            instructions += jobs[i].result.instructions;
+        }
+        free(jobs[i].path);
+    }
+    fprintf(stderr, "Batch: %zu programs, %llu instructions on %d workers in %.3f s, %llu stolen\n",
+            count, (unsigned long long)instructions, started > 0 ? started : 1, seconds, (unsigned long long)steals);
+
+    free(threads);
+    free(pool);
+    free(batch.queues);
+    free(jobs);
+    return failed;
+}
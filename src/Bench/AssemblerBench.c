@@ -0,0 +1,142 @@
+/**
+ * @file AssemblerBench.c
+ * @brief Measures the programs/sec of the assembler against the old fscanf loop of LoadProgram and program images.
+ *
+ * The benchmark writes a generated 1024 instruction program to a temporary file,
+ * assembles it repeatedly both ways and loads it as a program image, checks that
+ * all three produce the same instruction words and prints the throughput of each.
+ */
+
+#include "../Headers/Assembler.h"
+#include "../Headers/CPU.h"
+#include "../Headers/Image.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Report.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *mnemonics[12] = {"ADD", "SUB", "MUL", "MOVI", "BEQZ", "ANDI", "EOR", "BR", "SAL", "SAR", "LDR", "STR"};
+
+// Function to parse a file the way LoadProgram did before the assembler (fscanf, strcmp chain and atoi)
+static size_t LegacyLoad(const char *file_name, uint16_t *program)
+{
+    FILE *file = fopen(file_name, "r");
+    size_t address = 0;
+    while (file != NULL && !feof(file) && address < ASSEMBLER_MAX_INSTRUCTIONS)
+    {
+        char opcode[5];
+        char operand1[4];
+        char operand2[4];
+        if (fscanf(file, "%4s %3s %3s", opcode, operand1, operand2) != 3)
+        {
+            break;
+        }
+        uint8_t opcode_int = 15;
+        for (uint8_t i = 0; i < 12; i++)
+        {
+            if (strcmp(opcode, mnemonics[i]) == 0)
+            {
+                opcode_int = i;
+                break;
+            }
+        }
+        bool registerOperand = opcode_int <= 2 || opcode_int == 6 || opcode_int == 7;
+        uint8_t operand1_int = atoi(operand1 + 1);
+        int8_t operand2_int = atoi(registerOperand ? operand2 + 1 : operand2);
+        program[address++] = ((opcode_int & 0b1111) << 12) | ((operand1_int & 0b111111) << 6) | (operand2_int & 0b111111);
+    }
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    return address;
+}
+
+int main(int argc, char *argv[])
+{
+    int repetitions = argc > 1 ? atoi(argv[1]) : 2000;
+    char file_name[] = "/tmp/assembler_benchXXXXXX";
+    int fd = mkstemp(file_name);
+    FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (file == NULL)
+    {
+        printf("Error: could not create a temporary file\n");
+        return 1;
+    }
+    srand(1);
+    for (int i = 0; i < ASSEMBLER_MAX_INSTRUCTIONS; i++)
+    {
+        int opcode = rand() % 12;
+        bool registerOperand = opcode <= 2 || opcode == 6 || opcode == 7;
+        if (registerOperand)
+        {
+            fprintf(file, "%s R%d R%d\n", mnemonics[opcode], rand() % 64, rand() % 64);
+        }
+        else
+        {
+            fprintf(file, "%s R%d %d\n", mnemonics[opcode], rand() % 64, rand() % 64 - 32);
+        }
+    }
+    fclose(file);
+
+    uint16_t legacy[ASSEMBLER_MAX_INSTRUCTIONS];
+    uint16_t program[ASSEMBLER_MAX_INSTRUCTIONS];
+    size_t legacyCount = 0;
+    size_t count = 0;
+    AssemblerError error;
+
+    double start = Now();
+    for (int i = 0; i < repetitions; i++)
+    {
+        legacyCount = LegacyLoad(file_name, legacy);
+    }
+    double legacySeconds = Now() - start;
+
+    start = Now();
+    bool assembled = true;
+    for (int i = 0; i < repetitions; i++)
+    {
+        assembled = AssembleFile(file_name, program, &count, &error) && assembled;
+    }
+    double seconds = Now() - start;
+
+    // the same program as an image with the predecoded table, loaded by LoadProgram
+    char image_name[] = "/tmp/assembler_benchXXXXXX";
+    int image_fd = mkstemp(image_name);
+    CPU *cpu = CreateCPU();
+    if (image_fd < 0 || cpu == NULL || !LoadProgram(cpu, file_name, NULL) ||
+        !SaveImage(cpu, count, IMAGE_SEGMENT_PREDECODED, image_name))
+    {
+        printf("Error: could not write the program image\n");
+        return 1;
+    }
+    close(image_fd);
+    start = Now();
+    bool loaded = true;
+    for (int i = 0; i < repetitions; i++)
+    {
+        loaded = LoadProgram(cpu, image_name, &error) && loaded;
+    }
+    double imageSeconds = Now() - start;
+    unlink(file_name);
+    unlink(image_name);
+
+    int16_t loadedProgram[ASSEMBLER_MAX_INSTRUCTIONS];
+    ReadInstructionMemoryBlock(cpu, 0, loadedProgram, count);
+    bool same = assembled && count == legacyCount && memcmp(program, legacy, count * sizeof(uint16_t)) == 0 &&
+                loaded && memcmp(loadedProgram, program, count * sizeof(uint16_t)) == 0;
+    DestroyCPU(cpu);
+    printf("Parser      Programs  Seconds   Programs/sec  Instructions/sec\n");
+    printf("fscanf    %10d  %7.3f  %13.0f  %16.0f\n", repetitions, legacySeconds, repetitions / legacySeconds,
+           repetitions * (double)legacyCount / legacySeconds);
+    printf("assembler %10d  %7.3f  %13.0f  %16.0f\n", repetitions, seconds, repetitions / seconds,
+           repetitions * (double)count / seconds);
+    printf("image     %10d  %7.3f  %13.0f  %16.0f\n", repetitions, imageSeconds, repetitions / imageSeconds,
+           repetitions * (double)count / imageSeconds);
+    printf("Speedup over fscanf: assembler %.2fx, image %.2fx\n", legacySeconds / seconds, legacySeconds / imageSeconds);
+    printf("Instructions: %s\n", same ? "identical" : "DIFFERENT");
+    return same ? 0 : 1;
+}
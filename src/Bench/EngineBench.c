@@ -0,0 +1,114 @@
+/**
+ * @file EngineBench.c
+ * @brief Measures the instructions/sec of the execute() switch engine against the threaded and JIT engines.
+ *
+ * The benchmark runs a looping ALU/memory program for a fixed instruction budget on
+ * each engine, checks that all engines end in the same architectural state and
+ * prints the throughput of each.
+ */
+
+#include "../Headers/CPU.h"
+#include "../Headers/Engine.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/JIT.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Registers.h"
+#include "../Headers/Report.h"
+#include "../Headers/Trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Function to combine an opcode and its operands into a 16-bit instruction, like LoadProgram does
+static uint16_t Encode(uint8_t opcode, uint8_t operand1, int8_t operand2)
+{
+    return ((opcode & 0b1111) << 12) | ((operand1 & 0b111111) << 6) | (operand2 & 0b111111);
+}
+
+// Function to load a program whose outer loop never ends, so the budget decides the run length
+static void LoadLoopProgram(CPU *cpu)
+{
+    uint16_t program[] = {
+        Encode(3, 1, 0),    // 0  MOVI R1 0
+        Encode(3, 2, 1),    // 1  MOVI R2 1
+        Encode(3, 3, 0),    // 2  MOVI R3 0       outer loop
+        Encode(0, 3, 2),    // 3  ADD R3 R2       inner loop
+        Encode(6, 4, 3),    // 4  EOR R4 R3
+        Encode(8, 5, 1),    // 5  SAL R5 1
+        Encode(11, 4, 5),   // 6  STR R4 5
+        Encode(10, 6, 5),   // 7  LDR R6 5
+        Encode(1, 7, 6),    // 8  SUB R7 R6
+        Encode(2, 8, 3),    // 9  MUL R8 R3
+        Encode(5, 8, 15),   // 10 ANDI R8 15
+        Encode(9, 7, 2),    // 11 SAR R7 2
+        Encode(4, 3, 1),    // 12 BEQZ R3 1       leave the inner loop after 256 iterations
+        Encode(4, 0, -12),  // 13 BEQZ R0 -12     back to 3
+        Encode(3, 9, 0),    // 14 MOVI R9 0
+        Encode(0, 1, 2),    // 15 ADD R1 R2
+        Encode(4, 0, -16),  // 16 BEQZ R0 -16     back to 2
+        Encode(3, 9, 1),    // 17 MOVI R9 1
+        Encode(3, 9, 2),    // 18 MOVI R9 2
+    };
+    ResetCPU(cpu);
+    for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); i++)
+    {
+        WriteInstructionMemory(cpu, i, program[i]);
+    }
+    PredecodeProgram(cpu);
+}
+
+// Function to compare the architectural state of two processors
+static bool SameState(const CPU *a, const CPU *b)
+{
+    return memcmp(a->generalRegisters, b->generalRegisters, sizeof(a->generalRegisters)) == 0 &&
+           SameDataMemory(a, b) &&
+           ReadStatusRegister(a) == ReadStatusRegister(b) && a->pc == b->pc;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t budget = argc > 1 ? strtoull(argv[1], NULL, 10) : 50000000;
+    TraceSetLevel(TRACE_LEVEL_OFF);
+
+    CPU *switchCPU = CreateCPU();
+    CPU *cpu = CreateCPU();
+    if (switchCPU == NULL || cpu == NULL)
+    {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+
+    // switch engine
+    LoadLoopProgram(switchCPU);
+    double start = Now();
+    EngineResult switchResult = RunSwitchEngine(switchCPU, budget);
+    double switchSeconds = Now() - start;
+
+    // threaded engine
+    LoadLoopProgram(cpu);
+    start = Now();
+    EngineResult threadedResult = RunThreadedEngine(cpu, budget);
+    double threadedSeconds = Now() - start;
+    bool same = switchResult.instructions == threadedResult.instructions && SameState(switchCPU, cpu);
+
+    // jit engine
+    LoadLoopProgram(cpu);
+    start = Now();
+    EngineResult jitResult = RunJITEngine(cpu, budget, JIT_DEFAULT_THRESHOLD);
+    double jitSeconds = Now() - start;
+    same = same && switchResult.instructions == jitResult.instructions && SameState(switchCPU, cpu);
+
+    printf("Engine    Instructions  Seconds   Instructions/sec\n");
+    printf("switch    %12llu  %7.3f  %16.0f\n", (unsigned long long)switchResult.instructions, switchSeconds,
+           switchResult.instructions / switchSeconds);
+    printf("threaded  %12llu  %7.3f  %16.0f\n", (unsigned long long)threadedResult.instructions, threadedSeconds,
+           threadedResult.instructions / threadedSeconds);
+    printf("jit       %12llu  %7.3f  %16.0f\n", (unsigned long long)jitResult.instructions, jitSeconds,
+           jitResult.instructions / jitSeconds);
+    printf("Speedup over switch: threaded %.2fx, jit %.2fx\n", switchSeconds / threadedSeconds, switchSeconds / jitSeconds);
+    printf("Final state: %s\n", same ? "identical" : "DIFFERENT");
+    DestroyCPU(switchCPU);
+    DestroyCPU(cpu);
+    return same ? 0 : 1;
+}
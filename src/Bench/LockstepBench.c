@@ -0,0 +1,156 @@
+/**
+ * @file LockstepBench.c
+ * @brief Measures a parameter sweep run instance after instance on the switch engine against lockstep SIMD execution.
+ *
+ * Every instance runs the same looping ALU/memory program from a different initial
+ * register image. The benchmark checks that every instance ends in the same
+ * architectural state on both paths and prints the throughput of each.
+ */
+
+#include "../Headers/CPU.h"
+#include "../Headers/Engine.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Lockstep.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Registers.h"
+#include "../Headers/Report.h"
+#include "../Headers/Trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Function to combine an opcode and its operands into a 16-bit instruction, like LoadProgram does
+static uint16_t Encode(uint8_t opcode, uint8_t operand1, int8_t operand2)
+{
+    return ((opcode & 0b1111) << 12) | ((operand1 & 0b111111) << 6) | (operand2 & 0b111111);
+}
+
+// Function to load a program that loops until R1 (the swept register) counts up to zero
+static void LoadSweepProgram(CPU *cpu)
+{
+    uint16_t program[] = {
+        Encode(3, 2, 1),    // 0  MOVI R2 1
+        Encode(3, 3, 0),    // 1  MOVI R3 0
+        Encode(0, 3, 1),    // 2  ADD R3 R1       loop
+        Encode(6, 4, 3),    // 3  EOR R4 R3
+        Encode(8, 5, 1),    // 4  SAL R5 1
+        Encode(11, 4, 5),   // 5  STR R4 5
+        Encode(10, 6, 5),   // 6  LDR R6 5
+        Encode(1, 7, 6),    // 7  SUB R7 R6
+        Encode(2, 8, 3),    // 8  MUL R8 R3
+        Encode(5, 8, 15),   // 9  ANDI R8 15
+        Encode(9, 7, 2),    // 10 SAR R7 2
+        Encode(0, 1, 2),    // 11 ADD R1 R2
+        Encode(4, 1, 1),    // 12 BEQZ R1 1       leave the loop once R1 is zero
+        Encode(4, 0, -13),  // 13 BEQZ R0 -13     back to 2
+        Encode(3, 9, 1),    // 14 MOVI R9 1
+        Encode(3, 9, 2),    // 15 MOVI R9 2
+    };
+    ResetCPU(cpu);
+    for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); i++)
+    {
+        WriteInstructionMemory(cpu, i, program[i]);
+    }
+    PredecodeProgram(cpu);
+}
+
+// Function to give an instance its swept values: the loop count in R1 (always negative, so the loop ends) and R5
+static void SetInstanceImage(CPU *cpu, size_t instance, bool divergent)
+{
+    cpu->generalRegisters[1] = (int8_t)(divergent ? -1 - (int)(instance % 128) : -100);
+    cpu->generalRegisters[5] = (int8_t)instance;
+}
+
+// Function to compare the architectural state of two processors
+static bool SameState(const CPU *a, const CPU *b)
+{
+    return memcmp(a->generalRegisters, b->generalRegisters, sizeof(a->generalRegisters)) == 0 &&
+           SameDataMemory(a, b) &&
+           ReadStatusRegister(a) == ReadStatusRegister(b) && a->pc == b->pc;
+}
+
+// Function to run one sweep both ways, print the throughput of each and tell whether all instances agree
+static bool RunSweep(CPU *program, CPU *cpu, CPU *results, size_t instances, bool divergent)
+{
+    // one instance after another on the switch engine
+    uint64_t switchInstructions = 0;
+    double start = Now();
+    for (size_t i = 0; i < instances; i++)
+    {
+        CopyCPU(&results[i], program);
+        SetInstanceImage(&results[i], i, divergent);
+        switchInstructions += RunSwitchEngine(&results[i], 0).instructions;
+    }
+    double switchSeconds = Now() - start;
+
+    // all instances in lockstep
+    LockstepGroup *group = CreateLockstepGroup(program, instances);
+    if (group == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < instances; i++)
+    {
+        CopyCPU(cpu, program);
+        SetInstanceImage(cpu, i, divergent);
+        LockstepSetInstance(group, i, cpu);
+    }
+    start = Now();
+    LockstepStats stats = RunLockstep(group, 0);
+    double lockstepSeconds = Now() - start;
+
+    bool same = stats.instructions == switchInstructions;
+    for (size_t i = 0; i < instances && same; i++)
+    {
+        CopyCPU(cpu, program);
+        LockstepGetInstance(group, i, cpu);
+        same = SameState(&results[i], cpu) && LockstepInstanceResult(group, i).halted;
+    }
+    DestroyLockstepGroup(group);
+
+    printf("%s sweep: %zu instances, %d lanes per vector\n", divergent ? "Divergent" : "Uniform", instances, LOCKSTEP_LANES);
+    printf("Engine    Instructions  Seconds   Instructions/sec\n");
+    printf("switch    %12llu  %7.3f  %16.0f\n", (unsigned long long)switchInstructions, switchSeconds,
+           switchInstructions / switchSeconds);
+    printf("lockstep  %12llu  %7.3f  %16.0f\n", (unsigned long long)stats.instructions, lockstepSeconds,
+           stats.instructions / lockstepSeconds);
+    printf("Lockstep: %llu steps, %llu divergent, %llu splits, %llu reconvergences\n",
+           (unsigned long long)stats.steps,
+           (unsigned long long)stats.divergentSteps,
+           (unsigned long long)stats.splits,
+           (unsigned long long)stats.reconvergences);
+    printf("Speedup over switch: %.2fx\n", switchSeconds / lockstepSeconds);
+    printf("Final state: %s\n\n", same ? "identical" : "DIFFERENT");
+    return same;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t instances = argc > 1 ? strtoull(argv[1], NULL, 10) : 4096;
+    TraceSetLevel(TRACE_LEVEL_OFF);
+
+    CPU *program = CreateCPU();
+    CPU *cpu = CreateCPU();
+    // zero-filled, so CopyCPU finds no pages to release
+    CPU *results = calloc(instances, sizeof(CPU));
+    if (program == NULL || cpu == NULL || results == NULL)
+    {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+    LoadSweepProgram(program);
+
+    bool same = RunSweep(program, cpu, results, instances, false);
+    same = RunSweep(program, cpu, results, instances, true) && same;
+
+    for (size_t i = 0; i < instances; i++)
+    {
+        ReleaseCPU(&results[i]);
+    }
+    free(results);
+    DestroyCPU(program);
+    DestroyCPU(cpu);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+/**
+ * @file MicroBench.c
+ * @brief Per-function micro-benchmarks of the ALU, the flag updates and decode, with host hardware counters.
+ *
+ * Every kernel is called in a loop over pre-generated random operands (so the
+ * branches inside it see real data, not one repeated value) and measured with the
+ * wall clock and, where the host allows it, perf_event_open counters for cycles,
+ * instructions, branch misses and L1 data cache read misses, all counted in user
+ * space only. The target is built with PROCESSOR_TRACE_DISABLED, so the numbers are
+ * those of the kernels themselves without any trace checks.
+ */
+
+#include "../Headers/ALU.h"
+#include "../Headers/CPU.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Registers.h"
+#include "../Headers/Report.h"
+
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OPERANDS 4096 // a power of two, small enough to stay in the L1 cache
+
+// The counters read for every kernel, -1 for a counter the host does not provide
+enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_L1_MISSES,
+    COUNTERS
+};
+
+static const char *counterNames[COUNTERS] = {"cycles", "instructions", "branch-misses", "L1d-misses"};
+static int counters[COUNTERS];
+
+// The random operands every kernel reads
+static uint8_t registers1[OPERANDS];
+static uint8_t registers2[OPERANDS];
+static uint8_t values1[OPERANDS];
+static uint8_t values2[OPERANDS];
+static uint16_t words[OPERANDS];
+
+static CPU *cpu;
+static volatile uint32_t sink; // keeps the results of the kernels alive
+
+// Function to open one user-space counter of this thread, -1 if the host does not allow it
+static int OpenCounter(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// The kernels, each running its function once per operand set
+static void KernelADD(uint64_t i)
+{
+    ADD(cpu, registers1[i] & 63, registers2[i] & 63);
+}
+
+static void KernelSUB(uint64_t i)
+{
+    SUB(cpu, registers1[i] & 63, registers2[i] & 63);
+}
+
+static void KernelMUL(uint64_t i)
+{
+    MUL(cpu, registers1[i] & 63, registers2[i] & 63);
+}
+
+static void KernelSAL(uint64_t i)
+{
+    SAL(cpu, registers1[i] & 63, (int8_t)(values2[i] & 7));
+}
+
+static void KernelSAR(uint64_t i)
+{
+    SAR(cpu, registers1[i] & 63, (int8_t)(values2[i] & 7));
+}
+
+static void KernelCarryFlag(uint64_t i)
+{
+    updateCarryFlag(cpu, values1[i], values2[i]);
+}
+
+static void KernelOverflowFlag(uint64_t i)
+{
+    int8_t a = (int8_t)values1[i];
+    int8_t b = (int8_t)values2[i];
+    updateOverflowFlag(cpu, a, b, (int8_t)(a + b), values1[i] & 1);
+}
+
+static void KernelNegativeFlag(uint64_t i)
+{
+    updateNegativeFlag(cpu, (int8_t)values1[i]);
+}
+
+static void KernelSignFlag(uint64_t i)
+{
+    updateSignFlag(cpu, (int8_t)values1[i]);
+}
+
+static void KernelZeroFlag(uint64_t i)
+{
+    updateZeroFlag(cpu, (int8_t)(values1[i] & values2[i] & 1)); // zero half of the time
+}
+
+static void KernelAddFlags(uint64_t i)
+{
+    updateAddFlags(cpu, values1[i], values2[i], (uint8_t)(values1[i] + values2[i]));
+    sink += ReadStatusRegister(cpu);
+}
+
+static void KernelSubFlags(uint64_t i)
+{
+    int8_t a = (int8_t)values1[i];
+    int8_t b = (int8_t)values2[i];
+    updateSubFlags(cpu, a, b, (int8_t)(a - b));
+    sink += ReadStatusRegister(cpu);
+}
+
+static void KernelDecode(uint64_t i)
+{
+    Instruction ins = decode(words[i]);
+    sink += ins.opcode + ins.operand1 + (uint8_t)ins.value2 + (uint8_t)ins.type;
+}
+
+static void KernelGetOpcodeType(uint64_t i)
+{
+    sink += (uint8_t)GetOpcodeType(words[i] >> 12);
+}
+
+// One row of the report
+typedef struct {
+    const char *name;
+    void (*kernel)(uint64_t i);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"ADD", KernelADD},
+    {"SUB", KernelSUB},
+    {"MUL", KernelMUL},
+    {"SAL", KernelSAL},
+    {"SAR", KernelSAR},
+    {"updateCarryFlag", KernelCarryFlag},
+    {"updateOverflowFlag", KernelOverflowFlag},
+    {"updateNegativeFlag", KernelNegativeFlag},
+    {"updateSignFlag", KernelSignFlag},
+    {"updateZeroFlag", KernelZeroFlag},
+    {"updateAddFlags+read", KernelAddFlags},
+    {"updateSubFlags+read", KernelSubFlags},
+    {"decode", KernelDecode},
+    {"GetOpcodeType", KernelGetOpcodeType},
+};
+
+int main(int argc, char *argv[])
+{
+    uint64_t iterations = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    cpu = CreateCPU();
+    if (cpu == NULL || iterations == 0)
+    {
+        printf("Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+    srand(1);
+    for (int i = 0; i < OPERANDS; i++)
+    {
+        registers1[i] = (uint8_t)rand();
+        registers2[i] = (uint8_t)rand();
+        values1[i] = (uint8_t)rand();
+        values2[i] = (uint8_t)rand();
+        words[i] = (uint16_t)rand();
+        cpu->generalRegisters[i & 63] = (int8_t)rand();
+    }
+
+    counters[COUNTER_CYCLES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counters[COUNTER_INSTRUCTIONS] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counters[COUNTER_BRANCH_MISSES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    counters[COUNTER_L1_MISSES] = OpenCounter(PERF_TYPE_HW_CACHE,
+                                              PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    bool anyCounter = false;
+    for (int c = 0; c < COUNTERS; c++)
+    {
+        anyCounter = anyCounter || counters[c] >= 0;
+    }
+    if (!anyCounter)
+    {
+        fprintf(stderr, "Note: perf_event_open is not available (see /proc/sys/kernel/perf_event_paranoid), only the time is measured\n");
+    }
+
+    printf("%-20s %9s", "Kernel", "ns/call");
+    for (int c = 0; c < COUNTERS; c++)
+    {
+        printf(" %14s", counterNames[c]);
+    }
+    printf("   (per call)\n");
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++)
+    {
+        void (*kernel)(uint64_t i) = benchmarks[b].kernel;
+        for (uint64_t i = 0; i < OPERANDS; i++)
+        {
+            kernel(i); // warm up the caches and the branch predictor
+        }
+        for (int c = 0; c < COUNTERS; c++)
+        {
+            if (counters[c] >= 0)
+            {
+                ioctl(counters[c], PERF_EVENT_IOC_RESET, 0);
+                ioctl(counters[c], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+        double start = Now();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            kernel(i & (OPERANDS - 1));
+        }
+        double seconds = Now() - start;
+        printf("%-20s %9.2f", benchmarks[b].name, seconds * 1e9 / iterations);
+        for (int c = 0; c < COUNTERS; c++)
+        {
+            uint64_t count;
+            if (counters[c] >= 0)
+            {
+                ioctl(counters[c], PERF_EVENT_IOC_DISABLE, 0);
+            }
+            if (counters[c] >= 0 && read(counters[c], &count, sizeof(count)) == (ssize_t)sizeof(count))
+            {
+                printf(" %14.3f", (double)count / iterations);
+            }
+            else
+            {
+                printf(" %14s", "n/a");
+            }
+        }
+        printf("\n");
+    }
+
+    for (int c = 0; c < COUNTERS; c++)
+    {
+        if (counters[c] >= 0)
+        {
+            close(counters[c]);
+        }
+    }
+    DestroyCPU(cpu);
+    return 0;
+}
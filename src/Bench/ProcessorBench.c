@@ -0,0 +1,395 @@
+/**
+ * @file ProcessorBench.c
+ * @brief End-to-end throughput of every engine and trace level on synthetic and hand-written workloads, as JSON.
+ *
+ * The workloads are four generated programs (ALU-heavy, LDR/STR-heavy, BEQZ/BR loops
+ * and a mix of the three, all from a fixed seed so every run simulates the same
+ * instructions) and the programs of src/Test. Every workload runs on the pipeline at
+ * trace levels 0 to 3 (the events are formatted and discarded) and on the switch,
+ * threaded and jit engines, each configuration in its own child process so its peak
+ * RSS can be reported. The short src/Test programs are restarted from a snapshot until
+ * the instruction budget is used up. Traced runs get a tenth of the budget, they are
+ * more than ten times slower.
+ */
+
+#include "../Headers/CPU.h"
+#include "../Headers/Checkpoint.h"
+#include "../Headers/Engine.h"
+#include "../Headers/JIT.h"
+#include "../Headers/Report.h"
+#include "../Headers/Trace.h"
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef PROCESSOR_SOURCE_DIR
+#define PROCESSOR_SOURCE_DIR "."
+#endif
+
+// What one configuration measured, handed from the child process to the parent
+typedef struct {
+    int ok;
+    uint64_t instructions;
+    uint64_t cycles;
+    double seconds;
+    double loadSeconds;
+} Measurement;
+
+// One benchmark configuration: an engine and, for the pipeline, a trace level
+typedef struct {
+    const char *name;
+    EngineKind engine;
+    TraceLevel level;
+} Configuration;
+
+static const Configuration configurations[] = {
+    {"pipeline", ENGINE_PIPELINE, TRACE_LEVEL_OFF},
+    {"pipeline", ENGINE_PIPELINE, TRACE_LEVEL_STAGES},
+    {"pipeline", ENGINE_PIPELINE, TRACE_LEVEL_UPDATES},
+    {"pipeline", ENGINE_PIPELINE, TRACE_LEVEL_FLAGS},
+    {"switch", ENGINE_SWITCH, TRACE_LEVEL_OFF},
+    {"threaded", ENGINE_THREADED, TRACE_LEVEL_OFF},
+    {"jit", ENGINE_JIT, TRACE_LEVEL_OFF},
+};
+
+// Function to format and drop a trace event, the work of a trace that is written somewhere
+static void DiscardSink(void *context, const TraceEvent *event)
+{
+    char line[128];
+    *(uint64_t *)context += (uint64_t)TraceFormatEvent(event, line, sizeof(line));
+}
+
+// A deterministic generator (a 64-bit LCG), so the programs are the same on every platform
+static uint64_t seed;
+
+static int Random(int n)
+{
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (int)((seed >> 33) % (uint64_t)n);
+}
+
+// Function to pick a scratch register: R2..R29 (R0 stays 0 for BEQZ R0, R1 holds 1, R30 upwards are loop counters and BR targets)
+static int Scratch()
+{
+    return 2 + Random(28);
+}
+
+// Function to write a random ALU instruction
+static void EmitALU(FILE *file)
+{
+    switch (Random(8))
+    {
+    case 0:
+        fprintf(file, "ADD R%d R%d\n", Scratch(), Scratch());
+        break;
+    case 1:
+        fprintf(file, "SUB R%d R%d\n", Scratch(), Scratch());
+        break;
+    case 2:
+        fprintf(file, "MUL R%d R%d\n", Scratch(), Scratch());
+        break;
+    case 3:
+        fprintf(file, "EOR R%d R%d\n", Scratch(), Scratch());
+        break;
+    case 4:
+        fprintf(file, "ANDI R%d %d\n", Scratch(), Random(64) - 32);
+        break;
+    case 5:
+        fprintf(file, "SAL R%d %d\n", Scratch(), Random(8));
+        break;
+    case 6:
+        fprintf(file, "SAR R%d %d\n", Scratch(), Random(8));
+        break;
+    default:
+        fprintf(file, "MOVI R%d %d\n", Scratch(), Random(96) - 32);
+        break;
+    }
+}
+
+// Function to write a random LDR or STR
+static void EmitMemory(FILE *file)
+{
+    fprintf(file, "%s R%d %d\n", Random(2) ? "LDR" : "STR", Scratch(), Random(96) - 32);
+}
+
+/*
+ * Function to write a counted loop: a few instructions run 3 to 20 times. The exit
+ * BEQZ skips the two rows after it (the back branch and a filler row).
+ */
+static int EmitLoop(FILE *file, int counter)
+{
+    int body = 1 + Random(3);
+    fprintf(file, "MOVI R%d %d\n", counter, 3 + Random(18));
+    for (int i = 0; i < body; i++)
+    {
+        EmitALU(file);
+    }
+    fprintf(file, "SUB R%d R1\n", counter);
+    fprintf(file, "BEQZ R%d 1\n", counter);
+    fprintf(file, "BEQZ R0 %d\n", -(body + 4));
+    fprintf(file, "MOVI R%d 0\n", Scratch());
+    return body + 5;
+}
+
+/*
+ * Function to write a generated workload. Every program sets R1 to 1 and R62/R63 to
+ * the address of its body, and ends with a BR back to the body (followed by the two
+ * rows a taken branch needs), so it runs until the instruction budget is used up.
+ */
+static void WriteWorkload(FILE *file, const char *kind)
+{
+    seed = 1;
+    fprintf(file, "MOVI R1 1\nMOVI R62 0\nMOVI R63 3\n");
+    int rows = 3;
+    while (rows < 1000)
+    {
+        int pick = strcmp(kind, "alu") == 0 ? 0 : strcmp(kind, "memory") == 0 ? 1 : strcmp(kind, "branch") == 0 ? 2 : Random(3);
+        if (pick == 0)
+        {
+            EmitALU(file);
+            rows++;
+        }
+        else if (pick == 1)
+        {
+            if (Random(10) < 7)
+            {
+                EmitMemory(file);
+            }
+            else
+            {
+                EmitALU(file);
+            }
+            rows++;
+        }
+        else
+        {
+            rows += EmitLoop(file, 30 + Random(4));
+        }
+    }
+    fprintf(file, "BR R62 R63\nMOVI R2 0\nMOVI R2 0\n");
+}
+
+// Function to run one configuration of a workload in this process
+static Measurement Measure(const char *file_name, const Configuration *configuration, uint64_t budget, bool repeat)
+{
+    Measurement measurement = {0};
+    CPU *cpu = CreateCPU();
+    if (cpu == NULL)
+    {
+        return measurement;
+    }
+    double start = Now();
+    bool loaded = LoadProgram(cpu, file_name, NULL);
+    measurement.loadSeconds = Now() - start;
+    CPUSnapshot *initial = loaded ? TakeSnapshot(cpu) : NULL;
+    if (initial == NULL)
+    {
+        DestroyCPU(cpu);
+        return measurement;
+    }
+
+    uint64_t formatted = 0;
+    TraceSetLevel(configuration->level);
+    TraceSetSink(DiscardSink, &formatted);
+    start = Now();
+    while (measurement.instructions < budget)
+    {
+        RestoreSnapshot(cpu, initial);
+        EngineResult result = RunEngine(cpu, configuration->engine, budget - measurement.instructions, JIT_DEFAULT_THRESHOLD);
+        measurement.instructions += result.instructions;
+        measurement.cycles += configuration->engine == ENGINE_PIPELINE ? (uint64_t)(cpu->clockcycles - 1) : 0;
+        if (!repeat || result.instructions == 0)
+        {
+            break;
+        }
+    }
+    measurement.seconds = Now() - start;
+    TraceSetSink(NULL, NULL);
+    measurement.ok = 1;
+    DestroySnapshot(initial);
+    DestroyCPU(cpu);
+    return measurement;
+}
+
+// Function to run one configuration in a child process and print its JSON record
+static bool RunConfiguration(const char *workload, const char *file_name, const Configuration *configuration,
+                             uint64_t budget, bool repeat, bool first, FILE *out)
+{
+    int channel[2];
+    if (pipe(channel) != 0)
+    {
+        return false;
+    }
+    fflush(out);
+    pid_t child = fork();
+    if (child < 0)
+    {
+        return false;
+    }
+    if (child == 0)
+    {
+        close(channel[0]);
+        Measurement measurement = Measure(file_name, configuration, budget, repeat);
+        ssize_t written = write(channel[1], &measurement, sizeof(measurement));
+        _exit(written == (ssize_t)sizeof(measurement) ? 0 : 1);
+    }
+    close(channel[1]);
+    Measurement measurement = {0};
+    ssize_t received = read(channel[0], &measurement, sizeof(measurement));
+    close(channel[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) != child || received != (ssize_t)sizeof(measurement) || !measurement.ok)
+    {
+        return false;
+    }
+
+    fprintf(out, "%s\n    {\"workload\": \"%s\", \"engine\": \"%s\", \"trace_level\": %d, ", first ? "" : ",", workload,
+            configuration->name, (int)configuration->level);
+    fprintf(out, "\"instructions\": %llu, \"seconds\": %.6f, \"instructions_per_sec\": %.0f, ",
+            (unsigned long long)measurement.instructions, measurement.seconds, measurement.instructions / measurement.seconds);
+    if (configuration->engine == ENGINE_PIPELINE)
+    {
+        fprintf(out, "\"cycles\": %llu, \"cycles_per_sec\": %.0f, ", (unsigned long long)measurement.cycles,
+                measurement.cycles / measurement.seconds);
+    }
+    else
+    {
+        fprintf(out, "\"cycles\": null, \"cycles_per_sec\": null, ");
+    }
+    fprintf(out, "\"load_seconds\": %.6f, \"peak_rss_kb\": %ld}", measurement.loadSeconds, usage.ru_maxrss);
+    return true;
+}
+
+// Function to compare directory entries for a stable order
+static int CompareNames(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t budget = 2000000;
+    const char *output = NULL;
+    const char *testDirectory = PROCESSOR_SOURCE_DIR "/src/Test";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--instructions") == 0 && i + 1 < argc)
+        {
+            budget = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tests") == 0 && i + 1 < argc)
+        {
+            testDirectory = argv[++i];
+        }
+        else
+        {
+            printf("Usage: %s [--instructions <n>] [--output <file.json>] [--tests <directory>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (budget == 0)
+    {
+        budget = 1;
+    }
+    FILE *out = output != NULL ? fopen(output, "w") : stdout;
+    if (out == NULL)
+    {
+        printf("Error: could not open %s\n", output);
+        return 1;
+    }
+
+    // the generated workloads, written to temporary files so loading them is measured like any program
+    static const char *kinds[] = {"alu", "memory", "branch", "mixed"};
+    char generated[4][32];
+    for (int i = 0; i < 4; i++)
+    {
+        strcpy(generated[i], "/tmp/processor_benchXXXXXX");
+        int fd = mkstemp(generated[i]);
+        FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+        if (file == NULL)
+        {
+            printf("Error: could not create a temporary file\n");
+            return 1;
+        }
+        WriteWorkload(file, kinds[i]);
+        fclose(file);
+    }
+
+    // the hand-written programs, in name order
+    char *tests[256];
+    int testCount = 0;
+    DIR *directory = opendir(testDirectory);
+    struct dirent *entry;
+    while (directory != NULL && (entry = readdir(directory)) != NULL && testCount < 256)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length > 4 && strcmp(entry->d_name + length - 4, ".txt") == 0)
+        {
+            tests[testCount++] = strdup(entry->d_name);
+        }
+    }
+    if (directory != NULL)
+    {
+        closedir(directory);
+    }
+    qsort(tests, testCount, sizeof(tests[0]), CompareNames);
+
+    fprintf(out, "{\n  \"benchmark\": \"processor_bench\",\n  \"instruction_budget\": %llu,\n  \"results\": [",
+            (unsigned long long)budget);
+    bool first = true;
+    int failed = 0;
+    size_t configurationCount = sizeof(configurations) / sizeof(configurations[0]);
+    for (int i = 0; i < 4 + testCount; i++)
+    {
+        char path[4096];
+        const char *workload = i < 4 ? kinds[i] : tests[i - 4];
+        if (i < 4)
+        {
+            snprintf(path, sizeof(path), "%s", generated[i]);
+        }
+        else
+        {
+            snprintf(path, sizeof(path), "%s/%s", testDirectory, tests[i - 4]);
+        }
+        for (size_t c = 0; c < configurationCount; c++)
+        {
+            uint64_t instructions = configurations[c].level > TRACE_LEVEL_OFF && budget >= 10 ? budget / 10 : budget;
+            if (RunConfiguration(workload, path, &configurations[c], instructions, i >= 4, first, out))
+            {
+                first = false;
+            }
+            else
+            {
+                fprintf(stderr, "Error: %s on %s failed\n", workload, configurations[c].name);
+                failed++;
+            }
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    for (int i = 0; i < 4; i++)
+    {
+        unlink(generated[i]);
+    }
+    for (int i = 0; i < testCount; i++)
+    {
+        free(tests[i]);
+    }
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return failed == 0 ? 0 : 1;
+}
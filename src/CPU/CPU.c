@@ -0,0 +1,149 @@
+/**
+ * @file CPU.c
+ * @brief Creation, reset and program loading of processor contexts.
+ */
+
+#include "../Headers/CPU.h"
+#include "../Headers/Assembler.h"
+#include "../Headers/Counters.h"
+#include "../Headers/Image.h"
+#include "../Headers/DataMemory.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Pages.h"
+#include "../Headers/State.h"
+#include "../Headers/Registers.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+CPU *CreateCPU()
+{
+    // the size is a multiple of the 64 byte alignment of the struct, as aligned_alloc requires
+    CPU *cpu = aligned_alloc(_Alignof(CPU), sizeof(CPU));
+    if (cpu != NULL)
+    {
+        memset(cpu, 0, sizeof(*cpu)); // nothing for ResetCPU to release
+        ResetCPU(cpu);
+    }
+    return cpu;
+}
+
+void DestroyCPU(CPU *cpu)
+{
+    if (cpu != NULL)
+    {
+        ReleaseCPU(cpu);
+    }
+    free(cpu);
+}
+
+void ReleaseCPU(CPU *cpu)
+{
+    ReleaseMemoryPages(cpu);
+    free(cpu->counters);
+    cpu->counters = NULL;
+    free(cpu->cache);
+    cpu->cache = NULL;
+}
+
+void CopyCPU(CPU *destination, const CPU *source)
+{
+    if (destination == source)
+    {
+        return;
+    }
+    RetainMemoryPages(source);
+    ReleaseMemoryPages(destination);
+    // the counters and the cache are not shared: the destination keeps its own blocks
+    PerfCounters *counters = destination->counters;
+    DataCache *cache = destination->cache;
+    memcpy(destination, source, sizeof(CPU));
+    destination->counters = counters;
+    destination->cache = cache;
+    if (source->counters == NULL)
+    {
+        free(counters);
+        destination->counters = NULL;
+    }
+    else
+    {
+        EnableCounters(destination);
+        memcpy(destination->counters, source->counters, sizeof(PerfCounters));
+    }
+    if (source->cache == NULL)
+    {
+        free(cache);
+        destination->cache = NULL;
+    }
+    else
+    {
+        if (cache == NULL)
+        {
+            destination->cache = malloc(sizeof(DataCache));
+            if (destination->cache == NULL)
+            {
+                printf("Error: out of memory\n");
+                exit(1);
+            }
+        }
+        memcpy(destination->cache, source->cache, sizeof(DataCache));
+    }
+}
+
+void ResetCPU(CPU *cpu)
+{
+    ReleaseCPU(cpu);
+    memset(cpu, 0, sizeof(*cpu)); // empty pipeline stages, like the old zero-initialised globals
+    ResetDataMemory(cpu);
+    ResetInstructionMemory(cpu);
+    ResetRegisters(cpu);
+    cpu->clockcycles = 1;
+}
+
+/**
+ * @brief Loads the program from the given assembly file or program image into the instruction memory.
+ *
+ * @param cpu The processor to load the program into.
+ * @param file_name The name of the assembly file or image to load.
+ * @param error Receives the reason if the file could not be read, assembled or loaded, may be NULL.
+ * @return false if the file could not be read, assembled or loaded.
+ */
+bool LoadProgram(CPU *cpu, const char *file_name, AssemblerError *error)
+{
+    size_t length;
+    const char *text = MapProgramFile(file_name, &length, error);
+    if (text == NULL)
+    {
+        return false;
+    }
+    if (IsImage(text, length))
+    {
+        // a program image: copied straight into the memories, nothing to parse
+        bool loaded = LoadImage(cpu, text, length, error);
+        UnmapProgramFile(text, length);
+        return loaded;
+    }
+
+    uint16_t program[ASSEMBLER_MAX_INSTRUCTIONS];
+    size_t count;
+    bool assembled = Assemble(text, length, program, &count, error);
+    UnmapProgramFile(text, length);
+    if (!assembled)
+    {
+        return false;
+    }
+    for (size_t address = 0; address < count; address++)
+    {
+        WriteInstructionMemory(cpu, address, program[address]);
+    }
+    cpu->MaxClockCycles = 3 + ((int)count - 1); // 3 cycles for the first instruction, 1 for each of the others
+    PredecodeProgram(cpu);
+    return true;
+}
+
+void PrintCPUState(CPU *cpu, FILE *out)
+{
+    WriteState(cpu, STATE_FORMAT_TEXT, out);
+}
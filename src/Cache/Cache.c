@@ -0,0 +1,311 @@
+/**
+ * @file Cache.c
+ * @brief The data cache timing model: tag lookup, LRU and tree pseudo-LRU replacement, stall cycles and reports.
+ */
+
+#include "../Headers/Cache.h"
+#include "../Headers/Report.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *writePolicyNames[] = {"write-back", "write-through"};
+static const char *replacementNames[] = {"lru", "plru"};
+
+/**
+ * @brief The line a miss replaced, so the caller can write it back.
+ */
+typedef struct {
+    bool evicted;  /**< A valid line was replaced. */
+    bool dirty;    /**< It was dirty and has to be written to the next level. */
+    uint16_t line; /**< Its line number in that level. */
+} CacheVictim;
+
+// Function to tell whether a number is a power of two
+static bool IsPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+bool ParseCacheGeometry(const char *spec, CacheGeometry *geometry)
+{
+    int bytes, ways, lineBytes;
+    int length = 0;
+    if (sscanf(spec, "%d,%d,%d%n", &bytes, &ways, &lineBytes, &length) != 3 || spec[length] != '\0')
+    {
+        return false;
+    }
+    if (!IsPowerOfTwo(bytes) || !IsPowerOfTwo(ways) || !IsPowerOfTwo(lineBytes) || bytes > 2048 ||
+        ways > CACHE_MAX_WAYS || bytes / lineBytes > CACHE_MAX_LINES || bytes < ways * lineBytes)
+    {
+        return false;
+    }
+    geometry->bytes = (uint16_t)bytes;
+    geometry->ways = (uint8_t)ways;
+    geometry->lineBytes = (uint8_t)lineBytes;
+    return true;
+}
+
+bool ParseCacheWritePolicy(const char *name, CacheWritePolicy *policy)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (strcmp(name, writePolicyNames[i]) == 0)
+        {
+            *policy = (CacheWritePolicy)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParseCacheReplacement(const char *name, CacheReplacement *replacement)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (strcmp(name, replacementNames[i]) == 0)
+        {
+            *replacement = (CacheReplacement)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to clear a level and give it its shape (sets stays 0 for a level of 0 bytes)
+static void SetCacheLevel(CacheLevel *level, const CacheGeometry *geometry)
+{
+    memset(level, 0, sizeof(*level));
+    level->geometry = *geometry;
+    if (geometry->bytes != 0)
+    {
+        level->sets = (uint16_t)(geometry->bytes / geometry->lineBytes / geometry->ways);
+    }
+}
+
+void SetDataCache(CPU *cpu, const CacheConfig *config)
+{
+    if (config->l1.bytes == 0)
+    {
+        free(cpu->cache);
+        cpu->cache = NULL;
+        return;
+    }
+    if (cpu->cache == NULL)
+    {
+        cpu->cache = malloc(sizeof(DataCache));
+        if (cpu->cache == NULL)
+        {
+            printf("Error: out of memory\n");
+            exit(1);
+        }
+    }
+    DataCache *cache = cpu->cache;
+    memset(cache, 0, sizeof(*cache));
+    SetCacheLevel(&cache->l1, &config->l1);
+    SetCacheLevel(&cache->l2, &config->l2);
+    cache->writePolicy = config->writePolicy;
+    cache->replacement = config->replacement;
+    cache->l2Latency = config->l2Latency;
+    cache->memoryLatency = config->memoryLatency;
+}
+
+// Function to mark a way of a set as the most recently used one
+static void TouchLine(CacheLevel *level, uint8_t replacement, int set, int way)
+{
+    int ways = level->geometry.ways;
+    level->lines[set * ways + way].lastUse = ++level->clock;
+    if (replacement == CACHE_REPLACE_PLRU)
+    {
+        // every node on the path to the way points to the other half
+        uint16_t bits = level->plru[set];
+        for (int node = way + ways; node > 1; node /= 2)
+        {
+            if (node & 1)
+            {
+                bits &= (uint16_t)~(1u << (node / 2));
+            }
+            else
+            {
+                bits |= (uint16_t)(1u << (node / 2));
+            }
+        }
+        level->plru[set] = bits;
+    }
+}
+
+// Function to choose the way of a set a miss fills: an invalid one if there is one, else the replacement policy's
+static int ChooseVictim(const CacheLevel *level, uint8_t replacement, int set)
+{
+    int ways = level->geometry.ways;
+    const CacheLine *lines = &level->lines[set * ways];
+    int victim = 0;
+    for (int way = 0; way < ways; way++)
+    {
+        if (!lines[way].valid)
+        {
+            return way;
+        }
+        if (lines[way].lastUse < lines[victim].lastUse)
+        {
+            victim = way;
+        }
+    }
+    if (replacement == CACHE_REPLACE_PLRU)
+    {
+        int node = 1;
+        while (node < ways)
+        {
+            node = 2 * node + ((level->plru[set] >> node) & 1);
+        }
+        victim = node - ways;
+    }
+    return victim;
+}
+
+// Function to access the line of an address in one level, filling it on a miss when allocate is set; returns whether it hit
+static bool AccessLevel(CacheLevel *level, uint8_t replacement, uint16_t address, bool write, bool allocate,
+                        CacheVictim *victim)
+{
+    uint16_t line = (uint16_t)(address / level->geometry.lineBytes);
+    int set = line & (level->sets - 1);
+    int ways = level->geometry.ways;
+    CacheLine *lines = &level->lines[set * ways];
+    victim->evicted = false;
+    victim->dirty = false;
+    for (int way = 0; way < ways; way++)
+    {
+        if (lines[way].valid && lines[way].line == line)
+        {
+            lines[way].dirty |= write;
+            TouchLine(level, replacement, set, way);
+            level->hits++;
+            return true;
+        }
+    }
+    level->misses++;
+    if (!allocate)
+    {
+        return false;
+    }
+    int way = ChooseVictim(level, replacement, set);
+    if (lines[way].valid)
+    {
+        victim->evicted = true;
+        victim->dirty = lines[way].dirty;
+        victim->line = lines[way].line;
+        level->evictions++;
+        level->writebacks += lines[way].dirty;
+    }
+    lines[way].line = line;
+    lines[way].valid = true;
+    lines[way].dirty = write;
+    TouchLine(level, replacement, set, way);
+    return false;
+}
+
+// Function to write a line or a store to the level after L1 through the write buffer (never stalls)
+static void WriteNextLevel(DataCache *cache, uint16_t address)
+{
+    if (cache->l2.sets == 0)
+    {
+        cache->memoryWrites++;
+        return;
+    }
+    CacheVictim victim;
+    if (!AccessLevel(&cache->l2, cache->replacement, address, true, true, &victim))
+    {
+        cache->memoryReads++;
+    }
+    cache->memoryWrites += victim.dirty;
+}
+
+// Function to read the line of an L1 miss from the next levels; returns the cycles it takes
+static int ReadNextLevel(DataCache *cache, uint16_t address)
+{
+    if (cache->l2.sets == 0)
+    {
+        cache->memoryReads++;
+        return cache->memoryLatency;
+    }
+    CacheVictim victim;
+    bool hit = AccessLevel(&cache->l2, cache->replacement, address, false, true, &victim);
+    cache->memoryWrites += victim.dirty;
+    if (hit)
+    {
+        return cache->l2Latency;
+    }
+    cache->memoryReads++;
+    return cache->l2Latency + cache->memoryLatency;
+}
+
+int CacheAccess(CPU *cpu, uint16_t pc, uint16_t address, bool write)
+{
+    DataCache *cache = cpu->cache;
+    bool writeBack = cache->writePolicy == CACHE_WRITE_BACK;
+    CacheVictim victim;
+    bool hit = AccessLevel(&cache->l1, cache->replacement, address, write && writeBack, !write || writeBack, &victim);
+    int stall = 0;
+    if (write && !writeBack)
+    {
+        WriteNextLevel(cache, address);
+    }
+    if (!hit && (!write || writeBack))
+    {
+        stall = ReadNextLevel(cache, address);
+    }
+    if (victim.dirty)
+    {
+        WriteNextLevel(cache, (uint16_t)(victim.line * cache->l1.geometry.lineBytes));
+    }
+    pc &= 1023;
+    cache->pcHits[pc] += hit;
+    cache->pcMisses[pc] += !hit;
+    cache->pcEvictions[pc] += victim.evicted;
+    cache->pcStallCycles[pc] += (uint64_t)stall;
+    return stall;
+}
+
+// Function to print the shape and the counts of one level
+static void PrintCacheLevel(const char *name, const CacheLevel *level, FILE *out)
+{
+    fprintf(out, "%s: %d bytes, %d-way, %d byte lines, %d sets\n", name, level->geometry.bytes, level->geometry.ways,
+            level->geometry.lineBytes, level->sets);
+    fprintf(out, "%s: %llu hits, %llu misses (hit rate %.2f%%), %llu evictions, %llu write-backs\n", name,
+            (unsigned long long)level->hits, (unsigned long long)level->misses,
+            100.0 * Ratio(level->hits, level->hits + level->misses), (unsigned long long)level->evictions,
+            (unsigned long long)level->writebacks);
+}
+
+void PrintCacheStats(const CPU *cpu, FILE *out)
+{
+    const DataCache *cache = cpu->cache;
+    fprintf(out, "Data Cache: \n");
+    fprintf(out, "-------------------------------------------------- \n");
+    fprintf(out, "Policy: %s, %s replacement; L2 latency %d cycles, memory latency %d cycles\n",
+            writePolicyNames[cache->writePolicy], replacementNames[cache->replacement], cache->l2Latency,
+            cache->memoryLatency);
+    PrintCacheLevel("L1", &cache->l1, out);
+    if (cache->l2.sets != 0)
+    {
+        PrintCacheLevel("L2", &cache->l2, out);
+    }
+    fprintf(out, "Main memory: %llu line reads, %llu writes\n", (unsigned long long)cache->memoryReads,
+            (unsigned long long)cache->memoryWrites);
+    uint64_t stallCycles = cpu->counters != NULL ? cpu->counters->memoryStallCycles : 0;
+    fprintf(out, "Memory stall cycles: %llu\n", (unsigned long long)stallCycles);
+    for (int address = 0; address < 1024; address++)
+    {
+        if (cache->pcHits[address] != 0 || cache->pcMisses[address] != 0)
+        {
+            fprintf(out, "Instruction %d: %llu hits  %llu misses  %llu evictions  stall cycles %llu\n", address,
+                    (unsigned long long)cache->pcHits[address], (unsigned long long)cache->pcMisses[address],
+                    (unsigned long long)cache->pcEvictions[address],
+                    (unsigned long long)cache->pcStallCycles[address]);
+        }
+    }
+    fprintf(out, "-------------------------------------------------- \n");
+}
@@ -0,0 +1,227 @@
+/**
+ * @file Checkpoint.c
+ * @brief Snapshots of the whole machine state, in memory and as versioned checkpoint files.
+ */
+
+#include "../Headers/Checkpoint.h"
+#include "../Headers/CPU.h"
+#include "../Headers/Endian.h"
+#include "../Headers/Image.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Registers.h"
+#include "../Headers/State.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// registers, SREG, pc, clockcycles, MaxClockCycles, retired, pipeline1, pipeline2..4, data and instruction memory, branch predictor
+#define CHECKPOINT_BODY_BYTES \
+    (64 + 1 + 2 + 4 + 4 + 8 + 5 + 3 * 8 + 2048 + 1024 * 2 + 3 + PREDICTOR_BHT_ENTRIES + PREDICTOR_MAX_BTB_ENTRIES * 5)
+
+_Static_assert(sizeof(CheckpointHeader) == 16, "the checkpoint header is 16 bytes");
+
+struct CPUSnapshot {
+    CPU state;
+};
+
+CPUSnapshot *TakeSnapshot(const CPU *cpu)
+{
+    CPUSnapshot *snapshot = aligned_alloc(_Alignof(CPUSnapshot), sizeof(CPUSnapshot));
+    if (snapshot != NULL)
+    {
+        memset(&snapshot->state, 0, sizeof(snapshot->state)); // nothing for CopyCPU to release
+        UpdateSnapshot(snapshot, cpu);
+    }
+    return snapshot;
+}
+
+void UpdateSnapshot(CPUSnapshot *snapshot, const CPU *cpu)
+{
+    // the memory pages are shared with the processor until one of them writes
+    CopyCPU(&snapshot->state, cpu);
+}
+
+void RestoreSnapshot(CPU *cpu, const CPUSnapshot *snapshot)
+{
+    CopyCPU(cpu, &snapshot->state);
+}
+
+void DestroySnapshot(CPUSnapshot *snapshot)
+{
+    if (snapshot != NULL)
+    {
+        ReleaseCPU(&snapshot->state);
+    }
+    free(snapshot);
+}
+
+// Function to write a decoded pipeline register
+static void PutStage(uint8_t **p, const PipelineStage *stage)
+{
+    PutU8(p, stage->instruction.opcode);
+    PutU8(p, stage->instruction.operand1);
+    PutU8(p, stage->instruction.operand2);
+    PutU8(p, (uint8_t)stage->instruction.value2);
+    PutU8(p, (uint8_t)stage->instruction.type);
+    PutU8(p, stage->valid);
+    PutU16(p, stage->pcVal);
+}
+
+// Function to read a decoded pipeline register
+static void GetStage(const uint8_t **p, PipelineStage *stage)
+{
+    stage->instruction.opcode = GetU8(p);
+    stage->instruction.operand1 = GetU8(p);
+    stage->instruction.operand2 = GetU8(p);
+    stage->instruction.value2 = (int8_t)GetU8(p);
+    stage->instruction.type = (char)GetU8(p);
+    stage->valid = GetU8(p) != 0;
+    stage->pcVal = GetU16(p);
+}
+
+// Function to report a checkpoint that cannot be loaded; always returns false
+static bool CheckpointError(AssemblerError *error, int line, const char *message)
+{
+    if (error != NULL)
+    {
+        error->line = line;
+        error->column = 0;
+        snprintf(error->message, sizeof(error->message), "%s", message);
+    }
+    return false;
+}
+
+bool SaveCheckpoint(const CPU *cpu, const char *file_name)
+{
+    uint8_t checkpoint[sizeof(CheckpointHeader) + CHECKPOINT_BODY_BYTES];
+    uint8_t *body = checkpoint + sizeof(CheckpointHeader);
+    uint8_t *p = body;
+    memcpy(p, cpu->generalRegisters, 64);
+    p += 64;
+    PutU8(&p, ReadStatusRegister(cpu));
+    PutU16(&p, cpu->pc);
+    PutU32(&p, (uint32_t)cpu->clockcycles);
+    PutU32(&p, (uint32_t)cpu->MaxClockCycles);
+    PutU64(&p, cpu->retired);
+    PutU16(&p, (uint16_t)cpu->pipeline1.instruction);
+    PutU8(&p, cpu->pipeline1.valid);
+    PutU16(&p, cpu->pipeline1.pcVal);
+    PutStage(&p, &cpu->pipeline2);
+    PutStage(&p, &cpu->pipeline3);
+    PutStage(&p, &cpu->pipeline4);
+    ReadDataMemoryBlock(cpu, 0, (int8_t *)p, 2048);
+    p += 2048;
+    for (int address = 0; address < 1024; address++)
+    {
+        PutU16(&p, (uint16_t)PageReadInstruction(cpu, address));
+    }
+    PutU8(&p, cpu->predictor.kind);
+    PutU8(&p, cpu->predictor.btbEntries);
+    PutU8(&p, cpu->predictor.resolveInDecode);
+    memcpy(p, cpu->predictor.bht, PREDICTOR_BHT_ENTRIES);
+    p += PREDICTOR_BHT_ENTRIES;
+    for (int i = 0; i < PREDICTOR_MAX_BTB_ENTRIES; i++)
+    {
+        PutU16(&p, cpu->predictor.btb[i].address);
+        PutU16(&p, cpu->predictor.btb[i].target);
+        PutU8(&p, cpu->predictor.btb[i].valid);
+    }
+
+    CheckpointHeader header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+    header.version = CHECKPOINT_VERSION;
+    header.reserved = 0;
+    header.length = CHECKPOINT_BODY_BYTES;
+    header.checksum = ImageChecksum(body, CHECKPOINT_BODY_BYTES);
+    memcpy(checkpoint, &header, sizeof(header));
+
+    FILE *file = fopen(file_name, "wb");
+    bool written = file != NULL && fwrite(checkpoint, 1, sizeof(checkpoint), file) == sizeof(checkpoint);
+    if (file != NULL)
+    {
+        written = fclose(file) == 0 && written;
+    }
+    return written;
+}
+
+bool IsCheckpoint(const void *data, size_t length)
+{
+    return length >= sizeof(CheckpointHeader) && memcmp(data, CHECKPOINT_MAGIC, 4) == 0;
+}
+
+bool LoadCheckpoint(CPU *cpu, const char *file_name, AssemblerError *error)
+{
+    uint8_t checkpoint[sizeof(CheckpointHeader) + CHECKPOINT_BODY_BYTES + 1];
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL)
+    {
+        return CheckpointError(error, 0, "could not open the file");
+    }
+    size_t length = fread(checkpoint, 1, sizeof(checkpoint), file);
+    fclose(file);
+    if (!IsCheckpoint(checkpoint, length))
+    {
+        return CheckpointError(error, -1, "not a checkpoint");
+    }
+    CheckpointHeader header;
+    memcpy(&header, checkpoint, sizeof(header));
+    if (header.version != CHECKPOINT_VERSION)
+    {
+        return CheckpointError(error, -1, "unsupported checkpoint version");
+    }
+    const uint8_t *body = checkpoint + sizeof(header);
+    if (header.length != CHECKPOINT_BODY_BYTES || length != sizeof(header) + CHECKPOINT_BODY_BYTES)
+    {
+        return CheckpointError(error, -1, "truncated or damaged checkpoint");
+    }
+    if (ImageChecksum(body, CHECKPOINT_BODY_BYTES) != header.checksum)
+    {
+        return CheckpointError(error, -1, "checkpoint checksum mismatch");
+    }
+
+    ResetCPU(cpu);
+    const uint8_t *p = body;
+    memcpy(cpu->generalRegisters, p, 64);
+    MarkLoadedRegisters(cpu);
+    p += 64;
+    WriteStatusRegister(cpu, GetU8(&p));
+    cpu->pc = GetU16(&p);
+    cpu->clockcycles = (int)GetU32(&p);
+    cpu->MaxClockCycles = (int)GetU32(&p);
+    cpu->retired = GetU64(&p);
+    cpu->pipeline1.instruction = (int16_t)GetU16(&p);
+    cpu->pipeline1.valid = GetU8(&p) != 0;
+    cpu->pipeline1.pcVal = GetU16(&p);
+    GetStage(&p, &cpu->pipeline2);
+    GetStage(&p, &cpu->pipeline3);
+    GetStage(&p, &cpu->pipeline4);
+    WriteDataMemoryBlock(cpu, 0, (const int8_t *)p, 2048);
+    p += 2048;
+    for (int address = 0; address < 1024; address++)
+    {
+        PageWriteInstruction(cpu, (uint16_t)address, (int16_t)GetU16(&p));
+    }
+    cpu->predictor.kind = GetU8(&p);
+    cpu->predictor.btbEntries = GetU8(&p);
+    cpu->predictor.resolveInDecode = GetU8(&p) != 0;
+    memcpy(cpu->predictor.bht, p, PREDICTOR_BHT_ENTRIES);
+    p += PREDICTOR_BHT_ENTRIES;
+    for (int i = 0; i < PREDICTOR_MAX_BTB_ENTRIES; i++)
+    {
+        cpu->predictor.btb[i].address = GetU16(&p);
+        cpu->predictor.btb[i].target = GetU16(&p);
+        cpu->predictor.btb[i].valid = GetU8(&p) != 0;
+    }
+    if (cpu->predictor.kind > PREDICTOR_BIMODAL || cpu->predictor.btbEntries > PREDICTOR_MAX_BTB_ENTRIES ||
+        (cpu->predictor.btbEntries & (cpu->predictor.btbEntries - 1)) != 0)
+    {
+        ResetCPU(cpu);
+        return CheckpointError(error, -1, "unknown branch predictor in the checkpoint");
+    }
+    PredecodeProgram(cpu);
+    return true;
+}
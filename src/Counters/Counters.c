@@ -0,0 +1,300 @@
+/**
+ * @file Counters.c
+ * @brief Reports of the pipeline performance counters: CPI stack, text report, JSON and callgrind output.
+ */
+
+#include "../Headers/Counters.h"
+#include "../Headers/Assembler.h"
+#include "../Headers/Cache.h"
+#include "../Headers/Image.h"
+#include "../Headers/Predictor.h"
+#include "../Headers/Report.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *mnemonics[16] = {"ADD", "SUB", "MUL", "MOVI", "BEQZ", "ANDI", "EOR", "BR",
+                                    "SAL", "SAR", "LDR", "STR", "NOP12", "NOP13", "NOP14", "NOP15"};
+
+// the counters reported for a processor that never enabled them: all zero
+static const PerfCounters noCounters;
+
+// Function to get the counters of a processor, or the zero ones
+static const PerfCounters *CountersOf(const CPU *cpu)
+{
+    return cpu->counters != NULL ? cpu->counters : &noCounters;
+}
+
+void EnableCounters(CPU *cpu)
+{
+    if (cpu->counters == NULL)
+    {
+        cpu->counters = malloc(sizeof(PerfCounters));
+        if (cpu->counters == NULL)
+        {
+            printf("Error: out of memory\n");
+            exit(1);
+        }
+    }
+    memset(cpu->counters, 0, sizeof(PerfCounters));
+}
+
+CPIStack GetCPIStack(const CPU *cpu)
+{
+    const PerfCounters *counters = CountersOf(cpu);
+    CPIStack stack;
+    stack.instructions = 0;
+    for (int opcode = 0; opcode < 16; opcode++)
+    {
+        stack.instructions += counters->opcodeRetired[opcode];
+    }
+    stack.cycles = counters->cycles;
+    stack.base = stack.instructions;
+    stack.branchFlush = counters->flushCycles;
+    stack.fillDrain = counters->fillDrainCycles + counters->pendingBubbles;
+    stack.memoryStall = counters->memoryStallCycles;
+    return stack;
+}
+
+void PrintCounters(const CPU *cpu, FILE *out)
+{
+    const PerfCounters *counters = CountersOf(cpu);
+    CPIStack stack = GetCPIStack(cpu);
+    fprintf(out, "Performance Counters: \n");
+    fprintf(out, "-------------------------------------------------- \n");
+    fprintf(out, "Cycles: %llu  Instructions: %llu  CPI: %.4f\n",
+            (unsigned long long)stack.cycles, (unsigned long long)stack.instructions,
+            Ratio(stack.cycles, stack.instructions));
+    fprintf(out, "CPI stack: base %.4f  branch flush %.4f  fill/drain %.4f",
+            Ratio(stack.base, stack.instructions),
+            Ratio(stack.branchFlush, stack.instructions),
+            Ratio(stack.fillDrain, stack.instructions));
+    if (CacheActive(cpu))
+    {
+        fprintf(out, "  memory stall %.4f", Ratio(stack.memoryStall, stack.instructions));
+    }
+    fprintf(out, "\n");
+    fprintf(out, "Flushes: %llu (BEQZ %llu, BR %llu), %llu cycles lost\n",
+            (unsigned long long)(counters->beqzFlushes + counters->brFlushes),
+            (unsigned long long)counters->beqzFlushes, (unsigned long long)counters->brFlushes,
+            (unsigned long long)stack.branchFlush);
+    fprintf(out, "Fill/drain bubbles: %llu\n", (unsigned long long)stack.fillDrain);
+    fprintf(out, "Branch predictor: %s, BTB %d entries\n", PredictorName((PredictorKind)cpu->predictor.kind),
+            cpu->predictor.btbEntries);
+    fprintf(out, "BEQZ: %llu executed, %llu taken, %llu mispredicted (accuracy %.2f%%)\n",
+            (unsigned long long)counters->opcodeRetired[4], (unsigned long long)counters->beqzTaken,
+            (unsigned long long)counters->beqzFlushes,
+            100.0 * (1.0 - Ratio(counters->beqzFlushes, counters->opcodeRetired[4])));
+    fprintf(out, "BR: %llu executed, %llu mispredicted (accuracy %.2f%%)\n",
+            (unsigned long long)counters->opcodeRetired[7], (unsigned long long)counters->brFlushes,
+            100.0 * (1.0 - Ratio(counters->brFlushes, counters->opcodeRetired[7])));
+    if (cpu->predictor.resolveInDecode)
+    {
+        fprintf(out, "Branches resolved in decode: %llu (%llu with the register forwarded from execute)\n",
+                (unsigned long long)counters->decodeResolved, (unsigned long long)counters->decodeForwards);
+    }
+    fprintf(out, "Data memory: %llu reads, %llu writes\n",
+            (unsigned long long)counters->dataReads, (unsigned long long)counters->dataWrites);
+    for (int opcode = 0; opcode < 16; opcode++)
+    {
+        if (counters->opcodeRetired[opcode] != 0)
+        {
+            fprintf(out, "Opcode %s: %llu\n", mnemonics[opcode], (unsigned long long)counters->opcodeRetired[opcode]);
+        }
+    }
+    for (int address = 0; address < 1024; address++)
+    {
+        if (counters->pcExecutions[address] != 0)
+        {
+            fprintf(out, "Instruction %d: executed %llu  flush cycles %llu\n", address,
+                    (unsigned long long)counters->pcExecutions[address],
+                    (unsigned long long)counters->pcFlushCycles[address]);
+        }
+    }
+    fprintf(out, "-------------------------------------------------- \n");
+}
+
+// Function to write the shape and the counts of one data cache level as a JSON member
+static void WriteCacheLevelJSON(const char *name, const CacheLevel *level, FILE *out)
+{
+    fprintf(out, "\"%s\": {\"bytes\": %d, \"ways\": %d, \"line_bytes\": %d, \"hits\": %llu, \"misses\": %llu, ", name,
+            level->geometry.bytes, level->geometry.ways, level->geometry.lineBytes, (unsigned long long)level->hits,
+            (unsigned long long)level->misses);
+    fprintf(out, "\"evictions\": %llu, \"writebacks\": %llu}", (unsigned long long)level->evictions,
+            (unsigned long long)level->writebacks);
+}
+
+bool WriteCountersJSON(const CPU *cpu, const char *file_name)
+{
+    FILE *out = fopen(file_name, "w");
+    if (out == NULL)
+    {
+        return false;
+    }
+    const PerfCounters *counters = CountersOf(cpu);
+    CPIStack stack = GetCPIStack(cpu);
+    fprintf(out, "{\n  \"cycles\": %llu,\n  \"instructions\": %llu,\n  \"cpi\": %.6f,\n",
+            (unsigned long long)stack.cycles, (unsigned long long)stack.instructions,
+            Ratio(stack.cycles, stack.instructions));
+    fprintf(out, "  \"cpi_stack\": {\"base\": %.6f, \"branch_flush\": %.6f, \"fill_drain\": %.6f, \"memory_stall\": %.6f},\n",
+            Ratio(stack.base, stack.instructions),
+            Ratio(stack.branchFlush, stack.instructions),
+            Ratio(stack.fillDrain, stack.instructions),
+            Ratio(stack.memoryStall, stack.instructions));
+    fprintf(out, "  \"cycle_stack\": {\"base\": %llu, \"branch_flush\": %llu, \"fill_drain\": %llu, \"memory_stall\": %llu},\n",
+            (unsigned long long)stack.base, (unsigned long long)stack.branchFlush, (unsigned long long)stack.fillDrain,
+            (unsigned long long)stack.memoryStall);
+    fprintf(out, "  \"flushes\": {\"beqz\": %llu, \"br\": %llu, \"cycles\": %llu},\n",
+            (unsigned long long)counters->beqzFlushes, (unsigned long long)counters->brFlushes,
+            (unsigned long long)stack.branchFlush);
+    fprintf(out, "  \"branch_prediction\": {\"predictor\": \"%s\", \"btb_entries\": %d, \"resolved_in\": \"%s\", ",
+            PredictorName((PredictorKind)cpu->predictor.kind), cpu->predictor.btbEntries,
+            cpu->predictor.resolveInDecode ? "decode" : "execute");
+    fprintf(out, "\"decode_resolved\": %llu, \"decode_forwards\": %llu, ", (unsigned long long)counters->decodeResolved,
+            (unsigned long long)counters->decodeForwards);
+    fprintf(out, "\"beqz\": {\"executed\": %llu, \"taken\": %llu, \"mispredicted\": %llu}, ",
+            (unsigned long long)counters->opcodeRetired[4], (unsigned long long)counters->beqzTaken,
+            (unsigned long long)counters->beqzFlushes);
+    fprintf(out, "\"br\": {\"executed\": %llu, \"mispredicted\": %llu}},\n",
+            (unsigned long long)counters->opcodeRetired[7], (unsigned long long)counters->brFlushes);
+    fprintf(out, "  \"data_memory\": {\"reads\": %llu, \"writes\": %llu},\n",
+            (unsigned long long)counters->dataReads, (unsigned long long)counters->dataWrites);
+    if (CacheActive(cpu))
+    {
+        const DataCache *cache = cpu->cache;
+        fprintf(out, "  \"data_cache\": {");
+        WriteCacheLevelJSON("l1", &cache->l1, out);
+        if (cache->l2.sets != 0)
+        {
+            fprintf(out, ", ");
+            WriteCacheLevelJSON("l2", &cache->l2, out);
+        }
+        fprintf(out, ", \"write_policy\": \"%s\", \"replacement\": \"%s\", \"l2_latency\": %d, \"memory_latency\": %d, ",
+                cache->writePolicy == CACHE_WRITE_BACK ? "write-back" : "write-through",
+                cache->replacement == CACHE_REPLACE_LRU ? "lru" : "plru", cache->l2Latency, cache->memoryLatency);
+        fprintf(out, "\"memory_reads\": %llu, \"memory_writes\": %llu},\n", (unsigned long long)cache->memoryReads,
+                (unsigned long long)cache->memoryWrites);
+    }
+    fprintf(out, "  \"opcodes\": {");
+    bool first = true;
+    for (int opcode = 0; opcode < 16; opcode++)
+    {
+        if (counters->opcodeRetired[opcode] != 0)
+        {
+            fprintf(out, "%s\"%s\": %llu", first ? "" : ", ", mnemonics[opcode],
+                    (unsigned long long)counters->opcodeRetired[opcode]);
+            first = false;
+        }
+    }
+    fprintf(out, "},\n  \"instructions_by_address\": [");
+    first = true;
+    for (int address = 0; address < 1024; address++)
+    {
+        if (counters->pcExecutions[address] != 0)
+        {
+            fprintf(out, "%s\n    {\"address\": %d, \"executions\": %llu, \"flush_cycles\": %llu", first ? "" : ",", address,
+                    (unsigned long long)counters->pcExecutions[address],
+                    (unsigned long long)counters->pcFlushCycles[address]);
+            if (CacheActive(cpu) && (cpu->cache->pcHits[address] != 0 || cpu->cache->pcMisses[address] != 0))
+            {
+                fprintf(out, ", \"cache_hits\": %llu, \"cache_misses\": %llu, \"cache_evictions\": %llu, \"stall_cycles\": %llu",
+                        (unsigned long long)cpu->cache->pcHits[address], (unsigned long long)cpu->cache->pcMisses[address],
+                        (unsigned long long)cpu->cache->pcEvictions[address],
+                        (unsigned long long)cpu->cache->pcStallCycles[address]);
+            }
+            fprintf(out, "}");
+            first = false;
+        }
+    }
+    fprintf(out, "%s]\n}\n", first ? "" : "\n  ");
+    return fclose(out) == 0;
+}
+
+// Function to get the cycles execute stalled on the data cache misses of a row, 0 without a cache
+static uint64_t StallCyclesAt(const CPU *cpu, int address)
+{
+    return CacheActive(cpu) ? cpu->cache->pcStallCycles[address] : 0;
+}
+
+// Function to map every row to the line of the assembly file it came from (row + 1 for an image or an unreadable file)
+static void MapSourceLines(const char *program_file, int *lines)
+{
+    for (int address = 0; address < 1024; address++)
+    {
+        lines[address] = address + 1;
+    }
+    size_t length;
+    const char *text = MapProgramFile(program_file, &length, NULL);
+    if (text == NULL)
+    {
+        return;
+    }
+    if (!IsImage(text, length))
+    {
+        uint16_t program[ASSEMBLER_MAX_INSTRUCTIONS];
+        int assembled[ASSEMBLER_MAX_INSTRUCTIONS];
+        size_t count;
+        if (AssembleWithLines(text, length, program, assembled, &count, NULL))
+        {
+            for (size_t address = 0; address < count; address++)
+            {
+                lines[address] = assembled[address];
+            }
+        }
+    }
+    UnmapProgramFile(text, length);
+}
+
+bool WriteCountersCallgrind(const CPU *cpu, const char *program_file, const char *file_name)
+{
+    FILE *out = fopen(file_name, "w");
+    if (out == NULL)
+    {
+        return false;
+    }
+    const PerfCounters *counters = CountersOf(cpu);
+    int lines[1024];
+    MapSourceLines(program_file, lines);
+    char path[PATH_MAX];
+    if (realpath(program_file, path) == NULL)
+    {
+        snprintf(path, sizeof(path), "%s", program_file);
+    }
+
+    uint64_t totals[5] = {0, 0, 0, 0, 0};
+    for (int address = 0; address < 1024; address++)
+    {
+        uint64_t executions = counters->pcExecutions[address];
+        uint8_t opcode = cpu->predecoded->opcode[address];
+        totals[0] += executions;
+        totals[1] += executions + counters->pcFlushCycles[address] + StallCyclesAt(cpu, address);
+        totals[2] += counters->pcFlushCycles[address];
+        totals[3] += opcode == 10 ? executions : 0;
+        totals[4] += opcode == 11 ? executions : 0;
+    }
+    fprintf(out, "# callgrind format\nversion: 1\ncreator: processor\ncmd: %s\npositions: line\n", program_file);
+    fprintf(out, "events: Ir Cycles Flush Dr Dw\n");
+    fprintf(out, "summary: %llu %llu %llu %llu %llu\n\n", (unsigned long long)totals[0], (unsigned long long)totals[1],
+            (unsigned long long)totals[2], (unsigned long long)totals[3], (unsigned long long)totals[4]);
+    fprintf(out, "fl=%s\nfn=program\n", path);
+    for (int address = 0; address < 1024; address++)
+    {
+        uint64_t executions = counters->pcExecutions[address];
+        uint64_t cycles = executions + counters->pcFlushCycles[address] + StallCyclesAt(cpu, address);
+        if (executions == 0 && counters->pcFlushCycles[address] == 0)
+        {
+            continue;
+        }
+        uint8_t opcode = cpu->predecoded->opcode[address];
+        fprintf(out, "%d %llu %llu %llu %llu %llu\n", lines[address], (unsigned long long)executions,
+                (unsigned long long)cycles,
+                (unsigned long long)counters->pcFlushCycles[address],
+                (unsigned long long)(opcode == 10 ? executions : 0),
+                (unsigned long long)(opcode == 11 ? executions : 0));
+    }
+    return fclose(out) == 0;
+}
@@ -1,57 +1,63 @@
+#include "../Headers/DataMemory.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Trace.h"
 
 #include <stdint.h>
-
-int8_t data_memory[2048];
-
+#include <stdio.h>
 
 /**
  * Read data from the data memory at the specified address.
  *
+ * @param cpu The processor.
  * @param address The memory address to read from.
  * @return The data stored at the specified address.
  */
-int8_t ReadDataMemory(uint16_t address)
+int8_t ReadDataMemory(CPU *cpu, uint16_t address)
 {
-    return data_memory[address];
+    return PageReadData(cpu, address);
 }
 
 /**
  * Write data to the data memory at the specified address.
  *
+ * @param cpu The processor.
  * @param address The memory address to write to.
  * @param value The data to be written.
  */
-void WriteDataMemory(uint16_t address, int8_t value)
+void WriteDataMemory(CPU *cpu, uint16_t address, int8_t value)
 {
-    data_memory[address] = value;
-    printf("Update DataMemory Address:%d DataMemory Data: %d\n", address, value);
+    PageWriteData(cpu, address, value);
+    TraceMemoryWrite(address, value);
 }
 
 /**
  * Print all non-zero data stored in the data memory.
+ *
+ * @param cpu The processor.
+ * @param out The stream the data is printed to.
  */
-void PrintAllDataMemory()
+void PrintAllDataMemory(CPU *cpu, FILE *out)
 {
 
-    printf("Final State of Data Memory: \n");
-    printf("-------------------------------------------------- \n");
+    fprintf(out, "Final State of Data Memory: \n");
+    fprintf(out, "-------------------------------------------------- \n");
     for (int i = 0; i < 2048; i++)
     {
-        if (data_memory[i] != 0)
+        int8_t value = PageReadData(cpu, i);
+        if (value != 0)
         {
-            printf("Address:%d DataMemory Data: %d\n", i, data_memory[i]);
+            fprintf(out, "Address:%d DataMemory Data: %d\n", i, value);
         }
     }
-    printf("-------------------------------------------------- \n");
+    fprintf(out, "-------------------------------------------------- \n");
 }
 
 /**
- * Reset the data memory by setting all values to zero.
+ * Reset the data memory by attaching the shared zero page everywhere.
+ *
+ * @param cpu The processor.
  */
-void ResetDataMemory()
+void ResetDataMemory(CPU *cpu)
 {
-    for (int i = 0; i < 2048; i++)
-    {
-        data_memory[i] = 0;
-    }
+    AttachZeroPages(cpu);
 }
\ No newline at end of file
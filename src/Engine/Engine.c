@@ -0,0 +1,632 @@
+/**
+ * @file Engine.c
+ * @brief Execution engines: the pipeline clock loop, the execute() switch loop and a direct-threaded interpreter.
+ */
+
+#include "../Headers/Engine.h"
+#include "../Headers/Flags.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/JIT.h"
+#include "../Headers/OutOfOrder.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Predictor.h"
+#include "../Headers/Registers.h"
+#include "../Headers/State.h"
+#include "../Headers/Trace.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief One instruction memory row translated for the threaded engine.
+ */
+typedef struct {
+    const void *handler; /**< Address of the handler label. */
+    uint8_t r1;          /**< First register. */
+    uint8_t r2;          /**< Second register (R-type). */
+    int8_t imm;          /**< Sign-extended immediate, or the shift count masked to 5 bits. */
+    uint8_t address;     /**< Data memory address of LDR/STR. */
+    bool haltsWhenTaken; /**< A taken branch in this row ends the program (see GetExecutePC). */
+    uint16_t target;     /**< Taken target of BEQZ. */
+} ThreadedOp;
+
+/**
+ * @brief The mispredicted branches of a RunThreadedCode call, from which FastForward derives the pipeline cycles.
+ */
+typedef struct {
+    uint64_t flushes;     /**< Branches the fetch stage predicted wrong, each flushing the pipeline. */
+    uint64_t lastFlushAt; /**< Instructions executed up to and including the last mispredicted branch. */
+    bool endedByBranch;   /**< A taken branch ended the program (see GetExecutePC). */
+    bool stopped;         /**< The run stopped before the instruction at stopPC. */
+} ThreadedBranches;
+
+// Function to predict a branch as fetch would have and train the predictor with its outcome, telling whether it flushes
+static bool PredictBranch(CPU *cpu, uint16_t address, bool taken, uint16_t target)
+{
+    Instruction ins = GetPredecodedInstruction(cpu, address);
+    uint16_t fetched = PredictNextPC(cpu, address);
+    return TrainPredictor(cpu, ins, address, taken, target, fetched);
+}
+
+// Function to tell how many bubbles the flush of a mispredicted branch costs
+static inline int FlushBubbles(const CPU *cpu)
+{
+    return cpu->predictor.resolveInDecode ? 1 : 2;
+}
+
+bool ParseEngineKind(const char *name, EngineKind *kind)
+{
+    if (strcmp(name, "pipeline") == 0)
+    {
+        *kind = ENGINE_PIPELINE;
+    }
+    else if (strcmp(name, "switch") == 0)
+    {
+        *kind = ENGINE_SWITCH;
+    }
+    else if (strcmp(name, "threaded") == 0)
+    {
+        *kind = ENGINE_THREADED;
+    }
+    else if (strcmp(name, "jit") == 0)
+    {
+        *kind = ENGINE_JIT;
+    }
+    else if (strcmp(name, "ooo") == 0)
+    {
+        *kind = ENGINE_OOO;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// Function to execute the instruction at the PC with execute() and move the PC on
+StepResult StepInstruction(CPU *cpu)
+{
+    uint16_t address = cpu->pc;
+    if (ReadInstructionMemory(cpu, address) == -1)
+    {
+        return STEP_HALTED;
+    }
+    Instruction ins = GetPredecodedInstruction(cpu, address);
+    if (ins.opcode == 4 || ins.opcode == 7)
+    {
+        // branches compute their target from the PC the pipeline would hold in execute
+        bool taken = ins.opcode == 7 || ReadRegister(cpu, ins.operand1) == 0;
+        uint16_t executePC = GetExecutePC(cpu, address);
+        cpu->pc = taken ? executePC : address + 1;
+        execute(cpu, ins);
+        if (taken && executePC != address + 3)
+        {
+            return STEP_EXECUTED_AND_HALTED;
+        }
+        return STEP_EXECUTED;
+    }
+    cpu->pc = address + 1;
+    execute(cpu, ins);
+    return STEP_EXECUTED;
+}
+
+// Function to run the program one execute() call at a time
+EngineResult RunSwitchEngine(CPU *cpu, uint64_t maxInstructions)
+{
+    EngineResult result = {0, false};
+    while (maxInstructions == 0 || result.instructions < maxInstructions)
+    {
+        StepResult step = StepInstruction(cpu);
+        if (step == STEP_HALTED)
+        {
+            result.halted = true;
+            return result;
+        }
+        result.instructions++;
+        if (step == STEP_EXECUTED_AND_HALTED)
+        {
+            result.halted = true;
+            return result;
+        }
+    }
+    result.halted = ReadInstructionMemory(cpu, cpu->pc) == -1;
+    return result;
+}
+
+// Function to tell whether any pipeline stage holds an instruction
+static inline bool PipelineBusy(const CPU *cpu)
+{
+    return cpu->pipeline1.valid || cpu->pipeline2.valid || cpu->pipeline3.valid || cpu->pipeline4.valid;
+}
+
+// Function to run the program through the pipeline, one clock cycle at a time
+EngineResult RunPipelineEngine(CPU *cpu, uint64_t maxInstructions)
+{
+    return RunPipelineEngineUntil(cpu, maxInstructions, 0);
+}
+
+// Function to run the pipeline until the program ends, the budget runs out or the stop cycle is reached
+EngineResult RunPipelineEngineUntil(CPU *cpu, uint64_t maxInstructions, int stopCycle)
+{
+    uint64_t start = cpu->retired;
+    EngineResult result = {0, false};
+
+    /*
+     * The fetch of the first cycle happens before the loop; every other cycle fetches,
+     * decodes and executes until all stages are empty (no instruction left to fetch,
+     * decode or execute). A run that continues an earlier one (stopped by the budget or
+     * the stop cycle, or restored from a checkpoint) checks the stages first, exactly
+     * like the next iteration of the loop would have.
+     */
+    bool first = cpu->clockcycles == 1;
+    if (first)
+    {
+        TraceCycleBegin(cpu->clockcycles);
+        fetchPipeline(cpu);
+    }
+    while (PipelineBusy(cpu))
+    {
+        if (memoryStallPipeline(cpu))
+        {
+            // a data cache miss holds execute, fetch and decode keep their instructions
+            TraceCycleBegin(cpu->clockcycles);
+            holdPipeline(cpu);
+        }
+        else
+        {
+            if (!first)
+            {
+                TraceCycleBegin(cpu->clockcycles);
+                fetchPipeline(cpu);
+            }
+            decodePipeline(cpu);
+        }
+        first = false;
+
+        executePipeline(cpu);
+
+        TraceCycleEnd();
+        cpu->clockcycles++;
+        if ((maxInstructions != 0 && cpu->retired - start >= maxInstructions) || cpu->clockcycles == stopCycle)
+        {
+            result.instructions = cpu->retired - start;
+            result.halted = !PipelineBusy(cpu);
+            return result;
+        }
+    }
+    result.instructions = cpu->retired - start;
+    result.halted = true;
+    return result;
+}
+
+// Function to run the program as direct-threaded code, stopping before stopPC (-1 for never); with branches, the
+// predictor is consulted and trained for every branch and the mispredictions are counted
+static EngineResult RunThreadedCode(CPU *cpu, uint64_t maxInstructions, int stopPC, ThreadedBranches *branches)
+{
+    static const void *handlers[16] = {
+        &&op_add, &&op_sub, &&op_mul, &&op_movi, &&op_beqz, &&op_andi, &&op_eor, &&op_br,
+        &&op_sal, &&op_sar, &&op_ldr, &&op_str, &&op_nop, &&op_nop, &&op_nop, &&op_nop};
+
+    // translate every row; the code is rebuilt on each call so it always matches the memory
+    ThreadedOp threadedCode[1025]; // one record per row plus a halt record for addresses past the end
+    for (int i = 0; i < 1024; i++)
+    {
+        ThreadedOp *op = &threadedCode[i];
+        if (ReadInstructionMemory(cpu, i) == -1)
+        {
+            op->handler = &&op_halt;
+            continue;
+        }
+        Instruction ins = GetPredecodedInstruction(cpu, i);
+        op->handler = handlers[ins.opcode];
+        op->r1 = ins.operand1;
+        op->r2 = ins.operand2;
+        op->imm = (ins.opcode == 8 || ins.opcode == 9) ? (ins.value2 & 31) : ins.value2;
+        op->address = (uint8_t)ins.value2;
+        uint16_t executePC = GetExecutePC(cpu, i);
+        op->haltsWhenTaken = executePC != i + 3;
+        op->target = (uint16_t)(executePC + ins.value2 - 1);
+        // the handlers write the registers and memory directly, so mark everything the code can write
+        if (ins.opcode == 11)
+        {
+            MarkDataDirty(cpu, op->address);
+        }
+        else if (ins.opcode <= 10 && ins.opcode != 4 && ins.opcode != 7)
+        {
+            MarkRegisterDirty(cpu, op->r1);
+        }
+    }
+    threadedCode[1024].handler = &&op_halt;
+    if (stopPC >= 0 && threadedCode[stopPC].handler != &&op_halt)
+    {
+        threadedCode[stopPC].handler = &&op_stop;
+    }
+
+    uint64_t budget = maxInstructions == 0 ? UINT64_MAX : maxInstructions;
+    uint64_t executed = 0;
+    int8_t *regs = cpu->generalRegisters;
+    uint8_t sreg = ReadStatusRegister(cpu);
+    uint16_t finalPC;
+    const ThreadedOp *ip;
+    bool predicting = branches != NULL;
+    uint64_t flushes = 0;
+    uint64_t lastFlushAt = 0;
+    bool endedByBranch = false;
+    bool stopped = false;
+
+#define DISPATCH()              \
+    do                          \
+    {                           \
+        if (executed == budget) \
+        {                       \
+            goto out_of_budget; \
+        }                       \
+        executed++;             \
+        goto *ip->handler;      \
+    } while (0)
+#define NEXT()      \
+    do              \
+    {               \
+        ip++;       \
+        DISPATCH(); \
+    } while (0)
+#define BRANCH(isTaken, address)                                                                   \
+    do                                                                                             \
+    {                                                                                              \
+        bool branchTaken = (isTaken);                                                              \
+        uint16_t jumpTo = (address);                                                               \
+        if (ip->haltsWhenTaken)                                                                    \
+        {                                                                                          \
+            if (branchTaken)                                                                       \
+            {                                                                                      \
+                endedByBranch = true;                                                              \
+                finalPC = jumpTo;                                                                  \
+                goto halt;                                                                         \
+            }                                                                                      \
+        }                                                                                          \
+        else if (predicting && PredictBranch(cpu, (uint16_t)(ip - threadedCode), branchTaken, jumpTo)) \
+        {                                                                                          \
+            flushes++;                                                                             \
+            lastFlushAt = executed;                                                                \
+        }                                                                                          \
+        if (!branchTaken)                                                                          \
+        {                                                                                          \
+            NEXT();                                                                                \
+        }                                                                                          \
+        if (jumpTo >= 1024)                                                                        \
+        {                                                                                          \
+            finalPC = jumpTo;                                                                      \
+            goto halt;                                                                             \
+        }                                                                                          \
+        ip = &threadedCode[jumpTo];                                                                \
+        DISPATCH();                                                                                \
+    } while (0)
+
+    if (cpu->pc >= 1024)
+    {
+        finalPC = cpu->pc;
+        goto halt;
+    }
+    ip = &threadedCode[cpu->pc];
+    DISPATCH();
+
+op_add:
+{
+    uint8_t r1 = regs[ip->r1];
+    uint8_t r2 = regs[ip->r2];
+    uint8_t result = r1 + r2;
+    sreg = FlagsAdd(sreg, r1, r2, result);
+    regs[ip->r1] = result;
+    NEXT();
+}
+op_sub:
+{
+    int8_t r1 = regs[ip->r1];
+    int8_t r2 = regs[ip->r2];
+    int8_t result = r1 - r2;
+    sreg = FlagsSub(sreg, r1, r2, result);
+    regs[ip->r1] = result;
+    NEXT();
+}
+op_mul:
+{
+    int8_t result = regs[ip->r1] * regs[ip->r2];
+    sreg = FlagsNegativeZero(sreg, result);
+    regs[ip->r1] = result;
+    NEXT();
+}
+op_movi:
+    regs[ip->r1] = ip->imm;
+    NEXT();
+op_beqz:
+    BRANCH(regs[ip->r1] == 0, ip->target);
+op_andi:
+{
+    int8_t result = regs[ip->r1] & ip->imm;
+    sreg = FlagsNegativeZero(sreg, result);
+    regs[ip->r1] = result;
+    NEXT();
+}
+op_eor:
+{
+    int8_t result = regs[ip->r1] ^ regs[ip->r2];
+    sreg = FlagsNegativeZero(sreg, result);
+    regs[ip->r1] = result;
+    NEXT();
+}
+op_br:
+    BRANCH(true, BranchRegisterTarget(regs[ip->r1], regs[ip->r2]));
+op_sal:
+{
+    int8_t result = (int8_t)(uint8_t)((uint32_t)(int32_t)regs[ip->r1] << ip->imm);
+    sreg = FlagsNegativeZero(sreg, result);
+    regs[ip->r1] = result;
+    NEXT();
+}
+op_sar:
+{
+    int8_t result = (int8_t)(regs[ip->r1] >> ip->imm);
+    sreg = FlagsNegativeZero(sreg, result);
+    regs[ip->r1] = result;
+    NEXT();
+}
+op_ldr:
+    regs[ip->r1] = PageReadData(cpu, ip->address);
+    NEXT();
+op_str:
+    PageWriteData(cpu, ip->address, regs[ip->r1]);
+    NEXT();
+op_nop:
+    NEXT();
+
+op_stop:
+    // the stop row: DISPATCH counted it, but it does not execute
+    executed--;
+    stopped = true;
+    goto out_of_budget;
+
+op_halt:
+    // an empty row: DISPATCH counted it, but it is not an instruction
+    executed--;
+    finalPC = (uint16_t)(ip - threadedCode);
+
+halt:
+{
+    WriteStatusRegister(cpu, sreg);
+    cpu->pc = finalPC;
+    if (branches != NULL)
+    {
+        *branches = (ThreadedBranches){flushes, lastFlushAt, endedByBranch, false};
+    }
+    EngineResult result = {executed, true};
+    return result;
+}
+
+out_of_budget:
+{
+    WriteStatusRegister(cpu, sreg);
+    cpu->pc = (uint16_t)(ip - threadedCode);
+    if (branches != NULL)
+    {
+        *branches = (ThreadedBranches){flushes, lastFlushAt, false, stopped};
+    }
+    EngineResult result = {executed, ip->handler == &&op_halt};
+    return result;
+}
+
+#undef DISPATCH
+#undef NEXT
+#undef BRANCH
+}
+
+// Function to run the program as direct-threaded code
+EngineResult RunThreadedEngine(CPU *cpu, uint64_t maxInstructions)
+{
+    return RunThreadedCode(cpu, maxInstructions, -1, NULL);
+}
+
+// Function to fill the pipeline registers as the pipeline holds them just before the instruction at address executes
+static void FillPipeline(CPU *cpu, uint16_t address)
+{
+    ResetPipeline(cpu);
+    cpu->pipeline4.instruction = GetPredecodedInstruction(cpu, address);
+    cpu->pipeline4.pcVal = address;
+    cpu->pipeline4.valid = true;
+    // fetch followed the predictor (the next row when none is selected)
+    uint16_t nextAddress = PredictNextPC(cpu, address);
+    cpu->pc = nextAddress;
+    int16_t next = ReadInstructionMemory(cpu, nextAddress);
+    cpu->pipeline1.valid = next != -1;
+    if (next != -1)
+    {
+        // the next instruction was fetched and decoded the cycle before, fetch moved on past it
+        cpu->pipeline1.instruction = next;
+        cpu->pipeline1.pcVal = nextAddress;
+        cpu->pipeline2.instruction = GetPredecodedInstruction(cpu, nextAddress);
+        cpu->pipeline2.pcVal = nextAddress;
+        cpu->pipeline2.valid = true;
+        cpu->pc = PredictNextPC(cpu, nextAddress);
+    }
+    if (cpu->predictor.resolveInDecode)
+    {
+        ResolveBranchInDecode(cpu, NULL); // the instruction about to execute left decode the cycle before
+    }
+}
+
+// Function to execute the program without the pipeline until the target is reached, then hand over to the pipeline
+EngineResult FastForward(CPU *cpu, const FastForwardTarget *target)
+{
+    EngineResult result = {0, false};
+    if (cpu->clockcycles != 1 && !PipelineBusy(cpu))
+    {
+        result.halted = true; // the pipeline has drained, the program has ended
+        return result;
+    }
+
+    /*
+     * Continue from the pipeline state: the oldest instruction in flight is the next
+     * one to execute, one cycle later for every empty stage in front of it (the two
+     * refill cycles after a branch).
+     */
+    uint16_t address = cpu->pc;
+    int cycle = cpu->clockcycles + 2; // the cycle the next instruction executes in
+    if (cpu->pipeline4.valid)
+    {
+        address = cpu->pipeline4.pcVal;
+        cycle = cpu->clockcycles;
+    }
+    else if (cpu->pipeline2.valid)
+    {
+        address = cpu->pipeline2.pcVal;
+        cycle = cpu->clockcycles + 1;
+    }
+
+    int clock = cpu->clockcycles; // the clock cycle counter of the pipeline after the last executed instruction
+    int bubbles = FlushBubbles(cpu);
+    bool flushed = false;         // the last executed instruction was a mispredicted branch
+
+    /*
+     * The instructions run as threaded code. With a cycle target the runs are cut short
+     * enough never to pass it (an instruction takes at most 3 cycles); the last few
+     * instructions before it are stepped one at a time.
+     */
+    bool stepping = false;
+    cpu->pc = address;
+    for (;;)
+    {
+        uint64_t budget = 0;
+        if (target->instructions != 0)
+        {
+            if (result.instructions >= target->instructions)
+            {
+                break;
+            }
+            budget = target->instructions - result.instructions;
+        }
+        if (target->cycle != 0)
+        {
+            if (clock >= target->cycle)
+            {
+                break;
+            }
+            uint64_t chunk = (uint64_t)(target->cycle - clock) / 3;
+            if (chunk == 0)
+            {
+                stepping = true;
+                break;
+            }
+            budget = budget == 0 || chunk < budget ? chunk : budget;
+        }
+        ThreadedBranches branches;
+        EngineResult run = RunThreadedCode(cpu, budget, target->pc, &branches);
+        if (run.instructions > 0)
+        {
+            result.instructions += run.instructions;
+            cycle += (int)(run.instructions + bubbles * branches.flushes);
+            flushed = branches.flushes > 0 && branches.lastFlushAt == run.instructions;
+            clock = flushed ? cycle - bubbles : cycle;
+        }
+        address = cpu->pc;
+        result.halted = run.halted && branches.endedByBranch;
+        if (run.halted || branches.stopped || target->cycle == 0)
+        {
+            break;
+        }
+    }
+
+    TraceLevel level = traceLevel;
+    TraceSetLevel(TRACE_LEVEL_OFF);
+    while (stepping && (target->instructions == 0 || result.instructions < target->instructions) &&
+           (target->cycle == 0 || clock < target->cycle) && address != target->pc)
+    {
+        if (ReadInstructionMemory(cpu, address) == -1)
+        {
+            break;
+        }
+        Instruction ins = GetPredecodedInstruction(cpu, address);
+        bool taken = ins.opcode == 7 || (ins.opcode == 4 && ReadRegister(cpu, ins.operand1) == 0);
+        uint16_t executePC = GetExecutePC(cpu, address);
+        cpu->pc = executePC;
+        execute(cpu, ins);
+        result.instructions++;
+        clock = cycle + 1;
+        if (taken && executePC != address + 3)
+        {
+            result.halted = true;
+            break;
+        }
+        flushed = (ins.opcode == 4 || ins.opcode == 7) && PredictBranch(cpu, address, taken, cpu->pc);
+        cycle += flushed ? 1 + bubbles : 1;
+        address = taken ? cpu->pc : address + 1;
+    }
+    TraceSetLevel(level);
+    if (result.instructions == 0)
+    {
+        return result; // nothing executed, the pipeline state is still exact
+    }
+
+    // the cycle counter and pipeline registers of a pipeline that had executed the same instructions
+    cpu->retired += result.instructions;
+    cpu->clockcycles = clock;
+    if (!result.halted && ReadInstructionMemory(cpu, address) == -1)
+    {
+        // the pipeline drains; after a flush in execute it first spends a cycle failing to fetch the target
+        // (a flush in decode fetches it while the branch executes)
+        result.halted = true;
+        cpu->clockcycles = flushed && !cpu->predictor.resolveInDecode ? clock + 1 : clock;
+        cpu->pc = address;
+        ResetPipeline(cpu);
+        cpu->pipeline1.valid = false;
+    }
+    else if (result.halted)
+    {
+        ResetPipeline(cpu);
+        cpu->pipeline1.valid = false;
+    }
+    else if (flushed && !cpu->predictor.resolveInDecode)
+    {
+        ResetPipeline(cpu); // refetch from the target, like the flush of the branch
+        cpu->pipeline1.valid = true;
+    }
+    else if (flushed)
+    {
+        // a flush in decode: the target was fetched while the branch executed and executes two cycles after it
+        cpu->clockcycles = cycle;
+        FillPipeline(cpu, address);
+    }
+    else
+    {
+        FillPipeline(cpu, address);
+    }
+    return result;
+}
+
+// Function to run the program on the chosen engine
+EngineResult RunEngine(CPU *cpu, EngineKind kind, uint64_t maxInstructions, uint32_t jitThreshold)
+{
+    EngineResult result;
+    switch (kind)
+    {
+    case ENGINE_SWITCH:
+        result = RunSwitchEngine(cpu, maxInstructions);
+        break;
+    case ENGINE_THREADED:
+        result = RunThreadedEngine(cpu, maxInstructions);
+        break;
+    case ENGINE_JIT:
+        result = RunJITEngine(cpu, maxInstructions, jitThreshold);
+        break;
+    case ENGINE_OOO:
+    {
+        OutOfOrderConfig config = OOO_DEFAULT_CONFIG;
+        return RunOutOfOrderEngine(cpu, &config, maxInstructions);
+    }
+    default:
+        return RunPipelineEngine(cpu, maxInstructions);
+    }
+    // the functional engines retire instructions without a clock
+    cpu->retired += result.instructions;
+    cpu->clockcycles = STATE_CYCLES_UNKNOWN;
+    return result;
+}
@@ -0,0 +1,298 @@
+/**
+ * @file GoldenTest.c
+ * @brief Runs every program of src/Test on the pipeline, in parallel and in-process, and compares the
+ * final state with its golden file.
+ *
+ * The golden file of <program>.txt is Golden/<program>.json next to it, a JSON state
+ * (--state-format json) holding the PC, SREG, clock cycles, the registers and data
+ * memory bytes that are not 0 and the instruction memory. A program passes when
+ * CountStateDifferences finds nothing; otherwise the differences are printed as the
+ * text of --diff-against, one line per differing value. --update rewrites the golden
+ * files from the current simulator instead. The target is built with
+ * PROCESSOR_TRACE_DISABLED, so the pipeline runs without any trace checks.
+ */
+
+#include "../Headers/CPU.h"
+#include "../Headers/Engine.h"
+#include "../Headers/JIT.h"
+#include "../Headers/Report.h"
+#include "../Headers/State.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GOLDEN_MAX_INSTRUCTIONS 1000000 // a program that has not halted by then fails
+
+/**
+ * @brief One program of the suite and the outcome of its run.
+ */
+typedef struct {
+    char *path;     /**< The program. */
+    char *golden;   /**< Its golden file. */
+    bool passed;    /**< The final state equals the golden one (or the golden file was written). */
+    char *report;   /**< Why it failed: an error or the differences; NULL when it passed. */
+    int cycles;     /**< The clock cycles the run took. */
+} GoldenJob;
+
+/**
+ * @brief The programs shared by the workers; each takes the next one that nobody runs yet.
+ */
+typedef struct {
+    GoldenJob *jobs;     /**< The programs, sorted by name. */
+    size_t count;        /**< Programs in jobs. */
+    atomic_size_t next;  /**< The next program to run. */
+    bool update;         /**< Write the golden files instead of comparing with them. */
+} GoldenSuite;
+
+// Function to join a directory and a file name, and an optional extension
+static char *JoinPath(const char *directory, const char *name, size_t nameLength, const char *extension)
+{
+    size_t directoryLength = strlen(directory);
+    size_t extensionLength = strlen(extension);
+    char *path = malloc(directoryLength + 1 + nameLength + extensionLength + 1);
+    if (path == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    memcpy(path, directory, directoryLength);
+    path[directoryLength] = '/';
+    memcpy(path + directoryLength + 1, name, nameLength);
+    memcpy(path + directoryLength + 1 + nameLength, extension, extensionLength + 1);
+    return path;
+}
+
+static int CompareJobs(const void *a, const void *b)
+{
+    return strcmp(((const GoldenJob *)a)->path, ((const GoldenJob *)b)->path);
+}
+
+// Function to collect the *.txt programs of a directory, sorted by name, with their golden files
+static GoldenJob *ListPrograms(const char *directory, size_t *count)
+{
+    DIR *dir = opendir(directory);
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+    char *goldenDirectory = JoinPath(directory, "Golden", 6, "");
+    size_t capacity = 16;
+    GoldenJob *jobs = calloc(capacity, sizeof(GoldenJob));
+    *count = 0;
+    struct dirent *entry;
+    while (jobs != NULL && (entry = readdir(dir)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length <= 4 || strcmp(entry->d_name + length - 4, ".txt") != 0)
+        {
+            continue;
+        }
+        if (*count == capacity)
+        {
+            capacity *= 2;
+            jobs = realloc(jobs, capacity * sizeof(GoldenJob));
+            if (jobs == NULL)
+            {
+                break;
+            }
+        }
+        GoldenJob *job = &jobs[(*count)++];
+        memset(job, 0, sizeof(*job));
+        job->path = JoinPath(directory, entry->d_name, length, "");
+        job->golden = JoinPath(goldenDirectory, entry->d_name, length - 4, ".json");
+    }
+    closedir(dir);
+    free(goldenDirectory);
+    if (jobs != NULL)
+    {
+        qsort(jobs, *count, sizeof(GoldenJob), CompareJobs);
+    }
+    return jobs;
+}
+
+// Function to record why a program failed
+static void Fail(GoldenJob *job, const char *format, const char *detail)
+{
+    size_t size = strlen(format) + strlen(detail) + 1;
+    job->report = malloc(size);
+    if (job->report != NULL)
+    {
+        snprintf(job->report, size, format, detail);
+    }
+    job->passed = false;
+}
+
+// Function to run one program and compare its final state with the golden one (or write it)
+static void RunJob(CPU *cpu, CPU *golden, GoldenJob *job, bool update)
+{
+    AssemblerError error;
+    ResetCPU(cpu);
+    if (!LoadProgram(cpu, job->path, &error))
+    {
+        Fail(job, "could not load the program: %s\n", error.message);
+        return;
+    }
+    EngineResult result = RunEngine(cpu, ENGINE_PIPELINE, GOLDEN_MAX_INSTRUCTIONS, JIT_DEFAULT_THRESHOLD);
+    job->cycles = cpu->clockcycles - 1; // the counter starts at 1
+    if (!result.halted)
+    {
+        Fail(job, "%s\n", "did not halt within the instruction limit");
+        return;
+    }
+    if (update)
+    {
+        FILE *out = fopen(job->golden, "w");
+        if (out == NULL)
+        {
+            Fail(job, "could not write %s\n", job->golden);
+            return;
+        }
+        WriteState(cpu, STATE_FORMAT_JSON, out);
+        job->passed = fclose(out) == 0;
+        return;
+    }
+    if (!LoadStateReference(golden, job->golden, &error))
+    {
+        Fail(job, "no golden file: %s\n", error.message);
+        return;
+    }
+    if (CountStateDifferences(cpu, golden) == 0)
+    {
+        job->passed = true;
+        return;
+    }
+    size_t size;
+    FILE *report = open_memstream(&job->report, &size);
+    if (report != NULL)
+    {
+        WriteStateDiff(cpu, golden, STATE_FORMAT_TEXT, report);
+        fclose(report);
+    }
+    job->passed = false;
+}
+
+static void *WorkerMain(void *argument)
+{
+    GoldenSuite *suite = argument;
+    CPU *cpu = CreateCPU();
+    CPU *golden = CreateCPU();
+    if (cpu == NULL || golden == NULL)
+    {
+        DestroyCPU(cpu);
+        DestroyCPU(golden);
+        return NULL; // the other workers run this worker's programs
+    }
+    size_t job;
+    while ((job = atomic_fetch_add(&suite->next, 1)) < suite->count)
+    {
+        RunJob(cpu, golden, &suite->jobs[job], suite->update);
+    }
+    DestroyCPU(cpu);
+    DestroyCPU(golden);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *directory = PROCESSOR_SOURCE_DIR "/src/Test";
+    bool update = false;
+    long workers = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            char *end;
+            workers = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || workers < 1)
+            {
+                workers = -1;
+                break;
+            }
+        }
+        else if (argv[i][0] != '-')
+        {
+            directory = argv[i];
+        }
+        else
+        {
+            workers = -1;
+            break;
+        }
+    }
+    if (workers < 0)
+    {
+        printf("Usage: %s [--update] [-j <workers>] [test directory (default %s)]\n", argv[0], PROCESSOR_SOURCE_DIR "/src/Test");
+        printf("  compares the final state of every *.txt program with Golden/<program>.json, --update writes those files\n");
+        return 1;
+    }
+
+    size_t count;
+    GoldenJob *jobs = ListPrograms(directory, &count);
+    if (jobs == NULL || count == 0)
+    {
+        printf("Error: no programs in the directory %s\n", directory);
+        return 1;
+    }
+    if (workers == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? online : 1;
+    }
+    if ((size_t)workers > count)
+    {
+        workers = (long)count;
+    }
+
+    double start = Now();
+    GoldenSuite suite = {jobs, count, 0, update};
+    pthread_t *threads = calloc((size_t)workers, sizeof(pthread_t));
+    long started = 0;
+    while (threads != NULL && started < workers && pthread_create(&threads[started], NULL, WorkerMain, &suite) == 0)
+    {
+        started++;
+    }
+    if (started == 0)
+    {
+        WorkerMain(&suite);
+    }
+    for (long i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = Now() - start;
+
+    size_t failed = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        GoldenJob *job = &jobs[i];
+        const char *name = strrchr(job->path, '/') + 1;
+        if (job->passed)
+        {
+            printf("%s %s (%d cycles)\n", update ? "UPDATED" : "PASS", name, job->cycles);
+        }
+        else
+        {
+            printf("FAIL %s (golden %s)\n%s", name, job->golden, job->report != NULL ? job->report : "");
+            failed++;
+        }
+        free(job->path);
+        free(job->golden);
+        free(job->report);
+    }
+    printf("%zu programs, %zu failed, %.3f ms on %ld threads\n", count, failed, elapsed * 1e3, started == 0 ? 1 : started);
+    free(threads);
+    free(jobs);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+#ifndef ASSEMBLER_H_INCLUDED
+#define ASSEMBLER_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The number of instruction memory rows, the longest program that can be assembled.
+ */
+#define ASSEMBLER_MAX_INSTRUCTIONS 1024
+
+/**
+ * @brief Where and why assembling failed.
+ */
+typedef struct {
+    int line;          /**< 1-based line of the error, 0 if the file could not be read, -1 if the whole file is invalid. */
+    int column;        /**< 1-based column of the error. */
+    char message[80];  /**< What is wrong. */
+} AssemblerError;
+
+/**
+ * @brief Assembles a program text into 16-bit instruction words.
+ *
+ * Every line holds one instruction ("ADD R1 R2", "MOVI R1 -5"), blank lines are
+ * skipped and '#' or ';' starts a comment that runs to the end of the line. The
+ * R-type instructions (ADD, SUB, MUL, EOR, BR) take two registers, all others a
+ * register and a number from -32 to 63 (6 bits, signed or unsigned). Anything else
+ * is an error reported with its line and column.
+ *
+ * @param text The program text, not necessarily NUL terminated.
+ * @param length The length of the text in bytes.
+ * @param program Receives up to ASSEMBLER_MAX_INSTRUCTIONS instructions.
+ * @param count Receives the number of instructions.
+ * @param error Receives the position and reason of the first error, may be NULL.
+ * @return true if the whole text was assembled.
+ */
+bool Assemble(const char *text, size_t length, uint16_t *program, size_t *count, AssemblerError *error);
+
+/**
+ * @brief Assembles a program text like Assemble and records the source line of every instruction.
+ *
+ * @param text The program text, not necessarily NUL terminated.
+ * @param length The length of the text in bytes.
+ * @param program Receives up to ASSEMBLER_MAX_INSTRUCTIONS instructions.
+ * @param lines Receives the 1-based line of each instruction, may be NULL.
+ * @param count Receives the number of instructions.
+ * @param error Receives the position and reason of the first error, may be NULL.
+ * @return true if the whole text was assembled.
+ */
+bool AssembleWithLines(const char *text, size_t length, uint16_t *program, int *lines, size_t *count, AssemblerError *error);
+
+/**
+ * @brief Maps a program file into memory, read only.
+ *
+ * @param file_name The file to map.
+ * @param length Receives the length of the file.
+ * @param error Receives the reason (line 0) if the file could not be opened or mapped, may be NULL.
+ * @return The contents of the file, or NULL on error. Release it with UnmapProgramFile.
+ */
+const char *MapProgramFile(const char *file_name, size_t *length, AssemblerError *error);
+
+/**
+ * @brief Releases a mapping made by MapProgramFile.
+ *
+ * @param text The contents returned by MapProgramFile.
+ * @param length The length returned by MapProgramFile.
+ */
+void UnmapProgramFile(const char *text, size_t length);
+
+/**
+ * @brief Assembles a program file, reading it through a memory mapping.
+ *
+ * @param file_name The assembly file.
+ * @param program Receives up to ASSEMBLER_MAX_INSTRUCTIONS instructions.
+ * @param count Receives the number of instructions.
+ * @param error Receives the position and reason of the first error (line 0 if the file could not be read), may be NULL.
+ * @return true if the whole file was assembled.
+ */
+bool AssembleFile(const char *file_name, uint16_t *program, size_t *count, AssemblerError *error);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Engine.h"
+
+#include <stdint.h>
+
+/**
+ * @brief How the programs of a batch are run.
+ */
+typedef struct {
+    EngineKind engine;        /**< The engine every program runs on. */
+    uint64_t maxInstructions; /**< Instruction budget per program, 0 for no limit. */
+    uint32_t jitThreshold;    /**< Block entries before the JIT compiles a block. */
+    int workers;              /**< Worker threads, 0 for one per online CPU. */
+} BatchOptions;
+
+/**
+ * @brief Runs every program (*.txt) of a directory on a pool of worker threads.
+ *
+ * Each worker owns a processor context and a contiguous share of the programs, which
+ * it runs from the back; a worker without programs left steals from the front of the
+ * other workers' shares. The final state of each program is written to
+ * "<program>.out" exactly as a single run with --trace-level 0 prints it, and one
+ * summary line per program is printed to stdout in file name order. Tracing is
+ * switched off for the batch.
+ *
+ * @param directory The directory holding the programs.
+ * @param options The engine and limits of the runs.
+ * @return The number of programs that could not be run, or -1 if the directory could not be read.
+ */
+int RunBatch(const char *directory, const BatchOptions *options);
+
+#endif
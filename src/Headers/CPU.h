@@ -0,0 +1,82 @@
+#ifndef CPU_H_INCLUDED
+#define CPU_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Assembler.h"
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * @brief Allocates a processor context (cache line aligned) and resets it.
+ *
+ * @return The new processor, or NULL if the allocation failed.
+ */
+CPU *CreateCPU();
+
+/**
+ * @brief Frees a processor created by CreateCPU.
+ *
+ * @param cpu The processor to free, may be NULL.
+ */
+void DestroyCPU(CPU *cpu);
+
+/**
+ * @brief Releases what a processor holds outside its struct: its memory pages, counters and data cache.
+ *
+ * For processors embedded in other structs or arrays; DestroyCPU does this for the
+ * ones created by CreateCPU.
+ *
+ * @param cpu The processor, left without pages, counters or cache.
+ */
+void ReleaseCPU(CPU *cpu);
+
+/**
+ * @brief Copies the whole state of a processor into another one, sharing the memory pages copy-on-write.
+ *
+ * Only the page tables are copied: both processors use the same pages until one of
+ * them writes to a page, which then gets its own copy (see Pages.h). The performance
+ * counters and the data cache are copied into the destination's own blocks, or freed
+ * when the source has none.
+ *
+ * @param destination A processor created by CreateCPU; its own pages are released.
+ * @param source The processor to copy.
+ */
+void CopyCPU(CPU *destination, const CPU *source);
+
+/**
+ * @brief Resets the processor by resetting the data memory, instruction memory, registers and pipeline.
+ *
+ * The memories are reset by attaching the shared zero page and the shared page of
+ * empty rows, so no memory page is written.
+ *
+ * @param cpu The processor to reset, left without performance counters or data cache.
+ */
+void ResetCPU(CPU *cpu);
+
+/**
+ * @brief Loads a program image (see Image.h) or assembles an assembly file (see Assemble) into the instruction memory.
+ *
+ * The instruction memory is predecoded once the whole file was read, unless the image
+ * already carries the predecoded table.
+ *
+ * @param cpu The processor to load the program into.
+ * @param file_name The name of the assembly file or program image to load.
+ * @param error Receives the line, column and reason of the first error (line 0 if the file could not be read, -1 for a damaged image), may be NULL.
+ * @return false if the file could not be read, assembled or loaded.
+ */
+bool LoadProgram(CPU *cpu, const char *file_name, AssemblerError *error);
+
+/**
+ * @brief Prints the final state of the registers, the data memory and the instruction memory.
+ *
+ * The listing is built from the dirty map and printed with a single write (see WriteState).
+ *
+ * @param cpu The processor.
+ * @param out The stream the state is printed to.
+ */
+void PrintCPUState(CPU *cpu, FILE *out);
+
+#endif
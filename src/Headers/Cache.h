@@ -0,0 +1,105 @@
+#ifndef CACHE_H_INCLUDED
+#define CACHE_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CACHE_DEFAULT_L2_LATENCY 8      // cycles of an L1 miss that hits the second level
+#define CACHE_DEFAULT_MEMORY_LATENCY 40 // cycles of a miss that goes to main memory
+
+/**
+ * @brief The data cache hierarchy to simulate.
+ */
+typedef struct {
+    CacheGeometry l1;       /**< The first level. */
+    CacheGeometry l2;       /**< The second level, bytes 0 for none. */
+    uint8_t writePolicy;    /**< The CacheWritePolicy of the first level. */
+    uint8_t replacement;    /**< The CacheReplacement of both levels. */
+    uint16_t l2Latency;     /**< Cycles an L1 miss waits for the second level. */
+    uint16_t memoryLatency; /**< Cycles a miss of the last level waits for main memory. */
+} CacheConfig;
+
+/**
+ * @brief Parses the shape of a cache level: "bytes,ways,line bytes", e.g. "256,2,16".
+ *
+ * Every number is a power of two, the capacity at most the 2048 bytes of data memory,
+ * with at most CACHE_MAX_LINES lines and CACHE_MAX_WAYS ways.
+ *
+ * @param spec The shape to parse.
+ * @param geometry Receives the shape on success.
+ * @return true if the shape is valid.
+ */
+bool ParseCacheGeometry(const char *spec, CacheGeometry *geometry);
+
+/**
+ * @brief Parses a write policy ("write-back" or "write-through").
+ *
+ * @param name The name to parse.
+ * @param policy Receives the policy on success.
+ * @return true if the name is known.
+ */
+bool ParseCacheWritePolicy(const char *name, CacheWritePolicy *policy);
+
+/**
+ * @brief Parses a replacement policy ("lru" or "plru").
+ *
+ * @param name The name to parse.
+ * @param replacement Receives the policy on success.
+ * @return true if the name is known.
+ */
+bool ParseCacheReplacement(const char *name, CacheReplacement *replacement);
+
+/**
+ * @brief Puts a data cache hierarchy in front of the data memory, every line invalid and every counter cleared.
+ *
+ * The cache is allocated on the first call; a failed allocation ends the simulator.
+ * ResetCPU removes it.
+ *
+ * @param cpu The processor.
+ * @param config The hierarchy; an l1 of 0 bytes removes the cache.
+ */
+void SetDataCache(CPU *cpu, const CacheConfig *config);
+
+/**
+ * @brief Tells whether LDR and STR go through a data cache, false for the original single-cycle data memory.
+ *
+ * @param cpu The processor.
+ * @return true if SetDataCache installed a cache.
+ */
+static inline bool CacheActive(const CPU *cpu)
+{
+    return cpu->cache != NULL;
+}
+
+/**
+ * @brief Looks up the line of an LDR or STR and returns the cycles execute stalls for it.
+ *
+ * An L1 hit takes the execute cycle of the instruction and stalls for 0 cycles. A miss
+ * waits l2Latency cycles for a second level hit, or the second level latency (if there
+ * is one) plus memoryLatency for main memory, and fills the line in every level it
+ * missed. Dirty victims and write-through stores go to the next level through a write
+ * buffer and never stall. A write-through store that misses does not allocate. The
+ * hits, misses, evictions and stall cycles are counted per level and per row.
+ *
+ * @param cpu The processor.
+ * @param pc The row of the LDR or STR.
+ * @param address The data memory address it accesses.
+ * @param write true for STR.
+ * @return The stall cycles.
+ */
+int CacheAccess(CPU *cpu, uint16_t pc, uint16_t address, bool write);
+
+/**
+ * @brief Prints the shape, the hit rates, the traffic and the per-row counts of the data cache.
+ *
+ * @param cpu The processor.
+ * @param out The stream the report is printed to.
+ */
+void PrintCacheStats(const CPU *cpu, FILE *out);
+
+#endif
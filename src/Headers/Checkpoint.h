@@ -0,0 +1,114 @@
+#ifndef CHECKPOINT_H_INCLUDED
+#define CHECKPOINT_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Assembler.h"
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The first bytes of every checkpoint file.
+ */
+#define CHECKPOINT_MAGIC "CPCK"
+
+/**
+ * @brief The checkpoint format version written by SaveCheckpoint and accepted by LoadCheckpoint.
+ */
+#define CHECKPOINT_VERSION 3
+
+/**
+ * @brief The header at the start of a checkpoint file.
+ *
+ * The header is followed by the machine state, every field little-endian: the 64
+ * registers, SREG, the PC, the clock cycle counter, MaxClockCycles, the retired
+ * instruction count, the four pipeline registers (instruction or decoded fields,
+ * valid and pcVal), the data memory, the instruction memory and the branch predictor
+ * (kind, BTB size, counters and BTB entries; added in version 2) and where branches are
+ * resolved (added in version 3). The checksum
+ * (ImageChecksum) covers everything after the header.
+ */
+typedef struct {
+    char magic[4];     /**< CHECKPOINT_MAGIC. */
+    uint16_t version;  /**< CHECKPOINT_VERSION. */
+    uint16_t reserved; /**< Always 0. */
+    uint32_t length;   /**< Bytes after the header. */
+    uint32_t checksum; /**< ImageChecksum of the bytes after the header. */
+} CheckpointHeader;
+
+/**
+ * @brief An in-memory copy of the whole state of a processor.
+ */
+typedef struct CPUSnapshot CPUSnapshot;
+
+/**
+ * @brief Copies the whole state of a processor into a new snapshot.
+ *
+ * @param cpu The processor.
+ * @return The snapshot, or NULL if the allocation failed. Free it with DestroySnapshot.
+ */
+CPUSnapshot *TakeSnapshot(const CPU *cpu);
+
+/**
+ * @brief Overwrites a snapshot with the current state of a processor.
+ *
+ * @param snapshot The snapshot to overwrite.
+ * @param cpu The processor.
+ */
+void UpdateSnapshot(CPUSnapshot *snapshot, const CPU *cpu);
+
+/**
+ * @brief Puts a processor back into the state of a snapshot.
+ *
+ * The snapshot is left unchanged, so it can be restored any number of times.
+ *
+ * @param cpu The processor to overwrite.
+ * @param snapshot The snapshot.
+ */
+void RestoreSnapshot(CPU *cpu, const CPUSnapshot *snapshot);
+
+/**
+ * @brief Frees a snapshot taken by TakeSnapshot.
+ *
+ * @param snapshot The snapshot to free, may be NULL.
+ */
+void DestroySnapshot(CPUSnapshot *snapshot);
+
+/**
+ * @brief Writes the whole machine state of a processor as a checkpoint file.
+ *
+ * The lazily kept flags are written as the status register they stand for, the
+ * predecoded table is left out (it is rebuilt from the instruction memory), and so
+ * are the performance counters (a restored run counts from zero).
+ *
+ * @param cpu The processor.
+ * @param file_name The checkpoint file to write.
+ * @return false if the file could not be written.
+ */
+bool SaveCheckpoint(const CPU *cpu, const char *file_name);
+
+/**
+ * @brief Tells whether a file starts like a checkpoint.
+ *
+ * @param data The start of the file.
+ * @param length The length of the file.
+ */
+bool IsCheckpoint(const void *data, size_t length);
+
+/**
+ * @brief Puts a processor into the state saved in a checkpoint file.
+ *
+ * The pipeline engine continues the restored run exactly where the saved run was
+ * (see RunPipelineEngineUntil).
+ *
+ * @param cpu The processor to overwrite.
+ * @param file_name The checkpoint file.
+ * @param error Receives the reason (line 0 if the file could not be read, -1 if it is damaged or of another version), may be NULL.
+ * @return true if the checkpoint was loaded.
+ */
+bool LoadCheckpoint(CPU *cpu, const char *file_name, AssemblerError *error);
+
+#endif
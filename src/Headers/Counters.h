@@ -0,0 +1,80 @@
+#ifndef COUNTERS_H_INCLUDED
+#define COUNTERS_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief The clock cycles of the pipeline engine split by what they were spent on.
+ *
+ * base + branchFlush + fillDrain + memoryStall is the number of cycles the pipeline engine simulated.
+ */
+typedef struct {
+    uint64_t instructions; /**< Instructions executed by the pipeline engine. */
+    uint64_t cycles;       /**< Clock cycles simulated by the pipeline engine. */
+    uint64_t base;         /**< Cycles in which an instruction executed, one per instruction. */
+    uint64_t branchFlush;  /**< Bubbles after a taken BEQZ or a BR flushed the pipeline. */
+    uint64_t fillDrain;    /**< Bubbles while the pipeline filled at the start and drained at the end. */
+    uint64_t memoryStall;  /**< Cycles execute stalled on data cache misses. */
+} CPIStack;
+
+/**
+ * @brief Allocates the performance counters of a processor, all cleared, or clears the ones it has.
+ *
+ * The pipeline engine only counts for processors that have counters; ResetCPU removes
+ * them. The reports below print zeros for a processor without counters. A failed
+ * allocation ends the simulator.
+ *
+ * @param cpu The processor.
+ */
+void EnableCounters(CPU *cpu);
+
+/**
+ * @brief Splits the cycles counted so far into the CPI stack.
+ *
+ * The bubbles after the last instruction executed count as draining the pipeline.
+ *
+ * @param cpu The processor.
+ * @return The CPI stack.
+ */
+CPIStack GetCPIStack(const CPU *cpu);
+
+/**
+ * @brief Prints the counters: the CPI stack, the flushes, the data memory accesses and the executed instructions per opcode and per row.
+ *
+ * @param cpu The processor.
+ * @param out The stream the report is printed to.
+ */
+void PrintCounters(const CPU *cpu, FILE *out);
+
+/**
+ * @brief Writes all counters as one JSON object.
+ *
+ * @param cpu The processor.
+ * @param file_name The file to write.
+ * @return false if the file could not be written.
+ */
+bool WriteCountersJSON(const CPU *cpu, const char *file_name);
+
+/**
+ * @brief Writes the per-row counters in callgrind format, so a profile viewer (callgrind_annotate, KCachegrind) shows the cost of every line of the program.
+ *
+ * The events are Ir (instructions executed), Cycles (the base cycle of every execution
+ * plus the flush bubbles a taken branch caused and the data cache stall cycles of an LDR
+ * or STR), Flush (the flush bubbles alone) and Dr/Dw
+ * (data memory reads and writes). The rows are mapped to the lines of the assembly
+ * file; a program image has no lines, its row n is reported as line n + 1.
+ *
+ * @param cpu The processor.
+ * @param program_file The assembly file or program image the program was loaded from.
+ * @param file_name The file to write.
+ * @return false if the file could not be written.
+ */
+bool WriteCountersCallgrind(const CPU *cpu, const char *program_file, const char *file_name);
+
+#endif
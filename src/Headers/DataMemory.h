@@ -1,47 +1,60 @@
-#ifndef FUNCTIONS_H_INCLUDED
-#define FUNCTIONS_H_INCLUDED
+#ifndef DATAMEMORY_H_INCLUDED
+#define DATAMEMORY_H_INCLUDED
 
 /* ^^ these are the include guards */
 
+#include "Structs.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
 /*
  * Function: ReadDataMemory
  * ------------------------
  * Reads the value stored in the data memory at the specified address.
  *
+ * cpu: the processor whose data memory is read
  * address: the memory address to read from
  *
  * returns: the value stored at the specified address
  */
-int8_t ReadDataMemory(uint16_t address);
+int8_t ReadDataMemory(CPU *cpu, uint16_t address);
 
 /*
  * Function: WriteDataMemory
  * -------------------------
  * Writes the specified value to the data memory at the specified address.
  *
+ * cpu: the processor whose data memory is written
  * address: the memory address to write to
  * value: the value to be written
  *
  * returns: void
  */
-void WriteDataMemory(uint16_t address, int8_t value);
+void WriteDataMemory(CPU *cpu, uint16_t address, int8_t value);
 
 /*
  * Function: PrintAllDataMemory
  * ----------------------------
  * Prints the contents of the data memory.
  *
+ * cpu: the processor whose data memory is printed
+ * out: the stream the contents are printed to
+ *
  * returns: void
  */
-void PrintAllDataMemory();
+void PrintAllDataMemory(CPU *cpu, FILE *out);
 
 /*
  * Function: ResetDataMemory
  * -------------------------
- * Resets the data memory by clearing all its contents.
+ * Resets the data memory by clearing all its contents: every page becomes the
+ * shared zero page, without touching the bytes.
+ *
+ * cpu: the processor whose data memory is reset
  *
  * returns: void
  */
-void ResetDataMemory();
+void ResetDataMemory(CPU *cpu);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,139 @@
+#ifndef ENDIAN_H_INCLUDED
+#define ENDIAN_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include <stdint.h>
+
+/*
+ * Little-endian fields of the binary files (program images, state files,
+ * checkpoints and trace files), written and read byte by byte so the files are
+ * the same on every host. Load and Store work at a pointer, Get and Put also
+ * move the pointer past the field.
+ */
+
+/**
+ * @brief Reads a 16 bit little-endian field.
+ */
+static inline uint16_t LoadLE16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+
+/**
+ * @brief Reads a 32 bit little-endian field.
+ */
+static inline uint32_t LoadLE32(const uint8_t *p)
+{
+    return LoadLE16(p) | ((uint32_t)LoadLE16(p + 2) << 16);
+}
+
+/**
+ * @brief Reads a 64 bit little-endian field.
+ */
+static inline uint64_t LoadLE64(const uint8_t *p)
+{
+    return LoadLE32(p) | ((uint64_t)LoadLE32(p + 4) << 32);
+}
+
+/**
+ * @brief Writes a 16 bit little-endian field.
+ */
+static inline void StoreLE16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+/**
+ * @brief Writes a 32 bit little-endian field.
+ */
+static inline void StoreLE32(uint8_t *p, uint32_t value)
+{
+    StoreLE16(p, (uint16_t)value);
+    StoreLE16(p + 2, (uint16_t)(value >> 16));
+}
+
+/**
+ * @brief Writes a 64 bit little-endian field.
+ */
+static inline void StoreLE64(uint8_t *p, uint64_t value)
+{
+    StoreLE32(p, (uint32_t)value);
+    StoreLE32(p + 4, (uint32_t)(value >> 32));
+}
+
+/**
+ * @brief Reads a byte at *p and moves p past it.
+ */
+static inline uint8_t GetU8(const uint8_t **p)
+{
+    return *(*p)++;
+}
+
+/**
+ * @brief Reads a 16 bit little-endian field at *p and moves p past it.
+ */
+static inline uint16_t GetU16(const uint8_t **p)
+{
+    uint16_t value = LoadLE16(*p);
+    *p += 2;
+    return value;
+}
+
+/**
+ * @brief Reads a 32 bit little-endian field at *p and moves p past it.
+ */
+static inline uint32_t GetU32(const uint8_t **p)
+{
+    uint32_t value = LoadLE32(*p);
+    *p += 4;
+    return value;
+}
+
+/**
+ * @brief Reads a 64 bit little-endian field at *p and moves p past it.
+ */
+static inline uint64_t GetU64(const uint8_t **p)
+{
+    uint64_t value = LoadLE64(*p);
+    *p += 8;
+    return value;
+}
+
+/**
+ * @brief Writes a byte at *p and moves p past it.
+ */
+static inline void PutU8(uint8_t **p, uint8_t value)
+{
+    *(*p)++ = value;
+}
+
+/**
+ * @brief Writes a 16 bit little-endian field at *p and moves p past it.
+ */
+static inline void PutU16(uint8_t **p, uint16_t value)
+{
+    StoreLE16(*p, value);
+    *p += 2;
+}
+
+/**
+ * @brief Writes a 32 bit little-endian field at *p and moves p past it.
+ */
+static inline void PutU32(uint8_t **p, uint32_t value)
+{
+    StoreLE32(*p, value);
+    *p += 4;
+}
+
+/**
+ * @brief Writes a 64 bit little-endian field at *p and moves p past it.
+ */
+static inline void PutU64(uint8_t **p, uint64_t value)
+{
+    StoreLE64(*p, value);
+    *p += 8;
+}
+
+#endif
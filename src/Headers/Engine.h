@@ -0,0 +1,153 @@
+#ifndef ENGINE_H_INCLUDED
+#define ENGINE_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief The execution engines of the simulator.
+ *
+ * ENGINE_PIPELINE is the cycle by cycle 3 stage model (RunPipelineEngine) and ENGINE_OOO
+ * a cycle by cycle out-of-order core without a per-cycle trace. The other engines only
+ * execute the instructions (no pipeline registers, no per-cycle trace). All of them
+ * have exactly the register, flag, memory and branch behaviour of the pipeline.
+ */
+typedef enum {
+    ENGINE_PIPELINE, /**< fetchPipeline/decodePipeline/executePipeline, one clock cycle at a time. */
+    ENGINE_SWITCH,   /**< One call of execute(cpu) (and its switch) per instruction. */
+    ENGINE_THREADED, /**< Direct-threaded code: computed goto between handlers with inlined operands. */
+    ENGINE_JIT,      /**< Interpreter that compiles hot basic blocks to x86-64 code (see JIT.h). */
+    ENGINE_OOO       /**< Out-of-order core with renaming, reservation stations and a reorder buffer (see OutOfOrder.h). */
+} EngineKind;
+
+/**
+ * @brief The outcome of StepInstruction.
+ */
+typedef enum {
+    STEP_EXECUTED,            /**< One instruction was executed. */
+    STEP_EXECUTED_AND_HALTED, /**< One instruction (a taken branch) was executed and it ended the program. */
+    STEP_HALTED               /**< Nothing was executed: the PC is on an empty row, the program has ended. */
+} StepResult;
+
+/**
+ * @brief The result of a functional run.
+ */
+typedef struct {
+    uint64_t instructions; /**< Instructions executed. */
+    bool halted;           /**< True if the program ended, false if the instruction budget ran out. */
+} EngineResult;
+
+/**
+ * @brief Where FastForward hands over to the pipeline; it stops at the first target reached.
+ */
+typedef struct {
+    uint64_t instructions; /**< Stop after this many instructions, 0 for no limit. */
+    int cycle;             /**< Stop once the pipeline would have reached this clock cycle, 0 for no limit. */
+    int pc;                /**< Stop before the instruction at this address executes, -1 for none. */
+} FastForwardTarget;
+
+/**
+ * @brief Parses an engine name ("pipeline", "switch", "threaded", "jit" or "ooo").
+ *
+ * @param name The name to parse.
+ * @param kind Receives the engine on success.
+ * @return true if the name is known.
+ */
+bool ParseEngineKind(const char *name, EngineKind *kind);
+
+/**
+ * @brief Executes the instruction at the PC with execute() and moves the PC to the next one.
+ *
+ * This is the interpreter step shared by the switch engine and the JIT's first tier.
+ *
+ * @param cpu The processor.
+ * @return Whether an instruction was executed and whether the program has ended.
+ */
+StepResult StepInstruction(CPU *cpu);
+
+/**
+ * @brief Executes the loaded program from the current PC with the execute() switch.
+ *
+ * @param cpu The processor.
+ * @param maxInstructions The instruction budget, 0 for no limit.
+ * @return The number of executed instructions and whether the program ended.
+ */
+EngineResult RunSwitchEngine(CPU *cpu, uint64_t maxInstructions);
+
+/**
+ * @brief Runs the loaded program through the 3 stage pipeline, one clock cycle at a time.
+ *
+ * Every cycle fetches, decodes and executes and emits the trace of the cycle, until
+ * all pipeline stages are empty. The clock cycle counter of the context keeps counting
+ * across calls.
+ *
+ * @param cpu The processor.
+ * @param maxInstructions Stop once this many instructions were executed, 0 for no limit.
+ * @return The number of executed instructions and whether the program ended.
+ */
+EngineResult RunPipelineEngine(CPU *cpu, uint64_t maxInstructions);
+
+/**
+ * @brief Runs the pipeline like RunPipelineEngine, but stops before the given clock cycle.
+ *
+ * The run can be continued exactly where it stopped by calling RunPipelineEngine or
+ * RunPipelineEngineUntil again on the same context (or on a restored checkpoint of it).
+ *
+ * @param cpu The processor.
+ * @param maxInstructions Stop once this many instructions were executed, 0 for no limit.
+ * @param stopCycle Stop once the clock cycle counter reaches this cycle, 0 for no limit.
+ * @return The number of executed instructions and whether the program ended.
+ */
+EngineResult RunPipelineEngineUntil(CPU *cpu, uint64_t maxInstructions, int stopCycle);
+
+/**
+ * @brief Executes instructions without the pipeline, then leaves the context as the pipeline would have.
+ *
+ * Execution continues from the state of the pipeline (the oldest instruction in flight)
+ * and runs until one of the targets is reached or the program ends. The instructions
+ * run like on the switch engine, without trace events, while the clock cycle counter
+ * follows the timing of the 3 stage pipeline (one cycle per instruction, two more to
+ * refill after a branch fetch predicted wrong, one when branches resolve in decode).
+ * Every branch consults and trains the predictor as fetch would. At the end the retired count, clock cycle counter, PC
+ * and pipeline1..pipeline4 are set to what the pipeline holds at that cycle, so
+ * RunPipelineEngine continues in full detail exactly as if it had run from the start.
+ *
+ * @param cpu The processor.
+ * @param target When to stop.
+ * @return The number of executed instructions and whether the program ended.
+ */
+EngineResult FastForward(CPU *cpu, const FastForwardTarget *target);
+
+/**
+ * @brief Executes the loaded program from the current PC as direct-threaded code.
+ *
+ * The program is translated into one record per instruction memory row holding
+ * the handler address and the already decoded operands, then executed by jumping
+ * from handler to handler.
+ *
+ * @param cpu The processor.
+ * @param maxInstructions The instruction budget, 0 for no limit.
+ * @return The number of executed instructions and whether the program ended.
+ */
+EngineResult RunThreadedEngine(CPU *cpu, uint64_t maxInstructions);
+
+/**
+ * @brief Runs the loaded program on the given engine.
+ *
+ * @param cpu The processor.
+ * @param kind The engine to run.
+ * @param maxInstructions The instruction budget, 0 for no limit.
+ * @param jitThreshold Block entries before the JIT compiles a block (ENGINE_JIT only).
+ *
+ * ENGINE_OOO runs the core of OOO_DEFAULT_CONFIG. The switch, threaded and jit engines
+ * add the executed instructions to the retired count and leave the clock cycle counter
+ * at STATE_CYCLES_UNKNOWN.
+ * @return The number of executed instructions and whether the program ended.
+ */
+EngineResult RunEngine(CPU *cpu, EngineKind kind, uint64_t maxInstructions, uint32_t jitThreshold);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef FLAGS_H_INCLUDED
+#define FLAGS_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Pure versions of the update*Flag functions in Registers.c, for the engines
+ * that keep the status register in a local or per-instruction value instead of
+ * cpu->SREG (threaded, lockstep, out-of-order). Registers.c uses the FLAG_* bits
+ * to mark the groups pending in cpu->flags (see LazyFlags). Each
+ * function takes the old SREG value and returns the new one, with exactly the
+ * bits and conditions Registers.c uses: C = bit 0, V = bit 1, N = bit 2,
+ * S = bit 3 (set when the result is zero) and Z = bit 4.
+ */
+
+#define FLAG_C (1 << 0)
+#define FLAG_V (1 << 1)
+#define FLAG_N (1 << 2)
+#define FLAG_S (1 << 3)
+#define FLAG_Z (1 << 4)
+
+/**
+ * @brief The flags updated by ADD, SUB, MUL, ANDI, EOR, SAL and SAR: N and Z.
+ */
+static inline uint8_t FlagsNegativeZero(uint8_t sreg, int8_t result)
+{
+    sreg &= (uint8_t)~(FLAG_N | FLAG_Z);
+    if (result < 0)
+    {
+        sreg |= FLAG_N;
+    }
+    if (result == 0)
+    {
+        sreg |= FLAG_Z;
+    }
+    return sreg;
+}
+
+/**
+ * @brief The flags updated by ADD: C, V, N, S and Z.
+ *
+ * @param sreg The old status register.
+ * @param r1 The value of the first register before the addition.
+ * @param r2 The value of the second register.
+ * @param result The 8 bit result.
+ */
+static inline uint8_t FlagsAdd(uint8_t sreg, uint8_t r1, uint8_t r2, uint8_t result)
+{
+    int8_t a = (int8_t)r1;
+    int8_t b = (int8_t)r2;
+    int8_t r = (int8_t)result;
+    sreg = FlagsNegativeZero(sreg, r);
+    sreg &= (uint8_t)~(FLAG_C | FLAG_V | FLAG_S);
+    if ((r1 + r2) > 255)
+    {
+        sreg |= FLAG_C;
+    }
+    if (r == 0)
+    {
+        sreg |= FLAG_S;
+    }
+    if ((a > 0 && b > 0 && r < 0) || (a < 0 && b < 0 && r > 0))
+    {
+        sreg |= FLAG_V;
+    }
+    return sreg;
+}
+
+/**
+ * @brief The flags updated by SUB: V, N, S and Z.
+ *
+ * @param sreg The old status register.
+ * @param a The value of the first register before the subtraction.
+ * @param b The value of the second register.
+ * @param r The 8 bit result.
+ */
+static inline uint8_t FlagsSub(uint8_t sreg, int8_t a, int8_t b, int8_t r)
+{
+    sreg = FlagsNegativeZero(sreg, r);
+    sreg &= (uint8_t)~(FLAG_V | FLAG_S);
+    if (r == 0)
+    {
+        sreg |= FLAG_S;
+    }
+    if ((a < 0 && b > 0 && r > 0) || (a > 0 && b < 0 && r < 0))
+    {
+        sreg |= FLAG_V;
+    }
+    return sreg;
+}
+
+#endif
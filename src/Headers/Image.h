@@ -0,0 +1,89 @@
+#ifndef IMAGE_H_INCLUDED
+#define IMAGE_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Assembler.h"
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The first bytes of every program image.
+ */
+#define IMAGE_MAGIC "CPIM"
+
+/**
+ * @brief The image format version written by SaveImage and accepted by LoadImage.
+ */
+#define IMAGE_VERSION 1
+
+/**
+ * @brief The optional segments of an image (the instruction memory is always present).
+ */
+#define IMAGE_SEGMENT_DATA       (1 << 0) /**< The initial data memory, 2048 bytes. */
+#define IMAGE_SEGMENT_REGISTERS  (1 << 1) /**< The initial registers (64 bytes), SREG and 7 bytes of padding. */
+#define IMAGE_SEGMENT_PREDECODED (1 << 2) /**< The predecoded table (PredecodedStore) of the instruction memory, copied on load. */
+
+/**
+ * @brief The header at the start of a program image.
+ *
+ * The header is followed by the instruction memory (1024 little-endian 16-bit rows,
+ * -1 for an empty row) and then the segments flagged in segments, in the order of
+ * their IMAGE_SEGMENT_* bits. The header fields are little-endian; the other segments
+ * are byte arrays and have no byte order. The checksum covers everything after the header.
+ */
+typedef struct {
+    char magic[4];         /**< IMAGE_MAGIC. */
+    uint16_t version;      /**< IMAGE_VERSION. */
+    uint16_t segments;     /**< IMAGE_SEGMENT_* bits of the segments present. */
+    uint32_t instructions; /**< Rows of the program (the instruction memory beyond them is empty). */
+    uint32_t checksum;     /**< ImageChecksum of the bytes after the header. */
+} ImageHeader;
+
+/**
+ * @brief The checksum of program images and checkpoints: FNV-1a over 64-bit words (the
+ * tail byte by byte), folded to 32 bits.
+ *
+ * @param data The bytes to check.
+ * @param length The number of bytes.
+ */
+uint32_t ImageChecksum(const void *data, size_t length);
+
+/**
+ * @brief Tells whether a file starts like a program image.
+ *
+ * @param data The start of the file.
+ * @param length The length of the file.
+ */
+bool IsImage(const void *data, size_t length);
+
+/**
+ * @brief Loads a program image into a (reset) processor.
+ *
+ * The memories are copied straight from the image. A predecoded segment is copied
+ * too, once every entry has a valid opcode, registers and a matching immediate and
+ * type, otherwise the image is rejected; without one the program is predecoded.
+ *
+ * @param cpu The processor to load the program into.
+ * @param data The image.
+ * @param length The length of the image in bytes.
+ * @param error Receives the reason (line -1) if the image is damaged or of another version, may be NULL.
+ * @return true if the image was loaded.
+ */
+bool LoadImage(CPU *cpu, const void *data, size_t length, AssemblerError *error);
+
+/**
+ * @brief Writes the program of a processor as an image.
+ *
+ * @param cpu The processor holding the program (and the initial data memory and registers, if saved).
+ * @param instructions The number of program rows.
+ * @param segments The IMAGE_SEGMENT_* bits of the optional segments to write.
+ * @param file_name The image file to write.
+ * @return false if the file could not be written.
+ */
+bool SaveImage(CPU *cpu, size_t instructions, unsigned segments, const char *file_name);
+
+#endif
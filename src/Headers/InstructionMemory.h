@@ -1,5 +1,5 @@
-#ifndef FUNCTIONS_H_INCLUDED
-#define FUNCTIONS_H_INCLUDED
+#ifndef INSTRUCTIONMEMORY_H_INCLUDED
+#define INSTRUCTIONMEMORY_H_INCLUDED
 
 /* ^^ these are the include guards */
 
@@ -9,14 +9,18 @@
 
 #include "Structs.h"
 
+#include <stdio.h>
+
 
 /**
  * @brief Resets the pipeline.
  *
  * This function is responsible for resetting the pipeline in the computer processor.
  * It clears any stored instructions and prepares the pipeline for the execution of new instructions.
+ *
+ * @param cpu The processor.
  */
-void ResetPipeline();
+void ResetPipeline(CPU *cpu);
 
 
 /**
@@ -51,36 +55,102 @@ int8_t GetValue2(int16_t instruction);
 */
 char GetOpcodeType(uint8_t opcode);
 
+/**
+ * @brief Decodes one instruction memory row into the predecoded store.
+ *
+ * @param cpu The processor.
+ * @param address The address of the row to decode.
+ */
+void PredecodeInstruction(CPU *cpu, uint16_t address);
+
+/**
+ * @brief Decodes the whole instruction memory into the predecoded store.
+ *
+ * Called once after a program is loaded, so fetch and decode only read the store.
+ *
+ * @param cpu The processor.
+ */
+void PredecodeProgram(CPU *cpu);
+
+/**
+ * @brief Reads the predecoded form of the instruction at the specified address.
+ *
+ * Rows invalidated by WriteInstructionMemory are decoded again on demand.
+ *
+ * @param cpu The processor.
+ * @param address The address in the instruction memory.
+ * @return The decoded instruction.
+ */
+Instruction GetPredecodedInstruction(CPU *cpu, uint16_t address);
+
 /**
  * @brief Writes an instruction to the instruction memory at the specified address.
+ *
+ * The matching predecoded row is invalidated.
  * 
+ * @param cpu The processor.
  * @param address The address in the instruction memory where the instruction will be written.
  * @param instruction The instruction to be written.
  */
-void WriteInstructionMemory(uint16_t  address, uint16_t instruction);
+void WriteInstructionMemory(CPU *cpu, uint16_t  address, uint16_t instruction);
 
 /**
  * @brief Reads an instruction from the instruction memory at the specified address.
  * 
+ * @param cpu The processor.
  * @param address The address in the instruction memory from where the instruction will be read.
  * @return The instruction read from the instruction memory.
  */
-int16_t ReadInstructionMemory(uint16_t address);
+int16_t ReadInstructionMemory(CPU *cpu, uint16_t address);
+
+/**
+ * @brief Computes the value of the PC while the instruction at the given address executes.
+ *
+ * The fetch stage is two instructions ahead of execute, but stops advancing at the
+ * first empty row. BEQZ targets are relative to this value, and a taken branch whose
+ * execute PC is not address + 3 ends the program (the fetch stage had already run
+ * dry when the pipeline was flushed). Engines without a pipeline use this to keep
+ * the exact branch behaviour of the pipeline.
+ *
+ * @param cpu The processor.
+ * @param address The address of the executing instruction.
+ * @return The PC during its execute stage.
+ */
+uint16_t GetExecutePC(CPU *cpu, uint16_t address);
 
 /**
  * @brief Fetches the next instruction from the instruction memory and updates the pipeline.
+ * @param cpu The processor.
  */
-void fetchPipeline();
+void fetchPipeline(CPU *cpu);
 
 /**
  * @brief Decodes the instruction in the pipeline and prepares the necessary data for execution.
+ * @param cpu The processor.
  */
-void decodePipeline();
+void decodePipeline(CPU *cpu);
 
 /**
  * @brief Executes the instruction in the pipeline.
+ *
+ * With a data cache (see Cache.h) an LDR or STR that misses stays in execute for the
+ * stall cycles CacheAccess returned and executes in the last of them.
+ * @param cpu The processor.
+ */
+void executePipeline(CPU *cpu);
+
+/**
+ * @brief Tells whether the instruction in execute is waiting for the data cache, so fetch and decode hold this cycle.
+ * @param cpu The processor.
+ * @return true while an LDR or STR miss stalls execute.
+ */
+bool memoryStallPipeline(const CPU *cpu);
+
+/**
+ * @brief Reports the instructions fetch and decode hold during a cycle in which execute stalls.
+ * @param cpu The processor.
  */
-void executePipeline();
+void holdPipeline(CPU *cpu);
 
 /**
  * @brief Decodes the given instruction.
@@ -93,18 +163,22 @@ Instruction decode(uint16_t  instruction);
 /**
  * @brief Executes the given instruction.
  * 
+ * @param cpu The processor.
  * @param ins The instruction to be executed.
  */
-void execute(Instruction ins);
+void execute(CPU *cpu, Instruction ins);
 
 /**
- * @brief Resets the instruction memory, clearing all instructions.
+ * @brief Resets the instruction memory, clearing all instructions: every page becomes the shared page of empty rows.
+ * @param cpu The processor.
  */
-void ResetInstructionMemory();
+void ResetInstructionMemory(CPU *cpu);
 
 /**
  * @brief Prints all instructions in the instruction memory.
+ * @param cpu The processor.
+ * @param out The stream the state is printed to.
  */
-void PrintAllInstructionMemory();
+void PrintAllInstructionMemory(CPU *cpu, FILE *out);
 
 #endif
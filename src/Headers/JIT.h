@@ -0,0 +1,59 @@
+#ifndef JIT_H_INCLUDED
+#define JIT_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Engine.h"
+
+#include <stdint.h>
+
+/**
+ * @brief Number of entries into a basic block before it is compiled to native code.
+ */
+#define JIT_DEFAULT_THRESHOLD 50
+
+/**
+ * @brief Counters of the last JIT run.
+ */
+typedef struct {
+    uint64_t blocksCompiled;          /**< Basic blocks translated to x86-64 code. */
+    uint64_t nativeInstructions;      /**< Instructions executed by compiled blocks. */
+    uint64_t interpretedInstructions; /**< Instructions executed by the interpreter tier. */
+    uint64_t codeBytes;               /**< Bytes of native code emitted. */
+} JITStats;
+
+/**
+ * @brief Per-PC execution counters of the interpreter tier: how often a basic block
+ * was entered at each address during the calling thread's last JIT run.
+ */
+extern _Thread_local uint32_t jitBlockCounters[1024];
+
+/**
+ * @brief Tells whether native code generation is available on this host (x86-64 only).
+ */
+bool JITAvailable();
+
+/**
+ * @brief Executes the loaded program from the current PC with the tiered JIT.
+ *
+ * Instructions are interpreted (StepInstruction) and every basic block entry is
+ * counted. A block (a straight run of instructions ending with BEQZ, BR, an empty
+ * row or the block length limit) that is entered threshold times is compiled to
+ * x86-64 code working directly on the registers, SREG and data memory of the
+ * context, and runs natively from then on. The compiled code reproduces ALU.c exactly, including the
+ * carry and overflow flag rules of Registers.c. On hosts without x86-64 the whole
+ * run stays in the interpreter. Compiled code is cached per thread.
+ *
+ * @param cpu The processor.
+ * @param maxInstructions The instruction budget, 0 for no limit.
+ * @param threshold Block entries before compilation (0 compiles on first entry).
+ * @return The number of executed instructions and whether the program ended.
+ */
+EngineResult RunJITEngine(CPU *cpu, uint64_t maxInstructions, uint32_t threshold);
+
+/**
+ * @brief Returns the counters of the calling thread's last RunJITEngine call.
+ */
+JITStats GetJITStats();
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef LOCKSTEP_H_INCLUDED
+#define LOCKSTEP_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Engine.h"
+#include "Structs.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Instances handled by one vector operation (one byte lane each).
+ */
+#define LOCKSTEP_LANES 32
+
+/**
+ * @brief Many instances of one program, executed in lockstep.
+ *
+ * The state is kept as a structure of arrays: register k of every instance is
+ * stored contiguously, as is every data memory byte, so one instruction is executed
+ * for LOCKSTEP_LANES instances by each vector operation.
+ */
+typedef struct LockstepGroup LockstepGroup;
+
+/**
+ * @brief Counters of a lockstep run.
+ */
+typedef struct {
+    uint64_t steps;          /**< Instructions issued (each for every instance at that PC). */
+    uint64_t instructions;   /**< Instructions executed, summed over all instances. */
+    uint64_t divergentSteps; /**< Steps issued while the instances were at different PCs. */
+    uint64_t splits;         /**< Branches whose outcome differed between instances. */
+    uint64_t reconvergences; /**< Times all running instances were back at the same PC. */
+} LockstepStats;
+
+/**
+ * @brief Creates a group of instances running the program loaded into a processor.
+ *
+ * Every instance starts with the registers, status register, PC and data memory of
+ * the program's processor. The instruction memory is shared and must not change
+ * while the group exists.
+ *
+ * @param program The processor holding the (predecoded) program.
+ * @param instances The number of instances.
+ * @return The group, or NULL if it could not be allocated.
+ */
+LockstepGroup *CreateLockstepGroup(CPU *program, size_t instances);
+
+/**
+ * @brief Frees a group created by CreateLockstepGroup.
+ *
+ * @param group The group to free, may be NULL.
+ */
+void DestroyLockstepGroup(LockstepGroup *group);
+
+/**
+ * @brief Copies the registers, status register, PC and data memory of a processor into one instance.
+ *
+ * @param group The group.
+ * @param instance The instance to set.
+ * @param image The processor whose state is copied.
+ */
+void LockstepSetInstance(LockstepGroup *group, size_t instance, const CPU *image);
+
+/**
+ * @brief Copies the registers, status register, PC and data memory of one instance into a processor.
+ *
+ * @param group The group.
+ * @param instance The instance to read.
+ * @param cpu Receives the state (its instruction memory is left alone).
+ */
+void LockstepGetInstance(const LockstepGroup *group, size_t instance, CPU *cpu);
+
+/**
+ * @brief Runs every instance until it ends or has executed maxInstructions instructions.
+ *
+ * All instances at the lowest PC execute the instruction there together; instances
+ * whose branch went the other way wait (masked off) until the lowest-PC rule brings
+ * them back to the same instruction. Each instance gets exactly the registers,
+ * flags, memory and PC the switch engine would give it.
+ *
+ * @param group The group.
+ * @param maxInstructions The instruction budget of every instance, 0 for no limit.
+ * @return The counters of the run.
+ */
+LockstepStats RunLockstep(LockstepGroup *group, uint64_t maxInstructions);
+
+/**
+ * @brief Returns the executed instructions of one instance and whether it ended.
+ *
+ * @param group The group.
+ * @param instance The instance.
+ */
+EngineResult LockstepInstanceResult(const LockstepGroup *group, size_t instance);
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef OUTOFORDER_H_INCLUDED
+#define OUTOFORDER_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Engine.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define OOO_MAX_ROB 256 // largest reorder buffer
+#define OOO_MAX_RS 64   // largest reservation station of one functional unit class
+#define OOO_MAX_WIDTH 8 // widest fetch, dispatch and commit
+
+#define OOO_LATENCY_ALU 1   // cycles of ADD, SUB, MOVI, ANDI, EOR, SAL, SAR, BEQZ and BR
+#define OOO_LATENCY_MUL 3   // cycles of MUL (the multiplier is pipelined)
+#define OOO_LATENCY_LOAD 2  // cycles of LDR through the data memory port
+#define OOO_LATENCY_STORE 1 // cycles of STR to read its register (memory is written at commit)
+
+/**
+ * @brief The functional unit classes, each with its own reservation station.
+ */
+typedef enum {
+    OOO_UNIT_ALU,    /**< width ALUs: everything but MUL, LDR and STR, including the branches. */
+    OOO_UNIT_MUL,    /**< One pipelined multiplier. */
+    OOO_UNIT_MEMORY, /**< The one data memory port: LDR and STR. */
+    OOO_UNIT_CLASSES
+} OutOfOrderUnit;
+
+/**
+ * @brief The size of the out-of-order core.
+ */
+typedef struct {
+    int robEntries; /**< Reorder buffer entries, 1 to OOO_MAX_ROB. */
+    int rsEntries;  /**< Reservation station entries per functional unit class, 1 to OOO_MAX_RS. */
+    int width;      /**< Instructions fetched, dispatched and committed per cycle, and ALUs, 1 to OOO_MAX_WIDTH. */
+} OutOfOrderConfig;
+
+/**
+ * @brief The default core: 64 ROB entries, 16 reservation station entries per class, 4 wide.
+ */
+#define OOO_DEFAULT_CONFIG {64, 16, 4}
+
+/**
+ * @brief Counters of the last out-of-order run.
+ */
+typedef struct {
+    uint64_t cycles;                           /**< Clock cycles simulated. */
+    uint64_t committed;                        /**< Instructions committed (the executed instructions of the program). */
+    uint64_t dispatched;                       /**< Instructions renamed into the ROB, including the ones squashed later. */
+    uint64_t squashed;                         /**< Wrong path instructions thrown out of the ROB. */
+    uint64_t mispredictions;                   /**< Branches that resolved differently from the prediction of fetch. */
+    uint64_t robFullCycles;                    /**< Cycles dispatch stopped because the ROB was full. */
+    uint64_t rsFullCycles[OOO_UNIT_CLASSES];   /**< Cycles dispatch stopped because the reservation station of a class was full. */
+    uint64_t issued[OOO_UNIT_CLASSES];         /**< Instructions issued to the functional units of each class. */
+    uint64_t loadForwards;                     /**< Loads that took their value from an older STR in the ROB. */
+    uint64_t loadWaitCycles;                   /**< Cycles loads waited for the value of an older STR to the same address. */
+    uint64_t robOccupancy;                     /**< Sum of the ROB entries in use at the end of every cycle. */
+} OutOfOrderStats;
+
+/**
+ * @brief Runs the loaded program on an out-of-order core with Tomasulo scheduling and a reorder buffer.
+ *
+ * Fetch reads up to width rows per cycle along the branch predictor of the context
+ * (see SetPredictor). Dispatch renames them in order into the reorder buffer and the
+ * reservation station of their functional unit class: every register operand is
+ * either the value (from the registers or a completed ROB entry) or the tag of the ROB
+ * entry that will produce it, so only true dependences wait. The SREG flag groups are
+ * renamed as well: every ROB entry holds its own copy of the flags it writes and no
+ * instruction reads them, so flag writers never wait for each other. Ready
+ * instructions issue oldest first, results are broadcast to the waiting operands when
+ * they complete and the ROB commits up to width instructions per cycle in program
+ * order, writing the registers, SREG, the data memory and the PC. LDR waits for the
+ * youngest older STR to the same address and takes its value; addresses are immediate,
+ * so the disambiguation is exact. A branch resolving differently from its prediction
+ * squashes every younger entry, rebuilds the rename map and redirects fetch. The
+ * architectural results are those of every other engine. There is no per-cycle trace.
+ *
+ * @param cpu The processor.
+ * @param config The size of the core.
+ * @param maxInstructions Stop once this many instructions were committed, 0 for no limit.
+ * @return The number of committed instructions and whether the program ended.
+ */
+EngineResult RunOutOfOrderEngine(CPU *cpu, const OutOfOrderConfig *config, uint64_t maxInstructions);
+
+/**
+ * @brief Returns the counters of the calling thread's last RunOutOfOrderEngine call.
+ */
+OutOfOrderStats GetOutOfOrderStats();
+
+/**
+ * @brief Prints the size of the core, the IPC and the counters of a run.
+ *
+ * @param config The core that ran.
+ * @param stats Its counters.
+ * @param out The stream the report is printed to.
+ */
+void PrintOutOfOrderStats(const OutOfOrderConfig *config, const OutOfOrderStats *stats, FILE *out);
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef PAGES_H_INCLUDED
+#define PAGES_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "State.h"
+#include "Structs.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+_Static_assert(MEMORY_PAGE_BYTES >= 256, "LDR and STR address the first 256 bytes, which have to be one page for the JIT");
+
+/**
+ * @brief Makes the page in a page table slot private to its processor, copying it if it is shared.
+ *
+ * The shared page loses a reference; the copy starts with one. A failed allocation
+ * ends the simulator.
+ *
+ * @param slot The page table slot.
+ * @return The private page, now in the slot.
+ */
+MemoryPage *MakePagePrivate(MemoryPage **slot);
+
+/**
+ * @brief Makes the predecoded store of a processor private to it, copying it if it is shared.
+ *
+ * A failed allocation ends the simulator.
+ *
+ * @param cpu The processor.
+ * @return The private store, now the processor's.
+ */
+PredecodedStore *MakePredecodedStorePrivate(CPU *cpu);
+
+/**
+ * @brief Returns the predecoded store of a processor for writing, copying it first if it is shared.
+ *
+ * @param cpu The processor.
+ * @return The store, private to the processor.
+ */
+static inline PredecodedStore *WritablePredecodedStore(CPU *cpu)
+{
+    PredecodedStore *store = cpu->predecoded;
+    if (atomic_load_explicit(&store->references, memory_order_acquire) != 1)
+    {
+        store = MakePredecodedStorePrivate(cpu);
+    }
+    return store;
+}
+
+/**
+ * @brief Reads a byte of the data memory without tracing it.
+ *
+ * @param cpu The processor.
+ * @param address The address, 0 to 2047.
+ * @return The byte.
+ */
+static inline int8_t PageReadData(const CPU *cpu, uint16_t address)
+{
+    return cpu->dataPages[address / MEMORY_PAGE_BYTES]->data[address % MEMORY_PAGE_BYTES];
+}
+
+/**
+ * @brief Writes a byte of the data memory without tracing it, copying its page first if it is shared, and marks it dirty.
+ *
+ * @param cpu The processor.
+ * @param address The address, 0 to 2047.
+ * @param value The byte.
+ */
+static inline void PageWriteData(CPU *cpu, uint16_t address, int8_t value)
+{
+    MemoryPage **slot = &cpu->dataPages[address / MEMORY_PAGE_BYTES];
+    MemoryPage *page = *slot;
+    if (atomic_load_explicit(&page->references, memory_order_acquire) != 1)
+    {
+        page = MakePagePrivate(slot);
+    }
+    page->data[address % MEMORY_PAGE_BYTES] = value;
+    MarkDataDirty(cpu, address);
+}
+
+/**
+ * @brief Reads a row of the instruction memory.
+ *
+ * @param cpu The processor.
+ * @param address The row, 0 to 1023.
+ * @return The instruction, -1 for an empty row.
+ */
+static inline int16_t PageReadInstruction(const CPU *cpu, uint16_t address)
+{
+    return cpu->instructionPages[address / PAGE_INSTRUCTIONS]->instructions[address % PAGE_INSTRUCTIONS];
+}
+
+/**
+ * @brief Writes a row of the instruction memory, copying its page first if it is shared, and marks it dirty.
+ *
+ * @param cpu The processor.
+ * @param address The row, 0 to 1023.
+ * @param instruction The instruction, -1 for an empty row.
+ */
+static inline void PageWriteInstruction(CPU *cpu, uint16_t address, int16_t instruction)
+{
+    MemoryPage **slot = &cpu->instructionPages[address / PAGE_INSTRUCTIONS];
+    MemoryPage *page = *slot;
+    if (atomic_load_explicit(&page->references, memory_order_acquire) != 1)
+    {
+        page = MakePagePrivate(slot);
+    }
+    page->instructions[address % PAGE_INSTRUCTIONS] = instruction;
+    MarkInstructionDirty(cpu, address);
+}
+
+/**
+ * @brief Returns the first data memory page, private to the processor, for code that addresses it directly.
+ *
+ * The caller marks the bytes it writes in the dirty map.
+ *
+ * @param cpu The processor.
+ * @return The bytes of data memory addresses 0 to MEMORY_PAGE_BYTES - 1.
+ */
+int8_t *WritableDataPage(CPU *cpu);
+
+/**
+ * @brief Replaces every data memory page with the shared zero page, in O(pages).
+ *
+ * @param cpu The processor.
+ */
+void AttachZeroPages(CPU *cpu);
+
+/**
+ * @brief Replaces every instruction memory page with the shared page of empty rows, in O(pages).
+ *
+ * @param cpu The processor.
+ */
+void AttachEmptyInstructionPages(CPU *cpu);
+
+/**
+ * @brief Replaces the predecoded store with the shared one of an empty instruction memory, every row invalid.
+ *
+ * @param cpu The processor.
+ */
+void AttachInvalidPredecodedStore(CPU *cpu);
+
+/**
+ * @brief Drops the processor's reference to each of its pages and to its predecoded store, and clears the pointers.
+ *
+ * A page or store nobody references any more is freed. Pointers that are already NULL
+ * (a processor that never had pages) are skipped.
+ *
+ * @param cpu The processor.
+ */
+void ReleaseMemoryPages(CPU *cpu);
+
+/**
+ * @brief Adds a reference to each page and to the predecoded store of a processor, for a copy of its page tables.
+ *
+ * @param cpu The processor whose pages are copied.
+ */
+void RetainMemoryPages(const CPU *cpu);
+
+/**
+ * @brief Copies a range of the data memory out, without tracing.
+ *
+ * @param cpu The processor.
+ * @param address The first address.
+ * @param buffer Receives the bytes.
+ * @param length The number of bytes; address + length is at most 2048.
+ */
+void ReadDataMemoryBlock(const CPU *cpu, uint16_t address, int8_t *buffer, size_t length);
+
+/**
+ * @brief Copies bytes into the data memory, without tracing.
+ *
+ * A page whose bytes do not change stays shared, so loading an image that is mostly
+ * zero keeps the zero page. The chunks that change are marked dirty.
+ *
+ * @param cpu The processor.
+ * @param address The first address.
+ * @param buffer The bytes.
+ * @param length The number of bytes; address + length is at most 2048.
+ */
+void WriteDataMemoryBlock(CPU *cpu, uint16_t address, const int8_t *buffer, size_t length);
+
+/**
+ * @brief Copies a range of rows of the instruction memory out.
+ *
+ * @param cpu The processor.
+ * @param address The first row.
+ * @param buffer Receives the instructions.
+ * @param count The number of rows; address + count is at most 1024.
+ */
+void ReadInstructionMemoryBlock(const CPU *cpu, uint16_t address, int16_t *buffer, size_t count);
+
+/**
+ * @brief Copies rows into the instruction memory and invalidates their predecoded form.
+ *
+ * A page whose rows do not change stays shared; the chunks that change are marked dirty.
+ *
+ * @param cpu The processor.
+ * @param address The first row.
+ * @param buffer The instructions.
+ * @param count The number of rows; address + count is at most 1024.
+ */
+void WriteInstructionMemoryBlock(CPU *cpu, uint16_t address, const int16_t *buffer, size_t count);
+
+/**
+ * @brief Tells whether two processors have the same data memory, comparing only the pages they do not share.
+ *
+ * @param a One processor.
+ * @param b The other one.
+ * @return true if every byte is equal.
+ */
+bool SameDataMemory(const CPU *a, const CPU *b);
+
+/**
+ * @brief Returns the number of private pages allocated and not yet freed, by every processor of the simulator.
+ */
+size_t LivePages();
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef PREDICTOR_H_INCLUDED
+#define PREDICTOR_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Parses a predictor name ("not-taken", "backward-taken" or "bimodal").
+ *
+ * @param name The name to parse.
+ * @param kind Receives the predictor on success.
+ * @return true if the name is known.
+ */
+bool ParsePredictorKind(const char *name, PredictorKind *kind);
+
+/**
+ * @brief Returns the name of a predictor, as ParsePredictorKind accepts it.
+ *
+ * @param kind The predictor.
+ * @return The name.
+ */
+const char *PredictorName(PredictorKind kind);
+
+/**
+ * @brief Selects the branch predictor and clears its tables (the bimodal counters start weakly not-taken).
+ *
+ * @param cpu The processor.
+ * @param kind How BEQZ is predicted.
+ * @param btbEntries Entries of the BR target buffer, a power of two up to PREDICTOR_MAX_BTB_ENTRIES, 0 for none (BR is then predicted not taken).
+ */
+void SetPredictor(CPU *cpu, PredictorKind kind, int btbEntries);
+
+/**
+ * @brief Tells whether fetch has to consult the predictor, false for the original always-not-taken fetch.
+ *
+ * @param cpu The processor.
+ * @return true if a predictor other than not-taken or a BTB is selected.
+ */
+static inline bool PredictorActive(const CPU *cpu)
+{
+    return cpu->predictor.kind != PREDICTOR_NOT_TAKEN || cpu->predictor.btbEntries != 0;
+}
+
+/**
+ * @brief Predicts the row fetched after the given one.
+ *
+ * A BEQZ predicted taken continues at its target, a BR found in the BTB at the target
+ * it jumped to last time; everything else at the next row. A branch in one of the last
+ * two rows of the program ends it when taken (see GetExecutePC) and is never predicted.
+ *
+ * @param cpu The processor.
+ * @param address The row just fetched.
+ * @return The row to fetch next.
+ */
+uint16_t PredictNextPC(CPU *cpu, uint16_t address);
+
+/**
+ * @brief Trains the predictor with a resolved branch and tells whether the row fetched after it was the wrong one.
+ *
+ * A fetched row right after the branch counts as a not-taken prediction, so a taken
+ * branch to the next row is still a misprediction, like with the original flush.
+ *
+ * @param cpu The processor.
+ * @param ins The BEQZ or BR.
+ * @param address The row of the branch.
+ * @param taken Whether the branch was taken.
+ * @param target Where a taken branch goes.
+ * @param fetched The row fetch continued with after the branch.
+ * @return true if the fetched row is wrong and the younger instructions have to be flushed.
+ */
+bool TrainPredictor(CPU *cpu, Instruction ins, uint16_t address, bool taken, uint16_t target, uint16_t fetched);
+
+/**
+ * @brief Executes a BEQZ or BR in the execute stage, trains the predictor and recovers from a misprediction.
+ *
+ * The row fetched after the branch (the youngest instruction in the pipeline) is
+ * compared with where the branch actually goes. If they differ, the PC is set to the
+ * right row and the pipeline is flushed (ResetPipeline), costing two bubbles; with the
+ * not-taken predictor this is exactly the original flush of every taken branch. A
+ * branch already resolved in decode (see ResolveBranchInDecode) does nothing here.
+ *
+ * @param cpu The processor.
+ * @param ins The branch.
+ * @param address The row of the branch.
+ * @return true if the pipeline was flushed, here or in decode.
+ */
+bool ResolveBranch(CPU *cpu, Instruction ins, uint16_t address);
+
+/**
+ * @brief Resolves the BEQZ or BR that just left decode, when branches are resolved in decode.
+ *
+ * Called at the end of every clock cycle, after execute, for the instruction decode
+ * handed over to execute: decode reads the tested registers, taking the result of the
+ * instruction executed in the same cycle (forwarded from execute). A misprediction
+ * only throws away the one row fetched after the branch, costing one bubble instead
+ * of two. Branches in the last two rows of a program are left to execute, so a taken
+ * one still ends the program.
+ *
+ * @param cpu The processor.
+ * @param executed The instruction executed in this cycle, NULL for none.
+ */
+void ResolveBranchInDecode(CPU *cpu, const Instruction *executed);
+
+/**
+ * @brief Selects where BEQZ and BR are resolved: in execute (the default, reproducing Expected-Output.md) or in decode.
+ *
+ * @param cpu The processor.
+ * @param inDecode true to resolve the branches in decode.
+ */
+void SetBranchResolution(CPU *cpu, bool inDecode);
+
+#endif
@@ -1,96 +1,180 @@
-#ifndef FUNCTIONS_H_INCLUDED
-#define FUNCTIONS_H_INCLUDED
+#ifndef REGISTERS_H_INCLUDED
+#define REGISTERS_H_INCLUDED
+
+#include "Structs.h"
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 /**
  * Updates the carry flag based on the result of an arithmetic operation.
  *
+ * @param cpu The processor.
  * @param operand1 The first operand of the arithmetic operation.
  * @param operand2 The second operand of the arithmetic operation.
  * @param result The result of the arithmetic operation.
  */
-void updateCarryFlag(uint8_t operand1, uint8_t operand2);
+void updateCarryFlag(CPU *cpu, uint8_t operand1, uint8_t operand2);
 
 /**
  * Updates the overflow flag based on the result of an arithmetic operation.
  *
+ * @param cpu The processor.
  * @param operand1 The first operand of the arithmetic operation.
  * @param operand2 The second operand of the arithmetic operation.
  * @param result The result of the arithmetic operation.
  */
-void updateOverflowFlag(int8_t operand1, int8_t operand2, int8_t result, bool operation);
+void updateOverflowFlag(CPU *cpu, int8_t operand1, int8_t operand2, int8_t result, bool operation);
 
 /**
  * Updates the negative flag based on the result of an arithmetic operation.
  *
+ * @param cpu The processor.
  * @param result The result of the arithmetic operation.
  */
-void updateNegativeFlag(int8_t result);
+void updateNegativeFlag(CPU *cpu, int8_t result);
 
 /**
  * Updates the sign flag based on the result of an arithmetic operation.
  *
+ * @param cpu The processor.
  * @param result The result of the arithmetic operation.
  */
-void updateSignFlag(int8_t result);
+void updateSignFlag(CPU *cpu, int8_t result);
 
 /**
  * Updates the zero flag based on the result of an arithmetic operation.
  *
+ * @param cpu The processor.
  * @param result The result of the arithmetic operation.
  */
-void updateZeroFlag(int8_t result);
+void updateZeroFlag(CPU *cpu, int8_t result);
+
+/**
+ * Updates the flags of an addition (C, N, S, Z and V). Unless flag updates are
+ * traced, only the operands are recorded and the flags are computed when the
+ * status register is read.
+ *
+ * @param cpu The processor.
+ * @param operand1 The first operand of the addition.
+ * @param operand2 The second operand of the addition.
+ * @param result The result of the addition.
+ */
+void updateAddFlags(CPU *cpu, uint8_t operand1, uint8_t operand2, uint8_t result);
+
+/**
+ * Updates the flags of a subtraction (N, S, Z and V), recorded like updateAddFlags.
+ *
+ * @param cpu The processor.
+ * @param operand1 The first operand of the subtraction.
+ * @param operand2 The second operand of the subtraction.
+ * @param result The result of the subtraction.
+ */
+void updateSubFlags(CPU *cpu, int8_t operand1, int8_t operand2, int8_t result);
+
+/**
+ * Updates the flags of MUL, ANDI, EOR, SAL and SAR (N and Z), recorded like updateAddFlags.
+ *
+ * @param cpu The processor.
+ * @param result The result of the operation.
+ */
+void updateResultFlags(CPU *cpu, int8_t result);
+
+/**
+ * Reads the status register. Flags whose operation was only recorded are computed
+ * now, bit for bit as the update*Flag functions compute them.
+ *
+ * @param cpu The processor.
+ * @return The value of the status register.
+ */
+uint8_t ReadStatusRegister(const CPU *cpu);
+
+/**
+ * Writes the status register, replacing any recorded flag operations.
+ *
+ * @param cpu The processor.
+ * @param value The value to be written to the status register.
+ */
+void WriteStatusRegister(CPU *cpu, uint8_t value);
 
 /**
  * Reads the value stored in a register.
  *
+ * @param cpu The processor.
  * @param reg The register number.
  * @return The value stored in the register.
  */
-int8_t ReadRegister(uint8_t reg);
+int8_t ReadRegister(CPU *cpu, uint8_t reg);
 
 /**
  * Writes a value to a register.
  *
+ * @param cpu The processor.
  * @param reg The register number.
  * @param value The value to be written to the register.
  */
-void WriteRegister(uint8_t reg, int8_t value);
+void WriteRegister(CPU *cpu, uint8_t reg, int8_t value);
 
 /**
  * Resets all registers to their initial values.
+ *
+ * @param cpu The processor.
  */
-void ResetRegisters();
+void ResetRegisters(CPU *cpu);
 
 /**
  * Prints the values of all registers.
+ *
+ * @param cpu The processor.
+ * @param out The stream the state is printed to.
  */
-void PrintAllRegisters();
+void PrintAllRegisters(CPU *cpu, FILE *out);
 
 /**
  * Prints the value of the status register.
+ *
+ * @param cpu The processor.
+ * @param out The stream the state is printed to.
  */
-void PrintStatusRegister();
+void PrintStatusRegister(CPU *cpu, FILE *out);
 
 /**
  * Returns the value of the program counter (PC).
  *
+ * @param cpu The processor.
  * @return The value of the program counter.
  */
-uint16_t GetPC();
+uint16_t GetPC(CPU *cpu);
 
 /**
  * Sets the value of the program counter (PC).
  *
+ * @param cpu The processor.
  * @param value The value to be set as the program counter.
  */
-void SetPC(uint16_t value);
+void SetPC(CPU *cpu, uint16_t value);
+
+/**
+ * Computes the target of BR: the first register is the high byte, the second the low
+ * byte, sign-extended as BR always did, so a negative low byte sets the whole high byte.
+ * Shifted unsigned, as a negative high byte must not be.
+ *
+ * @param high The value of the first register.
+ * @param low The value of the second register.
+ * @return The address BR jumps to.
+ */
+static inline uint16_t BranchRegisterTarget(int8_t high, int8_t low)
+{
+    uint16_t extension = low < 0 ? 0xFF00 : 0;
+    return (uint16_t)(((uint16_t)(uint8_t)high << 8) | extension | (uint8_t)low);
+}
 
 /**
  * Increments the value of the program counter (PC) by 1.
+ *
+ * @param cpu The processor.
  */
-void IncrementPC();
+void IncrementPC(CPU *cpu);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef REPORT_H_INCLUDED
+#define REPORT_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @brief Divides two counts for a statistics report (CPI, IPC, hit rates).
+ *
+ * @param count The numerator.
+ * @param total The denominator.
+ * @return count / total, 0 when nothing was counted.
+ */
+static inline double Ratio(uint64_t count, uint64_t total)
+{
+    return total == 0 ? 0.0 : (double)count / (double)total;
+}
+
+/**
+ * @brief Reads the monotonic clock, for the wall times of the batch runs, tests and benchmarks.
+ *
+ * @return The time in seconds.
+ */
+static inline double Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+#endif
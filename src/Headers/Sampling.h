@@ -0,0 +1,50 @@
+#ifndef SAMPLING_H_INCLUDED
+#define SAMPLING_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief How RunSampled alternates between fast-forwarding and detailed simulation.
+ */
+typedef struct {
+    uint64_t interval;        /**< Instructions fast-forwarded before every sample. */
+    int sampleCycles;         /**< Clock cycles simulated in detail per sample. */
+    uint64_t maxInstructions; /**< Stop once this many instructions were executed, 0 for no limit. */
+} SamplingOptions;
+
+/**
+ * @brief The measurements of a sampled run and the cycle count extrapolated from them.
+ */
+typedef struct {
+    uint64_t samples;                 /**< Complete detailed windows, each giving one CPI sample. */
+    uint64_t detailedCycles;          /**< Clock cycles simulated in detail, including a window cut short by the end of the program. */
+    uint64_t detailedInstructions;    /**< Instructions executed in detail. */
+    uint64_t fastForwardInstructions; /**< Instructions executed by FastForward. */
+    double meanCPI;                   /**< Mean cycles per instruction of the samples. */
+    double cpiHalfWidth;              /**< Half width of the 95% confidence interval of meanCPI, 0 with fewer than 2 samples. */
+    double estimatedCycles;           /**< detailedCycles plus fastForwardInstructions at meanCPI. */
+    double cyclesHalfWidth;           /**< Half width of the 95% confidence interval of estimatedCycles. */
+    bool halted;                      /**< True if the program ended, false if the instruction budget ran out. */
+} SamplingResult;
+
+/**
+ * @brief Estimates the clock cycles of a long run by sampling it.
+ *
+ * The program alternates between FastForward (interval instructions, no pipeline) and
+ * the detailed pipeline (sampleCycles clock cycles), until it ends or the budget runs
+ * out. Every complete detailed window is one sample of the cycles per instruction;
+ * the cycles of the fast-forwarded instructions are extrapolated from their mean,
+ * with a Student t confidence interval.
+ *
+ * @param cpu The processor holding the program.
+ * @param options The sampling intervals.
+ * @return The measurements and the estimate.
+ */
+SamplingResult RunSampled(CPU *cpu, const SamplingOptions *options);
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef STAGES_H_INCLUDED
+#define STAGES_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Engine.h"
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define STAGES_MAX 16             // stages of the deepest pipeline RunStagedPipeline simulates
+#define STAGES_LATCH_OVERHEAD 0.1 // latch delay as a fraction of the 3 stage clock period
+#define STAGES_MAX_WIDTH 2        // instructions fetched and issued per cycle by the widest pipeline
+
+/**
+ * @brief The forwarding paths of the hazard unit, combined as a bitmask.
+ */
+typedef enum {
+    FORWARD_EX = 1,      /**< From the end of the last execute stage to the first one (EX/MEM latch to EX). */
+    FORWARD_MEM = 2,     /**< From the memory and write back stages to the first execute stage (MEM/WB latch to EX). */
+    FORWARD_REGFILE = 4, /**< The last stage writes the register file in the first half of the cycle, decode reads it in the second. */
+    FORWARD_ALL = 7
+} ForwardingPath;
+
+/**
+ * @brief The shape of a pipeline: how many stages each step takes and which forwarding paths exist.
+ *
+ * The stages are, in order: fetch, decode, execute, memory, write back. Fetch, decode
+ * and execute take at least one stage; a pipeline without memory or write back stages
+ * accesses the data memory and writes the registers in its last execute stage, like
+ * the original 3 stage IF/ID/EX pipeline.
+ */
+typedef struct {
+    uint8_t fetch;       /**< Fetch stages. */
+    uint8_t decode;      /**< Decode stages; the registers are read in the last one. */
+    uint8_t execute;     /**< Execute stages; results are ready and branches resolve at the end of the last one. */
+    uint8_t memory;      /**< Memory stages; loaded values are ready at the end of the last one. */
+    uint8_t writeback;   /**< Write back stages. */
+    uint8_t width;       /**< Instructions fetched, decoded and issued per cycle, 1 to STAGES_MAX_WIDTH. */
+    uint8_t forwarding;  /**< The ForwardingPath bits of the forwarding paths that exist. */
+} StageConfig;
+
+/**
+ * @brief What the hazard unit counted in a run of RunStagedPipeline.
+ */
+typedef struct {
+    uint64_t cycles;           /**< Clock cycles simulated. */
+    uint64_t instructions;     /**< Instructions executed. */
+    uint64_t rawStalls;        /**< Stall cycles waiting for the result of an ALU instruction. */
+    uint64_t loadUseStalls;    /**< Stall cycles waiting for the value of an LDR. */
+    uint64_t flushes;          /**< Times a branch (or a BR to an unexpected row) redirected fetch. */
+    uint64_t flushedSlots;     /**< Instructions thrown away by those flushes. */
+    uint64_t forwardsEX;       /**< Operands taken from the FORWARD_EX path. */
+    uint64_t forwardsMEM;      /**< Operands taken from the FORWARD_MEM path. */
+    uint64_t regfileBypasses;  /**< Operands taken from the FORWARD_REGFILE path. */
+    uint64_t dualIssues;       /**< Cycles in which two instructions issued to execute. */
+    uint64_t dependenceSplits; /**< Pairs issued one at a time because the second uses a register the first writes. */
+    uint64_t memoryPortSplits; /**< Pairs issued one at a time because both access the data memory. */
+    uint64_t hazardSplits;     /**< Pairs issued one at a time because the second waits for an older instruction. */
+} StageStats;
+
+/**
+ * @brief Parses a pipeline shape: "3" (IF/ID/EX), "5" (IF/ID/EX/MEM/WB) or the stage counts "F,D,E,M,W".
+ *
+ * The issue width and the forwarding paths are not touched.
+ *
+ * @param spec The shape to parse.
+ * @param config Receives the stage counts on success.
+ * @return true if the shape is valid and has at most STAGES_MAX stages.
+ */
+bool ParseStageConfig(const char *spec, StageConfig *config);
+
+/**
+ * @brief Parses the forwarding paths: "none" or a comma separated list of "ex", "mem" and "regfile".
+ *
+ * @param list The list to parse.
+ * @param paths Receives the ForwardingPath bits on success.
+ * @return true if every name is known.
+ */
+bool ParseForwarding(const char *list, uint8_t *paths);
+
+/**
+ * @brief Returns the total number of stages of a pipeline.
+ *
+ * @param config The pipeline.
+ * @return The number of stages.
+ */
+int StageCount(const StageConfig *config);
+
+/**
+ * @brief Runs the loaded program through a pipeline of the given shape, one clock cycle at a time.
+ *
+ * Every instruction executes (with StepInstruction) when it is in the last execute
+ * stage, so the results are the ones of every other engine; the shape only changes the
+ * timing. The hazard unit keeps a scoreboard of the registers written by the
+ * instructions past decode as a 64 bit mask: an instruction leaving decode whose
+ * registers are still being computed, and cannot be forwarded on one of the configured
+ * paths, stalls there and a bubble enters execute. Fetch follows the branch predictor
+ * of the context (see SetPredictor); a branch fetched down the wrong path flushes every
+ * younger stage when it resolves. With "3" and all forwarding paths the cycles are
+ * exactly those of RunPipelineEngine.
+ *
+ * With a width of 2 the pipeline is in-order dual-issue: fetch reads two consecutive
+ * rows per cycle (one if the first is a branch predicted taken), and both issue to
+ * execute together when the second neither reads nor writes a register the first
+ * writes, they do not both access the one data memory port, and neither waits for an
+ * older instruction; otherwise the first issues alone and the second follows on its
+ * own next cycle, holding up fetch. There is no per-cycle trace.
+ *
+ * @param cpu The processor holding the program.
+ * @param config The pipeline.
+ * @param maxInstructions Stop once this many instructions were executed, 0 for no limit.
+ * @param stats Receives the counts of the run.
+ * @return The number of executed instructions and whether the program ended.
+ */
+EngineResult RunStagedPipeline(CPU *cpu, const StageConfig *config, uint64_t maxInstructions, StageStats *stats);
+
+/**
+ * @brief Prints the stage layout, the CPI and IPC, the hazard counts and the dual-issue counts of a run.
+ *
+ * The time per instruction is estimated as CPI times the clock period, relative to the
+ * 3 stage pipeline, assuming the logic splits evenly over the stages and every
+ * pipeline latch adds STAGES_LATCH_OVERHEAD of the 3 stage clock period.
+ *
+ * @param config The pipeline that ran.
+ * @param stats The counts of the run.
+ * @param out The stream the report is printed to.
+ */
+void PrintStageStats(const StageConfig *config, const StageStats *stats, FILE *out);
+
+/**
+ * @brief Estimates the clock period of a pipeline relative to the 3 stage one (see PrintStageStats).
+ *
+ * @param config The pipeline.
+ * @return The clock period, 1.0 for 3 stages.
+ */
+double RelativeClockPeriod(const StageConfig *config);
+
+#endif
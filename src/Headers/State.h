@@ -0,0 +1,184 @@
+#ifndef STATE_H_INCLUDED
+#define STATE_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Assembler.h"
+#include "Structs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief The first bytes of every binary state file.
+ */
+#define STATE_MAGIC "CPST"
+
+/**
+ * @brief The binary state format version written by WriteState and accepted by LoadStateReference.
+ */
+#define STATE_VERSION 1
+
+/**
+ * @brief Set in the flags of a binary state file that holds differences (WriteStateDiff).
+ */
+#define STATE_FLAG_DIFF 1
+
+/**
+ * @brief The retired instruction count of a state rebuilt from something that does not record it (trace_tool --state).
+ *
+ * JSON leaves the "retired" member out, a binary state file stores this value.
+ */
+#define STATE_RETIRED_UNKNOWN UINT64_MAX
+
+/**
+ * @brief The clock cycle counter of a state left by an engine without clock cycles (RunEngine's functional engines).
+ *
+ * The counter starts at 1, so 0 is never a real value. JSON and the text diff leave
+ * the cycles out, a binary state file stores this value.
+ */
+#define STATE_CYCLES_UNKNOWN 0
+
+/**
+ * @brief The header at the start of a binary state file.
+ *
+ * The header is followed by the state, every field little-endian: the PC, SREG, the
+ * clock cycle counter and the retired instruction count, then three lists, each
+ * preceded by its length: registers (u8 number, i8 value; the count is a u8),
+ * data memory bytes (u16 address, i8 value) and instruction memory rows (u16 row,
+ * i16 instruction, -1 for an empty row). A full state lists the locations that do
+ * not hold their reset value, a diff the ones that differ from the reference, with
+ * the values of the run. The checksum (ImageChecksum) covers everything after the
+ * header.
+ */
+typedef struct {
+    char magic[4];     /**< STATE_MAGIC. */
+    uint16_t version;  /**< STATE_VERSION. */
+    uint16_t flags;    /**< STATE_FLAG_DIFF for a diff, 0 for a full state. */
+    uint32_t length;   /**< Bytes after the header. */
+    uint32_t checksum; /**< ImageChecksum of the bytes after the header. */
+} StateHeader;
+
+/**
+ * @brief The formats the final state can be written in.
+ */
+typedef enum {
+    STATE_FORMAT_TEXT,   /**< The "Final State of ..." listing (PrintCPUState). */
+    STATE_FORMAT_JSON,   /**< One JSON object. */
+    STATE_FORMAT_BINARY, /**< A binary state file (StateHeader). */
+} StateFormat;
+
+/**
+ * @brief Marks a register as written.
+ *
+ * @param cpu The processor.
+ * @param reg The register, 0 to 63.
+ */
+static inline void MarkRegisterDirty(CPU *cpu, uint8_t reg)
+{
+    cpu->dirty.registers |= UINT64_C(1) << (reg & 63);
+}
+
+/**
+ * @brief Marks a data memory byte as written.
+ *
+ * @param cpu The processor.
+ * @param address The address, 0 to 2047.
+ */
+static inline void MarkDataDirty(CPU *cpu, uint16_t address)
+{
+    cpu->dirty.data[address / 64] |= UINT64_C(1) << (address % 64);
+}
+
+/**
+ * @brief Marks an instruction memory row as written.
+ *
+ * @param cpu The processor.
+ * @param address The row, 0 to 1023.
+ */
+static inline void MarkInstructionDirty(CPU *cpu, uint16_t address)
+{
+    cpu->dirty.instructions[address / 64] |= UINT64_C(1) << (address % 64);
+}
+
+/**
+ * @brief Marks a range of locations as written in one of the bitmaps of a DirtyMap.
+ *
+ * @param bits The bitmap.
+ * @param first The first location.
+ * @param count The number of locations.
+ */
+void MarkDirtyRange(uint64_t *bits, size_t first, size_t count);
+
+/**
+ * @brief Marks the registers that are not 0 as written, after the register file was copied in as a whole.
+ *
+ * @param cpu The processor.
+ */
+void MarkLoadedRegisters(CPU *cpu);
+
+/**
+ * @brief Parses a state format name ("text", "json" or "binary").
+ *
+ * @param name The name to parse.
+ * @param format Receives the format on success.
+ * @return true if the name is known.
+ */
+bool ParseStateFormat(const char *name, StateFormat *format);
+
+/**
+ * @brief Writes the final state of a processor with a single write.
+ *
+ * The text format is the one of PrintCPUState: every register, the status register,
+ * the data memory bytes that are not 0 and the rows that are not empty. JSON and
+ * binary also hold the PC, the clock cycles and the retired instructions, and list
+ * only the registers that are not 0. JSON (like the text diff) gives the cycles the
+ * run took, the clock cycle counter - 1; binary stores the counter itself. Only the locations marked in the dirty map
+ * are visited.
+ *
+ * @param cpu The processor.
+ * @param format The format.
+ * @param out The stream the state is written to.
+ */
+void WriteState(const CPU *cpu, StateFormat format, FILE *out);
+
+/**
+ * @brief Writes only what differs between the state of a processor and a reference, with a single write.
+ *
+ * The PC, SREG and clock cycle counter are listed when they differ, then every
+ * register, data memory byte and instruction memory row whose value differs, with
+ * the value of the reference and of the processor. Only the locations marked in the
+ * dirty map of either processor are compared.
+ *
+ * @param cpu The processor.
+ * @param reference The state to compare with (see LoadStateReference).
+ * @param format The format.
+ * @param out The stream the differences are written to.
+ */
+void WriteStateDiff(const CPU *cpu, const CPU *reference, StateFormat format, FILE *out);
+
+/**
+ * @brief Counts what WriteStateDiff would list: the PC, SREG and clock cycle counter when they differ, and every differing location.
+ *
+ * @param cpu The processor.
+ * @param reference The state to compare with.
+ * @return The number of differences, 0 if the states are equal.
+ */
+int CountStateDifferences(const CPU *cpu, const CPU *reference);
+
+/**
+ * @brief Loads the state to compare a run with from a state file or a checkpoint.
+ *
+ * A JSON state may list the fields in any order and leave any of them out; what it
+ * leaves out keeps its reset value.
+ *
+ * @param cpu The processor that receives the state; it is reset first.
+ * @param file_name A binary or JSON state file written by WriteState, or a checkpoint.
+ * @param error Receives the reason (line 0 if the file could not be read, -1 if it is damaged or of another version), may be NULL.
+ * @return true if the state was loaded.
+ */
+bool LoadStateReference(CPU *cpu, const char *file_name, AssemblerError *error);
+
+#endif
@@ -3,6 +3,7 @@
 
 /* ^^ these are the include guards */
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -10,19 +11,38 @@
  * @brief Represents an instruction in the processor.
  */
 typedef struct {
-    uint8_t opcode :4;       /**< The opcode of the instruction. */
-    uint8_t operand1 : 6;     /**< The first operand of the instruction. */
-    int8_t value2 : 6;       /**< The second operand or immediate value or address. */
-    char type;          /**< The type of the instruction. */
+    uint8_t opcode;          /**< The opcode of the instruction. */
+    uint8_t operand1;        /**< The first operand of the instruction. */
+    uint8_t operand2;        /**< The second operand as an unsigned register number (R-type). */
+    int8_t value2;           /**< The second operand or immediate value or address, sign-extended. */
+    char type;               /**< The type of the instruction. */
 } Instruction;
 
+/**
+ * @brief The predecoded form of every instruction memory row (structure of arrays).
+ *
+ * Filled once when the program is loaded so the pipeline never has to shift and
+ * mask the instruction words again. A row whose valid flag is cleared (because the
+ * instruction memory was written) is decoded again the next time it is read. Shared
+ * copy-on-write like the memory pages, by the processors running the same program.
+ */
+typedef struct {
+    uint8_t opcode[1024];    /**< The opcode of each row. */
+    uint8_t operand1[1024];  /**< The first operand (register number) of each row. */
+    uint8_t operand2[1024];  /**< The raw 6 bit second operand, i.e. the register number of R-type instructions. */
+    int8_t immediate[1024];  /**< The second operand sign-extended from 6 bits. */
+    char type[1024];         /**< The type ('R' or 'I') of each row. */
+    bool valid[1024];        /**< Whether the row is up to date with the instruction memory. */
+    atomic_uint references;  /**< Processors and snapshots using the store, 0 for the static one of an empty memory that is never freed. */
+} PredecodedStore;
+
 /**
  * @brief Represents a stage in the processor pipeline.
  */
 typedef struct {
     Instruction instruction;    /**< The decoded instruction in the pipeline stage. */
     bool valid;                 /**< Indicates if the stage is valid. */
-    uint8_t pcVal;                /**< The program counter value. to be able to print it out during the pipeline*/
+    uint16_t pcVal;               /**< The program counter value. to be able to print it out during the pipeline*/
 } PipelineStage;
 
 /**
@@ -31,8 +51,231 @@ typedef struct {
 typedef struct {
     int16_t instruction;    /**< The fetched instruction. */
     bool valid;               /**< Indicates if the fetched instruction is valid. */
-    uint8_t pcVal;                /**< The program counter value. */
+    uint16_t pcVal;               /**< The program counter value. */
 } FetchedInstruction;
 
+/**
+ * @brief The last flag-producing operation of each flag group, kept instead of the flags.
+ *
+ * The ALU only records its operands and result here; the flags of a pending group
+ * are computed from the record when the status register is read (ReadStatusRegister).
+ * The groups are C (ADD), V and S (ADD, SUB) and N and Z (every flag-producing operation).
+ */
+typedef struct {
+    uint8_t pending;       /**< FLAG_* bits whose value is in this record instead of SREG. */
+    uint8_t carryA;        /**< First operand of the last ADD. */
+    uint8_t carryB;        /**< Second operand of the last ADD. */
+    bool overflowSub;      /**< The last ADD/SUB was a SUB. */
+    int8_t overflowA;      /**< First operand of the last ADD/SUB. */
+    int8_t overflowB;      /**< Second operand of the last ADD/SUB. */
+    int8_t overflowResult; /**< Result of the last ADD/SUB. */
+    int8_t result;         /**< Result of the last flag-producing operation. */
+} LazyFlags;
+
+/**
+ * @brief The branch predictors the fetch stage can consult (see Predictor.h).
+ */
+typedef enum {
+    PREDICTOR_NOT_TAKEN,      /**< Always fetch the next row; every taken branch flushes (the original pipeline). */
+    PREDICTOR_BACKWARD_TAKEN, /**< Predict a BEQZ taken if it jumps backwards. */
+    PREDICTOR_BIMODAL         /**< A 2-bit saturating counter per BEQZ, indexed by the low bits of its address. */
+} PredictorKind;
+
+#define PREDICTOR_BHT_ENTRIES 256    /**< Counters of the bimodal branch history table. */
+#define PREDICTOR_MAX_BTB_ENTRIES 64 /**< Largest branch target buffer. */
+
+/**
+ * @brief One branch target buffer entry: the last target of the BR at an address.
+ */
+typedef struct {
+    uint16_t address; /**< The row of the BR. */
+    uint16_t target;  /**< Where it jumped the last time. */
+    bool valid;       /**< The entry holds a BR. */
+} BTBEntry;
+
+/**
+ * @brief The state of the branch predictor, trained when the branches execute.
+ */
+typedef struct {
+    uint8_t kind;                              /**< The PredictorKind of the BEQZ prediction. */
+    uint8_t btbEntries;                        /**< Entries of the BR target buffer (a power of two), 0 for none. */
+    bool resolveInDecode;                      /**< BEQZ and BR are resolved in decode instead of execute (see ResolveBranchInDecode). */
+    bool decodeFlushed;                        /**< The branch in execute already flushed the pipeline in decode. */
+    uint8_t bht[PREDICTOR_BHT_ENTRIES];        /**< The 2-bit counters of PREDICTOR_BIMODAL, 2 and 3 predict taken. */
+    BTBEntry btb[PREDICTOR_MAX_BTB_ENTRIES];   /**< The direct-mapped BR target buffer. */
+} BranchPredictor;
+
+#define CACHE_MAX_LINES 512 /**< Most lines of one cache level. */
+#define CACHE_MAX_WAYS 16   /**< Highest associativity (the PLRU tree of a set fits 16 bits). */
+
+/**
+ * @brief How stores update the data cache (see Cache.h).
+ */
+typedef enum {
+    CACHE_WRITE_BACK,   /**< Stores allocate the line and mark it dirty; dirty lines are written to the next level when evicted. */
+    CACHE_WRITE_THROUGH /**< Stores go to the next level through a write buffer and update the line only if it is present. */
+} CacheWritePolicy;
+
+/**
+ * @brief Which line of a full set a miss replaces.
+ */
+typedef enum {
+    CACHE_REPLACE_LRU, /**< The least recently used line. */
+    CACHE_REPLACE_PLRU /**< The line a binary tree of recently-used bits points to (tree pseudo-LRU). */
+} CacheReplacement;
+
+/**
+ * @brief The shape of one cache level; all three are powers of two.
+ */
+typedef struct {
+    uint16_t bytes;    /**< Capacity, 0 for no cache at this level. */
+    uint8_t ways;      /**< Lines per set. */
+    uint8_t lineBytes; /**< Bytes per line. */
+} CacheGeometry;
+
+/**
+ * @brief One line of a cache level: only the tag is kept, the data stays in the data memory.
+ */
+typedef struct {
+    uint16_t line;    /**< The data memory address divided by the line size. */
+    bool valid;       /**< The line holds data. */
+    bool dirty;       /**< The line was written and not yet written back. */
+    uint32_t lastUse; /**< When the line was last used, for CACHE_REPLACE_LRU. */
+} CacheLine;
+
+/**
+ * @brief The tags, replacement state and counters of one cache level.
+ */
+typedef struct {
+    CacheGeometry geometry;           /**< The shape of the level. */
+    uint16_t sets;                    /**< Sets of the level, 0 if the level does not exist. */
+    uint32_t clock;                   /**< Accesses so far, stamped on the lines for CACHE_REPLACE_LRU. */
+    CacheLine lines[CACHE_MAX_LINES]; /**< The lines, set after set. */
+    uint16_t plru[CACHE_MAX_LINES];   /**< The tree bits of every set for CACHE_REPLACE_PLRU (node n is bit n). */
+    uint64_t hits;                    /**< Accesses that found their line. */
+    uint64_t misses;                  /**< Accesses that did not. */
+    uint64_t evictions;               /**< Valid lines replaced by a miss. */
+    uint64_t writebacks;              /**< Dirty lines written to the next level. */
+} CacheLevel;
+
+/**
+ * @brief The data cache hierarchy in front of the data memory, a timing model only.
+ *
+ * The cache never holds data: every access still reads and writes the data memory, the
+ * cache only decides how many cycles the access takes (see CacheAccess). Allocated
+ * by SetDataCache, only for the runs that simulate a cache.
+ */
+typedef struct {
+    CacheLevel l1;                 /**< The first level, accessed by LDR and STR. */
+    CacheLevel l2;                 /**< The optional second level (write-back, write-allocate). */
+    uint8_t writePolicy;           /**< The CacheWritePolicy of the first level. */
+    uint8_t replacement;           /**< The CacheReplacement of both levels. */
+    uint16_t l2Latency;            /**< Cycles an L1 miss waits for the second level. */
+    uint16_t memoryLatency;        /**< Cycles a miss of the last level waits for main memory. */
+    uint16_t stallCycles;          /**< Cycles the LDR or STR in execute still waits for the memory. */
+    uint64_t memoryReads;          /**< Lines read from main memory. */
+    uint64_t memoryWrites;         /**< Lines and write-through stores written to main memory. */
+    uint64_t pcHits[1024];         /**< L1 hits of the LDR or STR in each row. */
+    uint64_t pcMisses[1024];       /**< L1 misses of the LDR or STR in each row. */
+    uint64_t pcEvictions[1024];    /**< L1 lines replaced by the misses of each row. */
+    uint64_t pcStallCycles[1024];  /**< Cycles execute stalled on the misses of each row. */
+} DataCache;
+
+/**
+ * @brief The performance counters of the pipeline engine.
+ *
+ * Allocated by EnableCounters, only for the runs that report them. Updated by
+ * executePipeline once per clock cycle: a cycle in which an instruction
+ * executes is a base cycle, any other one a bubble. The bubbles are held back until
+ * the next instruction executes and then charged to the branch flush that preceded it
+ * (a mispredicted BEQZ or BR, see ResolveBranch) or to filling the pipeline; the
+ * bubbles still held back at the end are draining it. Only the pipeline engine counts,
+ * the instructions of FastForward and of the functional engines are not included.
+ */
+typedef struct {
+    uint64_t cycles;               /**< Clock cycles simulated by the pipeline engine. */
+    uint64_t opcodeRetired[16];    /**< Instructions executed, per opcode. */
+    uint64_t pcExecutions[1024];   /**< Instructions executed, per instruction memory row. */
+    uint64_t pcFlushCycles[1024];  /**< Bubbles caused by the taken branch in each row. */
+    uint64_t beqzTaken;            /**< Taken BEQZ. */
+    uint64_t beqzFlushes;          /**< Mispredicted BEQZ, each flushing the pipeline. */
+    uint64_t brFlushes;            /**< Mispredicted BR, each flushing the pipeline. */
+    uint64_t flushCycles;          /**< Bubbles between a flush and the next instruction executed. */
+    uint64_t fillDrainCycles;      /**< Bubbles while filling the pipeline (at the start or after a fast-forward). */
+    uint64_t pendingBubbles;       /**< Bubbles since the last instruction executed, not yet charged. */
+    uint64_t decodeResolved;       /**< Branches resolved in decode. */
+    uint64_t decodeForwards;       /**< Of those, branches whose register was forwarded from the instruction in execute. */
+    uint64_t dataReads;            /**< Data memory reads (LDR). */
+    uint64_t dataWrites;           /**< Data memory writes (STR). */
+    uint64_t memoryStallCycles;    /**< Cycles execute stalled on data cache misses (see CacheAccess). */
+    bool flushPending;             /**< The last instruction executed flushed the pipeline. */
+    uint16_t flushPC;              /**< The row of that branch. */
+} PerfCounters;
+
+#define MEMORY_PAGE_BYTES 256                               /**< Bytes of one memory page. */
+#define DATA_MEMORY_PAGES (2048 / MEMORY_PAGE_BYTES)        /**< Pages of the 2048 byte data memory. */
+#define PAGE_INSTRUCTIONS (MEMORY_PAGE_BYTES / 2)           /**< Instruction memory rows of one page. */
+#define INSTRUCTION_MEMORY_PAGES (1024 / PAGE_INSTRUCTIONS) /**< Pages of the 1024 row instruction memory. */
+
+/**
+ * @brief A reference-counted page of data or instruction memory, shared copy-on-write (see Pages.h).
+ */
+typedef struct {
+    union {
+        int8_t data[MEMORY_PAGE_BYTES];          /**< The bytes of a data memory page. */
+        int16_t instructions[PAGE_INSTRUCTIONS]; /**< The rows of an instruction memory page, -1 marks an empty row. */
+    };
+    atomic_uint references; /**< Processors and snapshots using the page, 0 for the static shared pages that are never freed. */
+} MemoryPage;
+
+/**
+ * @brief The locations written since the last reset, one bit each (see State.h).
+ *
+ * A clear bit means the location still holds its reset value (register and data
+ * memory 0, instruction memory -1), so the final state and its differences are
+ * found from the set bits alone. A set bit only means the location may have been
+ * written: the threaded engine and the JIT mark what their code can write.
+ */
+typedef struct {
+    uint64_t registers;               /**< One bit per general purpose register. */
+    uint64_t data[2048 / 64];         /**< One bit per data memory byte. */
+    uint64_t instructions[1024 / 64]; /**< One bit per instruction memory row. */
+} DirtyMap;
+
+/**
+ * @brief The whole state of one simulated processor.
+ *
+ * Every ALU, register, memory, pipeline and engine function works on the context
+ * it is given, so any number of processors can run side by side (one per batch
+ * worker). The fields touched by every instruction come first: the register file
+ * fills the first cache line, the PC, status register, pipeline registers and
+ * cycle counters the second one. The page tables of the memories follow; the pages
+ * and the predecoded store are shared copy-on-write between processors running the
+ * same program, and the counters and the data cache are only allocated when asked
+ * for, so copying a processor copies little more than its registers and page tables.
+ */
+typedef struct {
+    _Alignas(64) int8_t generalRegisters[64]; /**< The 64 general purpose registers. */
+
+    _Alignas(64) uint16_t pc;     /**< Program counter. */
+    uint8_t SREG;                 /**< Status register flags: C, V, N, S, Z, 0, 0, 0 (except the pending ones, see ReadStatusRegister). */
+    LazyFlags flags;              /**< The operations the pending flags are computed from. */
+    FetchedInstruction pipeline1; /**< The fetched instruction, handed over to decode the next clock cycle. */
+    PipelineStage pipeline2;      /**< The instruction being decoded. */
+    PipelineStage pipeline3;      /**< The decoded instruction, handed over to execute the next clock cycle. */
+    PipelineStage pipeline4;      /**< The instruction being executed. */
+    int clockcycles;              /**< The current clock cycle of the pipeline engine. */
+    int MaxClockCycles;           /**< Clock cycles the loaded program needs without branches. */
+    uint64_t retired;             /**< Instructions executed by the pipeline engine. */
+
+    _Alignas(64) MemoryPage *dataPages[DATA_MEMORY_PAGES]; /**< The data memory, page by page (see Pages.h). */
+    MemoryPage *instructionPages[INSTRUCTION_MEMORY_PAGES]; /**< The instruction memory, page by page. */
+    DirtyMap dirty;                         /**< The registers and memory locations written since the last reset. */
+    PredecodedStore *predecoded;            /**< Predecoded copy of the instruction memory, filled by PredecodeProgram (see Pages.h). */
+    BranchPredictor predictor;              /**< The branch predictor of the fetch stage (see Predictor.h). */
+    PerfCounters *counters;                 /**< The performance counters of the pipeline engine, NULL unless EnableCounters was called (see Counters.h). */
+    DataCache *cache;                       /**< The data cache timing model of the pipeline engine, NULL unless SetDataCache installed one (see Cache.h). */
+} CPU;
+
 
 #endif
@@ -0,0 +1,274 @@
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief How much of the per-cycle activity is reported to the trace sink.
+ *
+ * Each level includes everything reported by the levels below it.
+ */
+typedef enum {
+    TRACE_LEVEL_OFF = 0,     /**< Nothing is traced, only the final PrintAll* state is printed. */
+    TRACE_LEVEL_STAGES = 1,  /**< Cycle boundaries and the instruction held by each pipeline stage. */
+    TRACE_LEVEL_UPDATES = 2, /**< Adds register, PC and data memory writes. */
+    TRACE_LEVEL_FLAGS = 3    /**< Adds every status flag update (the original console output). */
+} TraceLevel;
+
+/**
+ * @brief The kind of a trace event.
+ */
+typedef enum {
+    TRACE_CYCLE_BEGIN,    /**< A new clock cycle starts. */
+    TRACE_CYCLE_END,      /**< The current clock cycle is over. */
+    TRACE_STAGE,          /**< The instruction a pipeline stage worked on (or that it was empty). */
+    TRACE_REGISTER_WRITE, /**< A general purpose register was written. */
+    TRACE_FLAG_UPDATE,    /**< A status register flag was updated. */
+    TRACE_MEMORY_WRITE,   /**< A data memory location was written. */
+    TRACE_PC_WRITE        /**< The program counter was changed by a branch. */
+} TraceEventKind;
+
+/**
+ * @brief The pipeline stages reported by TRACE_STAGE events.
+ */
+typedef enum {
+    TRACE_STAGE_FETCH,
+    TRACE_STAGE_DECODE,
+    TRACE_STAGE_EXECUTE
+} TraceStage;
+
+/**
+ * @brief Status register bits reported by TRACE_FLAG_UPDATE events.
+ */
+typedef enum {
+    TRACE_FLAG_C = 0,
+    TRACE_FLAG_V = 1,
+    TRACE_FLAG_N = 2,
+    TRACE_FLAG_S = 3,
+    TRACE_FLAG_Z = 4
+} TraceFlag;
+
+/**
+ * @brief A fixed-size trace record.
+ *
+ * Only the fields relevant to the event kind are meaningful, the others are zero.
+ */
+typedef struct {
+    uint32_t cycle;    /**< The clock cycle the event happened in. */
+    uint8_t kind;      /**< A TraceEventKind. */
+    uint8_t index;     /**< The stage, register number or flag bit. */
+    uint16_t address;  /**< The instruction address, data memory address or new PC value. */
+    int8_t value;      /**< The written register/memory value or the new flag value. */
+    uint8_t occupied;  /**< For stage events: 1 if the stage held an instruction. */
+    uint8_t opcode;    /**< For stage events: the opcode of the instruction. */
+    uint8_t operand1;  /**< For stage events: the first operand of the instruction. */
+    int8_t value2;     /**< For stage events: the second operand/Immediate value. */
+    char type;         /**< For stage events: the type of the instruction. */
+    uint8_t reserved[2];
+} TraceEvent;
+
+_Static_assert(sizeof(TraceEvent) == 16, "TraceEvent must stay a 16 byte record");
+
+/**
+ * @brief A trace sink receives every event that passes the current trace level.
+ *
+ * @param context The context pointer given to TraceSetSink.
+ * @param event The event to consume. It is only valid for the duration of the call.
+ */
+typedef void (*TraceSink)(void *context, const TraceEvent *event);
+
+extern TraceLevel traceLevel;   /**< The current runtime trace level. */
+extern TraceSink traceSink;     /**< The sink every event is sent to. */
+extern void *traceSinkContext;  /**< The context passed to the sink. */
+extern uint32_t traceCycle;     /**< The clock cycle stamped on new events. */
+
+/*
+ * Building with PROCESSOR_TRACE_DISABLED defined removes every trace call
+ * from the simulator: TRACE_ACTIVE becomes constant false and the event
+ * helpers at the end of this header expand to nothing.
+ */
+#ifdef PROCESSOR_TRACE_DISABLED
+#define TRACE_ACTIVE(level) 0
+#else
+#define TRACE_ACTIVE(level) (traceLevel >= (level))
+#endif
+
+/**
+ * @brief Sets the runtime trace level.
+ *
+ * @param level The new trace level.
+ */
+void TraceSetLevel(TraceLevel level);
+
+/**
+ * @brief Replaces the trace sink.
+ *
+ * @param sink The new sink, or NULL to restore the console sink.
+ * @param context The context pointer passed to the sink on every event.
+ */
+void TraceSetSink(TraceSink sink, void *context);
+
+/**
+ * @brief Formats an event in the simulator's console text format.
+ *
+ * @param event The event to format.
+ * @param buffer The buffer the text is written to.
+ * @param size The size of the buffer.
+ * @return The length of the formatted text (as returned by snprintf).
+ */
+int TraceFormatEvent(const TraceEvent *event, char *buffer, size_t size);
+
+/**
+ * @brief The default sink: prints every event to the FILE* given as context (stdout when NULL).
+ */
+void TraceConsoleSink(void *context, const TraceEvent *event);
+
+#ifdef PROCESSOR_TRACE_DISABLED
+
+#define TraceCycleBegin(cycle) ((void)0)
+#define TraceCycleEnd() ((void)0)
+#define TraceStageBusy(stage, pcVal, opcode, operand1, value2, type) ((void)0)
+#define TraceStageEmpty(stage) ((void)0)
+#define TraceRegisterWrite(reg, value) ((void)0)
+#define TracePCWrite(value) ((void)0)
+#define TraceMemoryWrite(address, value) ((void)0)
+#define TraceFlagUpdate(flag, value) ((void)0)
+
+#else
+
+/**
+ * @brief Sends an event to the current sink.
+ */
+static inline void TraceEmit(TraceEvent *event)
+{
+    event->cycle = traceCycle;
+    traceSink(traceSinkContext, event);
+}
+
+/**
+ * @brief Marks the start of a clock cycle.
+ *
+ * @param cycle The number of the cycle that starts.
+ */
+static inline void TraceCycleBegin(uint32_t cycle)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_STAGES))
+    {
+        traceCycle = cycle;
+        TraceEvent event = {.kind = TRACE_CYCLE_BEGIN};
+        TraceEmit(&event);
+    }
+}
+
+/**
+ * @brief Marks the end of the current clock cycle.
+ */
+static inline void TraceCycleEnd(void)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_STAGES))
+    {
+        TraceEvent event = {.kind = TRACE_CYCLE_END};
+        TraceEmit(&event);
+    }
+}
+
+/**
+ * @brief Reports the instruction a stage worked on this cycle.
+ *
+ * @param stage The stage (TraceStage).
+ * @param pcVal The address of the instruction.
+ * @param opcode The opcode of the instruction.
+ * @param operand1 The first operand of the instruction.
+ * @param value2 The second operand/Immediate value of the instruction.
+ * @param type The type of the instruction.
+ */
+static inline void TraceStageBusy(TraceStage stage, uint16_t pcVal, uint8_t opcode, uint8_t operand1, int8_t value2, char type)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_STAGES))
+    {
+        TraceEvent event = {
+            .kind = TRACE_STAGE,
+            .index = stage,
+            .address = pcVal,
+            .occupied = 1,
+            .opcode = opcode,
+            .operand1 = operand1,
+            .value2 = value2,
+            .type = type,
+        };
+        TraceEmit(&event);
+    }
+}
+
+/**
+ * @brief Reports that a stage had no instruction to work on this cycle.
+ *
+ * @param stage The stage (TraceStage).
+ */
+static inline void TraceStageEmpty(TraceStage stage)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_STAGES))
+    {
+        TraceEvent event = {.kind = TRACE_STAGE, .index = stage};
+        TraceEmit(&event);
+    }
+}
+
+/**
+ * @brief Reports a write to a general purpose register.
+ */
+static inline void TraceRegisterWrite(uint8_t reg, int8_t value)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_UPDATES))
+    {
+        TraceEvent event = {.kind = TRACE_REGISTER_WRITE, .index = reg, .value = value};
+        TraceEmit(&event);
+    }
+}
+
+/**
+ * @brief Reports a write to the program counter.
+ */
+static inline void TracePCWrite(uint16_t value)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_UPDATES))
+    {
+        TraceEvent event = {.kind = TRACE_PC_WRITE, .address = value};
+        TraceEmit(&event);
+    }
+}
+
+/**
+ * @brief Reports a write to the data memory.
+ */
+static inline void TraceMemoryWrite(uint16_t address, int8_t value)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_UPDATES))
+    {
+        TraceEvent event = {.kind = TRACE_MEMORY_WRITE, .address = address, .value = value};
+        TraceEmit(&event);
+    }
+}
+
+/**
+ * @brief Reports an update of a status register flag.
+ *
+ * @param flag The flag bit (TraceFlag).
+ * @param value The new value of the flag.
+ */
+static inline void TraceFlagUpdate(TraceFlag flag, bool value)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_FLAGS))
+    {
+        TraceEvent event = {.kind = TRACE_FLAG_UPDATE, .index = flag, .value = value};
+        TraceEmit(&event);
+    }
+}
+
+#endif /* PROCESSOR_TRACE_DISABLED */
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef TRACEFILE_H_INCLUDED
+#define TRACEFILE_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Assembler.h"
+#include "Structs.h"
+#include "Trace.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The first bytes of every compact trace file.
+ */
+#define TRACE_FILE_MAGIC "CPTR"
+
+/**
+ * @brief The compact trace format version written by the encoder and accepted by the reader.
+ */
+#define TRACE_FILE_VERSION 1
+
+/**
+ * @brief The first bytes of the trailer that closes the index of a compact trace.
+ */
+#define TRACE_FILE_INDEX_MAGIC "CPTI"
+
+/**
+ * @brief Clock cycles between two keyframes, the points a reader can start decoding from.
+ */
+#define TRACE_FILE_KEYFRAME_INTERVAL 4096
+
+/**
+ * @brief The most bytes the encoder writes for one event, including the header and a keyframe in front of it.
+ */
+#define TRACE_FILE_MAX_RECORD 16384
+
+/**
+ * @brief The header at the start of a compact trace file.
+ *
+ * The header is followed by the instruction memory (u16 count, then u16 row and i16
+ * instruction for every row that is not empty) and the record stream. Every record
+ * starts with an op byte: the top three bits are a TraceFileOp, the low five bits
+ * hold the stage and its encoding, the flag and its value, or whether the cycle
+ * number follows. A stage record only names its row when it is not the predicted
+ * one (fetch: the row after the previous fetch; decode: the previous fetch; execute:
+ * the previous decode), and only lists the opcode and operands when they are not the
+ * ones of the row in the instruction memory. Keyframes hold the whole register file,
+ * the status register, the PC and the data memory bytes that are not 0, and empty
+ * the stages the predictions start from, so decoding can start at any of them.
+ * A trace that was closed properly ends with the index: a u32 cycle and a u64 offset for every
+ * keyframe, then a trailer (TRACE_FILE_INDEX_MAGIC, u32 entries, u64 offset of the
+ * index). Every field is little-endian; cycle steps and rows are LEB128 varints.
+ */
+typedef struct {
+    char magic[4];             /**< TRACE_FILE_MAGIC. */
+    uint16_t version;          /**< TRACE_FILE_VERSION. */
+    uint16_t flags;            /**< 0, reserved. */
+    uint32_t keyframeInterval; /**< Clock cycles between two keyframes. */
+    uint32_t reserved;         /**< 0. */
+} TraceFileHeader;
+
+_Static_assert(sizeof(TraceFileHeader) == 16, "TraceFileHeader must stay a 16 byte header");
+
+/**
+ * @brief The kinds of records in a compact trace, stored in the top three bits of the op byte.
+ */
+typedef enum {
+    TRACE_OP_BEGIN,    /**< A cycle starts; bit 0 set: a zigzag varint step from the previous cycle follows, else it is the next one. */
+    TRACE_OP_END,      /**< The cycle is over. */
+    TRACE_OP_STAGE,    /**< A stage; bits 0-1 the stage, bits 2-3 a TraceStageEncoding. */
+    TRACE_OP_REGISTER, /**< A register write: u8 register, i8 value. */
+    TRACE_OP_FLAG,     /**< A flag update: bits 0-2 the flag, bit 3 the value. */
+    TRACE_OP_MEMORY,   /**< A data memory write: u16 address, i8 value. */
+    TRACE_OP_PC,       /**< A branch: u16 new PC. */
+    TRACE_OP_KEYFRAME  /**< The whole state: u32 cycle, u16 PC, u8 SREG, 64 registers, u16 count of (u16 address, i8 value). */
+} TraceFileOp;
+
+/**
+ * @brief How a stage record gives the instruction of the stage.
+ */
+typedef enum {
+    TRACE_STAGE_EMPTY,     /**< The stage held no instruction. */
+    TRACE_STAGE_PREDICTED, /**< The predicted row, decoded from the instruction memory. */
+    TRACE_STAGE_ROW,       /**< A varint row follows, decoded from the instruction memory. */
+    TRACE_STAGE_EXPLICIT   /**< A varint row, then u8 opcode, u8 operand1, i8 value2 and the type character follow. */
+} TraceStageEncoding;
+
+/**
+ * @brief An entry of the index: where the keyframe in front of a cycle starts.
+ */
+typedef struct {
+    uint32_t cycle;  /**< The cycle of the keyframe: the last one that began before it. */
+    uint64_t offset; /**< The offset of the keyframe record in the file. */
+} TraceIndexEntry;
+
+/**
+ * @brief The opcode and operands a stage reports for each instruction memory row.
+ *
+ * Fetch reports the raw second operand, decode and execute the sign-extended one.
+ */
+typedef struct {
+    TraceEvent fetch[1024];   /**< The fetch stage event of each row (occupied 0 for an empty row). */
+    TraceEvent decoded[1024]; /**< The decode and execute stage event of each row. */
+} TraceRowTable;
+
+/**
+ * @brief The machine state a compact trace reconstructs from its events.
+ *
+ * The flags are only followed at TRACE_LEVEL_FLAGS and the registers and data memory
+ * from TRACE_LEVEL_UPDATES; the PC is the row after the last fetch, or the last
+ * branch target if it came later.
+ */
+typedef struct {
+    uint32_t cycle;         /**< The last cycle that began. */
+    uint16_t pc;            /**< The program counter. */
+    uint8_t sreg;           /**< The status register. */
+    int8_t registers[64];   /**< The general purpose registers. */
+    int8_t data[2048];      /**< The data memory. */
+    TraceEvent stages[3];   /**< The last event of each stage (TraceStage), empty after a keyframe. */
+    TraceEvent previous[3]; /**< The stages when the last cycle began, which the predictions start from. */
+} TraceMachineState;
+
+/**
+ * @brief The state of the compact encoder, kept by the trace writer thread.
+ */
+typedef struct {
+    bool started;                 /**< The header and the first keyframe were written. */
+    uint32_t keyframeInterval;    /**< Clock cycles between two keyframes. */
+    uint32_t nextKeyframe;        /**< The first cycle that gets a keyframe in front of it. */
+    int16_t instructions[1024];   /**< The instruction memory at the start of the trace. */
+    TraceRowTable rows;           /**< What the stages report for each row. */
+    TraceMachineState state;      /**< The state after the events encoded so far. */
+    TraceIndexEntry *index;       /**< The keyframes written so far. */
+    size_t indexCount;            /**< Entries in index. */
+    size_t indexCapacity;         /**< Entries allocated for index. */
+} TraceEncoder;
+
+/**
+ * @brief Reads a compact trace back, event by event, from any keyframe.
+ */
+typedef struct {
+    uint8_t *bytes;               /**< The whole file. */
+    size_t size;                  /**< Its size. */
+    size_t streamStart;           /**< Offset of the first record. */
+    size_t streamEnd;             /**< Offset after the last record (the index, or the end of the file). */
+    size_t position;              /**< Offset of the next record. */
+    bool damaged;                 /**< A record could not be decoded; TraceReaderNext stops there. */
+    uint32_t keyframeInterval;    /**< From the header. */
+    int16_t instructions[1024];   /**< The instruction memory at the start of the trace. */
+    TraceRowTable rows;           /**< What the stages report for each row. */
+    TraceMachineState state;      /**< The state after the events read so far. */
+    TraceIndexEntry *index;       /**< The keyframes, NULL when the trace has no index. */
+    size_t indexCount;            /**< Entries in index. */
+} TraceReader;
+
+/**
+ * @brief Prepares an encoder from the state of the processor when its trace starts.
+ *
+ * Call it before the first event; the encoder keeps no reference to the processor.
+ *
+ * @param encoder The encoder.
+ * @param cpu The processor, or NULL to start from a reset one with an empty instruction memory.
+ * @param keyframeInterval Clock cycles between two keyframes.
+ */
+void TraceEncoderInit(TraceEncoder *encoder, const CPU *cpu, uint32_t keyframeInterval);
+
+/**
+ * @brief Encodes one event, with the header and a keyframe in front of it when they are due.
+ *
+ * @param encoder The encoder.
+ * @param event The event.
+ * @param offset The offset in the file the bytes will be written at.
+ * @param out Receives the bytes, at least TRACE_FILE_MAX_RECORD of room.
+ * @return The number of bytes written.
+ */
+size_t TraceEncodeEvent(TraceEncoder *encoder, const TraceEvent *event, uint64_t offset, uint8_t *out);
+
+/**
+ * @brief Encodes the index and the trailer that close a trace.
+ *
+ * When no event was encoded the header and the starting keyframe come first, so
+ * every closed trace can be opened.
+ *
+ * @param encoder The encoder.
+ * @param offset The offset in the file the index will be written at.
+ * @param length Receives the number of bytes.
+ * @return The bytes (free them), or NULL if the allocation failed.
+ */
+uint8_t *TraceEncodeIndex(TraceEncoder *encoder, uint64_t offset, size_t *length);
+
+/**
+ * @brief Frees the index kept by an encoder.
+ *
+ * @param encoder The encoder.
+ */
+void TraceEncoderFree(TraceEncoder *encoder);
+
+/**
+ * @brief Reads a compact trace file and its index, and positions the reader at its start.
+ *
+ * @param reader The reader.
+ * @param file_name The trace file.
+ * @param error Receives the reason (line 0 if the file could not be read, -1 if it is not a compact trace or of another version), may be NULL.
+ * @return true if the trace can be read.
+ */
+bool TraceReaderOpen(TraceReader *reader, const char *file_name, AssemblerError *error);
+
+/**
+ * @brief Positions the reader at the last keyframe in front of a cycle.
+ *
+ * Without an index (a run that did not stop the writer) the reader goes back to the
+ * start of the trace.
+ *
+ * @param reader The reader.
+ * @param cycle The cycle to reach.
+ */
+void TraceReaderSeek(TraceReader *reader, uint32_t cycle);
+
+/**
+ * @brief Decodes the next event and applies it to the reconstructed state.
+ *
+ * @param reader The reader.
+ * @param event Receives the event, exactly as the simulator reported it.
+ * @return false at the end of the trace, or if it is damaged (reader->damaged).
+ */
+bool TraceReaderNext(TraceReader *reader, TraceEvent *event);
+
+/**
+ * @brief Frees the file and the index of a reader.
+ *
+ * @param reader The reader.
+ */
+void TraceReaderClose(TraceReader *reader);
+
+#endif
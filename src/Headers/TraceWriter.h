@@ -0,0 +1,85 @@
+#ifndef TRACEWRITER_H_INCLUDED
+#define TRACEWRITER_H_INCLUDED
+
+/* ^^ these are the include guards */
+
+#include "Structs.h"
+#include "Trace.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief What the writer thread puts in the output file.
+ */
+typedef enum {
+    TRACE_WRITER_TEXT,   /**< The console text format ("Cycle: N", "Fetched Instruction ..."). */
+    TRACE_WRITER_RAW,    /**< The 16 byte TraceEvent records back to back, without any header. */
+    TRACE_WRITER_COMPACT /**< Delta-encoded records with keyframes and an index (TraceFileHeader), read by trace_tool. */
+} TraceWriterFormat;
+
+/**
+ * @brief What the simulator thread does when the ring buffer is full.
+ */
+typedef enum {
+    TRACE_WRITER_BLOCK, /**< Wait for the writer thread, so a slow disk throttles the run (default). */
+    TRACE_WRITER_DROP   /**< Drop the event and count it, the simulation never waits. */
+} TraceWriterPolicy;
+
+/**
+ * @brief Counters collected by a trace writer.
+ */
+typedef struct {
+    uint64_t events;  /**< Events written to the output. */
+    uint64_t bytes;   /**< Bytes written to the output. */
+    uint64_t stalls;  /**< Times the simulator found the ring full and had to wait. */
+    uint64_t dropped; /**< Events dropped because the ring was full (TRACE_WRITER_DROP only). */
+    uint64_t writes;  /**< Block writes issued to the output. */
+} TraceWriterStats;
+
+/**
+ * @brief An asynchronous trace writer: a single-producer/single-consumer ring of
+ * TraceEvent records drained by a dedicated writer thread.
+ */
+typedef struct TraceWriter TraceWriter;
+
+/**
+ * @brief Opens the output and starts the writer thread.
+ *
+ * @param path The output file, or "-" for the standard output.
+ * @param format The output format.
+ * @param policy What to do when the ring is full.
+ * @param capacity The number of records in the ring (rounded up to a power of two).
+ * @return The writer, or NULL if the file could not be opened or the thread could not be started.
+ */
+TraceWriter *TraceWriterStart(const char *path, TraceWriterFormat format, TraceWriterPolicy policy, size_t capacity);
+
+/**
+ * @brief Names the processor whose state at the first traced event starts a compact trace.
+ *
+ * The sink copies the registers, the status register, the PC and both memories on the
+ * simulator thread when the first event arrives. Without it a compact trace starts
+ * from a reset processor with an empty instruction memory, and every stage record
+ * lists its operands. Other formats ignore it.
+ *
+ * @param writer The writer.
+ * @param cpu The processor being traced.
+ */
+void TraceWriterWatchCPU(TraceWriter *writer, const CPU *cpu);
+
+/**
+ * @brief A TraceSink that pushes events into the writer's ring.
+ *
+ * Install it with TraceSetSink(TraceWriterSink, writer). Only one thread may push.
+ */
+void TraceWriterSink(void *context, const TraceEvent *event);
+
+/**
+ * @brief Drains the ring, stops the writer thread and closes the output.
+ *
+ * @param writer The writer to stop. It is freed by this call.
+ * @return The final counters of the writer.
+ */
+TraceWriterStats TraceWriterStop(TraceWriter *writer);
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * @file Image.c
+ * @brief Binary program images: an assembled program (and optionally its initial
+ * state and predecoded table) that is loaded by copying, without any parsing.
+ */
+
+#include "../Headers/Image.h"
+#include "../Headers/Endian.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Registers.h"
+#include "../Headers/State.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_INSTRUCTION_BYTES (1024 * sizeof(int16_t))
+#define IMAGE_DATA_BYTES 2048
+#define IMAGE_REGISTER_BYTES 72 // 64 registers, SREG and padding to a multiple of 8
+#define IMAGE_PREDECODED_BYTES offsetof(PredecodedStore, references)
+
+_Static_assert(sizeof(ImageHeader) == 16, "the image header is 16 bytes");
+_Static_assert(IMAGE_PREDECODED_BYTES % 8 == 0, "segments are a multiple of 8 bytes");
+
+uint32_t ImageChecksum(const void *data, size_t length)
+{
+    const uint8_t *body = data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i + 8 <= length; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, body + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (size_t i = length & ~(size_t)7; i < length; i++)
+    {
+        hash = (hash ^ body[i]) * 0x100000001b3ULL;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// Function to compute the size of the image body for the given segments
+static size_t ImageBodySize(unsigned segments)
+{
+    size_t size = IMAGE_INSTRUCTION_BYTES;
+    size += (segments & IMAGE_SEGMENT_DATA) ? IMAGE_DATA_BYTES : 0;
+    size += (segments & IMAGE_SEGMENT_REGISTERS) ? IMAGE_REGISTER_BYTES : 0;
+    size += (segments & IMAGE_SEGMENT_PREDECODED) ? IMAGE_PREDECODED_BYTES : 0;
+    return size;
+}
+
+// Function to report a damaged image; always returns false
+static bool ImageError(AssemblerError *error, const char *message)
+{
+    if (error != NULL)
+    {
+        error->line = -1;
+        error->column = 0;
+        snprintf(error->message, sizeof(error->message), "%s", message);
+    }
+    return false;
+}
+
+// Function to check every entry of a predecoded segment before it is copied: the engines
+// index their dispatch tables and the register file with it
+static bool ValidPredecodedSegment(const uint8_t *segment)
+{
+    const uint8_t *opcode = segment + offsetof(PredecodedStore, opcode);
+    const uint8_t *operand1 = segment + offsetof(PredecodedStore, operand1);
+    const uint8_t *operand2 = segment + offsetof(PredecodedStore, operand2);
+    const uint8_t *immediate = segment + offsetof(PredecodedStore, immediate);
+    const uint8_t *type = segment + offsetof(PredecodedStore, type);
+    const uint8_t *valid = segment + offsetof(PredecodedStore, valid);
+    for (int i = 0; i < 1024; i++)
+    {
+        int extended = (operand2[i] & 0b100000) ? operand2[i] - 64 : operand2[i];
+        if (opcode[i] >= 16 || operand1[i] >= 64 || operand2[i] >= 64 || (int8_t)immediate[i] != extended ||
+            type[i] != (uint8_t)GetOpcodeType(opcode[i]) || valid[i] > 1)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IsImage(const void *data, size_t length)
+{
+    return length >= sizeof(ImageHeader) && memcmp(data, IMAGE_MAGIC, 4) == 0;
+}
+
+bool LoadImage(CPU *cpu, const void *data, size_t length, AssemblerError *error)
+{
+    if (!IsImage(data, length))
+    {
+        return ImageError(error, "not a program image");
+    }
+    const uint8_t *bytes = data;
+    ImageHeader header;
+    memcpy(header.magic, bytes, 4);
+    header.version = LoadLE16(bytes + offsetof(ImageHeader, version));
+    header.segments = LoadLE16(bytes + offsetof(ImageHeader, segments));
+    header.instructions = LoadLE32(bytes + offsetof(ImageHeader, instructions));
+    header.checksum = LoadLE32(bytes + offsetof(ImageHeader, checksum));
+    if (header.version != IMAGE_VERSION)
+    {
+        return ImageError(error, "unsupported program image version");
+    }
+    const uint8_t *body = (const uint8_t *)data + sizeof(header);
+    size_t bodySize = ImageBodySize(header.segments);
+    if ((header.segments & ~(IMAGE_SEGMENT_DATA | IMAGE_SEGMENT_REGISTERS | IMAGE_SEGMENT_PREDECODED)) != 0 ||
+        length != sizeof(header) + bodySize || header.instructions > 1024)
+    {
+        return ImageError(error, "truncated or damaged program image");
+    }
+    if (ImageChecksum(body, bodySize) != header.checksum)
+    {
+        return ImageError(error, "program image checksum mismatch");
+    }
+
+    int16_t rows[IMAGE_INSTRUCTION_BYTES / 2];
+    for (size_t i = 0; i < IMAGE_INSTRUCTION_BYTES / 2; i++)
+    {
+        rows[i] = (int16_t)LoadLE16(body + 2 * i);
+    }
+    WriteInstructionMemoryBlock(cpu, 0, rows, IMAGE_INSTRUCTION_BYTES / 2);
+    body += IMAGE_INSTRUCTION_BYTES;
+    if (header.segments & IMAGE_SEGMENT_DATA)
+    {
+        WriteDataMemoryBlock(cpu, 0, (const int8_t *)body, IMAGE_DATA_BYTES);
+        body += IMAGE_DATA_BYTES;
+    }
+    if (header.segments & IMAGE_SEGMENT_REGISTERS)
+    {
+        memcpy(cpu->generalRegisters, body, 64);
+        MarkLoadedRegisters(cpu);
+        WriteStatusRegister(cpu, body[64]);
+        body += IMAGE_REGISTER_BYTES;
+    }
+    if (!(header.segments & IMAGE_SEGMENT_PREDECODED))
+    {
+        PredecodeProgram(cpu);
+    }
+    else if (ValidPredecodedSegment(body))
+    {
+        memcpy(WritablePredecodedStore(cpu), body, IMAGE_PREDECODED_BYTES);
+    }
+    else
+    {
+        return ImageError(error, "damaged predecoded segment");
+    }
+    cpu->MaxClockCycles = 3 + ((int)header.instructions - 1); // 3 cycles for the first instruction, 1 for each of the others
+    return true;
+}
+
+bool SaveImage(CPU *cpu, size_t instructions, unsigned segments, const char *file_name)
+{
+    size_t bodySize = ImageBodySize(segments);
+    uint8_t *image = calloc(1, sizeof(ImageHeader) + bodySize);
+    if (image == NULL)
+    {
+        return false;
+    }
+    uint8_t *body = image + sizeof(ImageHeader);
+    uint8_t *p = body;
+    int16_t rows[IMAGE_INSTRUCTION_BYTES / 2];
+    ReadInstructionMemoryBlock(cpu, 0, rows, IMAGE_INSTRUCTION_BYTES / 2);
+    for (size_t i = 0; i < IMAGE_INSTRUCTION_BYTES / 2; i++)
+    {
+        PutU16(&p, (uint16_t)rows[i]);
+    }
+    if (segments & IMAGE_SEGMENT_DATA)
+    {
+        ReadDataMemoryBlock(cpu, 0, (int8_t *)p, IMAGE_DATA_BYTES);
+        p += IMAGE_DATA_BYTES;
+    }
+    if (segments & IMAGE_SEGMENT_REGISTERS)
+    {
+        memcpy(p, cpu->generalRegisters, 64);
+        p[64] = ReadStatusRegister(cpu);
+        p += IMAGE_REGISTER_BYTES;
+    }
+    if (segments & IMAGE_SEGMENT_PREDECODED)
+    {
+        PredecodeProgram(cpu); // every row valid, as LoadImage decodes it
+        memcpy(p, cpu->predecoded, IMAGE_PREDECODED_BYTES);
+    }
+
+    memcpy(image, IMAGE_MAGIC, 4);
+    StoreLE16(image + offsetof(ImageHeader, version), IMAGE_VERSION);
+    StoreLE16(image + offsetof(ImageHeader, segments), (uint16_t)segments);
+    StoreLE32(image + offsetof(ImageHeader, instructions), (uint32_t)instructions);
+    StoreLE32(image + offsetof(ImageHeader, checksum), ImageChecksum(body, bodySize));
+
+    FILE *file = fopen(file_name, "wb");
+    bool written = file != NULL && fwrite(image, 1, sizeof(ImageHeader) + bodySize, file) == sizeof(ImageHeader) + bodySize;
+    if (file != NULL)
+    {
+        written = fclose(file) == 0 && written;
+    }
+    free(image);
+    return written;
+}
@@ -1,43 +1,42 @@
 #include "../Headers/Registers.h"
 #include "../Headers/Structs.h"
 #include "../Headers/ALU.h"
+#include "../Headers/Cache.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Predictor.h"
+#include "../Headers/Trace.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 
-// Global variables
-int16_t instruction_memory[1024];
-FetchedInstruction pipeline1; // Saving the fetched instruction to hand over to decode stage next CC
-PipelineStage pipeline2; // holds the instruction to be decoded
-PipelineStage pipeline3; // Saving the decoded instruction to hand over to excute stage next CC
-PipelineStage pipeline4; // holds the instruction to be executed
-
-
 // Function to reset the pipeline stages
-void ResetPipeline() {
-    pipeline2.valid = false;
-    pipeline3.valid = false;
-    pipeline4.valid = false;
-    pipeline1.pcVal = 0;
-    pipeline2.pcVal = 0;
-    pipeline3.pcVal = 0;
-    pipeline4.pcVal = 0;
-    pipeline2.instruction.opcode = -1;
-    pipeline3.instruction.opcode = -1;
-    pipeline4.instruction.opcode = -1;
-    pipeline2.instruction.operand1 = 0;
-    pipeline3.instruction.operand1 = 0;
-    pipeline4.instruction.operand1 = 0;
-    pipeline2.instruction.value2 = 0;
-    pipeline3.instruction.value2 = 0;
-    pipeline4.instruction.value2 = 0;
-    pipeline2.instruction.type = 'R';
-    pipeline3.instruction.type = 'R';
-    pipeline4.instruction.type = 'R';
-
-    pipeline1.instruction = 0;
+void ResetPipeline(CPU *cpu) {
+    cpu->pipeline2.valid = false;
+    cpu->pipeline3.valid = false;
+    cpu->pipeline4.valid = false;
+    cpu->pipeline1.pcVal = 0;
+    cpu->pipeline2.pcVal = 0;
+    cpu->pipeline3.pcVal = 0;
+    cpu->pipeline4.pcVal = 0;
+    cpu->pipeline2.instruction.opcode = -1;
+    cpu->pipeline3.instruction.opcode = -1;
+    cpu->pipeline4.instruction.opcode = -1;
+    cpu->pipeline2.instruction.operand1 = 0;
+    cpu->pipeline3.instruction.operand1 = 0;
+    cpu->pipeline4.instruction.operand1 = 0;
+    cpu->pipeline2.instruction.operand2 = 0;
+    cpu->pipeline3.instruction.operand2 = 0;
+    cpu->pipeline4.instruction.operand2 = 0;
+    cpu->pipeline2.instruction.value2 = 0;
+    cpu->pipeline3.instruction.value2 = 0;
+    cpu->pipeline4.instruction.value2 = 0;
+    cpu->pipeline2.instruction.type = 'R';
+    cpu->pipeline3.instruction.type = 'R';
+    cpu->pipeline4.instruction.type = 'R';
+
+    cpu->pipeline1.instruction = 0;
     
 }
 
@@ -80,161 +79,354 @@ char GetOpcodeType(uint8_t opcode)
     }
 }
 
+// Function to decode one instruction memory row into the predecoded store
+void PredecodeInstruction(CPU *cpu, uint16_t address)
+{
+    int16_t instruction = PageReadInstruction(cpu, address);
+    uint8_t opcode = GetOpcode(instruction);
+    uint8_t value2 = GetValue2(instruction);
+    PredecodedStore *store = WritablePredecodedStore(cpu);
+    store->opcode[address] = opcode;
+    store->operand1[address] = GetOperand1(instruction);
+    store->operand2[address] = value2;
+    store->immediate[address] = (value2 & 0b100000) ? (int8_t)(value2 - 64) : (int8_t)value2;
+    store->type[address] = GetOpcodeType(opcode);
+    store->valid[address] = true;
+}
+
+// Function to decode the whole instruction memory once, after a program was loaded
+void PredecodeProgram(CPU *cpu)
+{
+    for (int i = 0; i < 1024; i++)
+    {
+        PredecodeInstruction(cpu, i);
+    }
+}
+
+// Function to read the predecoded form of the instruction at the given address
+Instruction GetPredecodedInstruction(CPU *cpu, uint16_t address)
+{
+    if (!cpu->predecoded->valid[address])
+    {
+        PredecodeInstruction(cpu, address);
+    }
+    const PredecodedStore *store = cpu->predecoded;
+    Instruction ins;
+    ins.opcode = store->opcode[address];
+    ins.operand1 = store->operand1[address];
+    ins.operand2 = store->operand2[address];
+    ins.value2 = store->immediate[address];
+    ins.type = store->type[address];
+    return ins;
+}
+
 // Function to write an instruction to the instruction memory at the given address
-void WriteInstructionMemory(uint16_t  address, uint16_t instruction)
+void WriteInstructionMemory(CPU *cpu, uint16_t  address, uint16_t instruction)
 {
-    instruction_memory[address] = instruction;
+    PageWriteInstruction(cpu, address, (int16_t)instruction);
+    if (cpu->predecoded->valid[address])
+    {
+        WritablePredecodedStore(cpu)->valid[address] = false;
+    }
 }
 
 // Function to read an instruction from the instruction memory at the given address
-int16_t ReadInstructionMemory(uint16_t address)
+int16_t ReadInstructionMemory(CPU *cpu, uint16_t address)
+{
+    if (address >= 1024)
+    {
+        return -1; // a branch past the end of the memory ends the program like an empty row
+    }
+    return PageReadInstruction(cpu, address);
+}
+
+// Function to compute the PC the pipeline holds when the instruction at the given address executes
+uint16_t GetExecutePC(CPU *cpu, uint16_t address)
 {
-    return instruction_memory[address];
+    // fetch keeps running for two more cycles and stops advancing at the first empty row
+    uint16_t executePC = address + 1;
+    if (ReadInstructionMemory(cpu, executePC) != -1)
+    {
+        executePC++;
+        if (ReadInstructionMemory(cpu, executePC) != -1)
+        {
+            executePC++;
+        }
+    }
+    return executePC;
 }
 
 // Function to fetch an instruction from the instruction memory and update the fetch pipeline stage
-void fetchPipeline()
+void fetchPipeline(CPU *cpu)
 {
-    int16_t instruction = ReadInstructionMemory(GetPC());
+    int16_t instruction = ReadInstructionMemory(cpu, GetPC(cpu));
     if (instruction == -1) {
-        printf("No more Instructions\n");
-        pipeline1.valid = false;
+        TraceStageEmpty(TRACE_STAGE_FETCH);
+        cpu->pipeline1.valid = false;
         return;
     }
     else
     {
-        pipeline1.instruction = instruction;
-        pipeline1.valid = 1;
-        pipeline1.pcVal = GetPC();
-
-        uint8_t opcode = GetOpcode(instruction);
-        uint8_t operand1 = GetOperand1(instruction);
-        int8_t value2 = GetValue2(instruction);
-
-        printf("Fetched Instruction %d: Opcode:%d  Register:%d Reg/IMM:%d Type:%c\n",
-               pipeline1.pcVal,
-               opcode,
-               operand1,
-               value2,
-               GetOpcodeType(opcode));
-        IncrementPC();
+        cpu->pipeline1.instruction = instruction;
+        cpu->pipeline1.valid = 1;
+        cpu->pipeline1.pcVal = GetPC(cpu);
+
+        if (TRACE_ACTIVE(TRACE_LEVEL_STAGES))
+        {
+            Instruction ins = GetPredecodedInstruction(cpu, cpu->pipeline1.pcVal);
+            (void)ins; // only read by the trace call, which PROCESSOR_TRACE_DISABLED compiles out
+            TraceStageBusy(TRACE_STAGE_FETCH,
+                           cpu->pipeline1.pcVal,
+                           ins.opcode,
+                           ins.operand1,
+                           ins.operand2,
+                           ins.type);
+        }
+        if (PredictorActive(cpu))
+        {
+            cpu->pc = PredictNextPC(cpu, cpu->pc);
+        }
+        else
+        {
+            IncrementPC(cpu);
+        }
     }
 }
 
 Instruction decode(uint16_t  instruction)
 {
     Instruction ins;
+    uint8_t value2 = GetValue2(instruction);
     ins.opcode = GetOpcode(instruction);
     ins.operand1 = GetOperand1(instruction);
-    ins.value2 = GetValue2(instruction);
+    ins.operand2 = value2;
+    ins.value2 = (value2 & 0b100000) ? (int8_t)(value2 - 64) : (int8_t)value2;
     ins.type = GetOpcodeType(ins.opcode);
     return ins;
 }
 
 // Function to decode the instruction in the decode pipeline stage and update the execute pipeline stage
-void decodePipeline()
+void decodePipeline(CPU *cpu)
 {
-    if (pipeline2.valid)
+    if (cpu->pipeline2.valid)
     {
-        pipeline3.instruction = pipeline2.instruction;
-        pipeline3.pcVal = pipeline2.pcVal;
-        pipeline3.valid = true;
-        pipeline2.valid = false;
-        printf("Decoded Instruction %d : Opcode:%d  Register:%d Reg/IMM:%d Type:%c\n",
-               pipeline2.pcVal,
-               pipeline2.instruction.opcode,
-               pipeline2.instruction.operand1,
-               pipeline2.instruction.value2,
-               pipeline2.instruction.type);
+        cpu->pipeline3.instruction = cpu->pipeline2.instruction;
+        cpu->pipeline3.pcVal = cpu->pipeline2.pcVal;
+        cpu->pipeline3.valid = true;
+        cpu->pipeline2.valid = false;
+        TraceStageBusy(TRACE_STAGE_DECODE,
+                       cpu->pipeline2.pcVal,
+                       cpu->pipeline2.instruction.opcode,
+                       cpu->pipeline2.instruction.operand1,
+                       cpu->pipeline2.instruction.value2,
+                       cpu->pipeline2.instruction.type);
     }
     else
     {
-        printf("No instruction to be decoded \n");
+        TraceStageEmpty(TRACE_STAGE_DECODE);
     }
 
-    if (pipeline1.valid)
+    if (cpu->pipeline1.valid)
     {
-        pipeline2.instruction = decode(pipeline1.instruction);
-        pipeline2.pcVal = pipeline1.pcVal;
-        pipeline2.valid = true;
+        cpu->pipeline2.instruction = GetPredecodedInstruction(cpu, cpu->pipeline1.pcVal);
+        cpu->pipeline2.pcVal = cpu->pipeline1.pcVal;
+        cpu->pipeline2.valid = true;
     }
 }
 
 // Function to execute the given instruction
-void execute(Instruction ins)
+void execute(CPU *cpu, Instruction ins)
 {
     switch (ins.opcode)
     {
     case 0:
-        ADD(ins.operand1, ins.value2);
+        ADD(cpu, ins.operand1, ins.operand2);
         break;
     case 1:
-        SUB(ins.operand1, ins.value2);
+        SUB(cpu, ins.operand1, ins.operand2);
         break;
     case 2:
-        MUL(ins.operand1, ins.value2);
+        MUL(cpu, ins.operand1, ins.operand2);
         break;
     case 3:
-        MOVI(ins.operand1, ins.value2);
+        MOVI(cpu, ins.operand1, ins.value2);
         break;
     case 4:
-        BEQZ(ins.operand1, ins.value2);
+        BEQZ(cpu, ins.operand1, ins.value2);
         break;
     case 5:
-        ANDI(ins.operand1, ins.value2);
+        ANDI(cpu, ins.operand1, ins.value2);
         break;
     case 6:
-        EOR(ins.operand1, ins.value2);
+        EOR(cpu, ins.operand1, ins.operand2);
         break;
     case 7:
-        BR(ins.operand1, ins.value2);
+        BR(cpu, ins.operand1, ins.operand2);
         break;
     case 8:
-        SAL(ins.operand1, ins.value2);
+        SAL(cpu, ins.operand1, ins.value2);
         break;
     case 9:
-        SAR(ins.operand1, ins.value2);
+        SAR(cpu, ins.operand1, ins.value2);
         break;
     case 10:
-        LDR(ins.operand1, ins.value2);
+        LDR(cpu, ins.operand1, ins.value2);
         break;
     case 11:
-        STR(ins.operand1, ins.value2);
+        STR(cpu, ins.operand1, ins.value2);
         break;
     default:
         return;
     }
 }
 
+// Function to look the LDR or STR in execute up in the data cache and tell whether it stalls this cycle
+static bool StallForMemory(CPU *cpu)
+{
+    DataCache *cache = cpu->cache;
+    if (cache->stallCycles > 0)
+    {
+        // the line arrives at the end of the last stall cycle, the instruction executes in it
+        return --cache->stallCycles > 0;
+    }
+    Instruction ins = cpu->pipeline4.instruction;
+    if (ins.opcode != 10 && ins.opcode != 11)
+    {
+        return false;
+    }
+    int stall = CacheAccess(cpu, cpu->pipeline4.pcVal & 1023, (uint8_t)ins.value2, ins.opcode == 11);
+    cache->stallCycles = (uint16_t)stall;
+    return stall > 0;
+}
+
+bool memoryStallPipeline(const CPU *cpu)
+{
+    return CacheActive(cpu) && cpu->cache->stallCycles > 0;
+}
+
+// Function to report the instructions fetch and decode hold while execute stalls
+void holdPipeline(CPU *cpu)
+{
+    if (cpu->pipeline1.valid)
+    {
+        if (TRACE_ACTIVE(TRACE_LEVEL_STAGES))
+        {
+            Instruction held = GetPredecodedInstruction(cpu, cpu->pipeline1.pcVal);
+            (void)held; // only read by the trace call, which PROCESSOR_TRACE_DISABLED compiles out
+            TraceStageBusy(TRACE_STAGE_FETCH, cpu->pipeline1.pcVal, held.opcode, held.operand1, held.operand2, held.type);
+        }
+    }
+    else
+    {
+        TraceStageEmpty(TRACE_STAGE_FETCH);
+    }
+    if (cpu->pipeline3.valid)
+    {
+        TraceStageBusy(TRACE_STAGE_DECODE,
+                       cpu->pipeline3.pcVal,
+                       cpu->pipeline3.instruction.opcode,
+                       cpu->pipeline3.instruction.operand1,
+                       cpu->pipeline3.instruction.value2,
+                       cpu->pipeline3.instruction.type);
+    }
+    else
+    {
+        TraceStageEmpty(TRACE_STAGE_DECODE);
+    }
+}
+
+// Function to count an executed instruction, charging the bubbles since the previous one to its flush or to filling the pipeline
+static void CountExecuted(PerfCounters *counters, Instruction ins, uint16_t address, bool flushes)
+{
+    if (counters->flushPending)
+    {
+        counters->flushCycles += counters->pendingBubbles;
+        counters->pcFlushCycles[counters->flushPC] += counters->pendingBubbles;
+    }
+    else
+    {
+        counters->fillDrainCycles += counters->pendingBubbles;
+    }
+    counters->pendingBubbles = 0;
+    counters->flushPending = flushes;
+    counters->flushPC = address;
+    counters->opcodeRetired[ins.opcode & 15]++;
+    counters->pcExecutions[address]++;
+    counters->beqzFlushes += flushes && ins.opcode == 4;
+    counters->brFlushes += flushes && ins.opcode == 7;
+    counters->dataReads += ins.opcode == 10;
+    counters->dataWrites += ins.opcode == 11;
+}
+
 // Function to execute the instruction in the execute pipeline stage
-void executePipeline()
+void executePipeline(CPU *cpu)
 {
-    if (pipeline4.valid)
+    PerfCounters *counters = cpu->counters;
+    Instruction ins;
+    bool executed = cpu->pipeline4.valid;
+    if (executed)
     {
-        printf("Executed Instruction %d: Opcode:%d  Register:%d Reg/IMM:%d Type:%c\n",
-               pipeline4.pcVal,
-               pipeline4.instruction.opcode,
-               pipeline4.instruction.operand1,
-               pipeline4.instruction.value2,
-               pipeline4.instruction.type);
-        execute(pipeline4.instruction);
-        pipeline4.valid = false;
+        TraceStageBusy(TRACE_STAGE_EXECUTE,
+                       cpu->pipeline4.pcVal,
+                       cpu->pipeline4.instruction.opcode,
+                       cpu->pipeline4.instruction.operand1,
+                       cpu->pipeline4.instruction.value2,
+                       cpu->pipeline4.instruction.type);
+        if (CacheActive(cpu) && StallForMemory(cpu))
+        {
+            // the instruction keeps execute, nothing behind it moves
+            if (counters != NULL)
+            {
+                counters->memoryStallCycles++;
+                counters->cycles++;
+            }
+            return;
+        }
+        ins = cpu->pipeline4.instruction;
+        uint16_t address = cpu->pipeline4.pcVal & 1023; // a flush clears pcVal
+        bool flushes = false;
+        if (ins.opcode == 4 || ins.opcode == 7)
+        {
+            flushes = ResolveBranch(cpu, ins, address);
+        }
+        else
+        {
+            execute(cpu, ins);
+        }
+        cpu->retired++;
+        if (counters != NULL)
+        {
+            CountExecuted(counters, ins, address, flushes);
+        }
+        cpu->pipeline4.valid = false;
     }
     else
     {
-        printf("No instruction to be executed\n");
+        TraceStageEmpty(TRACE_STAGE_EXECUTE);
+        if (counters != NULL)
+        {
+            counters->pendingBubbles++;
+        }
+    }
+    if (counters != NULL)
+    {
+        counters->cycles++;
     }
 
-    if (pipeline3.valid)
+    if (cpu->pipeline3.valid)
     {
-        pipeline4.instruction = pipeline3.instruction;
-        pipeline4.pcVal = pipeline3.pcVal;
-        pipeline4.valid = true;
-        pipeline3.valid = false;
+        cpu->pipeline4.instruction = cpu->pipeline3.instruction;
+        cpu->pipeline4.pcVal = cpu->pipeline3.pcVal;
+        cpu->pipeline4.valid = true;
+        cpu->pipeline3.valid = false;
+        if (cpu->predictor.resolveInDecode)
+        {
+            ResolveBranchInDecode(cpu, executed ? &ins : NULL);
+        }
     }
     else
     {
-        pipeline4.valid = false;
+        cpu->pipeline4.valid = false;
     }
 }
 
@@ -243,34 +435,33 @@ void executePipeline()
 
 
 // Function to reset the instruction memory
-void ResetInstructionMemory()
+void ResetInstructionMemory(CPU *cpu)
 {
-    for (int i = 0; i < 1024; i++)
-    {
-        instruction_memory[i] = -1;
-    }
+    AttachEmptyInstructionPages(cpu);
+    AttachInvalidPredecodedStore(cpu);
 }
 
 // Function to print all instructions in the instruction memory
-void PrintAllInstructionMemory()
+void PrintAllInstructionMemory(CPU *cpu, FILE *out)
 {
 
-    printf("Final State of Instruction Memory: \n");
-    printf("-------------------------------------------------- \n");
+    fprintf(out, "Final State of Instruction Memory: \n");
+    fprintf(out, "-------------------------------------------------- \n");
     for (int i = 0; i < 1024; i++)
     {
-        if (instruction_memory[i] != -1)
+        int16_t instruction = PageReadInstruction(cpu, i);
+        if (instruction != -1)
         {
-            uint8_t opcode = GetOpcode(instruction_memory[i]);
-            uint8_t operand1 = GetOperand1(instruction_memory[i]);
-            int8_t value2 = GetValue2(instruction_memory[i]);
-            printf("Instruction %d: Opcode:%d  Register:%d  Reg/IMM:%d  Type:%c\n",
+            uint8_t opcode = GetOpcode(instruction);
+            uint8_t operand1 = GetOperand1(instruction);
+            int8_t value2 = GetValue2(instruction);
+            fprintf(out, "Instruction %d: Opcode:%d  Register:%d  Reg/IMM:%d  Type:%c\n",
                    i,
                    opcode,
                    operand1,
                    value2,
                    GetOpcodeType(opcode));
-            printf("-------------------------------------------------- \n");
+            fprintf(out, "-------------------------------------------------- \n");
         }
     }
 }
@@ -0,0 +1,437 @@
+/**
+ * @file JIT.c
+ * @brief Tiered execution: an interpreter that counts basic block entries and compiles
+ * hot blocks to x86-64 machine code.
+ *
+ * Compiled blocks are called as uint32_t block(int8_t *registers, uint8_t *sreg, int8_t *memory)
+ * and return the next PC in the low 16 bits, with bit 16 set when a taken branch ended
+ * the program. Inside a block the status register lives in r10d; the registers and the
+ * data memory are addressed through rdi and rdx.
+ */
+
+#include "../Headers/JIT.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Registers.h"
+#include "../Headers/State.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+#define JIT_ARENA_SIZE (4 * 1024 * 1024) // bytes of executable memory for compiled blocks
+#define JIT_MAX_BLOCK_LENGTH 64          // instructions per compiled block
+#define JIT_HALT_BIT 0x10000             // set in a block's return value when the program ends
+
+typedef uint32_t (*CompiledBlock)(int8_t *registers, uint8_t *sreg, int8_t *memory);
+
+// the code cache belongs to the calling thread, so batch workers can each run the JIT
+_Thread_local uint32_t jitBlockCounters[1024];   // block entries per start address
+static _Thread_local CompiledBlock blocks[1024];  // compiled code per start address, NULL if not compiled
+static _Thread_local uint16_t blockLengths[1024]; // instructions in each compiled block
+static _Thread_local JITStats stats;
+
+#if defined(__x86_64__)
+
+static _Thread_local uint8_t *arena; // executable memory, mapped on first use
+static _Thread_local size_t arenaUsed;
+
+/**
+ * @brief A code buffer being filled with machine code.
+ */
+typedef struct {
+    uint8_t *code;
+    size_t used;
+    size_t size;
+    bool overflow;
+} CodeBuffer;
+
+static void EmitBytes(CodeBuffer *buffer, const uint8_t *bytes, size_t count)
+{
+    if (buffer->used + count > buffer->size)
+    {
+        buffer->overflow = true;
+        return;
+    }
+    memcpy(buffer->code + buffer->used, bytes, count);
+    buffer->used += count;
+}
+
+#define EMIT(...)                                       \
+    do                                                  \
+    {                                                   \
+        const uint8_t bytes_[] = {__VA_ARGS__};         \
+        EmitBytes(buffer, bytes_, sizeof(bytes_));      \
+    } while (0)
+
+static void Emit32(CodeBuffer *buffer, uint32_t value)
+{
+    EMIT(value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF);
+}
+
+// movzx eax/ecx, byte [rdi + reg]
+static void LoadUnsigned(CodeBuffer *buffer, bool intoEcx, uint8_t reg)
+{
+    EMIT(0x0F, 0xB6, intoEcx ? 0x4F : 0x47, reg);
+}
+
+// movsx eax/ecx, byte [rdi + reg]
+static void LoadSigned(CodeBuffer *buffer, bool intoEcx, uint8_t reg)
+{
+    EMIT(0x0F, 0xBE, intoEcx ? 0x4F : 0x47, reg);
+}
+
+// mov byte [rdi + reg], al
+static void StoreResult(CodeBuffer *buffer, uint8_t reg)
+{
+    EMIT(0x88, 0x47, reg);
+}
+
+// N and Z from the result in al (updateNegativeFlag/updateZeroFlag)
+static void EmitNegativeZero(CodeBuffer *buffer)
+{
+    EMIT(0x84, 0xC0);                   // test al, al
+    EMIT(0x41, 0x0F, 0x98, 0xC3);       // sets r11b
+    EMIT(0x0F, 0x94, 0xC1);             // setz cl
+    EMIT(0x45, 0x0F, 0xB6, 0xDB);       // movzx r11d, r11b
+    EMIT(0x0F, 0xB6, 0xC9);             // movzx ecx, cl
+    EMIT(0x41, 0x81, 0xE2);             // and r10d, ~(N | Z)
+    Emit32(buffer, ~(uint32_t)0x14);
+    EMIT(0x41, 0xC1, 0xE3, 0x02);       // shl r11d, 2
+    EMIT(0x45, 0x09, 0xDA);             // or r10d, r11d
+    EMIT(0xC1, 0xE1, 0x04);             // shl ecx, 4
+    EMIT(0x41, 0x09, 0xCA);             // or r10d, ecx
+}
+
+/*
+ * Merges the flags of ADD/SUB into r10d: C (ADD only) in r8d, the overflow
+ * candidate in r9d, N in r11d and "result is zero" in ecx (it sets S and Z).
+ */
+static void EmitMergeArithmeticFlags(CodeBuffer *buffer, bool withCarry)
+{
+    EMIT(0x41, 0x81, 0xE2);             // and r10d, ~(C | V | N | S | Z) or ~(V | N | S | Z)
+    Emit32(buffer, withCarry ? ~(uint32_t)0x1F : ~(uint32_t)0x1E);
+    if (withCarry)
+    {
+        EMIT(0x45, 0x09, 0xC2);         // or r10d, r8d
+    }
+    EMIT(0x41, 0xD1, 0xE1);             // shl r9d, 1
+    EMIT(0x45, 0x09, 0xCA);             // or r10d, r9d
+    EMIT(0x41, 0xC1, 0xE3, 0x02);       // shl r11d, 2
+    EMIT(0x45, 0x09, 0xDA);             // or r10d, r11d
+    EMIT(0x89, 0xC8);                   // mov eax, ecx
+    EMIT(0xC1, 0xE0, 0x03);             // shl eax, 3
+    EMIT(0x41, 0x09, 0xC2);             // or r10d, eax
+    EMIT(0xC1, 0xE1, 0x04);             // shl ecx, 4
+    EMIT(0x41, 0x09, 0xCA);             // or r10d, ecx
+}
+
+/*
+ * ADD: the host's 8 bit add gives C, N and Z directly. Registers.c only sets V
+ * when the result is also non-zero (-128 + -128 leaves V clear), so the host
+ * overflow flag is masked with "result != 0".
+ */
+static void EmitAdd(CodeBuffer *buffer, uint8_t r1, uint8_t r2)
+{
+    LoadUnsigned(buffer, false, r1);
+    LoadUnsigned(buffer, true, r2);
+    EMIT(0x00, 0xC8);                   // add al, cl
+    StoreResult(buffer, r1);
+    EMIT(0x41, 0x0F, 0x92, 0xC0);       // setc r8b
+    EMIT(0x41, 0x0F, 0x90, 0xC1);       // seto r9b
+    EMIT(0x41, 0x0F, 0x98, 0xC3);       // sets r11b
+    EMIT(0x0F, 0x94, 0xC1);             // setz cl
+    EMIT(0x45, 0x0F, 0xB6, 0xC0);       // movzx r8d, r8b
+    EMIT(0x45, 0x0F, 0xB6, 0xC9);       // movzx r9d, r9b
+    EMIT(0x45, 0x0F, 0xB6, 0xDB);       // movzx r11d, r11b
+    EMIT(0x0F, 0xB6, 0xC9);             // movzx ecx, cl
+    EMIT(0x89, 0xC8);                   // mov eax, ecx
+    EMIT(0x83, 0xF0, 0x01);             // xor eax, 1
+    EMIT(0x41, 0x21, 0xC1);             // and r9d, eax
+    EmitMergeArithmeticFlags(buffer, true);
+}
+
+/*
+ * SUB: Registers.c never sets V when the first operand is zero (0 - -128), so
+ * the host overflow flag is masked with "first operand != 0". C is untouched.
+ */
+static void EmitSub(CodeBuffer *buffer, uint8_t r1, uint8_t r2)
+{
+    LoadUnsigned(buffer, false, r1);
+    LoadUnsigned(buffer, true, r2);
+    EMIT(0x45, 0x31, 0xC0);             // xor r8d, r8d
+    EMIT(0x84, 0xC0);                   // test al, al
+    EMIT(0x41, 0x0F, 0x95, 0xC0);       // setnz r8b
+    EMIT(0x28, 0xC8);                   // sub al, cl
+    StoreResult(buffer, r1);
+    EMIT(0x41, 0x0F, 0x90, 0xC1);       // seto r9b
+    EMIT(0x41, 0x0F, 0x98, 0xC3);       // sets r11b
+    EMIT(0x0F, 0x94, 0xC1);             // setz cl
+    EMIT(0x45, 0x0F, 0xB6, 0xC9);       // movzx r9d, r9b
+    EMIT(0x45, 0x0F, 0xB6, 0xDB);       // movzx r11d, r11b
+    EMIT(0x0F, 0xB6, 0xC9);             // movzx ecx, cl
+    EMIT(0x45, 0x21, 0xC1);             // and r9d, r8d
+    EmitMergeArithmeticFlags(buffer, false);
+}
+
+// mov [rsi], r10b ; mov eax, value ; ret
+static void EmitExit(CodeBuffer *buffer, uint32_t value)
+{
+    EMIT(0x44, 0x88, 0x16);
+    EMIT(0xB8);
+    Emit32(buffer, value);
+    EMIT(0xC3);
+}
+
+// Function to emit one non-branch instruction
+static void EmitInstruction(CodeBuffer *buffer, Instruction ins)
+{
+    uint8_t r1 = ins.operand1;
+    uint8_t r2 = ins.operand2;
+    switch (ins.opcode)
+    {
+    case 0:
+        EmitAdd(buffer, r1, r2);
+        break;
+    case 1:
+        EmitSub(buffer, r1, r2);
+        break;
+    case 2:
+        LoadSigned(buffer, false, r1);
+        LoadSigned(buffer, true, r2);
+        EMIT(0x0F, 0xAF, 0xC1);         // imul eax, ecx
+        StoreResult(buffer, r1);
+        EmitNegativeZero(buffer);
+        break;
+    case 3:
+        EMIT(0xC6, 0x47, r1, (uint8_t)ins.value2); // mov byte [rdi + r1], imm8
+        break;
+    case 5:
+        LoadUnsigned(buffer, false, r1);
+        EMIT(0x24, (uint8_t)ins.value2); // and al, imm8
+        StoreResult(buffer, r1);
+        EmitNegativeZero(buffer);
+        break;
+    case 6:
+        LoadUnsigned(buffer, false, r1);
+        LoadUnsigned(buffer, true, r2);
+        EMIT(0x30, 0xC8);               // xor al, cl
+        StoreResult(buffer, r1);
+        EmitNegativeZero(buffer);
+        break;
+    case 8:
+    case 9:
+        // the register is sign-extended to 32 bits and shifted by the count masked to 5 bits
+        LoadSigned(buffer, false, r1);
+        if ((ins.value2 & 31) != 0)
+        {
+            EMIT(0xC1, ins.opcode == 8 ? 0xE0 : 0xF8, ins.value2 & 31); // shl/sar eax, count
+        }
+        StoreResult(buffer, r1);
+        EmitNegativeZero(buffer);
+        break;
+    case 10:
+        EMIT(0x0F, 0xB6, 0x82);         // movzx eax, byte [rdx + address]
+        Emit32(buffer, (uint8_t)ins.value2);
+        StoreResult(buffer, r1);
+        break;
+    case 11:
+        LoadUnsigned(buffer, false, r1);
+        EMIT(0x88, 0x82);               // mov byte [rdx + address], al
+        Emit32(buffer, (uint8_t)ins.value2);
+        break;
+    default:
+        break; // opcodes 12-15 do nothing, like execute()
+    }
+}
+
+// Function to compile the basic block starting at the given address
+static bool CompileBlock(CPU *cpu, uint16_t start)
+{
+    if (arena == NULL)
+    {
+        void *memory = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            return false;
+        }
+        arena = memory;
+    }
+    if (mprotect(arena, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE) != 0)
+    {
+        return false;
+    }
+
+    CodeBuffer code = {arena + arenaUsed, 0, JIT_ARENA_SIZE - arenaUsed, false};
+    CodeBuffer *buffer = &code;
+    EMIT(0x44, 0x0F, 0xB6, 0x16);       // movzx r10d, byte [rsi]
+
+    uint16_t address = start;
+    uint16_t length = 0;
+    bool ended = false;
+    while (!ended && length < JIT_MAX_BLOCK_LENGTH && ReadInstructionMemory(cpu, address) != -1)
+    {
+        Instruction ins = GetPredecodedInstruction(cpu, address);
+        uint16_t executePC = GetExecutePC(cpu, address);
+        uint32_t haltBit = executePC != address + 3 ? JIT_HALT_BIT : 0;
+        length++;
+        if (ins.opcode == 4)
+        {
+            // BEQZ: jump to the PC computed by the pipeline (PC in execute + IMM - 1)
+            uint16_t target = (uint16_t)(executePC + ins.value2 - 1);
+            EMIT(0x44, 0x88, 0x16);     // mov [rsi], r10b
+            EMIT(0x80, 0x7F, ins.operand1, 0x00); // cmp byte [rdi + r1], 0
+            EMIT(0x75, 0x06);           // jne over the taken exit
+            EMIT(0xB8);                 // mov eax, target ; ret
+            Emit32(buffer, target | haltBit);
+            EMIT(0xC3);
+            EMIT(0xB8);                 // mov eax, address + 1 ; ret
+            Emit32(buffer, (uint16_t)(address + 1));
+            EMIT(0xC3);
+            ended = true;
+        }
+        else if (ins.opcode == 7)
+        {
+            // BR: PC = R1 concat R2, with both registers sign-extended like ALU.c
+            EMIT(0x44, 0x88, 0x16);     // mov [rsi], r10b
+            LoadSigned(buffer, false, ins.operand1);
+            EMIT(0xC1, 0xE0, 0x08);     // shl eax, 8
+            LoadSigned(buffer, true, ins.operand2);
+            EMIT(0x09, 0xC8);           // or eax, ecx
+            EMIT(0x0F, 0xB7, 0xC0);     // movzx eax, ax
+            if (haltBit)
+            {
+                EMIT(0x0D);             // or eax, JIT_HALT_BIT
+                Emit32(buffer, haltBit);
+            }
+            EMIT(0xC3);
+            ended = true;
+        }
+        else
+        {
+            EmitInstruction(buffer, ins);
+            // the native code writes the registers and memory directly: the code cache lives for one run, so mark them now
+            if (ins.opcode == 11)
+            {
+                MarkDataDirty(cpu, (uint8_t)ins.value2);
+            }
+            else if (ins.opcode <= 10)
+            {
+                MarkRegisterDirty(cpu, ins.operand1);
+            }
+        }
+        address++;
+    }
+    if (!ended)
+    {
+        EmitExit(buffer, address);
+    }
+
+    bool compiled = !code.overflow;
+    if (compiled)
+    {
+        blocks[start] = (CompiledBlock)(void *)code.code;
+        blockLengths[start] = length;
+        arenaUsed += (code.used + 15) & ~(size_t)15;
+        stats.blocksCompiled++;
+        stats.codeBytes += code.used;
+    }
+    mprotect(arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC);
+    return compiled;
+}
+
+bool JITAvailable()
+{
+    return true;
+}
+
+#else
+
+static bool CompileBlock(CPU *cpu, uint16_t start)
+{
+    (void)cpu;
+    (void)start;
+    return false;
+}
+
+bool JITAvailable()
+{
+    return false;
+}
+
+#endif
+
+EngineResult RunJITEngine(CPU *cpu, uint64_t maxInstructions, uint32_t threshold)
+{
+    // the compiled code always matches the memory: every run starts with an empty cache
+    memset(jitBlockCounters, 0, sizeof(jitBlockCounters));
+    memset(blocks, 0, sizeof(blocks));
+    memset(&stats, 0, sizeof(stats));
+#if defined(__x86_64__)
+    arenaUsed = 0;
+#endif
+
+    uint64_t budget = maxInstructions == 0 ? UINT64_MAX : maxInstructions;
+    EngineResult result = {0, false};
+    bool blockStart = true;
+    bool compileFailed = false;
+    while (result.instructions < budget)
+    {
+        uint16_t address = cpu->pc;
+        if (blockStart && address < 1024)
+        {
+            jitBlockCounters[address]++;
+            if (blocks[address] == NULL && !compileFailed && jitBlockCounters[address] > threshold &&
+                ReadInstructionMemory(cpu, address) != -1)
+            {
+                compileFailed = !CompileBlock(cpu, address);
+            }
+            if (blocks[address] != NULL && budget - result.instructions >= blockLengths[address])
+            {
+                if (cpu->flags.pending != 0)
+                {
+                    // compiled code keeps the real flags in SREG
+                    WriteStatusRegister(cpu, ReadStatusRegister(cpu));
+                }
+                uint32_t next = blocks[address](cpu->generalRegisters, &cpu->SREG, WritableDataPage(cpu));
+                result.instructions += blockLengths[address];
+                stats.nativeInstructions += blockLengths[address];
+                cpu->pc = next & 0xFFFF;
+                if (next & JIT_HALT_BIT)
+                {
+                    result.halted = true;
+                    return result;
+                }
+                continue;
+            }
+        }
+
+        Instruction ins = GetPredecodedInstruction(cpu, address < 1024 ? address : 0);
+        StepResult step = StepInstruction(cpu);
+        if (step == STEP_HALTED)
+        {
+            result.halted = true;
+            return result;
+        }
+        result.instructions++;
+        stats.interpretedInstructions++;
+        if (step == STEP_EXECUTED_AND_HALTED)
+        {
+            result.halted = true;
+            return result;
+        }
+        // a branch ends the basic block, the next instruction starts a new one
+        blockStart = ins.opcode == 4 || ins.opcode == 7;
+    }
+    result.halted = ReadInstructionMemory(cpu, cpu->pc) == -1;
+    return result;
+}
+
+JITStats GetJITStats()
+{
+    return stats;
+}
@@ -0,0 +1,618 @@
+/**
+ * @file Lockstep.c
+ * @brief Lockstep execution of many instances of one program on SIMD byte lanes.
+ *
+ * The lane types are GCC vector extensions of LOCKSTEP_LANES elements: the compiler
+ * turns every operation on them into AVX2 (one instruction per 32 instances) or SSE2
+ * (two instructions) code, depending on the target. Masks are vectors of 0xFF (lane
+ * selected) and 0x00 lanes, and every update is a blend under the mask of the
+ * instances that execute the current instruction.
+ */
+
+#include "../Headers/Lockstep.h"
+#include "../Headers/Flags.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Registers.h"
+#include "../Headers/State.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t LaneBytes __attribute__((vector_size(LOCKSTEP_LANES)));         // one byte per instance
+typedef int8_t LaneSigned __attribute__((vector_size(LOCKSTEP_LANES)));         // the same bytes, signed
+typedef uint16_t LaneWords __attribute__((vector_size(LOCKSTEP_LANES * 2)));    // one PC per instance
+typedef int16_t LaneWordMask __attribute__((vector_size(LOCKSTEP_LANES * 2)));  // a mask widened to PCs
+typedef uint64_t LaneCounts __attribute__((vector_size(LOCKSTEP_LANES * 8)));   // one counter per instance
+typedef int64_t LaneCountMask __attribute__((vector_size(LOCKSTEP_LANES * 8))); // a mask widened to counters
+
+struct LockstepGroup {
+    CPU *program;         // holds the shared instruction memory
+    size_t instances;     // number of instances
+    size_t chunks;        // groups of LOCKSTEP_LANES instances
+    LaneBytes *registers; // [64][chunks]: register k of every instance is contiguous
+    LaneBytes *memory;    // [2048][chunks]: data memory byte a of every instance is contiguous
+    LaneBytes *sreg;      // [chunks]
+    LaneWords *pc;        // [chunks]
+    LaneBytes *present;   // [chunks]: 0xFF for the lanes that hold an instance
+    LaneBytes *running;   // [chunks]: 0xFF while the instance has not ended or run out of budget
+    LaneBytes *halted;    // [chunks]: 0xFF once the program of the instance ended
+    LaneCounts *executed; // [chunks]: instructions executed in the last run (without pending)
+    LaneWords *pending;   // [chunks]: instructions executed since the last FlushCounts
+    LaneBytes *mask;      // [chunks]: scratch, the instances executing the current instruction
+    LaneBytes *taken;     // [chunks]: scratch, the instances whose branch is taken
+};
+
+#define REGISTER(group, reg, chunk) ((group)->registers[(size_t)(reg) * (group)->chunks + (chunk)])
+#define MEMORY(group, address, chunk) ((group)->memory[(size_t)(address) * (group)->chunks + (chunk)])
+#define LANE(vector, instance) (((uint8_t *)&(vector)[(instance) / LOCKSTEP_LANES])[(instance) % LOCKSTEP_LANES])
+#define LANE_PC(group, instance) (((uint16_t *)&(group)->pc[(instance) / LOCKSTEP_LANES])[(instance) % LOCKSTEP_LANES])
+#define LANE_COUNT(group, instance) (((uint64_t *)&(group)->executed[(instance) / LOCKSTEP_LANES])[(instance) % LOCKSTEP_LANES])
+
+// the lane helpers are macros: lane vectors are never passed to or returned from functions
+#define BLEND(oldValue, newValue, mask) (((newValue) & (mask)) | ((oldValue) & ~(mask)))
+#define WIDEN_TO_WORDS(mask) ((LaneWords)__builtin_convertvector((LaneSigned)(mask), LaneWordMask))
+#define WIDEN_TO_COUNTS(mask) ((LaneCounts)__builtin_convertvector((LaneSigned)(mask), LaneCountMask))
+#define NARROW_WORDS(mask) ((LaneBytes)__builtin_convertvector((LaneWordMask)(mask), LaneSigned))
+#define WIDEN_WORDS_TO_COUNTS(words) ((LaneCounts)__builtin_convertvector((LaneWords)(words), LaneCounts))
+#define NARROW_COUNTS(mask) ((LaneBytes)__builtin_convertvector((LaneCountMask)(mask), LaneSigned))
+
+/*
+ * The functions doing the lane work are inlined into the run loop, which is compiled
+ * twice on x86-64, for AVX2 and for the SSE2 baseline; RunLockstep picks the version
+ * the CPU supports with __builtin_cpu_supports. (target_clones would pick it in an
+ * ifunc resolver, which runs before ThreadSanitizer is initialised and crashes it.)
+ */
+#if defined(__x86_64__) && defined(__linux__)
+#define LOCKSTEP_AVX2
+#endif
+#define LANE_INLINE inline __attribute__((always_inline))
+
+// Function to tell whether any lane of a mask is selected
+static inline bool Any(const LaneBytes *mask)
+{
+    uint64_t words[LOCKSTEP_LANES / 8];
+    memcpy(words, mask, sizeof(words));
+    uint64_t any = 0;
+    for (size_t i = 0; i < LOCKSTEP_LANES / 8; i++)
+    {
+        any |= words[i];
+    }
+    return any != 0;
+}
+
+// Function to allocate zeroed, cache line aligned lane storage
+static void *AllocLanes(size_t bytes)
+{
+    size_t size = (bytes + 63) & ~(size_t)63;
+    void *lanes = aligned_alloc(64, size);
+    if (lanes != NULL)
+    {
+        memset(lanes, 0, size);
+    }
+    return lanes;
+}
+
+LockstepGroup *CreateLockstepGroup(CPU *program, size_t instances)
+{
+    LockstepGroup *group = calloc(1, sizeof(LockstepGroup));
+    if (group == NULL || instances == 0)
+    {
+        free(group);
+        return NULL;
+    }
+    size_t chunks = (instances + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES;
+    group->program = program;
+    group->instances = instances;
+    group->chunks = chunks;
+    group->registers = AllocLanes(64 * chunks * sizeof(LaneBytes));
+    group->memory = AllocLanes(2048 * chunks * sizeof(LaneBytes));
+    group->sreg = AllocLanes(chunks * sizeof(LaneBytes));
+    group->pc = AllocLanes(chunks * sizeof(LaneWords));
+    group->present = AllocLanes(chunks * sizeof(LaneBytes));
+    group->running = AllocLanes(chunks * sizeof(LaneBytes));
+    group->halted = AllocLanes(chunks * sizeof(LaneBytes));
+    group->executed = AllocLanes(chunks * sizeof(LaneCounts));
+    group->pending = AllocLanes(chunks * sizeof(LaneWords));
+    group->mask = AllocLanes(chunks * sizeof(LaneBytes));
+    group->taken = AllocLanes(chunks * sizeof(LaneBytes));
+    if (group->registers == NULL || group->memory == NULL || group->sreg == NULL || group->pc == NULL ||
+        group->present == NULL || group->running == NULL || group->halted == NULL ||
+        group->executed == NULL || group->pending == NULL || group->mask == NULL || group->taken == NULL)
+    {
+        DestroyLockstepGroup(group);
+        return NULL;
+    }
+    for (size_t i = 0; i < instances; i++)
+    {
+        LANE(group->present, i) = 0xFF;
+        LockstepSetInstance(group, i, program);
+    }
+    return group;
+}
+
+void DestroyLockstepGroup(LockstepGroup *group)
+{
+    if (group == NULL)
+    {
+        return;
+    }
+    free(group->registers);
+    free(group->memory);
+    free(group->sreg);
+    free(group->pc);
+    free(group->present);
+    free(group->running);
+    free(group->halted);
+    free(group->executed);
+    free(group->pending);
+    free(group->mask);
+    free(group->taken);
+    free(group);
+}
+
+void LockstepSetInstance(LockstepGroup *group, size_t instance, const CPU *image)
+{
+    for (int k = 0; k < 64; k++)
+    {
+        LANE(&REGISTER(group, k, 0), instance) = (uint8_t)image->generalRegisters[k];
+    }
+    for (int a = 0; a < 2048; a++)
+    {
+        LANE(&MEMORY(group, a, 0), instance) = (uint8_t)PageReadData(image, (uint16_t)a);
+    }
+    LANE(group->sreg, instance) = ReadStatusRegister(image);
+    LANE_PC(group, instance) = image->pc;
+    LANE(group->halted, instance) = 0;
+}
+
+void LockstepGetInstance(const LockstepGroup *group, size_t instance, CPU *cpu)
+{
+    for (int k = 0; k < 64; k++)
+    {
+        cpu->generalRegisters[k] = (int8_t)LANE(&REGISTER(group, k, 0), instance);
+    }
+    MarkLoadedRegisters(cpu);
+    int8_t data[2048];
+    for (int a = 0; a < 2048; a++)
+    {
+        data[a] = (int8_t)LANE(&MEMORY(group, a, 0), instance);
+    }
+    WriteDataMemoryBlock(cpu, 0, data, sizeof(data));
+    WriteStatusRegister(cpu, LANE(group->sreg, instance));
+    cpu->pc = LANE_PC(group, instance);
+}
+
+EngineResult LockstepInstanceResult(const LockstepGroup *group, size_t instance)
+{
+    EngineResult result = {LANE_COUNT(group, instance), LANE(group->halted, instance) != 0};
+    return result;
+}
+
+// Function to execute a non-branch instruction for the lanes selected by the mask (ALU.c semantics)
+static LANE_INLINE void ExecuteLanes(LockstepGroup *group, Instruction ins, const LaneBytes *mask)
+{
+    size_t chunks = group->chunks;
+    uint8_t r1 = ins.operand1;
+    uint8_t r2 = ins.operand2;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        LaneBytes m = mask[c];
+        LaneBytes a = REGISTER(group, r1, c);
+        LaneBytes result;
+        LaneBytes flags = {0}; // the new flag bits
+        uint8_t flagMask = 0;  // the flag bits the instruction updates
+        switch (ins.opcode)
+        {
+        case 0:
+        {
+            LaneBytes b = REGISTER(group, r2, c);
+            result = a + b;
+            LaneSigned sa = (LaneSigned)a, sb = (LaneSigned)b, sr = (LaneSigned)result;
+            LaneBytes carry = (LaneBytes)(result < a);
+            LaneBytes overflow = (LaneBytes)(((sa > 0) & (sb > 0) & (sr < 0)) | ((sa < 0) & (sb < 0) & (sr > 0)));
+            LaneBytes zero = (LaneBytes)(sr == 0);
+            flags = (carry & FLAG_C) | (overflow & FLAG_V) | ((LaneBytes)(sr < 0) & FLAG_N) | (zero & (FLAG_S | FLAG_Z));
+            flagMask = FLAG_C | FLAG_V | FLAG_N | FLAG_S | FLAG_Z;
+            break;
+        }
+        case 1:
+        {
+            LaneBytes b = REGISTER(group, r2, c);
+            result = a - b;
+            LaneSigned sa = (LaneSigned)a, sb = (LaneSigned)b, sr = (LaneSigned)result;
+            LaneBytes overflow = (LaneBytes)(((sa < 0) & (sb > 0) & (sr > 0)) | ((sa > 0) & (sb < 0) & (sr < 0)));
+            LaneBytes zero = (LaneBytes)(sr == 0);
+            flags = (overflow & FLAG_V) | ((LaneBytes)(sr < 0) & FLAG_N) | (zero & (FLAG_S | FLAG_Z));
+            flagMask = FLAG_V | FLAG_N | FLAG_S | FLAG_Z;
+            break;
+        }
+        case 2:
+            result = a * REGISTER(group, r2, c);
+            break;
+        case 3:
+            result = (LaneBytes){0} + (uint8_t)ins.value2;
+            break;
+        case 5:
+            result = a & (uint8_t)ins.value2;
+            break;
+        case 6:
+            result = a ^ REGISTER(group, r2, c);
+            break;
+        case 8:
+        {
+            // the register is shifted as an int: counts of 8 or more leave nothing in the low byte
+            int count = ins.value2 & 31;
+            result = count >= 8 ? (LaneBytes){0} : a << count;
+            break;
+        }
+        case 9:
+        {
+            // counts of 8 or more fill the byte with the sign
+            int count = ins.value2 & 31;
+            result = (LaneBytes)((LaneSigned)a >> (count > 7 ? 7 : count));
+            break;
+        }
+        case 10:
+            result = MEMORY(group, (uint8_t)ins.value2, c);
+            break;
+        case 11:
+            MEMORY(group, (uint8_t)ins.value2, c) = BLEND(MEMORY(group, (uint8_t)ins.value2, c), a, m);
+            continue;
+        default:
+            continue; // opcodes 12-15 do nothing
+        }
+        if (ins.opcode == 2 || ins.opcode == 5 || ins.opcode == 6 || ins.opcode == 8 || ins.opcode == 9)
+        {
+            LaneSigned sr = (LaneSigned)result;
+            flags = ((LaneBytes)(sr < 0) & FLAG_N) | ((LaneBytes)(sr == 0) & FLAG_Z);
+            flagMask = FLAG_N | FLAG_Z;
+        }
+        REGISTER(group, r1, c) = BLEND(a, result, m);
+        if (flagMask != 0)
+        {
+            LaneBytes sreg = group->sreg[c];
+            group->sreg[c] = BLEND(sreg, (sreg & (uint8_t)~flagMask) | flags, m);
+        }
+    }
+}
+
+// Function to find the lowest PC of the running instances
+static LANE_INLINE bool LowestPC(const LockstepGroup *group, uint16_t *lowest)
+{
+    LaneWords minimum = (LaneWords){0} + 0xFFFF;
+    bool any = false;
+    for (size_t c = 0; c < group->chunks; c++)
+    {
+        LaneBytes running = group->running[c];
+        if (!Any(&running))
+        {
+            continue;
+        }
+        any = true;
+        LaneWords wide = WIDEN_TO_WORDS(running);
+        LaneWords pcs = (group->pc[c] & wide) | (~wide & 0xFFFF);
+        LaneWords smaller = (LaneWords)(pcs < minimum);
+        minimum = (pcs & smaller) | (minimum & ~smaller);
+    }
+    uint16_t lanes[LOCKSTEP_LANES];
+    memcpy(lanes, &minimum, sizeof(lanes));
+    *lowest = 0xFFFF;
+    for (size_t i = 0; i < LOCKSTEP_LANES; i++)
+    {
+        *lowest = lanes[i] < *lowest ? lanes[i] : *lowest;
+    }
+    return any;
+}
+
+// Function to select the running instances at the given PC; returns true if that is all of them
+static LANE_INLINE bool SelectLanes(LockstepGroup *group, uint16_t pc)
+{
+    bool all = true;
+    for (size_t c = 0; c < group->chunks; c++)
+    {
+        LaneBytes atPC = NARROW_WORDS(group->pc[c] == pc);
+        LaneBytes elsewhere = group->running[c] & ~atPC;
+        group->mask[c] = group->running[c] & atPC;
+        all = all && !Any(&elsewhere);
+    }
+    return all;
+}
+
+// Function to write the common PC of the converged instances back to their lanes and count their instructions
+static LANE_INLINE void Materialize(LockstepGroup *group, uint16_t pc, uint64_t steps)
+{
+    for (size_t c = 0; c < group->chunks; c++)
+    {
+        LaneWords wide = WIDEN_TO_WORDS(group->running[c]);
+        group->pc[c] = (((LaneWords){0} + pc) & wide) | (group->pc[c] & ~wide);
+        group->executed[c] += WIDEN_TO_COUNTS(group->running[c]) & steps;
+    }
+}
+
+// Function to add the pending 16-bit instruction counts to the 64-bit counters
+static LANE_INLINE void FlushCounts(LockstepGroup *group)
+{
+    for (size_t c = 0; c < group->chunks; c++)
+    {
+        group->executed[c] += WIDEN_WORDS_TO_COUNTS(group->pending[c]);
+        group->pending[c] = (LaneWords){0};
+    }
+}
+
+// Function to stop the instances that have used up their budget (the counters must be flushed); returns the highest count of the running instances
+static LANE_INLINE uint64_t StopAtBudget(LockstepGroup *group, uint64_t budget)
+{
+    uint64_t most = 0;
+    for (size_t c = 0; c < group->chunks; c++)
+    {
+        LaneBytes exhausted = NARROW_COUNTS(group->executed[c] >= budget);
+        group->running[c] &= ~exhausted;
+        LaneCounts counts = group->executed[c] & WIDEN_TO_COUNTS(group->running[c]);
+        for (size_t i = 0; i < LOCKSTEP_LANES; i++)
+        {
+            most = counts[i] > most ? counts[i] : most;
+        }
+    }
+    return most;
+}
+
+// Function to compute the taken lanes of a BEQZ; sets *anyTaken and *anyNotTaken
+static LANE_INLINE void BranchLanes(LockstepGroup *group, Instruction ins, bool *anyTaken, bool *anyNotTaken)
+{
+    *anyTaken = false;
+    *anyNotTaken = false;
+    for (size_t c = 0; c < group->chunks; c++)
+    {
+        LaneBytes m = group->mask[c];
+        LaneBytes taken = m & (LaneBytes)(REGISTER(group, ins.operand1, c) == 0);
+        LaneBytes notTaken = m & ~taken;
+        group->taken[c] = taken;
+        *anyTaken = *anyTaken || Any(&taken);
+        *anyNotTaken = *anyNotTaken || Any(&notTaken);
+    }
+}
+
+// Function to move the selected lanes on (taken lanes to their target, the others to the next row) and count their instruction
+static LANE_INLINE void AdvanceLanes(LockstepGroup *group, uint16_t next, uint16_t target)
+{
+    for (size_t c = 0; c < group->chunks; c++)
+    {
+        LaneBytes m = group->mask[c];
+        LaneWords selected = WIDEN_TO_WORDS(m);
+        LaneWords taken = WIDEN_TO_WORDS(group->taken[c]);
+        LaneWords newPC = (((LaneWords){0} + target) & taken) | (((LaneWords){0} + next) & ~taken);
+        group->pc[c] = (newPC & selected) | (group->pc[c] & ~selected);
+        group->pending[c] -= selected; // selected lanes are all ones, -1
+    }
+}
+
+// Function to end the selected lanes whose branch was taken (a taken branch that ends the program)
+static LANE_INLINE void HaltTaken(LockstepGroup *group)
+{
+    for (size_t c = 0; c < group->chunks; c++)
+    {
+        group->halted[c] |= group->taken[c];
+        group->running[c] &= ~group->taken[c];
+    }
+}
+
+// Function to compute the BR target of every selected lane into the taken mask and the PC lanes; returns true if all targets agree
+static bool BranchRegisterTargets(LockstepGroup *group, Instruction ins, uint16_t *common)
+{
+    bool same = true;
+    bool first = true;
+    for (size_t i = 0; i < group->instances; i++)
+    {
+        if (LANE(group->mask, i) == 0)
+        {
+            continue;
+        }
+        int8_t high = (int8_t)LANE(&REGISTER(group, ins.operand1, 0), i);
+        int8_t low = (int8_t)LANE(&REGISTER(group, ins.operand2, 0), i);
+        uint16_t target = BranchRegisterTarget(high, low);
+        LANE_PC(group, i) = target;
+        if (first)
+        {
+            *common = target;
+            first = false;
+        }
+        same = same && target == *common;
+    }
+    return same;
+}
+
+// Function to run the instances until all have ended or used up their budget, inlined into each target's version
+static LANE_INLINE LockstepStats RunLanes(LockstepGroup *group, uint64_t maxInstructions)
+{
+    LockstepStats stats = {0, 0, 0, 0, 0};
+    uint64_t budget = maxInstructions == 0 ? UINT64_MAX : maxInstructions;
+    CPU *program = group->program;
+    for (size_t c = 0; c < group->chunks; c++)
+    {
+        group->running[c] = group->present[c] & ~group->halted[c];
+        group->executed[c] = (LaneCounts){0};
+        group->pending[c] = (LaneWords){0};
+    }
+
+    bool converged = false; // all running lanes are at pc; their PC lanes and counters are not updated
+    bool split = false;     // the lanes went different ways since they were last converged
+    uint16_t pc = 0;
+    uint64_t steps = 0;     // steps executed since the lanes converged
+    uint64_t limit = 0;     // steps the converged lanes may execute before one reaches the budget
+    uint64_t bound = 0;     // no running lane has executed more instructions than this
+    uint32_t unflushed = 0; // divergent steps since the pending counters were flushed
+    for (;;)
+    {
+        if (!converged)
+        {
+            if (!LowestPC(group, &pc))
+            {
+                break;
+            }
+            if (SelectLanes(group, pc))
+            {
+                // every running instance is at this PC: run them as one until they diverge
+                converged = true;
+                stats.reconvergences += split;
+                split = false;
+                steps = 0;
+                FlushCounts(group);
+                unflushed = 0;
+                bound = StopAtBudget(group, budget);
+                limit = budget - bound;
+                memcpy(group->mask, group->running, group->chunks * sizeof(LaneBytes));
+            }
+        }
+
+        if (ReadInstructionMemory(program, pc) == -1)
+        {
+            // an empty row ends the program of every instance that reaches it
+            if (converged)
+            {
+                Materialize(group, pc, steps);
+                bound += steps;
+                converged = false;
+            }
+            for (size_t c = 0; c < group->chunks; c++)
+            {
+                group->halted[c] |= group->mask[c];
+                group->running[c] &= ~group->mask[c];
+            }
+            continue;
+        }
+
+        Instruction ins = GetPredecodedInstruction(program, pc);
+        stats.steps++;
+        stats.divergentSteps += !converged;
+        uint16_t next = pc + 1;
+        if (ins.opcode == 4 || ins.opcode == 7)
+        {
+            uint16_t executePC = GetExecutePC(program, pc);
+            bool halts = executePC != pc + 3;
+            if (ins.opcode == 4)
+            {
+                uint16_t target = (uint16_t)(executePC + ins.value2 - 1);
+                bool anyTaken, anyNotTaken;
+                BranchLanes(group, ins, &anyTaken, &anyNotTaken);
+                if (converged && !(anyTaken && anyNotTaken) && !(anyTaken && halts))
+                {
+                    pc = anyTaken ? target : next;
+                    steps++;
+                }
+                else
+                {
+                    if (converged)
+                    {
+                        Materialize(group, pc, steps);
+                        bound += steps;
+                        converged = false;
+                    }
+                    stats.splits += anyTaken && anyNotTaken;
+                    split = split || (anyTaken && anyNotTaken);
+                    AdvanceLanes(group, next, target);
+                    if (halts)
+                    {
+                        HaltTaken(group);
+                    }
+                }
+            }
+            else
+            {
+                // BR: every lane is taken, but the targets come from the registers
+                if (converged)
+                {
+                    Materialize(group, pc, steps);
+                    bound += steps;
+                    converged = false;
+                }
+                uint16_t common;
+                bool same = BranchRegisterTargets(group, ins, &common);
+                stats.splits += !same;
+                split = split || !same;
+                for (size_t c = 0; c < group->chunks; c++)
+                {
+                    group->pending[c] -= WIDEN_TO_WORDS(group->mask[c]);
+                    group->taken[c] = group->mask[c];
+                }
+                if (halts)
+                {
+                    HaltTaken(group);
+                }
+            }
+        }
+        else
+        {
+            ExecuteLanes(group, ins, group->mask);
+            if (converged)
+            {
+                pc = next;
+                steps++;
+            }
+            else
+            {
+                memset(group->taken, 0, group->chunks * sizeof(LaneBytes));
+                AdvanceLanes(group, next, next);
+            }
+        }
+
+        if (converged && steps == limit)
+        {
+            Materialize(group, pc, steps);
+            bound += steps;
+            converged = false;
+        }
+        if (!converged)
+        {
+            // every divergent step adds at most one instruction to a lane: check the budget only when it may be reached
+            if (++unflushed == 0xFFFF)
+            {
+                FlushCounts(group);
+                unflushed = 0;
+            }
+            if (++bound >= budget)
+            {
+                FlushCounts(group);
+                unflushed = 0;
+                bound = StopAtBudget(group, budget);
+            }
+        }
+    }
+
+    FlushCounts(group);
+    for (size_t i = 0; i < group->instances; i++)
+    {
+        // an instance stopped by the budget on an empty row has ended as well
+        if (ReadInstructionMemory(program, LANE_PC(group, i)) == -1)
+        {
+            LANE(group->halted, i) = 0xFF;
+        }
+        stats.instructions += LANE_COUNT(group, i);
+    }
+    return stats;
+}
+
+#ifdef LOCKSTEP_AVX2
+__attribute__((target("avx2"))) static LockstepStats RunLanesAVX2(LockstepGroup *group, uint64_t maxInstructions)
+{
+    return RunLanes(group, maxInstructions);
+}
+#endif
+
+static LockstepStats RunLanesBaseline(LockstepGroup *group, uint64_t maxInstructions)
+{
+    return RunLanes(group, maxInstructions);
+}
+
+LockstepStats RunLockstep(LockstepGroup *group, uint64_t maxInstructions)
+{
+#ifdef LOCKSTEP_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return RunLanesAVX2(group, maxInstructions);
+    }
+#endif
+    return RunLanesBaseline(group, maxInstructions);
+}
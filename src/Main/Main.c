@@ -3,209 +3,1090 @@
  * @brief This file contains the main function and related functions for the computer processor simulation.
  */
 
+#include "../Headers/Batch.h"
+#include "../Headers/Cache.h"
+#include "../Headers/CPU.h"
+#include "../Headers/Checkpoint.h"
+#include "../Headers/Counters.h"
+#include "../Headers/Engine.h"
+#include "../Headers/Image.h"
 #include "../Headers/InstructionMemory.h"
+#include "../Headers/JIT.h"
+#include "../Headers/Lockstep.h"
+#include "../Headers/OutOfOrder.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Predictor.h"
+#include "../Headers/Sampling.h"
+#include "../Headers/Stages.h"
+#include "../Headers/State.h"
+#include "../Headers/Trace.h"
+#include "../Headers/TraceWriter.h"
 
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-int MaxClockCycles;                      // Global variable in main.c gets init in load program function after the while loop
-int clockcycles = 1;                     // global var to track the current clock cycle for the program
-extern int16_t instruction_memory[1024]; /**< External array representing the instruction memory. */
-extern FetchedInstruction pipeline1;     /**< External variable representing the first pipeline stage. */
-extern PipelineStage pipeline2;          /**< External variable representing the second pipeline stage. */
-extern PipelineStage pipeline3;          /**< External variable representing the third pipeline stage. */
-extern PipelineStage pipeline4;          /**< External variable representing the fourth pipeline stage. */
-extern int8_t data_memory[2048];         /**< External array representing the data memory. */
-extern int8_t generalRegisters[64];      /**< External array representing the registers. */
-extern uint8_t SREG;                     /**< External array representing the status register. SREG[0] = C, SREG[1] = V, SREG[2] = N, SREG[3] = S, SREG[4] = Z */
-extern uint16_t pc;                      /**< External variable representing the program counter. */
-
-// Function to convert opcode string to corresponding opcode value
-uint8_t incodeOpcode(char *opcode)
+/**
+ * @brief Prints the command line usage and exits.
+ *
+ * @param program The name the simulator was started with.
+ */
+void PrintUsage(char *program)
+{
+    printf("Usage: %s [--engine <pipeline|switch|threaded|jit|ooo>] [--max-instructions <n>] [--jit-threshold <n>] [--trace-level <0-3>] [--trace-file <file|->] [--trace-raw | --trace-compact] [--trace-drop] [--checkpoint-every <cycles> [--checkpoint-prefix <path>]] [--fast-forward <n>] [--fast-forward-pc <address>] [--fast-forward-cycle <cycle>] [--predictor <not-taken|backward-taken|bimodal>] [--btb <entries>] [--branch-resolution <execute|decode>] [--cache <bytes,ways,line> [--cache-write <write-back|write-through>] [--cache-replacement <lru|plru>] [--l2 <bytes,ways,line>] [--l2-latency <cycles>] [--memory-latency <cycles>]] [--stages <3|5|F,D,E,M,W> [--forwarding <none|ex,mem,regfile>]] [--rob <entries>] [--rs <entries>] [--issue-width <n>] [--stats] [--stats-json <file>] [--callgrind <file>] [--state-format <text|json|binary>] [--state-file <file>] [--diff-against <state file|checkpoint>] <assembly file | --restore <checkpoint>>\n", program);
+    printf("       %s --sample-every <instructions> [--sample-cycles <cycles>] [--max-instructions <n>] <assembly file>\n", program);
+    printf("       %s --batch <directory> [-j <workers>] [--engine <...>] [--max-instructions <n>] [--jit-threshold <n>]\n", program);
+    printf("       %s --sweep R<k> [--max-instructions <n>] <assembly file>\n", program);
+    printf("       %s assemble [--data <file>] [--registers <file>] [--no-predecode] <assembly file> <image file>\n", program);
+    printf("  --engine pipeline   simulate the 3 stage pipeline cycle by cycle (default)\n");
+    printf("  --engine switch     only execute the instructions, one execute() call each (no per-cycle trace)\n");
+    printf("  --engine threaded   only execute the instructions as direct-threaded code (no per-cycle trace)\n");
+    printf("  --engine jit        interpret and compile hot basic blocks to x86-64 code (no per-cycle trace)\n");
+    printf("  --engine ooo        simulate an out-of-order core with register renaming, reservation stations and a reorder buffer cycle by cycle (no per-cycle trace)\n");
+    printf("  --max-instructions  stop the engine after this many instructions\n");
+    printf("  --jit-threshold     basic block entries before the jit compiles a block (default %d)\n", JIT_DEFAULT_THRESHOLD);
+    printf("  --trace-level 0  only print the final state of registers and memories\n");
+    printf("  --trace-level 1  also print the pipeline stages of every clock cycle\n");
+    printf("  --trace-level 2  also print register, PC and data memory updates\n");
+    printf("  --trace-level 3  also print every flag update (default)\n");
+    printf("  --trace-file     write the trace from a separate writer thread to a file (- for the console)\n");
+    printf("  --trace-raw      write raw 16 byte trace records instead of text (needs --trace-file)\n");
+    printf("  --trace-compact  write a compact delta-encoded trace with keyframes and an index, read back by trace_tool (needs --trace-file)\n");
+    printf("  --trace-drop     drop trace records when the writer falls behind instead of waiting for it (not with --trace-compact)\n");
+    printf("  --checkpoint-every  save the whole machine state every this many clock cycles (pipeline engine)\n");
+    printf("  --checkpoint-prefix checkpoints are written to <path>.<cycle> (default checkpoint)\n");
+    printf("  --restore        continue the run saved in a checkpoint instead of loading a program (pipeline engine)\n");
+    printf("  --fast-forward      execute this many instructions without the pipeline before simulating it in detail\n");
+    printf("  --fast-forward-pc   fast-forward until the instruction at this address is about to execute\n");
+    printf("  --fast-forward-cycle fast-forward until the pipeline would have reached this clock cycle\n");
+    printf("  --predictor         branch prediction in the fetch stage: not-taken (default, every taken branch flushes), backward-taken or bimodal 2-bit counters\n");
+    printf("  --btb               entries (1 to %d, a power of two) of a branch target buffer predicting BR targets\n", PREDICTOR_MAX_BTB_ENTRIES);
+    printf("  --branch-resolution resolve BEQZ/BR in execute (default, as in Expected-Output.md) or in decode, which reads the register (forwarded from execute) and saves a cycle per taken branch\n");
+    printf("  --cache             put a data cache of this capacity, associativity and line size (powers of two) in front of the data memory; an LDR or STR miss stalls execute (pipeline engine)\n");
+    printf("  --cache-write       write-back (default, stores allocate) or write-through (stores go to the next level through a write buffer)\n");
+    printf("  --cache-replacement lru (default) or plru (tree pseudo-LRU) replacement in every cache level\n");
+    printf("  --l2                add a second cache level of this capacity, associativity and line size\n");
+    printf("  --l2-latency        cycles an L1 miss waits for the second level (default %d)\n", CACHE_DEFAULT_L2_LATENCY);
+    printf("  --memory-latency    cycles a miss waits for main memory (default %d)\n", CACHE_DEFAULT_MEMORY_LATENCY);
+    printf("  --stages            simulate a pipeline of this shape instead: 3 (IF/ID/EX), 5 (IF/ID/EX/MEM/WB) or the number of fetch, decode, execute, memory and write back stages (up to %d in total)\n", STAGES_MAX);
+    printf("  --forwarding        forwarding paths of --stages: ex (EX to EX), mem (MEM/WB to EX), regfile (write back before decode reads), none (default: all)\n");
+    printf("  --issue-width       instructions fetched and issued per cycle by --stages (default 1); 2 issues independent pairs in order and reports the IPC (alone it implies --stages 3). With --engine ooo: fetch, dispatch and commit width and ALUs, 1 to %d (default %d)\n", OOO_MAX_WIDTH, ((OutOfOrderConfig)OOO_DEFAULT_CONFIG).width);
+    printf("  --rob               reorder buffer entries of --engine ooo, 1 to %d (default %d)\n", OOO_MAX_ROB, ((OutOfOrderConfig)OOO_DEFAULT_CONFIG).robEntries);
+    printf("  --rs                reservation station entries per functional unit class of --engine ooo, 1 to %d (default %d)\n", OOO_MAX_RS, ((OutOfOrderConfig)OOO_DEFAULT_CONFIG).rsEntries);
+    printf("  --stats             print the performance counters and the CPI stack after the final state (pipeline engine, or the hazard counts of --stages)\n");
+    printf("  --stats-json        write the performance counters to a JSON file (pipeline engine)\n");
+    printf("  --callgrind         write the executions and flush cycles of every program line in callgrind format (pipeline engine)\n");
+    printf("  --state-format      write the final state as text (default), JSON or a binary state file, listing only the locations that were written\n");
+    printf("  --state-file        write the final state to this file instead of the console\n");
+    printf("  --diff-against      write only what differs from the final state in a binary or JSON state file (--state-format binary or json) or a checkpoint\n");
+    printf("  --sample-every      estimate the clock cycles: fast-forward this many instructions between detailed samples\n");
+    printf("  --sample-cycles     clock cycles simulated in detail per sample (default 1000)\n");
+    printf("  --batch          run every *.txt program of the directory, writing the final state of each to <program>.out\n");
+    printf("  -j               worker threads of --batch (default: one per CPU)\n");
+    printf("  --sweep          run 256 instances in lockstep with R<k> set to -128..127, one result line each\n");
+    printf("  assemble         write a binary program image, loaded by copying instead of parsing (any command accepts it in place of an assembly file)\n");
+    printf("  --data           raw bytes for the initial data memory of the image (up to 2048)\n");
+    printf("  --registers      raw bytes for the initial registers R0.. of the image (up to 64)\n");
+    printf("  --no-predecode   leave the predecoded table out of the image (it is then predecoded when loaded)\n");
+    exit(1);
+}
+
+/**
+ * @brief Runs the loaded program once for every value of one register, all instances in lockstep.
+ *
+ * Prints one line per instance: the swept value, the executed instructions and the
+ * registers that are not zero at the end.
+ *
+ * @param cpu The processor holding the program.
+ * @param reg The register to sweep.
+ * @param maxInstructions The instruction budget of every instance, 0 for no limit.
+ */
+void RunSweep(CPU *cpu, int reg, uint64_t maxInstructions)
 {
-    if (strcmp(opcode, "ADD") == 0)
+    LockstepGroup *group = CreateLockstepGroup(cpu, 256);
+    if (group == NULL)
     {
-        return 0;
+        printf("Error: out of memory\n");
+        exit(1);
     }
-    else if (strcmp(opcode, "SUB") == 0)
+    for (int value = -128; value <= 127; value++)
     {
-        return 1;
+        cpu->generalRegisters[reg] = (int8_t)value;
+        LockstepSetInstance(group, value + 128, cpu);
     }
-    else if (strcmp(opcode, "MUL") == 0)
+
+    LockstepStats stats = RunLockstep(group, maxInstructions);
+
+    for (int value = -128; value <= 127; value++)
     {
-        return 2;
+        LockstepGetInstance(group, value + 128, cpu);
+        EngineResult result = LockstepInstanceResult(group, value + 128);
+        printf("R%d=%-4d %llu instructions%s:", reg, value, (unsigned long long)result.instructions,
+               result.halted ? "" : " (limit reached)");
+        for (int i = 0; i < 64; i++)
+        {
+            if (cpu->generalRegisters[i] != 0)
+            {
+                printf(" R%d=%d", i, cpu->generalRegisters[i]);
+            }
+        }
+        printf("\n");
     }
-    else if (strcmp(opcode, "MOVI") == 0)
+    fprintf(stderr, "Lockstep: %llu steps for %llu instructions, %llu divergent steps, %llu splits, %llu reconvergences\n",
+            (unsigned long long)stats.steps,
+            (unsigned long long)stats.instructions,
+            (unsigned long long)stats.divergentSteps,
+            (unsigned long long)stats.splits,
+            (unsigned long long)stats.reconvergences);
+    DestroyLockstepGroup(group);
+}
+
+/**
+ * @brief Runs the pipeline engine and saves a checkpoint every given number of clock cycles.
+ *
+ * The checkpoints are written to <prefix>.<cycle>, cycle being the number of clock
+ * cycles simulated so far.
+ *
+ * @param cpu The processor.
+ * @param maxInstructions Stop once this many instructions were executed, 0 for no limit.
+ * @param every The clock cycles between two checkpoints.
+ * @param prefix The file name prefix of the checkpoints.
+ * @return The number of executed instructions and whether the program ended.
+ */
+EngineResult RunPipelineWithCheckpoints(CPU *cpu, uint64_t maxInstructions, int every, const char *prefix)
+{
+    EngineResult total = {0, false};
+    for (;;)
     {
-        return 3;
+        int stopCycle = (cpu->clockcycles - 1) / every * every + every + 1;
+        EngineResult result = RunPipelineEngineUntil(cpu, maxInstructions == 0 ? 0 : maxInstructions - total.instructions, stopCycle);
+        total.instructions += result.instructions;
+        total.halted = result.halted;
+        if (result.halted || cpu->clockcycles != stopCycle)
+        {
+            return total;
+        }
+        char file_name[4096];
+        snprintf(file_name, sizeof(file_name), "%s.%d", prefix, cpu->clockcycles - 1);
+        if (!SaveCheckpoint(cpu, file_name))
+        {
+            printf("Error: could not write checkpoint %s\n", file_name);
+            printf("Exiting...\n");
+            exit(1);
+        }
+        if (maxInstructions != 0 && total.instructions >= maxInstructions)
+        {
+            return total;
+        }
     }
-    else if (strcmp(opcode, "BEQZ") == 0)
+}
+
+// Function to read up to size bytes of a raw file into buffer, exiting if it cannot be read
+static void ReadRawFile(const char *file_name, void *buffer, size_t size)
+{
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL)
     {
-        return 4;
+        printf("Error: could not open %s\n", file_name);
+        printf("Exiting...\n");
+        exit(1);
     }
-    else if (strcmp(opcode, "ANDI") == 0)
+    fread(buffer, 1, size, file);
+    fclose(file);
+}
+
+/**
+ * @brief Runs the assemble subcommand: assembles a program into a binary program image.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments, argv[1] being "assemble".
+ * @return 0 if the image was written.
+ */
+int RunAssemble(int argc, char *argv[])
+{
+    char *files[2] = {NULL, NULL};
+    int file_count = 0;
+    char *data_file = NULL;
+    char *register_file = NULL;
+    unsigned segments = IMAGE_SEGMENT_PREDECODED;
+    for (int i = 2; i < argc; i++)
     {
-        return 5;
+        if (strcmp(argv[i], "--data") == 0 && i + 1 < argc)
+        {
+            data_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--registers") == 0 && i + 1 < argc)
+        {
+            register_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-predecode") == 0)
+        {
+            segments &= ~IMAGE_SEGMENT_PREDECODED;
+        }
+        else if (argv[i][0] == '-' || file_count == 2)
+        {
+            PrintUsage(argv[0]);
+        }
+        else
+        {
+            files[file_count++] = argv[i];
+        }
     }
-    else if (strcmp(opcode, "EOR") == 0)
+    if (file_count != 2)
     {
-        return 6;
+        PrintUsage(argv[0]);
     }
-    else if (strcmp(opcode, "BR") == 0)
+
+    CPU *cpu = CreateCPU();
+    if (cpu == NULL)
     {
-        return 7;
+        printf("Error: out of memory\n");
+        exit(1);
     }
-    else if (strcmp(opcode, "SAL") == 0)
+    uint16_t program[ASSEMBLER_MAX_INSTRUCTIONS];
+    size_t count;
+    AssemblerError error;
+    if (!AssembleFile(files[0], program, &count, &error))
     {
-        return 8;
+        if (error.line > 0)
+        {
+            printf("Error: %s:%d:%d: %s\n", files[0], error.line, error.column, error.message);
+        }
+        else
+        {
+            printf("Error: Assembly file not found\n");
+        }
+        printf("Exiting...\n");
+        exit(1);
     }
-    else if (strcmp(opcode, "SAR") == 0)
+    for (size_t address = 0; address < count; address++)
     {
-        return 9;
+        WriteInstructionMemory(cpu, address, program[address]);
     }
-    else if (strcmp(opcode, "LDR") == 0)
+    if (data_file != NULL)
     {
-        return 10;
+        int8_t data[2048] = {0};
+        ReadRawFile(data_file, data, sizeof(data));
+        WriteDataMemoryBlock(cpu, 0, data, sizeof(data));
+        segments |= IMAGE_SEGMENT_DATA;
     }
-    else if (strcmp(opcode, "STR") == 0)
+    if (register_file != NULL)
     {
-        return 11;
+        ReadRawFile(register_file, cpu->generalRegisters, sizeof(cpu->generalRegisters));
+        segments |= IMAGE_SEGMENT_REGISTERS;
     }
-    else
+    if (!SaveImage(cpu, count, segments, files[1]))
     {
-        return -1;
+        printf("Error: could not write %s\n", files[1]);
+        printf("Exiting...\n");
+        exit(1);
     }
+    DestroyCPU(cpu);
+    return 0;
 }
 
 /**
- * @brief Loads the program from the given file into the instruction memory.
+ * @brief How the final state of a run is written.
+ */
+typedef struct {
+    StateFormat format; /**< Text, JSON or binary. */
+    char *file;         /**< The file to write, NULL for the console. */
+    CPU *reference;     /**< Only the differences from this state are written, NULL for the whole state. */
+} FinalState;
+
+/**
+ * @brief Writes the final state of the run, or its differences from the reference.
  *
- * @param file_name The name of the assembly file to load.
+ * @param cpu The processor.
+ * @param final_state Where and how to write it.
  */
-void LoadProgram(char *file_name)
+static void PrintFinalState(CPU *cpu, const FinalState *final_state)
 {
-    FILE *file = fopen(file_name, "r");
-    if (file == NULL)
+    FILE *out = stdout;
+    if (final_state->file != NULL)
     {
-        printf("Error: Assembly file not found\n");
-        printf("Please make sure the file exists\n");
+        out = fopen(final_state->file, final_state->format == STATE_FORMAT_BINARY ? "wb" : "w");
+        if (out == NULL)
+        {
+            printf("Error: could not write %s\n", final_state->file);
+            printf("Exiting...\n");
+            exit(1);
+        }
+    }
+    if (final_state->reference != NULL)
+    {
+        WriteStateDiff(cpu, final_state->reference, final_state->format, out);
+    }
+    else
+    {
+        WriteState(cpu, final_state->format, out);
+    }
+    if (out != stdout && fclose(out) != 0)
+    {
+        printf("Error: could not write %s\n", final_state->file);
         printf("Exiting...\n");
         exit(1);
     }
-    int address = 0;
-    /**
-     * This while loop continues until the end of the file is reached.
-     * It checks if the end-of-file indicator for the given file stream is set.
-     * The feof() function returns a non-zero value if the end-of-file indicator is set,
-     * and 0 otherwise.
-     */
-    while (!feof(file))
-    {
-
-        char opcode[5];
-        char operand1[4];
-        char operand2[4];
-        /**
-         * Reads three strings from the file using the specified format and stores them in the given variables.
-         *
-         * @param file The file to read from.
-         * @param opcode The variable to store the first string.
-         * @param operand1 The variable to store the second string.
-         * @param operand2 The variable to store the third string.
-         *
-         * @return The number of items successfully read and assigned, or EOF if an error occurred.
-         */
-        fscanf(file, "%4s %3s %3s", opcode, operand1, operand2);
-        // Convert the opcode string to an integer
-        uint8_t opcode_int = incodeOpcode(opcode); // encodes the opcode string to a 4-bit integer
-        // Convert the operand strings to integers
-        uint8_t operand1_int = atoi(operand1 + 1);
-        int8_t operand2_int;
-        switch (opcode_int)
-        {
-            case 0:
-            case 1:
-            case 2:
-            case 6:
-            case 7:
-                operand2_int = atoi(operand2 + 1);
-                break;
-            case 3:
-            case 4:
-            case 5:
-            case 8:
-            case 9:
-            case 10:
-            case 11:
-                operand2_int = atoi(operand2);
-                break;
-        }
-        // Print the opcode and operands
-        // printf("Opcode: %04b, Operand1: %06b, Operand2: %06b\n", opcode_int, operand1_int, operand2_int&0b111111);
-
-        // Combine the opcode and operands into a 16-bit instruction
-        uint16_t instruction = ((opcode_int & 0b1111) << 12) | ((operand1_int & 0b111111) << 6) | (operand2_int & 0b111111);
-        // printf("Instruction: %016b\n", instruction);
-        // Write the instruction to the instruction memory
-        WriteInstructionMemory(address, instruction);
-        address++;
+}
+
+/**
+ * @brief The command line options of a run.
+ */
+typedef struct {
+    char *fileName;                 /**< The assembly file or image to run, NULL with --restore or --batch. */
+    char *batchDirectory;           /**< Run every program of this directory (--batch), NULL for a single run. */
+    int batchWorkers;               /**< Worker threads of the batch, 0 for one per core. */
+    char *traceFile;                /**< The file the trace is written to, NULL for the console. */
+    TraceWriterFormat traceFormat;  /**< Text, raw or compact trace. */
+    TraceWriterPolicy tracePolicy;  /**< Block or drop when the trace writer falls behind. */
+    EngineKind engine;              /**< The engine to run. */
+    uint64_t maxInstructions;       /**< The instruction budget, 0 for no limit. */
+    uint32_t jitThreshold;          /**< Executions of a block before the JIT compiles it. */
+    bool traceRequested;            /**< A trace level above 0 or a trace file was given. */
+    int sweepRegister;              /**< The register --sweep runs every value of, -1 for none. */
+    char *restoreFile;              /**< The checkpoint to continue, NULL to load fileName. */
+    int checkpointEvery;            /**< Clock cycles between two checkpoints, 0 for none. */
+    char *checkpointPrefix;         /**< The file name prefix of the checkpoints. */
+    FastForwardTarget fastForward;  /**< Where fast-forwarding stops. */
+    bool fastForwardRequested;      /**< One of the --fast-forward options was given. */
+    uint64_t sampleEvery;           /**< Instructions between two samples, 0 for no sampling. */
+    int sampleCycles;               /**< Clock cycles of a sample. */
+    PredictorKind predictor;        /**< The branch predictor. */
+    int btbEntries;                 /**< Entries of the BTB, 0 for none. */
+    int resolveInDecode;            /**< 1 to resolve branches in decode, 0 in execute, -1 to keep the processor's. */
+    bool predictorRequested;        /**< One of the predictor options was given. */
+    bool printStats;                /**< --stats was given. */
+    char *statsJSONFile;            /**< The file the counters are written to as JSON, NULL for none. */
+    char *callgrindFile;            /**< The file the callgrind profile is written to, NULL for none. */
+    StageConfig stages;             /**< The shape of the staged pipeline. */
+    bool stagesRequested;           /**< The staged pipeline runs instead of the 3 stage one. */
+    bool forwardingRequested;       /**< --forwarding was given. */
+    long issueWidth;                /**< --issue-width, 0 if not given. */
+    CacheConfig cache;              /**< The data cache hierarchy. */
+    bool cacheRequested;            /**< --cache was given. */
+    bool cacheOptions;              /**< One of the other cache options was given. */
+    OutOfOrderConfig ooo;           /**< The out-of-order core. */
+    bool oooRequested;              /**< One of the out-of-order options was given. */
+    StateFormat stateFormat;        /**< The format of the final state. */
+    char *stateFile;                /**< The file the final state is written to, NULL for the console. */
+    char *diffFile;                 /**< The state to write the differences from, NULL for the whole state. */
+    bool stateRequested;            /**< One of the final state options was given. */
+    bool statsRequested;            /**< Any of the counter reports was asked for (set by ValidateOptions). */
+} MainOptions;
+
+/**
+ * @brief Parses the command line of a run, printing the usage and exiting on an unknown or malformed option.
+ *
+ * --trace-level sets the trace level as it is parsed.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @param options Receives the options, the defaults for the ones not given.
+ */
+static void ParseOptions(int argc, char *argv[], MainOptions *options)
+{
+    *options = (MainOptions){
+        .traceFormat = TRACE_WRITER_TEXT,
+        .tracePolicy = TRACE_WRITER_BLOCK,
+        .engine = ENGINE_PIPELINE,
+        .jitThreshold = JIT_DEFAULT_THRESHOLD,
+        .sweepRegister = -1,
+        .checkpointPrefix = "checkpoint",
+        .fastForward = {0, 0, -1},
+        .sampleCycles = 1000,
+        .predictor = PREDICTOR_NOT_TAKEN,
+        .resolveInDecode = -1,
+        .stages = {1, 1, 1, 0, 0, 1, FORWARD_ALL},
+        .cache = {{0, 0, 0}, {0, 0, 0}, CACHE_WRITE_BACK, CACHE_REPLACE_LRU, CACHE_DEFAULT_L2_LATENCY,
+                  CACHE_DEFAULT_MEMORY_LATENCY},
+        .ooo = OOO_DEFAULT_CONFIG,
+        .stateFormat = STATE_FORMAT_TEXT,
+    };
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--trace-level") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long level = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || level < TRACE_LEVEL_OFF || level > TRACE_LEVEL_FLAGS)
+            {
+                PrintUsage(argv[0]);
+            }
+            TraceSetLevel((TraceLevel)level);
+            options->traceRequested = level > TRACE_LEVEL_OFF;
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+        {
+            if (!ParseEngineKind(argv[++i], &options->engine))
+            {
+                PrintUsage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--max-instructions") == 0 && i + 1 < argc)
+        {
+            char *end;
+            options->maxInstructions = strtoull(argv[++i], &end, 10);
+            if (*end != '\0')
+            {
+                PrintUsage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--jit-threshold") == 0 && i + 1 < argc)
+        {
+            char *end;
+            unsigned long threshold = strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || threshold > UINT32_MAX)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->jitThreshold = (uint32_t)threshold;
+        }
+        else if (strcmp(argv[i], "--trace-file") == 0 && i + 1 < argc)
+        {
+            options->traceFile = argv[++i];
+            options->traceRequested = true;
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            options->batchDirectory = argv[++i];
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long workers = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || workers < 1 || workers > 1024)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->batchWorkers = (int)workers;
+        }
+        else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc)
+        {
+            char *end;
+            char *name = argv[++i];
+            long reg = strtol(name + (name[0] == 'R'), &end, 10);
+            if (name[0] != 'R' || *end != '\0' || end == name + 1 || reg < 0 || reg > 63)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->sweepRegister = (int)reg;
+        }
+        else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long cycles = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || cycles < 1 || cycles > 1000000000)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->checkpointEvery = (int)cycles;
+        }
+        else if (strcmp(argv[i], "--checkpoint-prefix") == 0 && i + 1 < argc)
+        {
+            options->checkpointPrefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fast-forward") == 0 && i + 1 < argc)
+        {
+            char *end;
+            options->fastForward.instructions = strtoull(argv[++i], &end, 10);
+            if (*end != '\0' || options->fastForward.instructions == 0)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->fastForwardRequested = true;
+        }
+        else if (strcmp(argv[i], "--fast-forward-pc") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long address = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || address < 0 || address > 1023)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->fastForward.pc = (int)address;
+            options->fastForwardRequested = true;
+        }
+        else if (strcmp(argv[i], "--fast-forward-cycle") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long cycle = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || cycle < 1 || cycle > 1000000000)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->fastForward.cycle = (int)cycle;
+            options->fastForwardRequested = true;
+        }
+        else if (strcmp(argv[i], "--sample-every") == 0 && i + 1 < argc)
+        {
+            char *end;
+            options->sampleEvery = strtoull(argv[++i], &end, 10);
+            if (*end != '\0' || options->sampleEvery == 0)
+            {
+                PrintUsage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--sample-cycles") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long cycles = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || cycles < 1 || cycles > 1000000000)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->sampleCycles = (int)cycles;
+        }
+        else if (strcmp(argv[i], "--predictor") == 0 && i + 1 < argc)
+        {
+            if (!ParsePredictorKind(argv[++i], &options->predictor))
+            {
+                PrintUsage(argv[0]);
+            }
+            options->predictorRequested = true;
+        }
+        else if (strcmp(argv[i], "--btb") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long entries = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || entries < 1 || entries > PREDICTOR_MAX_BTB_ENTRIES || (entries & (entries - 1)) != 0)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->btbEntries = (int)entries;
+            options->predictorRequested = true;
+        }
+        else if (strcmp(argv[i], "--branch-resolution") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "execute") != 0 && strcmp(argv[i], "decode") != 0)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->resolveInDecode = strcmp(argv[i], "decode") == 0;
+            options->predictorRequested = true;
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+        {
+            if (!ParseCacheGeometry(argv[++i], &options->cache.l1))
+            {
+                PrintUsage(argv[0]);
+            }
+            options->cacheRequested = true;
+        }
+        else if (strcmp(argv[i], "--cache-write") == 0 && i + 1 < argc)
+        {
+            CacheWritePolicy policy;
+            if (!ParseCacheWritePolicy(argv[++i], &policy))
+            {
+                PrintUsage(argv[0]);
+            }
+            options->cache.writePolicy = (uint8_t)policy;
+            options->cacheOptions = true;
+        }
+        else if (strcmp(argv[i], "--cache-replacement") == 0 && i + 1 < argc)
+        {
+            CacheReplacement replacement;
+            if (!ParseCacheReplacement(argv[++i], &replacement))
+            {
+                PrintUsage(argv[0]);
+            }
+            options->cache.replacement = (uint8_t)replacement;
+            options->cacheOptions = true;
+        }
+        else if (strcmp(argv[i], "--l2") == 0 && i + 1 < argc)
+        {
+            if (!ParseCacheGeometry(argv[++i], &options->cache.l2))
+            {
+                PrintUsage(argv[0]);
+            }
+            options->cacheOptions = true;
+        }
+        else if ((strcmp(argv[i], "--l2-latency") == 0 || strcmp(argv[i], "--memory-latency") == 0) && i + 1 < argc)
+        {
+            char *end;
+            long cycles = strtol(argv[i + 1], &end, 10);
+            if (*end != '\0' || cycles < 0 || cycles > 10000)
+            {
+                PrintUsage(argv[0]);
+            }
+            if (strcmp(argv[i], "--l2-latency") == 0)
+            {
+                options->cache.l2Latency = (uint16_t)cycles;
+            }
+            else
+            {
+                options->cache.memoryLatency = (uint16_t)cycles;
+            }
+            i++;
+            options->cacheOptions = true;
+        }
+        else if (strcmp(argv[i], "--stages") == 0 && i + 1 < argc)
+        {
+            if (!ParseStageConfig(argv[++i], &options->stages))
+            {
+                PrintUsage(argv[0]);
+            }
+            options->stagesRequested = true;
+        }
+        else if (strcmp(argv[i], "--forwarding") == 0 && i + 1 < argc)
+        {
+            if (!ParseForwarding(argv[++i], &options->stages.forwarding))
+            {
+                PrintUsage(argv[0]);
+            }
+            options->forwardingRequested = true;
+        }
+        else if (strcmp(argv[i], "--issue-width") == 0 && i + 1 < argc)
+        {
+            char *end;
+            options->issueWidth = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || options->issueWidth < 1 || options->issueWidth > OOO_MAX_WIDTH)
+            {
+                PrintUsage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--rob") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long entries = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || entries < 1 || entries > OOO_MAX_ROB)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->ooo.robEntries = (int)entries;
+            options->oooRequested = true;
+        }
+        else if (strcmp(argv[i], "--rs") == 0 && i + 1 < argc)
+        {
+            char *end;
+            long entries = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || entries < 1 || entries > OOO_MAX_RS)
+            {
+                PrintUsage(argv[0]);
+            }
+            options->ooo.rsEntries = (int)entries;
+            options->oooRequested = true;
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            options->printStats = true;
+        }
+        else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc)
+        {
+            options->statsJSONFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--callgrind") == 0 && i + 1 < argc)
+        {
+            options->callgrindFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--state-format") == 0 && i + 1 < argc)
+        {
+            if (!ParseStateFormat(argv[++i], &options->stateFormat))
+            {
+                PrintUsage(argv[0]);
+            }
+            options->stateRequested = true;
+        }
+        else if (strcmp(argv[i], "--state-file") == 0 && i + 1 < argc)
+        {
+            options->stateFile = argv[++i];
+            options->stateRequested = true;
+        }
+        else if (strcmp(argv[i], "--diff-against") == 0 && i + 1 < argc)
+        {
+            options->diffFile = argv[++i];
+            options->stateRequested = true;
+        }
+        else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc)
+        {
+            options->restoreFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace-raw") == 0)
+        {
+            options->traceFormat = TRACE_WRITER_RAW;
+        }
+        else if (strcmp(argv[i], "--trace-compact") == 0)
+        {
+            options->traceFormat = TRACE_WRITER_COMPACT;
+        }
+        else if (strcmp(argv[i], "--trace-drop") == 0)
+        {
+            options->tracePolicy = TRACE_WRITER_DROP;
+        }
+        else if (argv[i][0] == '-')
+        {
+            PrintUsage(argv[0]);
+        }
+        else
+        {
+            options->fileName = argv[i];
+        }
     }
-    fclose(file);
 }
 
 /**
- * @brief Resets the processor by resetting the data memory, instruction memory, and registers.
+ * @brief Checks that the options of a run go together, printing the usage and exiting if they do not.
+ *
+ * Also hands --issue-width to the staged pipeline or the out-of-order core, and sets
+ * statsRequested. The checks that depend on the loaded program are made by main.
+ *
+ * @param program The name of the simulator, for the usage.
+ * @param options The parsed options.
  */
-void ResetProcessor()
+static void ValidateOptions(char *program, MainOptions *options)
 {
-    ResetDataMemory();
-    ResetInstructionMemory();
-    ResetRegisters();
+    options->statsRequested = options->printStats || options->statsJSONFile != NULL || options->callgrindFile != NULL;
+    if (options->engine == ENGINE_OOO)
+    {
+        // the out-of-order core has no --stages shape; --issue-width is its width
+        if (options->stagesRequested)
+        {
+            PrintUsage(program);
+        }
+        if (options->issueWidth != 0)
+        {
+            options->ooo.width = (int)options->issueWidth;
+        }
+    }
+    else if (options->issueWidth != 0)
+    {
+        if (options->issueWidth > STAGES_MAX_WIDTH)
+        {
+            PrintUsage(program);
+        }
+        options->stages.width = (uint8_t)options->issueWidth;
+        options->stagesRequested = true;
+    }
+    // a dropped record would corrupt every delta of the compact trace up to the next keyframe
+    if ((options->forwardingRequested && !options->stagesRequested) ||
+        (options->oooRequested && options->engine != ENGINE_OOO) || (options->cacheOptions && !options->cacheRequested) ||
+        (options->traceFormat == TRACE_WRITER_COMPACT && options->tracePolicy == TRACE_WRITER_DROP))
+    {
+        PrintUsage(program);
+    }
+    if (options->batchDirectory != NULL)
+    {
+        if (options->fileName != NULL || options->traceRequested || options->restoreFile != NULL ||
+            options->checkpointEvery > 0 || options->fastForwardRequested || options->sampleEvery > 0 ||
+            options->statsRequested || options->predictorRequested || options->stagesRequested ||
+            options->cacheRequested || options->stateRequested)
+        {
+            PrintUsage(program);
+        }
+    }
+    else if ((options->fileName == NULL) == (options->restoreFile == NULL))
+    {
+        PrintUsage(program);
+    }
+}
+
+/**
+ * @brief Creates the processor of a run and loads the program or the checkpoint into it, exiting if it cannot be read.
+ *
+ * @param options The options of the run.
+ * @return The processor.
+ */
+static CPU *LoadInput(const MainOptions *options)
+{
+    CPU *cpu = CreateCPU();
+    if (cpu == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    AssemblerError error;
+    if (options->restoreFile != NULL)
+    {
+        if (!LoadCheckpoint(cpu, options->restoreFile, &error))
+        {
+            printf("Error: %s: %s\n", options->restoreFile, error.message);
+            printf("Exiting...\n");
+            exit(1);
+        }
+    }
+    else if (!LoadProgram(cpu, options->fileName, &error))
+    {
+        if (error.line > 0)
+        {
+            printf("Error: %s:%d:%d: %s\n", options->fileName, error.line, error.column, error.message);
+            printf("Exiting...\n");
+            exit(1);
+        }
+        if (error.line < 0)
+        {
+            printf("Error: %s: %s\n", options->fileName, error.message);
+            printf("Exiting...\n");
+            exit(1);
+        }
+        printf("Error: Assembly file not found\n");
+        printf("Please make sure the file exists\n");
+        printf("Exiting...\n");
+        exit(1);
+    }
+    return cpu;
 }
 
 /**
  * @brief The main function that simulates the computer processor.
  *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
  * @return 0 indicating successful execution.
  */
-int main()
+int main(int argc, char *argv[])
 {
-    ResetProcessor();
-    // Only works with absolute path of the txt file
-    LoadProgram("/home/ashmxwy/Desktop/University/Work/CA/c-computer-processor/src/Test/ALL_test.txt");
+    if (argc > 1 && strcmp(argv[1], "assemble") == 0)
+    {
+        return RunAssemble(argc, argv);
+    }
+    MainOptions options;
+    ParseOptions(argc, argv, &options);
+    ValidateOptions(argv[0], &options);
+    if (options.batchDirectory != NULL)
+    {
+        BatchOptions batch_options = {options.engine, options.maxInstructions, options.jitThreshold,
+                                      options.batchWorkers};
+        int failed = RunBatch(options.batchDirectory, &batch_options);
+        if (failed < 0)
+        {
+            printf("Error: could not read the directory %s\n", options.batchDirectory);
+            printf("Exiting...\n");
+            exit(1);
+        }
+        return failed == 0 ? 0 : 1;
+    }
 
-    /**
-     * This function represents the main loop of the processor. It executes the pipeline stages
-     * (fetch, decode, execute) until certain conditions are met.
-     *
-     * Conditions for loop termination:
-     *  - The instruction pointer is not NULL (needed for the first instruction and to check if there are instructions left to fetch)
-     *  - The second pipeline stage (pipeline2) is valid, indicating that the last decode operation is still in progress
-     *  - The fourth pipeline stage (pipeline4) is valid, indicating that the last execute operation is still in progress
-     *  - The number of clock cycles is less than the maximum allowed clock cycles (MaxClockCycles)
-     *
-     * Inside the loop, the current clock cycle is printed, and the fetch, decode, and execute pipeline stages are executed.
-     * After each iteration, the clock cycle is incremented, and a separator line is printed.
-     * Finally, the instruction pointer is updated by reading the instruction memory at the current program counter (PC).
-     */
-    printf("Cycle: %i \n", clockcycles);
-    fetchPipeline();
-    while (pipeline1.valid == true || pipeline2.valid == true || pipeline3.valid == true || pipeline4.valid == true)
+    CPU *cpu = LoadInput(&options);
+    FinalState final_state = {options.stateFormat, options.stateFile, NULL};
+    if (options.diffFile != NULL)
     {
+        AssemblerError error;
+        final_state.reference = CreateCPU();
+        if (final_state.reference == NULL)
+        {
+            printf("Error: out of memory\n");
+            exit(1);
+        }
+        if (!LoadStateReference(final_state.reference, options.diffFile, &error))
+        {
+            printf("Error: %s: %s\n", options.diffFile, error.message);
+            printf("Exiting...\n");
+            exit(1);
+        }
+    }
 
-        if (clockcycles != 1)
+    if (options.predictorRequested)
+    {
+        // replaces the predictor of a restored checkpoint, with cleared tables
+        bool in_decode = options.resolveInDecode < 0 ? cpu->predictor.resolveInDecode : options.resolveInDecode != 0;
+        SetPredictor(cpu, options.predictor, options.btbEntries);
+        SetBranchResolution(cpu, in_decode);
+    }
+    if (options.cacheRequested)
+    {
+        SetDataCache(cpu, &options.cache);
+    }
+
+    if (options.sweepRegister >= 0)
+    {
+        if (options.traceRequested || options.restoreFile != NULL || options.checkpointEvery > 0 ||
+            options.fastForwardRequested || options.sampleEvery > 0 || options.statsRequested ||
+            options.predictorRequested || options.stagesRequested || options.cacheRequested || options.stateRequested)
+        {
+            PrintUsage(argv[0]);
+        }
+        TraceSetLevel(TRACE_LEVEL_OFF);
+        RunSweep(cpu, options.sweepRegister, options.maxInstructions);
+        DestroyCPU(cpu);
+        DestroyCPU(final_state.reference);
+        return 0;
+    }
+
+    if (options.stagesRequested)
+    {
+        // the staged pipeline keeps its own stages, nothing of the 3 stage pipeline applies to it
+        if (options.traceRequested || options.restoreFile != NULL || options.checkpointEvery > 0 ||
+            options.fastForwardRequested || options.sampleEvery > 0 || options.statsJSONFile != NULL ||
+            options.callgrindFile != NULL || cpu->predictor.resolveInDecode || options.cacheRequested)
+        {
+            PrintUsage(argv[0]);
+        }
+        TraceSetLevel(TRACE_LEVEL_OFF);
+        StageStats stage_stats;
+        EngineResult result = RunStagedPipeline(cpu, &options.stages, options.maxInstructions, &stage_stats);
+        fprintf(stderr, "Executed %llu instructions in %llu cycles%s\n",
+                (unsigned long long)result.instructions,
+                (unsigned long long)stage_stats.cycles,
+                result.halted ? "" : " (instruction limit reached)");
+        PrintFinalState(cpu, &final_state);
+        if (options.printStats)
+        {
+            PrintStageStats(&options.stages, &stage_stats, stdout);
+        }
+        DestroyCPU(cpu);
+        DestroyCPU(final_state.reference);
+        return 0;
+    }
+
+    if (options.engine == ENGINE_OOO)
+    {
+        // the out-of-order core keeps its own reorder buffer, nothing of the 3 stage pipeline applies to it
+        if (options.traceRequested || options.restoreFile != NULL || options.checkpointEvery > 0 ||
+            options.fastForwardRequested || options.sampleEvery > 0 || options.statsJSONFile != NULL ||
+            options.callgrindFile != NULL || cpu->predictor.resolveInDecode || options.cacheRequested)
+        {
+            PrintUsage(argv[0]);
+        }
+        TraceSetLevel(TRACE_LEVEL_OFF);
+        EngineResult result = RunOutOfOrderEngine(cpu, &options.ooo, options.maxInstructions);
+        OutOfOrderStats ooo_stats = GetOutOfOrderStats();
+        fprintf(stderr, "Executed %llu instructions in %llu cycles%s\n",
+                (unsigned long long)result.instructions,
+                (unsigned long long)ooo_stats.cycles,
+                result.halted ? "" : " (instruction limit reached)");
+        PrintFinalState(cpu, &final_state);
+        if (options.printStats)
+        {
+            PrintOutOfOrderStats(&options.ooo, &ooo_stats, stdout);
+        }
+        DestroyCPU(cpu);
+        DestroyCPU(final_state.reference);
+        return 0;
+    }
+
+    if (options.engine != ENGINE_PIPELINE && options.traceRequested)
+    {
+        // only the pipeline model produces the cycle-accurate trace that was asked for
+        fprintf(stderr, "Note: a trace was requested, running the pipeline engine instead\n");
+        options.engine = ENGINE_PIPELINE;
+    }
+    if (options.engine != ENGINE_PIPELINE &&
+        (options.restoreFile != NULL || options.checkpointEvery > 0 || options.fastForwardRequested ||
+         options.sampleEvery > 0 || options.statsRequested || options.predictorRequested || options.cacheRequested))
+    {
+        // checkpoints hold the pipeline registers, fast-forwarding and sampling hand over to the pipeline model, only it counts cycles
+        fprintf(stderr, "Note: checkpoints, fast-forwarding, sampling, branch predictors, data caches and performance counters need the pipeline engine, running it instead\n");
+        options.engine = ENGINE_PIPELINE;
+    }
+
+    if (options.cacheRequested &&
+        (options.restoreFile != NULL || options.checkpointEvery > 0 || options.fastForwardRequested || options.sampleEvery > 0))
+    {
+        // checkpoints do not hold the cache lines, and fast-forwarding would start the detailed run with a cold cache
+        PrintUsage(argv[0]);
+    }
+
+    if (options.sampleEvery > 0)
+    {
+        if (options.traceRequested || options.checkpointEvery > 0 || options.fastForwardRequested ||
+            options.statsRequested)
+        {
+            PrintUsage(argv[0]);
+        }
+        TraceSetLevel(TRACE_LEVEL_OFF);
+        SamplingOptions sampling = {options.sampleEvery, options.sampleCycles, options.maxInstructions};
+        SamplingResult sampled = RunSampled(cpu, &sampling);
+        printf("Sampled run: %llu samples of %d cycles, %llu instructions in detail (%llu cycles), %llu fast-forwarded%s\n",
+               (unsigned long long)sampled.samples, options.sampleCycles,
+               (unsigned long long)sampled.detailedInstructions,
+               (unsigned long long)sampled.detailedCycles,
+               (unsigned long long)sampled.fastForwardInstructions,
+               sampled.halted ? "" : " (instruction limit reached)");
+        if (sampled.samples == 0)
+        {
+            printf("Estimated clock cycles: no complete sample, %llu cycles simulated in detail\n",
+                   (unsigned long long)sampled.detailedCycles);
+        }
+        else
+        {
+            printf("Estimated clock cycles: %.0f +/- %.0f (95%% confidence), CPI %.4f +/- %.4f\n",
+                   sampled.estimatedCycles, sampled.cyclesHalfWidth, sampled.meanCPI, sampled.cpiHalfWidth);
+        }
+        PrintFinalState(cpu, &final_state);
+        DestroyCPU(cpu);
+        DestroyCPU(final_state.reference);
+        return 0;
+    }
+
+    if (options.engine != ENGINE_PIPELINE)
+    {
+        // the functional engines have no clock cycles to trace
+        TraceSetLevel(TRACE_LEVEL_OFF);
+        EngineResult result = RunEngine(cpu, options.engine, options.maxInstructions, options.jitThreshold);
+        fprintf(stderr, "Executed %llu instructions%s\n",
+                (unsigned long long)result.instructions,
+                result.halted ? "" : " (instruction limit reached)");
+        if (options.engine == ENGINE_JIT)
         {
-            printf("Cycle: %i \n", clockcycles);
-            fetchPipeline();
+            JITStats stats = GetJITStats();
+            fprintf(stderr, "JIT: %llu blocks compiled (%llu bytes), %llu native and %llu interpreted instructions\n",
+                    (unsigned long long)stats.blocksCompiled,
+                    (unsigned long long)stats.codeBytes,
+                    (unsigned long long)stats.nativeInstructions,
+                    (unsigned long long)stats.interpretedInstructions);
         }
-        decodePipeline();
+        PrintFinalState(cpu, &final_state);
+        DestroyCPU(cpu);
+        DestroyCPU(final_state.reference);
+        return 0;
+    }
 
-        executePipeline();
+    if (options.statsRequested)
+    {
+        // only the runs that report the counters pay for counting them
+        EnableCounters(cpu);
+    }
+
+    TraceWriter *trace_writer = NULL;
+    if (options.traceFile != NULL)
+    {
+        trace_writer = TraceWriterStart(options.traceFile, options.traceFormat, options.tracePolicy, 1 << 16);
+        if (trace_writer == NULL)
+        {
+            printf("Error: could not open trace file %s\n", options.traceFile);
+            printf("Exiting...\n");
+            exit(1);
+        }
+        TraceWriterWatchCPU(trace_writer, cpu);
+        TraceSetSink(TraceWriterSink, trace_writer);
+    }
+
+    EngineResult skipped = {0, false};
+    if (options.fastForwardRequested)
+    {
+        if (options.maxInstructions != 0 &&
+            (options.fastForward.instructions == 0 || options.fastForward.instructions > options.maxInstructions))
+        {
+            options.fastForward.instructions = options.maxInstructions;
+        }
+        skipped = FastForward(cpu, &options.fastForward);
+        fprintf(stderr, "Fast-forwarded %llu instructions to clock cycle %d\n", (unsigned long long)skipped.instructions, cpu->clockcycles);
+    }
+    EngineResult result = skipped;
+    if (!skipped.halted && (options.maxInstructions == 0 || skipped.instructions < options.maxInstructions))
+    {
+        uint64_t budget = options.maxInstructions == 0 ? 0 : options.maxInstructions - skipped.instructions;
+        result = options.checkpointEvery > 0
+                     ? RunPipelineWithCheckpoints(cpu, budget, options.checkpointEvery, options.checkpointPrefix)
+                     : RunPipelineEngine(cpu, budget);
+        result.instructions += skipped.instructions;
+    }
+    if (!result.halted)
+    {
+        fprintf(stderr, "Executed %llu instructions (instruction limit reached)\n", (unsigned long long)result.instructions);
+    }
 
-        clockcycles++;
-        printf("-------------------------------------------------- \n");
+    if (trace_writer != NULL)
+    {
+        TraceSetSink(NULL, NULL);
+        TraceWriterStats stats = TraceWriterStop(trace_writer);
+        fprintf(stderr, "Trace writer: %llu events, %llu bytes in %llu writes, %llu stalls, %llu dropped\n",
+                (unsigned long long)stats.events,
+                (unsigned long long)stats.bytes,
+                (unsigned long long)stats.writes,
+                (unsigned long long)stats.stalls,
+                (unsigned long long)stats.dropped);
     }
 
     /**
@@ -213,9 +1094,30 @@ int main()
      * Calls the functions to print the final state of registers, data memory, and instruction memory.
      */
 
-    PrintAllRegisters();
-    PrintAllDataMemory();
-    PrintAllInstructionMemory();
+    PrintFinalState(cpu, &final_state);
+    if (options.printStats)
+    {
+        PrintCounters(cpu, stdout);
+        if (CacheActive(cpu))
+        {
+            PrintCacheStats(cpu, stdout);
+        }
+    }
+    if (options.statsJSONFile != NULL && !WriteCountersJSON(cpu, options.statsJSONFile))
+    {
+        printf("Error: could not write %s\n", options.statsJSONFile);
+        printf("Exiting...\n");
+        exit(1);
+    }
+    const char *program_file = options.fileName != NULL ? options.fileName : options.restoreFile;
+    if (options.callgrindFile != NULL && !WriteCountersCallgrind(cpu, program_file, options.callgrindFile))
+    {
+        printf("Error: could not write %s\n", options.callgrindFile);
+        printf("Exiting...\n");
+        exit(1);
+    }
+    DestroyCPU(cpu);
+    DestroyCPU(final_state.reference);
 
     return 0;
 }
\ No newline at end of file
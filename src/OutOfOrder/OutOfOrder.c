@@ -0,0 +1,571 @@
+/**
+ * @file OutOfOrder.c
+ * @brief The out-of-order core: register renaming, reservation stations, a reorder buffer and branch recovery.
+ */
+
+#include "../Headers/OutOfOrder.h"
+#include "../Headers/DataMemory.h"
+#include "../Headers/Flags.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Predictor.h"
+#include "../Headers/Registers.h"
+#include "../Headers/Report.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief An instruction in the reorder buffer.
+ */
+typedef struct {
+    uint16_t address;
+    Instruction ins;
+    uint8_t unit;
+    bool writes;        // writes register ins.operand1
+    bool issued;        // left its reservation station
+    bool done;          // its result was broadcast, it can commit
+    uint64_t doneCycle; // the cycle its functional unit finishes
+    int8_t value;       // the register result, or the value an STR stores
+    uint8_t flags;      // this entry's own copy of the flag groups it writes (renamed SREG)
+    uint8_t flagMask;   // the flag groups it writes
+    bool taken;         // a taken BEQZ or BR
+    uint16_t predicted; // the row fetch continued with after it
+    uint16_t next;      // the row the program continues with after it, known for branches once executed
+    bool halts;         // a taken branch in the last two rows, the program ends when it commits
+} ROBEntry;
+
+/**
+ * @brief A reservation station entry: an instruction waiting for its operands and a functional unit.
+ */
+typedef struct {
+    bool busy;
+    int rob;          // its ROB entry
+    int8_t values[2]; // the operands whose tag is -1
+    int tags[2];      // the ROB entry producing an operand, -1 once the value is there
+} Station;
+
+/**
+ * @brief A fetched row waiting for dispatch.
+ */
+typedef struct {
+    uint16_t address;
+    uint16_t predicted;
+} FetchedRow;
+
+/**
+ * @brief The whole state of the core between cycles.
+ */
+typedef struct {
+    const OutOfOrderConfig *config;
+    ROBEntry rob[OOO_MAX_ROB];
+    int head;
+    int count;
+    Station stations[OOO_UNIT_CLASSES][OOO_MAX_RS];
+    int renameMap[64]; // the ROB entry that will write each register, -1 for the register file
+    FetchedRow fetched[2 * OOO_MAX_WIDTH];
+    int fetchedCount;
+    uint16_t fetchPC;
+    bool fetching;
+    uint64_t fetchResume; // fetch waits until this cycle after a redirect
+    uint64_t cycle;
+} Core;
+
+static _Thread_local OutOfOrderStats lastStats;
+
+static const char *unitNames[OOO_UNIT_CLASSES] = {"ALU", "MUL", "memory"};
+
+// Function to tell which functional unit class executes an opcode
+static uint8_t UnitOf(uint8_t opcode)
+{
+    if (opcode == 2)
+    {
+        return OOO_UNIT_MUL;
+    }
+    if (opcode == 10 || opcode == 11)
+    {
+        return OOO_UNIT_MEMORY;
+    }
+    return OOO_UNIT_ALU;
+}
+
+// Function to count the functional units of a class
+static int UnitCount(const OutOfOrderConfig *config, int unit)
+{
+    return unit == OOO_UNIT_ALU ? config->width : 1;
+}
+
+// Function to tell whether an opcode reads its first register (every one but MOVI and LDR)
+static bool ReadsFirst(uint8_t opcode)
+{
+    return opcode < 12 && opcode != 3 && opcode != 10;
+}
+
+// Function to tell whether an opcode reads its second register (ADD, SUB, MUL, EOR and BR)
+static bool ReadsSecond(uint8_t opcode)
+{
+    return opcode <= 2 || opcode == 6 || opcode == 7;
+}
+
+// Function to tell whether an opcode writes its first register (every one but BEQZ, BR and STR)
+static bool WritesFirst(uint8_t opcode)
+{
+    return opcode < 12 && opcode != 4 && opcode != 7 && opcode != 11;
+}
+
+// Function to return the ROB index the given number of entries after the head
+static inline int ROBIndex(const Core *core, int age)
+{
+    return (core->head + age) % core->config->robEntries;
+}
+
+// Function to return how many entries the given ROB entry is behind the head
+static inline int ROBAge(const Core *core, int index)
+{
+    return (index - core->head + core->config->robEntries) % core->config->robEntries;
+}
+
+// Function to compute the result, flags and next row of an instruction from its operand values
+static void Execute(CPU *cpu, ROBEntry *entry, int8_t a, int8_t b)
+{
+    Instruction ins = entry->ins;
+    int8_t result = 0;
+    switch (ins.opcode)
+    {
+    case 0:
+        result = (int8_t)(uint8_t)((uint8_t)a + (uint8_t)b);
+        entry->flags = FlagsAdd(0, (uint8_t)a, (uint8_t)b, (uint8_t)result);
+        break;
+    case 1:
+        result = (int8_t)(a - b);
+        entry->flags = FlagsSub(0, a, b, result);
+        break;
+    case 2:
+        result = (int8_t)(a * b);
+        entry->flags = FlagsNegativeZero(0, result);
+        break;
+    case 3:
+        result = ins.value2;
+        break;
+    case 4:
+    case 7:
+    {
+        // branches compute their target from the PC the pipeline would hold in execute
+        uint16_t executePC = GetExecutePC(cpu, entry->address);
+        entry->taken = ins.opcode == 7 || a == 0;
+        uint16_t target = ins.opcode == 4 ? (uint16_t)(executePC + ins.value2 - 1) : BranchRegisterTarget(a, b);
+        entry->next = entry->taken ? target : entry->address + 1;
+        entry->halts = entry->taken && executePC != entry->address + 3;
+        break;
+    }
+    case 5:
+        result = (int8_t)(a & ins.value2);
+        entry->flags = FlagsNegativeZero(0, result);
+        break;
+    case 6:
+        result = (int8_t)(a ^ b);
+        entry->flags = FlagsNegativeZero(0, result);
+        break;
+    case 8:
+        result = (int8_t)(uint8_t)((uint32_t)(int32_t)a << (ins.value2 & 31));
+        entry->flags = FlagsNegativeZero(0, result);
+        break;
+    case 9:
+        result = (int8_t)(a >> (ins.value2 & 31));
+        entry->flags = FlagsNegativeZero(0, result);
+        break;
+    case 11:
+        result = a;
+        break;
+    default:
+        break;
+    }
+    if (ins.opcode != 10)
+    {
+        entry->value = result;
+    }
+}
+
+// Function to find the youngest STR older than the given ROB entry storing to the same address, -1 if there is none
+static int FindOlderStore(const Core *core, int index)
+{
+    uint8_t address = (uint8_t)core->rob[index].ins.value2;
+    for (int age = ROBAge(core, index) - 1; age >= 0; age--)
+    {
+        const ROBEntry *older = &core->rob[ROBIndex(core, age)];
+        if (older->ins.opcode == 11 && (uint8_t)older->ins.value2 == address)
+        {
+            return ROBIndex(core, age);
+        }
+    }
+    return -1;
+}
+
+// Function to tell whether a reservation station entry has its operands, and for an LDR the value of the older STR it reads
+static bool ReadyToIssue(const Core *core, const Station *station)
+{
+    if (station->tags[0] >= 0 || station->tags[1] >= 0)
+    {
+        return false;
+    }
+    if (core->rob[station->rob].ins.opcode != 10)
+    {
+        return true;
+    }
+    int store = FindOlderStore(core, station->rob);
+    return store < 0 || core->rob[store].done;
+}
+
+// Function to read the value of an LDR: from the youngest older STR to the same address, or from the data memory
+static int8_t LoadValue(const Core *core, CPU *cpu, int index)
+{
+    int store = FindOlderStore(core, index);
+    if (store >= 0)
+    {
+        lastStats.loadForwards++;
+        return core->rob[store].value;
+    }
+    return ReadDataMemory(cpu, (uint8_t)core->rob[index].ins.value2);
+}
+
+// Function to throw away every ROB entry younger than the given one and restart fetch where the program really goes
+static void Recover(Core *core, int index)
+{
+    int keep = ROBAge(core, index) + 1;
+    lastStats.squashed += core->count - keep;
+    for (int age = keep; age < core->count; age++)
+    {
+        int squashed = ROBIndex(core, age);
+        Station *stations = core->stations[core->rob[squashed].unit];
+        for (int i = 0; i < core->config->rsEntries; i++)
+        {
+            if (stations[i].busy && stations[i].rob == squashed)
+            {
+                stations[i].busy = false;
+            }
+        }
+    }
+    core->count = keep;
+    // the rename map of the surviving entries
+    for (int reg = 0; reg < 64; reg++)
+    {
+        core->renameMap[reg] = -1;
+    }
+    for (int age = 0; age < core->count; age++)
+    {
+        const ROBEntry *entry = &core->rob[ROBIndex(core, age)];
+        if (entry->writes)
+        {
+            core->renameMap[entry->ins.operand1] = ROBIndex(core, age);
+        }
+    }
+    core->fetchedCount = 0;
+    core->fetchPC = core->rob[index].next;
+    core->fetching = !core->rob[index].halts;
+    core->fetchResume = core->cycle + 1;
+}
+
+// Function to complete the instructions whose functional unit finishes this cycle, oldest first, and broadcast their results
+static void Writeback(Core *core)
+{
+    for (int age = 0; age < core->count; age++)
+    {
+        int index = ROBIndex(core, age);
+        ROBEntry *entry = &core->rob[index];
+        if (!entry->issued || entry->done || entry->doneCycle > core->cycle)
+        {
+            continue;
+        }
+        entry->done = true;
+        if (entry->writes)
+        {
+            for (int unit = 0; unit < OOO_UNIT_CLASSES; unit++)
+            {
+                for (int i = 0; i < core->config->rsEntries; i++)
+                {
+                    Station *station = &core->stations[unit][i];
+                    for (int k = 0; k < 2; k++)
+                    {
+                        if (station->busy && station->tags[k] == index)
+                        {
+                            station->values[k] = entry->value;
+                            station->tags[k] = -1;
+                        }
+                    }
+                }
+            }
+        }
+        if (entry->next != entry->predicted || entry->halts)
+        {
+            lastStats.mispredictions += !entry->halts;
+            Recover(core, index);
+        }
+    }
+}
+
+// Function to issue the oldest ready instructions of every class to its free functional units
+static void Issue(Core *core, CPU *cpu)
+{
+    static const uint8_t latency[16] = {OOO_LATENCY_ALU, OOO_LATENCY_ALU, OOO_LATENCY_MUL, OOO_LATENCY_ALU,
+                                        OOO_LATENCY_ALU, OOO_LATENCY_ALU, OOO_LATENCY_ALU, OOO_LATENCY_ALU,
+                                        OOO_LATENCY_ALU, OOO_LATENCY_ALU, OOO_LATENCY_LOAD, OOO_LATENCY_STORE,
+                                        OOO_LATENCY_ALU, OOO_LATENCY_ALU, OOO_LATENCY_ALU, OOO_LATENCY_ALU};
+    for (int unit = 0; unit < OOO_UNIT_CLASSES; unit++)
+    {
+        Station *stations = core->stations[unit];
+        for (int free = UnitCount(core->config, unit); free > 0; free--)
+        {
+            int oldest = -1;
+            for (int i = 0; i < core->config->rsEntries; i++)
+            {
+                if (stations[i].busy && (oldest < 0 || ROBAge(core, stations[i].rob) < ROBAge(core, stations[oldest].rob)) &&
+                    ReadyToIssue(core, &stations[i]))
+                {
+                    oldest = i;
+                }
+            }
+            if (oldest < 0)
+            {
+                break;
+            }
+            Station *station = &stations[oldest];
+            ROBEntry *entry = &core->rob[station->rob];
+            if (entry->ins.opcode == 10)
+            {
+                entry->value = LoadValue(core, cpu, station->rob);
+            }
+            Execute(cpu, entry, station->values[0], station->values[1]);
+            entry->issued = true;
+            entry->doneCycle = core->cycle + latency[entry->ins.opcode];
+            station->busy = false;
+            lastStats.issued[unit]++;
+        }
+    }
+    // the loads left behind that wait for an older STR still computing its value
+    for (int i = 0; i < core->config->rsEntries; i++)
+    {
+        const Station *station = &core->stations[OOO_UNIT_MEMORY][i];
+        if (station->busy && station->tags[0] < 0 && core->rob[station->rob].ins.opcode == 10 && !ReadyToIssue(core, station))
+        {
+            lastStats.loadWaitCycles++;
+        }
+    }
+}
+
+// Function to rename the fetched rows into the ROB and the reservation stations, in order
+static void Dispatch(Core *core, CPU *cpu)
+{
+    int dispatched = 0;
+    while (dispatched < core->config->width && dispatched < core->fetchedCount)
+    {
+        if (core->count == core->config->robEntries)
+        {
+            lastStats.robFullCycles++;
+            break;
+        }
+        FetchedRow *row = &core->fetched[dispatched];
+        Instruction ins = GetPredecodedInstruction(cpu, row->address);
+        uint8_t unit = UnitOf(ins.opcode);
+        Station *station = NULL;
+        for (int i = 0; i < core->config->rsEntries && station == NULL; i++)
+        {
+            station = core->stations[unit][i].busy ? NULL : &core->stations[unit][i];
+        }
+        if (station == NULL)
+        {
+            lastStats.rsFullCycles[unit]++;
+            break;
+        }
+
+        int index = ROBIndex(core, core->count);
+        ROBEntry *entry = &core->rob[index];
+        memset(entry, 0, sizeof(*entry));
+        entry->address = row->address;
+        entry->ins = ins;
+        entry->unit = unit;
+        entry->writes = WritesFirst(ins.opcode);
+        entry->flagMask = ins.opcode == 0   ? FLAG_C | FLAG_V | FLAG_N | FLAG_S | FLAG_Z
+                          : ins.opcode == 1 ? FLAG_V | FLAG_N | FLAG_S | FLAG_Z
+                          : ins.opcode == 2 || ins.opcode == 5 || ins.opcode == 6 || ins.opcode == 8 || ins.opcode == 9
+                              ? FLAG_N | FLAG_Z
+                              : 0;
+        entry->predicted = row->predicted;
+        entry->next = row->address + 1;
+        core->count++;
+
+        // the operands are read before the destination is renamed, ADD R1 R1 reads the old R1
+        station->busy = true;
+        station->rob = index;
+        const uint8_t regs[2] = {ins.operand1, ins.operand2};
+        const bool reads[2] = {ReadsFirst(ins.opcode), ReadsSecond(ins.opcode)};
+        for (int k = 0; k < 2; k++)
+        {
+            int producer = reads[k] ? core->renameMap[regs[k]] : -1;
+            station->tags[k] = -1;
+            station->values[k] = reads[k] ? ReadRegister(cpu, regs[k]) : 0;
+            if (producer >= 0 && core->rob[producer].done)
+            {
+                station->values[k] = core->rob[producer].value;
+            }
+            else if (producer >= 0)
+            {
+                station->tags[k] = producer;
+            }
+        }
+        if (entry->writes)
+        {
+            core->renameMap[ins.operand1] = index;
+        }
+        dispatched++;
+        lastStats.dispatched++;
+    }
+    core->fetchedCount -= dispatched;
+    memmove(core->fetched, core->fetched + dispatched, core->fetchedCount * sizeof(FetchedRow));
+}
+
+// Function to fetch up to width rows along the predicted path, a predicted taken branch ends the group
+static void Fetch(Core *core, CPU *cpu, bool predicting)
+{
+    if (!core->fetching || core->cycle < core->fetchResume)
+    {
+        return;
+    }
+    for (int n = 0; n < core->config->width && core->fetchedCount < 2 * core->config->width; n++)
+    {
+        uint16_t address = core->fetchPC;
+        if (ReadInstructionMemory(cpu, address) == -1)
+        {
+            return;
+        }
+        uint16_t predicted = predicting ? PredictNextPC(cpu, address) : address + 1;
+        core->fetched[core->fetchedCount++] = (FetchedRow){address, predicted};
+        core->fetchPC = predicted;
+        if (predicted != address + 1)
+        {
+            return;
+        }
+    }
+}
+
+// Function to commit up to width completed instructions from the head of the ROB, true once the program ended
+static bool Commit(Core *core, CPU *cpu, EngineResult *result, uint64_t maxInstructions)
+{
+    for (int n = 0; n < core->config->width && core->count > 0; n++)
+    {
+        ROBEntry *entry = &core->rob[core->head];
+        if (!entry->done)
+        {
+            return false;
+        }
+        if (entry->writes)
+        {
+            WriteRegister(cpu, entry->ins.operand1, entry->value);
+            if (core->renameMap[entry->ins.operand1] == core->head)
+            {
+                core->renameMap[entry->ins.operand1] = -1;
+            }
+        }
+        if (entry->flagMask != 0)
+        {
+            WriteStatusRegister(cpu, (uint8_t)((ReadStatusRegister(cpu) & ~entry->flagMask) | (entry->flags & entry->flagMask)));
+        }
+        if (entry->ins.opcode == 11)
+        {
+            WriteDataMemory(cpu, (uint8_t)entry->ins.value2, entry->value);
+        }
+        if ((entry->ins.opcode == 4 || entry->ins.opcode == 7) && GetExecutePC(cpu, entry->address) == entry->address + 3)
+        {
+            TrainPredictor(cpu, entry->ins, entry->address, entry->taken, entry->next, entry->predicted);
+        }
+        cpu->pc = entry->next;
+        cpu->retired++;
+        result->instructions++;
+        core->head = (core->head + 1) % core->config->robEntries;
+        core->count--;
+        if (entry->halts)
+        {
+            result->halted = true;
+            return true;
+        }
+        if (maxInstructions != 0 && result->instructions >= maxInstructions)
+        {
+            result->halted = ReadInstructionMemory(cpu, cpu->pc) == -1;
+            return true;
+        }
+    }
+    return false;
+}
+
+EngineResult RunOutOfOrderEngine(CPU *cpu, const OutOfOrderConfig *config, uint64_t maxInstructions)
+{
+    static _Thread_local Core core;
+    memset(&core, 0, sizeof(core));
+    memset(&lastStats, 0, sizeof(lastStats));
+    core.config = config;
+    for (int reg = 0; reg < 64; reg++)
+    {
+        core.renameMap[reg] = -1;
+    }
+    core.fetchPC = cpu->pc;
+    core.fetching = true;
+    bool predicting = PredictorActive(cpu);
+
+    EngineResult result = {0, false};
+    for (;;)
+    {
+        // the stages run back to front, so an instruction spends at least a cycle in each
+        core.cycle++;
+        lastStats.cycles++;
+        if (Commit(&core, cpu, &result, maxInstructions))
+        {
+            break;
+        }
+        Writeback(&core);
+        Issue(&core, cpu);
+        Dispatch(&core, cpu);
+        Fetch(&core, cpu, predicting);
+        lastStats.robOccupancy += core.count;
+        if (core.count == 0 && core.fetchedCount == 0 &&
+            (!core.fetching || ReadInstructionMemory(cpu, core.fetchPC) == -1))
+        {
+            result.halted = true;
+            break;
+        }
+    }
+    lastStats.committed = result.instructions;
+    cpu->clockcycles += (int)lastStats.cycles;
+    return result;
+}
+
+OutOfOrderStats GetOutOfOrderStats()
+{
+    return lastStats;
+}
+
+void PrintOutOfOrderStats(const OutOfOrderConfig *config, const OutOfOrderStats *stats, FILE *out)
+{
+    fprintf(out, "Out-of-Order Core: \n");
+    fprintf(out, "-------------------------------------------------- \n");
+    fprintf(out, "ROB %d entries, %d reservation station entries per class, %d wide (%d ALUs, 1 multiplier, 1 data memory port)\n",
+            config->robEntries, config->rsEntries, config->width, config->width);
+    fprintf(out, "Cycles: %llu  Instructions: %llu  IPC: %.4f  CPI: %.4f\n", (unsigned long long)stats->cycles,
+            (unsigned long long)stats->committed, Ratio(stats->committed, stats->cycles),
+            Ratio(stats->cycles, stats->committed));
+    fprintf(out, "Dispatched: %llu, %llu squashed, %llu mispredicted branches\n", (unsigned long long)stats->dispatched,
+            (unsigned long long)stats->squashed, (unsigned long long)stats->mispredictions);
+    fprintf(out, "Dispatch stalls: ROB full %llu cycles", (unsigned long long)stats->robFullCycles);
+    for (int unit = 0; unit < OOO_UNIT_CLASSES; unit++)
+    {
+        fprintf(out, ", %s stations full %llu", unitNames[unit], (unsigned long long)stats->rsFullCycles[unit]);
+    }
+    fprintf(out, "\nIssued:");
+    for (int unit = 0; unit < OOO_UNIT_CLASSES; unit++)
+    {
+        fprintf(out, " %s %llu", unitNames[unit], (unsigned long long)stats->issued[unit]);
+    }
+    fprintf(out, "\nLoads: %llu forwarded from an older STR, %llu cycles waiting for one\n",
+            (unsigned long long)stats->loadForwards, (unsigned long long)stats->loadWaitCycles);
+    fprintf(out, "Average ROB occupancy: %.2f\n", Ratio(stats->robOccupancy, stats->cycles));
+    fprintf(out, "-------------------------------------------------- \n");
+}
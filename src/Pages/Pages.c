@@ -0,0 +1,254 @@
+/**
+ * @file Pages.c
+ * @brief Reference-counted memory pages shared copy-on-write between processors.
+ */
+
+#include "../Headers/Pages.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the pages every reset attaches; their reference count stays 0, so they are copied on the first write and never freed
+static MemoryPage zeroPage;
+static MemoryPage emptyInstructionPage = {.instructions = {[0 ... PAGE_INSTRUCTIONS - 1] = -1}};
+
+// the predecoded store every reset attaches, every row invalid; like the static pages it is copied on the first write
+static PredecodedStore invalidPredecodedStore;
+
+static atomic_size_t livePages;
+
+// Function to add a reference to a page (the static pages are not counted)
+static void RetainPage(MemoryPage *page)
+{
+    if (page != NULL && page != &zeroPage && page != &emptyInstructionPage)
+    {
+        atomic_fetch_add_explicit(&page->references, 1, memory_order_relaxed);
+    }
+}
+
+// Function to drop a reference to a page and free it if it was the last one
+static void ReleasePage(MemoryPage *page)
+{
+    if (page == NULL || page == &zeroPage || page == &emptyInstructionPage)
+    {
+        return;
+    }
+    if (atomic_fetch_sub_explicit(&page->references, 1, memory_order_release) == 1)
+    {
+        atomic_thread_fence(memory_order_acquire);
+        free(page);
+        atomic_fetch_sub_explicit(&livePages, 1, memory_order_relaxed);
+    }
+}
+
+MemoryPage *MakePagePrivate(MemoryPage **slot)
+{
+    MemoryPage *shared = *slot;
+    MemoryPage *page = malloc(sizeof(MemoryPage));
+    if (page == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    memcpy(page->data, shared->data, MEMORY_PAGE_BYTES);
+    atomic_init(&page->references, 1);
+    atomic_fetch_add_explicit(&livePages, 1, memory_order_relaxed);
+    *slot = page;
+    ReleasePage(shared);
+    return page;
+}
+
+// Function to drop a reference to a predecoded store and free it if it was the last one
+static void ReleasePredecodedStore(PredecodedStore *store)
+{
+    if (store == NULL || store == &invalidPredecodedStore)
+    {
+        return;
+    }
+    if (atomic_fetch_sub_explicit(&store->references, 1, memory_order_release) == 1)
+    {
+        atomic_thread_fence(memory_order_acquire);
+        free(store);
+    }
+}
+
+PredecodedStore *MakePredecodedStorePrivate(CPU *cpu)
+{
+    PredecodedStore *shared = cpu->predecoded;
+    PredecodedStore *store = malloc(sizeof(PredecodedStore));
+    if (store == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    memcpy(store, shared, offsetof(PredecodedStore, references));
+    atomic_init(&store->references, 1);
+    cpu->predecoded = store;
+    ReleasePredecodedStore(shared);
+    return store;
+}
+
+int8_t *WritableDataPage(CPU *cpu)
+{
+    MemoryPage *page = cpu->dataPages[0];
+    if (atomic_load_explicit(&page->references, memory_order_acquire) != 1)
+    {
+        page = MakePagePrivate(&cpu->dataPages[0]);
+    }
+    return page->data;
+}
+
+void AttachZeroPages(CPU *cpu)
+{
+    for (int i = 0; i < DATA_MEMORY_PAGES; i++)
+    {
+        ReleasePage(cpu->dataPages[i]);
+        cpu->dataPages[i] = &zeroPage;
+    }
+}
+
+void AttachEmptyInstructionPages(CPU *cpu)
+{
+    for (int i = 0; i < INSTRUCTION_MEMORY_PAGES; i++)
+    {
+        ReleasePage(cpu->instructionPages[i]);
+        cpu->instructionPages[i] = &emptyInstructionPage;
+    }
+}
+
+void AttachInvalidPredecodedStore(CPU *cpu)
+{
+    ReleasePredecodedStore(cpu->predecoded);
+    cpu->predecoded = &invalidPredecodedStore;
+}
+
+void ReleaseMemoryPages(CPU *cpu)
+{
+    for (int i = 0; i < DATA_MEMORY_PAGES; i++)
+    {
+        ReleasePage(cpu->dataPages[i]);
+        cpu->dataPages[i] = NULL;
+    }
+    for (int i = 0; i < INSTRUCTION_MEMORY_PAGES; i++)
+    {
+        ReleasePage(cpu->instructionPages[i]);
+        cpu->instructionPages[i] = NULL;
+    }
+    ReleasePredecodedStore(cpu->predecoded);
+    cpu->predecoded = NULL;
+}
+
+void RetainMemoryPages(const CPU *cpu)
+{
+    for (int i = 0; i < DATA_MEMORY_PAGES; i++)
+    {
+        RetainPage(cpu->dataPages[i]);
+    }
+    for (int i = 0; i < INSTRUCTION_MEMORY_PAGES; i++)
+    {
+        RetainPage(cpu->instructionPages[i]);
+    }
+    if (cpu->predecoded != NULL && cpu->predecoded != &invalidPredecodedStore)
+    {
+        atomic_fetch_add_explicit(&cpu->predecoded->references, 1, memory_order_relaxed);
+    }
+}
+
+void ReadDataMemoryBlock(const CPU *cpu, uint16_t address, int8_t *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        size_t offset = address % MEMORY_PAGE_BYTES;
+        size_t chunk = MEMORY_PAGE_BYTES - offset < length ? MEMORY_PAGE_BYTES - offset : length;
+        memcpy(buffer, &cpu->dataPages[address / MEMORY_PAGE_BYTES]->data[offset], chunk);
+        buffer += chunk;
+        address += (uint16_t)chunk;
+        length -= chunk;
+    }
+}
+
+void WriteDataMemoryBlock(CPU *cpu, uint16_t address, const int8_t *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        size_t offset = address % MEMORY_PAGE_BYTES;
+        size_t chunk = MEMORY_PAGE_BYTES - offset < length ? MEMORY_PAGE_BYTES - offset : length;
+        MemoryPage **slot = &cpu->dataPages[address / MEMORY_PAGE_BYTES];
+        if (memcmp(&(*slot)->data[offset], buffer, chunk) != 0)
+        {
+            MemoryPage *page = *slot;
+            if (atomic_load_explicit(&page->references, memory_order_acquire) != 1)
+            {
+                page = MakePagePrivate(slot);
+            }
+            memcpy(&page->data[offset], buffer, chunk);
+            MarkDirtyRange(cpu->dirty.data, address, chunk);
+        }
+        buffer += chunk;
+        address += (uint16_t)chunk;
+        length -= chunk;
+    }
+}
+
+void ReadInstructionMemoryBlock(const CPU *cpu, uint16_t address, int16_t *buffer, size_t count)
+{
+    while (count > 0)
+    {
+        size_t offset = address % PAGE_INSTRUCTIONS;
+        size_t chunk = PAGE_INSTRUCTIONS - offset < count ? PAGE_INSTRUCTIONS - offset : count;
+        memcpy(buffer, &cpu->instructionPages[address / PAGE_INSTRUCTIONS]->instructions[offset], chunk * 2);
+        buffer += chunk;
+        address += (uint16_t)chunk;
+        count -= chunk;
+    }
+}
+
+void WriteInstructionMemoryBlock(CPU *cpu, uint16_t address, const int16_t *buffer, size_t count)
+{
+    // the rows are decoded again when next read; a store without valid rows there is left shared
+    if (memchr(&cpu->predecoded->valid[address], true, count) != NULL)
+    {
+        memset(&WritablePredecodedStore(cpu)->valid[address], 0, count);
+    }
+    while (count > 0)
+    {
+        size_t offset = address % PAGE_INSTRUCTIONS;
+        size_t chunk = PAGE_INSTRUCTIONS - offset < count ? PAGE_INSTRUCTIONS - offset : count;
+        MemoryPage **slot = &cpu->instructionPages[address / PAGE_INSTRUCTIONS];
+        if (memcmp(&(*slot)->instructions[offset], buffer, chunk * 2) != 0)
+        {
+            MemoryPage *page = *slot;
+            if (atomic_load_explicit(&page->references, memory_order_acquire) != 1)
+            {
+                page = MakePagePrivate(slot);
+            }
+            memcpy(&page->instructions[offset], buffer, chunk * 2);
+            MarkDirtyRange(cpu->dirty.instructions, address, chunk);
+        }
+        buffer += chunk;
+        address += (uint16_t)chunk;
+        count -= chunk;
+    }
+}
+
+bool SameDataMemory(const CPU *a, const CPU *b)
+{
+    for (int i = 0; i < DATA_MEMORY_PAGES; i++)
+    {
+        if (a->dataPages[i] != b->dataPages[i] && memcmp(a->dataPages[i]->data, b->dataPages[i]->data, MEMORY_PAGE_BYTES) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t LivePages()
+{
+    return atomic_load_explicit(&livePages, memory_order_relaxed);
+}
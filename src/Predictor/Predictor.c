@@ -0,0 +1,198 @@
+/**
+ * @file Predictor.c
+ * @brief Branch prediction in the fetch stage and branch resolution in the execute stage.
+ */
+
+#include "../Headers/Predictor.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Registers.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+static const char *predictorNames[] = {"not-taken", "backward-taken", "bimodal"};
+
+bool ParsePredictorKind(const char *name, PredictorKind *kind)
+{
+    for (int i = 0; i < (int)(sizeof(predictorNames) / sizeof(predictorNames[0])); i++)
+    {
+        if (strcmp(name, predictorNames[i]) == 0)
+        {
+            *kind = (PredictorKind)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *PredictorName(PredictorKind kind)
+{
+    return predictorNames[kind];
+}
+
+void SetPredictor(CPU *cpu, PredictorKind kind, int btbEntries)
+{
+    cpu->predictor.kind = (uint8_t)kind;
+    cpu->predictor.btbEntries = (uint8_t)btbEntries;
+    memset(cpu->predictor.bht, 1, sizeof(cpu->predictor.bht));
+    memset(cpu->predictor.btb, 0, sizeof(cpu->predictor.btb));
+}
+
+// Function to find the BTB entry of the BR at the given address
+static BTBEntry *FindBTBEntry(CPU *cpu, uint16_t address)
+{
+    return &cpu->predictor.btb[address & (cpu->predictor.btbEntries - 1)];
+}
+
+uint16_t PredictNextPC(CPU *cpu, uint16_t address)
+{
+    Instruction ins = GetPredecodedInstruction(cpu, address);
+    if ((ins.opcode != 4 && ins.opcode != 7) || GetExecutePC(cpu, address) != address + 3)
+    {
+        return address + 1;
+    }
+    BranchPredictor *predictor = &cpu->predictor;
+    if (ins.opcode == 4)
+    {
+        uint16_t target = (uint16_t)(address + 2 + ins.value2);
+        bool taken = false;
+        if (predictor->kind == PREDICTOR_BACKWARD_TAKEN)
+        {
+            taken = target < address;
+        }
+        else if (predictor->kind == PREDICTOR_BIMODAL)
+        {
+            taken = predictor->bht[address % PREDICTOR_BHT_ENTRIES] >= 2;
+        }
+        return taken ? target : address + 1;
+    }
+    if (predictor->btbEntries != 0)
+    {
+        BTBEntry *entry = FindBTBEntry(cpu, address);
+        if (entry->valid && entry->address == address)
+        {
+            return entry->target;
+        }
+    }
+    return address + 1;
+}
+
+// Function to compute where a branch goes: whether it is taken and its target
+static bool BranchOutcome(CPU *cpu, Instruction ins, uint16_t address, uint16_t *target)
+{
+    // the same targets BEQZ and BR compute from the PC the pipeline holds without prediction
+    *target = ins.opcode == 4 ? (uint16_t)(address + 2 + ins.value2)
+                              : BranchRegisterTarget(ReadRegister(cpu, ins.operand1), ReadRegister(cpu, ins.operand2));
+    return ins.opcode == 7 || ReadRegister(cpu, ins.operand1) == 0;
+}
+
+bool TrainPredictor(CPU *cpu, Instruction ins, uint16_t address, bool taken, uint16_t target, uint16_t fetched)
+{
+    BranchPredictor *predictor = &cpu->predictor;
+    if (ins.opcode == 4)
+    {
+        uint8_t *counter = &predictor->bht[address % PREDICTOR_BHT_ENTRIES];
+        if (taken && *counter < 3)
+        {
+            (*counter)++;
+        }
+        else if (!taken && *counter > 0)
+        {
+            (*counter)--;
+        }
+    }
+    else if (predictor->btbEntries != 0)
+    {
+        BTBEntry *entry = FindBTBEntry(cpu, address);
+        entry->address = address;
+        entry->target = target;
+        entry->valid = true;
+    }
+
+    // a prediction of the next row counts as not taken
+    bool predictedTaken = fetched != address + 1;
+    return taken != predictedTaken || (taken && fetched != target);
+}
+
+bool ResolveBranch(CPU *cpu, Instruction ins, uint16_t address)
+{
+    bool normal = GetExecutePC(cpu, address) == address + 3;
+    if (normal && cpu->predictor.resolveInDecode)
+    {
+        // resolved in decode the cycle before
+        bool flushed = cpu->predictor.decodeFlushed;
+        cpu->predictor.decodeFlushed = false;
+        return flushed;
+    }
+    uint16_t target;
+    bool taken = BranchOutcome(cpu, ins, address, &target);
+    if (cpu->counters != NULL)
+    {
+        cpu->counters->beqzTaken += taken && ins.opcode == 4;
+    }
+    if (!normal)
+    {
+        // fetch ran into the end of the program right after this branch, it was not predicted and a taken one halts
+        execute(cpu, ins);
+        return taken;
+    }
+
+    // the row fetch continued with after the branch, the youngest instruction in the pipeline
+    uint16_t fetched = cpu->pipeline3.valid   ? cpu->pipeline3.pcVal
+                       : cpu->pipeline2.valid ? cpu->pipeline2.pcVal
+                                              : cpu->pc;
+    if (!TrainPredictor(cpu, ins, address, taken, target, fetched))
+    {
+        return false;
+    }
+    SetPC(cpu, taken ? target : address + 1);
+    ResetPipeline(cpu);
+    cpu->pipeline1.valid = true; // refetch even if the wrong path ran into an empty row
+    return true;
+}
+
+void ResolveBranchInDecode(CPU *cpu, const Instruction *executed)
+{
+    Instruction ins = cpu->pipeline4.instruction;
+    uint16_t address = cpu->pipeline4.pcVal;
+    cpu->predictor.decodeFlushed = false;
+    if (!cpu->pipeline4.valid || (ins.opcode != 4 && ins.opcode != 7) || GetExecutePC(cpu, address) != address + 3)
+    {
+        return;
+    }
+    if (cpu->counters != NULL)
+    {
+        if (executed != NULL)
+        {
+            // every instruction but BEQZ, BR and STR writes its first register
+            bool writes = executed->opcode < 12 && executed->opcode != 4 && executed->opcode != 7 && executed->opcode != 11;
+            bool forwarded = writes && (executed->operand1 == ins.operand1 || (ins.opcode == 7 && executed->operand1 == ins.operand2));
+            cpu->counters->decodeForwards += forwarded;
+        }
+        cpu->counters->decodeResolved++;
+    }
+
+    uint16_t target;
+    bool taken = BranchOutcome(cpu, ins, address, &target);
+    if (cpu->counters != NULL)
+    {
+        cpu->counters->beqzTaken += taken && ins.opcode == 4;
+    }
+    uint16_t fetched = cpu->pipeline2.valid ? cpu->pipeline2.pcVal : cpu->pc;
+    if (!TrainPredictor(cpu, ins, address, taken, target, fetched))
+    {
+        return;
+    }
+    // only the one row fetched after the branch is thrown away
+    SetPC(cpu, taken ? target : address + 1);
+    cpu->pipeline2.valid = false;
+    cpu->pipeline3.valid = false;
+    cpu->pipeline1.valid = true; // refetch even if the wrong path ran into an empty row
+    cpu->predictor.decodeFlushed = true;
+}
+
+void SetBranchResolution(CPU *cpu, bool inDecode)
+{
+    cpu->predictor.resolveInDecode = inDecode;
+}
@@ -3,6 +3,11 @@
  * @brief Implementation of register-related functions.
  */
 
+#include "../Headers/Registers.h"
+#include "../Headers/Flags.h"
+#include "../Headers/State.h"
+#include "../Headers/Trace.h"
+
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -13,212 +18,359 @@
 #define Togle(data)   (data =~data )         /** Togle Data value     **/
 
 
-int8_t generalRegisters[64]; // Array to store general purpose registers
-uint8_t SREG = 0;              // status register flags: C, V, N, S, Z ,0,0,0
-uint16_t pc = 0;               // Program counter
-
 /**
  * @brief Reads the value of a register.
+ * @param cpu The processor.
  * @param reg The register number.
  * @return The value of the register.
  */
-int8_t ReadRegister(uint8_t reg)
+int8_t ReadRegister(CPU *cpu, uint8_t reg)
 {
-    return generalRegisters[reg];
+    return cpu->generalRegisters[reg];
 }
 
 /**
  * @brief Writes a value to a register.
+ * @param cpu The processor.
  * @param address The register number.
  * @param value The value to be written.
  */
-void WriteRegister(uint8_t address, int8_t value)
+void WriteRegister(CPU *cpu, uint8_t address, int8_t value)
 {
-    generalRegisters[address] = value;
-    printf("Updated: R%d: %d\n", address, value);
+    cpu->generalRegisters[address] = value;
+    MarkRegisterDirty(cpu, address);
+    TraceRegisterWrite(address, value);
 }
 
 /**
  * @brief Increments the program counter by 1.
+ * @param cpu The processor.
  */
-void IncrementPC()
+void IncrementPC(CPU *cpu)
 {
-    pc++;
+    cpu->pc++;
 }
 
 /**
  * @brief Sets the value of the program counter.
+ * @param cpu The processor.
  * @param value The value to be set.
  */
-void SetPC(uint16_t value)
+void SetPC(CPU *cpu, uint16_t value)
 {
-    pc = value;
-    printf("Updated: PC: %d\n", pc);
+    cpu->pc = value;
+    TracePCWrite(cpu->pc);
 }
 
 /**
  * @brief Gets the value of the program counter.
+ * @param cpu The processor.
  * @return The value of the program counter.
  */
-uint8_t GetPC()
+uint16_t GetPC(CPU *cpu)
 {
-    return pc;
+    return cpu->pc;
 }
 
 /**
  * @brief Updates the carry flag based on the result of an operation.
+ * @param cpu The processor.
  * @param operand1 The first operand.
  * @param operand2 The second operand.
  * @param result The result of the operation.
  */
-void updateCarryFlag(uint8_t operand1, uint8_t operand2)
+void updateCarryFlag(CPU *cpu, uint8_t operand1, uint8_t operand2)
 {
     if ((operand1 + operand2) > 255)
     {
-        SetBit(SREG, 0);
+        SetBit(cpu->SREG, 0);
     }
     else
     {
-        ClearBit(SREG, 0);
+        ClearBit(cpu->SREG, 0);
     }
-        printf("Carry Flag Updated: %d\n", BitVal(SREG, 0));
-    
+    TraceFlagUpdate(TRACE_FLAG_C, BitVal(cpu->SREG, 0));
 }
 
 /**
  * @brief Updates the overflow flag based on the result of an operation.
+ * @param cpu The processor.
  * @param operand1 The first operand.
  * @param operand2 The second operand.
  * @param result The result of the operation.
  */
-void updateOverflowFlag(int8_t operand1, int8_t operand2, int8_t result, bool operation)
+void updateOverflowFlag(CPU *cpu, int8_t operand1, int8_t operand2, int8_t result, bool operation)
 {
     if(operation == 0){
         if ((operand1 > 0 && operand2 > 0 && result < 0) || (operand1 < 0 && operand2 < 0 && result > 0))
         {
-            SetBit(SREG, 1);
+            SetBit(cpu->SREG, 1);
         }
         else
         {
-            ClearBit(SREG, 1);
+            ClearBit(cpu->SREG, 1);
         }
     }
     else{
         if ((operand1 < 0 && operand2 > 0 && result > 0) || (operand1 > 0 && operand2 < 0 && result < 0))
         {
-            SetBit(SREG, 1);
+            SetBit(cpu->SREG, 1);
         }
         else
         {
-           ClearBit(SREG, 1);
+           ClearBit(cpu->SREG, 1);
         }
     }
-    printf("Overflow Flag Updated: %d\n", BitVal(SREG, 1));
-    
+    TraceFlagUpdate(TRACE_FLAG_V, BitVal(cpu->SREG, 1));
 }
 
 /**
  * @brief Updates the negative flag based on the result of an operation.
+ * @param cpu The processor.
  * @param result The result of the operation.
  */
-void updateNegativeFlag(int8_t result)
+void updateNegativeFlag(CPU *cpu, int8_t result)
 {
     if (result < 0)
     {
-        SetBit(SREG, 2);
+        SetBit(cpu->SREG, 2);
     }
     else
     {
-        ClearBit(SREG, 2);
+        ClearBit(cpu->SREG, 2);
     }
-    printf("Negative Flag Updated: %d\n", BitVal(SREG, 2));
-
+    TraceFlagUpdate(TRACE_FLAG_N, BitVal(cpu->SREG, 2));
 }
 
 /**
  * @brief Updates the sign flag based on the result of an operation.
+ * @param cpu The processor.
  * @param result The result of the operation.
  */
-void updateSignFlag(int8_t result)
+void updateSignFlag(CPU *cpu, int8_t result)
 {
 
     if (result == 0)
     {
-        SetBit(SREG, 3);
+        SetBit(cpu->SREG, 3);
     }
     else
     {
-        ClearBit(SREG, 3);
+        ClearBit(cpu->SREG, 3);
     }
 
-    printf("Sign Flag Updated: %d\n", BitVal(SREG, 3));
-    
+    TraceFlagUpdate(TRACE_FLAG_S, BitVal(cpu->SREG, 3));
 }
 
 /**
  * @brief Updates the zero flag based on the result of an operation.
+ * @param cpu The processor.
  * @param result The result of the operation.
  */
-void updateZeroFlag(int8_t result)
+void updateZeroFlag(CPU *cpu, int8_t result)
 {
     if (result == 0)
     {
-        SetBit(SREG, 4);
+        SetBit(cpu->SREG, 4);
     }
     else
     {
-        ClearBit(SREG, 4);
+        ClearBit(cpu->SREG, 4);
+    }
+    TraceFlagUpdate(TRACE_FLAG_Z, BitVal(cpu->SREG, 4));
+}
+
+/**
+ * @brief Updates the flags of an addition: C, N, S, Z and V.
+ *
+ * When flag updates are traced the flags are updated right away (and traced one by
+ * one); otherwise only the operands are recorded and ReadStatusRegister computes the
+ * flags from them.
+ *
+ * @param cpu The processor.
+ * @param operand1 The first operand.
+ * @param operand2 The second operand.
+ * @param result The result of the addition.
+ */
+void updateAddFlags(CPU *cpu, uint8_t operand1, uint8_t operand2, uint8_t result)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_FLAGS))
+    {
+        cpu->flags.pending = 0;
+        updateCarryFlag(cpu, operand1, operand2);
+        updateNegativeFlag(cpu, result);
+        updateSignFlag(cpu, result);
+        updateZeroFlag(cpu, result);
+        updateOverflowFlag(cpu, operand1, operand2, result, 0);
+        return;
+    }
+    cpu->flags.pending = FLAG_C | FLAG_V | FLAG_N | FLAG_S | FLAG_Z;
+    cpu->flags.carryA = operand1;
+    cpu->flags.carryB = operand2;
+    cpu->flags.overflowSub = false;
+    cpu->flags.overflowA = operand1;
+    cpu->flags.overflowB = operand2;
+    cpu->flags.overflowResult = result;
+    cpu->flags.result = result;
+}
+
+/**
+ * @brief Updates the flags of a subtraction: N, S, Z and V.
+ *
+ * @param cpu The processor.
+ * @param operand1 The first operand.
+ * @param operand2 The second operand.
+ * @param result The result of the subtraction.
+ */
+void updateSubFlags(CPU *cpu, int8_t operand1, int8_t operand2, int8_t result)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_FLAGS))
+    {
+        cpu->flags.pending &= FLAG_C;
+        updateNegativeFlag(cpu, result);
+        updateSignFlag(cpu, result);
+        updateZeroFlag(cpu, result);
+        updateOverflowFlag(cpu, operand1, operand2, result, 1);
+        return;
+    }
+    cpu->flags.pending |= FLAG_V | FLAG_N | FLAG_S | FLAG_Z;
+    cpu->flags.overflowSub = true;
+    cpu->flags.overflowA = operand1;
+    cpu->flags.overflowB = operand2;
+    cpu->flags.overflowResult = result;
+    cpu->flags.result = result;
+}
+
+/**
+ * @brief Updates the flags of MUL, ANDI, EOR, SAL and SAR: N and Z.
+ *
+ * @param cpu The processor.
+ * @param result The result of the operation.
+ */
+void updateResultFlags(CPU *cpu, int8_t result)
+{
+    if (TRACE_ACTIVE(TRACE_LEVEL_FLAGS))
+    {
+        cpu->flags.pending &= (uint8_t)~(FLAG_N | FLAG_Z);
+        updateNegativeFlag(cpu, result);
+        updateZeroFlag(cpu, result);
+        return;
     }
-    printf("Zero Flag Updated: %d\n", BitVal(SREG, 4));
+    cpu->flags.pending |= FLAG_N | FLAG_Z;
+    cpu->flags.result = result;
+}
+
+/**
+ * @brief Reads the status register, computing the pending flags from the recorded operations.
+ * @param cpu The processor.
+ * @return The status register, exactly as the update*Flag functions would have left it.
+ */
+uint8_t ReadStatusRegister(const CPU *cpu)
+{
+    const LazyFlags *flags = &cpu->flags;
+    uint8_t sreg = cpu->SREG & (uint8_t)~flags->pending;
+    if (flags->pending & FLAG_C)
+    {
+        if ((flags->carryA + flags->carryB) > 255)
+        {
+            sreg |= FLAG_C;
+        }
+    }
+    if (flags->pending & FLAG_V)
+    {
+        int8_t a = flags->overflowA;
+        int8_t b = flags->overflowB;
+        int8_t r = flags->overflowResult;
+        bool overflow = flags->overflowSub ? (a < 0 && b > 0 && r > 0) || (a > 0 && b < 0 && r < 0)
+                                           : (a > 0 && b > 0 && r < 0) || (a < 0 && b < 0 && r > 0);
+        if (overflow)
+        {
+            sreg |= FLAG_V;
+        }
+        if (r == 0)
+        {
+            sreg |= FLAG_S;
+        }
+    }
+    if (flags->pending & FLAG_N)
+    {
+        if (flags->result < 0)
+        {
+            sreg |= FLAG_N;
+        }
+        if (flags->result == 0)
+        {
+            sreg |= FLAG_Z;
+        }
+    }
+    return sreg;
+}
+
+/**
+ * @brief Sets the status register and drops the pending flag records.
+ * @param cpu The processor.
+ * @param value The new status register.
+ */
+void WriteStatusRegister(CPU *cpu, uint8_t value)
+{
+    cpu->SREG = value;
+    cpu->flags.pending = 0;
 }
 
 /**
  * @brief Resets all registers and the program counter to zero.
+ * @param cpu The processor.
  */
-void ResetRegisters()
+void ResetRegisters(CPU *cpu)
 {
     for (int i = 0; i < 64; i++)
     {
-        generalRegisters[i] = 0;
+        cpu->generalRegisters[i] = 0;
     }
     for (int i = 0; i < 8; i++)
     {
-        ClearBit(SREG, i);
+        ClearBit(cpu->SREG, i);
     }
-    pc = 0;
+    cpu->flags.pending = 0;
+    cpu->pc = 0;
 }
 
 /**
  * @brief Prints the status register flags.
+ * @param cpu The processor.
+ * @param out The stream the state is printed to.
  */
-void PrintStatusRegister()
+void PrintStatusRegister(CPU *cpu, FILE *out)
 {
-    printf("Status Register:\n");
-    printf("C: %d\n", BitVal(SREG, 0));
-    printf("V: %d\n", BitVal(SREG, 1));
-    printf("N: %d\n", BitVal(SREG, 2));
-    printf("S: %d\n", BitVal(SREG, 3));
-    printf("Z: %d\n", BitVal(SREG, 4));
-    printf("6: %d\n", BitVal(SREG, 5));
-    printf("7: %d\n", BitVal(SREG, 6));
-    printf("8: %d\n", BitVal(SREG, 7));
+    uint8_t sreg = ReadStatusRegister(cpu);
+    fprintf(out, "Status Register:\n");
+    fprintf(out, "C: %d\n", BitVal(sreg, 0));
+    fprintf(out, "V: %d\n", BitVal(sreg, 1));
+    fprintf(out, "N: %d\n", BitVal(sreg, 2));
+    fprintf(out, "S: %d\n", BitVal(sreg, 3));
+    fprintf(out, "Z: %d\n", BitVal(sreg, 4));
+    fprintf(out, "6: %d\n", BitVal(sreg, 5));
+    fprintf(out, "7: %d\n", BitVal(sreg, 6));
+    fprintf(out, "8: %d\n", BitVal(sreg, 7));
 }
 
 /**
  * @brief Prints the values of all non-zero registers.
+ * @param cpu The processor.
+ * @param out The stream the state is printed to.
  */
-void PrintAllRegisters()
+void PrintAllRegisters(CPU *cpu, FILE *out)
 {
-    printf("Final State of Registers:\n");
-    printf("-------------------------------------------------- \n");
-    printf("General Registers:\n");
+    fprintf(out, "Final State of Registers:\n");
+    fprintf(out, "-------------------------------------------------- \n");
+    fprintf(out, "General Registers:\n");
     for (int i = 0; i < 64; i++)
     {
     
-            printf("Register %d: %d\n", i, generalRegisters[i]);
-            printf("-------------------------------------------------- \n");
+            fprintf(out, "Register %d: %d\n", i, cpu->generalRegisters[i]);
+            fprintf(out, "-------------------------------------------------- \n");
     
     }
-    printf("-------------------------------------------------- \n");
-    PrintStatusRegister();
+    fprintf(out, "-------------------------------------------------- \n");
+    PrintStatusRegister(cpu, out);
 }
\ No newline at end of file
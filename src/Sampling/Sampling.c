@@ -0,0 +1,98 @@
+/**
+ * @file Sampling.c
+ * @brief Sampled simulation: fast-forward, simulate a window in detail, repeat, and extrapolate the cycle count.
+ */
+
+#include "../Headers/Sampling.h"
+#include "../Headers/Engine.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Two-sided 95% quantiles of Student's t distribution for 1 to 30 degrees of freedom
+static const double tQuantile95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+// Function to return the instructions left in the budget, or the limit if it is smaller
+static uint64_t Remaining(const SamplingOptions *options, uint64_t executed, uint64_t limit)
+{
+    if (options->maxInstructions == 0)
+    {
+        return limit;
+    }
+    uint64_t left = options->maxInstructions - executed;
+    return limit != 0 && limit < left ? limit : left;
+}
+
+SamplingResult RunSampled(CPU *cpu, const SamplingOptions *options)
+{
+    SamplingResult result = {0};
+    double sum = 0;
+    double sumOfSquares = 0;
+    uint64_t executed = 0;
+    for (;;)
+    {
+        FastForwardTarget target = {Remaining(options, executed, options->interval), 0, -1};
+        EngineResult skipped = FastForward(cpu, &target);
+        result.fastForwardInstructions += skipped.instructions;
+        executed += skipped.instructions;
+        if (skipped.halted || (options->maxInstructions != 0 && executed >= options->maxInstructions))
+        {
+            result.halted = skipped.halted;
+            break;
+        }
+
+        /*
+         * The window ends with the first instruction executed from its last cycle on, so it
+         * covers whole instructions: the cycles since the one before the window (the one
+         * FastForward ended with) up to the last one executed in the window.
+         */
+        int startCycle = cpu->clockcycles;
+        EngineResult window = {0, false};
+        if (options->sampleCycles > 1)
+        {
+            window = RunPipelineEngineUntil(cpu, Remaining(options, executed, 0), startCycle + options->sampleCycles - 1);
+        }
+        bool budgetLeft = options->maxInstructions == 0 || executed + window.instructions < options->maxInstructions;
+        if (!window.halted && budgetLeft)
+        {
+            EngineResult last = RunPipelineEngineUntil(cpu, 1, 0);
+            window.instructions += last.instructions;
+            window.halted = last.halted;
+        }
+        int cycles = cpu->clockcycles - startCycle;
+        result.detailedCycles += (uint64_t)cycles;
+        result.detailedInstructions += window.instructions;
+        executed += window.instructions;
+        if (!window.halted && cycles >= options->sampleCycles && window.instructions > 0)
+        {
+            double cpi = (double)cycles / (double)window.instructions;
+            sum += cpi;
+            sumOfSquares += cpi * cpi;
+            result.samples++;
+        }
+        if (window.halted || (options->maxInstructions != 0 && executed >= options->maxInstructions))
+        {
+            result.halted = window.halted;
+            break;
+        }
+    }
+
+    if (result.samples > 0)
+    {
+        double n = (double)result.samples;
+        result.meanCPI = sum / n;
+        if (result.samples > 1)
+        {
+            double variance = (sumOfSquares - n * result.meanCPI * result.meanCPI) / (n - 1);
+            double t = result.samples <= 31 ? tQuantile95[result.samples - 2] : 1.96;
+            result.cpiHalfWidth = t * sqrt(variance > 0 ? variance : 0) / sqrt(n);
+        }
+    }
+    result.estimatedCycles = (double)result.detailedCycles + (double)result.fastForwardInstructions * result.meanCPI;
+    result.cyclesHalfWidth = (double)result.fastForwardInstructions * result.cpiHalfWidth;
+    return result;
+}
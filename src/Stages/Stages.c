@@ -0,0 +1,482 @@
+/**
+ * @file Stages.c
+ * @brief The parameterized pipeline: N stages, a scoreboarding hazard unit with configurable forwarding, stalls and flushes.
+ */
+
+#include "../Headers/Stages.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Predictor.h"
+#include "../Headers/Registers.h"
+#include "../Headers/Report.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief An instruction in one stage of the pipeline, with the registers it reads and writes as masks.
+ */
+typedef struct {
+    uint16_t address;
+    uint64_t reads;
+    uint64_t writes;
+    bool load;   // LDR, its value is ready after the memory stages
+    bool memory; // LDR or STR, they share the one data memory port
+} StageSlot;
+
+/**
+ * @brief The instructions in one stage of the pipeline, in program order.
+ */
+typedef struct {
+    uint8_t count;
+    StageSlot slots[STAGES_MAX_WIDTH];
+} StageGroup;
+
+/**
+ * @brief The stage indices where the steps of a pipeline end.
+ */
+typedef struct {
+    int decodeLast;  // the registers are read here, a stalled instruction waits here
+    int executeLast; // instructions execute and branches resolve here
+    int memoryLast;  // loaded values are ready at the end of this stage
+    int last;        // instructions leave the pipeline after this stage
+    uint8_t forwarding;
+} StageLayout;
+
+static const char *stepNames[5] = {"IF", "ID", "EX", "MEM", "WB"};
+
+bool ParseStageConfig(const char *spec, StageConfig *config)
+{
+    int counts[5];
+    int length = 0;
+    if (strcmp(spec, "3") == 0)
+    {
+        counts[0] = counts[1] = counts[2] = 1;
+        counts[3] = counts[4] = 0;
+    }
+    else if (strcmp(spec, "5") == 0)
+    {
+        counts[0] = counts[1] = counts[2] = counts[3] = counts[4] = 1;
+    }
+    else if (sscanf(spec, "%d,%d,%d,%d,%d%n", &counts[0], &counts[1], &counts[2], &counts[3], &counts[4], &length) != 5 ||
+             spec[length] != '\0')
+    {
+        return false;
+    }
+    int total = 0;
+    for (int step = 0; step < 5; step++)
+    {
+        if (counts[step] < (step < 3 ? 1 : 0) || counts[step] > STAGES_MAX)
+        {
+            return false;
+        }
+        total += counts[step];
+    }
+    if (total > STAGES_MAX)
+    {
+        return false;
+    }
+    config->fetch = (uint8_t)counts[0];
+    config->decode = (uint8_t)counts[1];
+    config->execute = (uint8_t)counts[2];
+    config->memory = (uint8_t)counts[3];
+    config->writeback = (uint8_t)counts[4];
+    return true;
+}
+
+bool ParseForwarding(const char *list, uint8_t *paths)
+{
+    if (strcmp(list, "none") == 0)
+    {
+        *paths = 0;
+        return true;
+    }
+    uint8_t parsed = 0;
+    const char *name = list;
+    for (;;)
+    {
+        size_t length = strcspn(name, ",");
+        if (length == 2 && strncmp(name, "ex", 2) == 0)
+        {
+            parsed |= FORWARD_EX;
+        }
+        else if (length == 3 && strncmp(name, "mem", 3) == 0)
+        {
+            parsed |= FORWARD_MEM;
+        }
+        else if (length == 7 && strncmp(name, "regfile", 7) == 0)
+        {
+            parsed |= FORWARD_REGFILE;
+        }
+        else
+        {
+            return false;
+        }
+        if (name[length] == '\0')
+        {
+            break;
+        }
+        name += length + 1;
+    }
+    *paths = parsed;
+    return true;
+}
+
+int StageCount(const StageConfig *config)
+{
+    return config->fetch + config->decode + config->execute + config->memory + config->writeback;
+}
+
+// Function to fill a pipeline slot with the instruction at the given address and the registers it reads and writes
+static void FillSlot(CPU *cpu, StageSlot *slot, uint16_t address)
+{
+    Instruction ins = GetPredecodedInstruction(cpu, address);
+    uint64_t first = 1ULL << ins.operand1;
+    uint64_t second = 1ULL << ins.operand2;
+    slot->address = address;
+    slot->load = ins.opcode == 10;
+    slot->memory = ins.opcode == 10 || ins.opcode == 11;
+    switch (ins.opcode)
+    {
+    case 0: // ADD, SUB, MUL, EOR
+    case 1:
+    case 2:
+    case 6:
+        slot->reads = first | second;
+        slot->writes = first;
+        break;
+    case 5: // ANDI, SAL, SAR
+    case 8:
+    case 9:
+        slot->reads = first;
+        slot->writes = first;
+        break;
+    case 3: // MOVI, LDR
+    case 10:
+        slot->reads = 0;
+        slot->writes = first;
+        break;
+    case 4: // BEQZ, STR
+    case 11:
+        slot->reads = first;
+        slot->writes = 0;
+        break;
+    case 7: // BR
+        slot->reads = first | second;
+        slot->writes = 0;
+        break;
+    default:
+        slot->reads = 0;
+        slot->writes = 0;
+        break;
+    }
+}
+
+// Function to tell which forwarding path delivers the result of the producer in the given stage to the first execute stage next cycle, 0 if none does yet
+static uint8_t ForwardingPathFrom(const StageLayout *layout, const StageSlot *producer, int stage)
+{
+    // the result exists once the producer left the stage computing it
+    int ready = producer->load ? layout->memoryLast : layout->executeLast;
+    if (stage >= ready)
+    {
+        if (stage <= layout->executeLast && (layout->forwarding & FORWARD_EX))
+        {
+            return FORWARD_EX;
+        }
+        // past the last stage there is no latch, only the register file
+        if (stage > layout->executeLast && (stage < layout->last || stage <= layout->memoryLast) &&
+            (layout->forwarding & FORWARD_MEM))
+        {
+            return FORWARD_MEM;
+        }
+    }
+    if (stage == layout->last && (layout->forwarding & FORWARD_REGFILE))
+    {
+        return FORWARD_REGFILE;
+    }
+    return 0;
+}
+
+// Function to find the older instruction the given one has to wait for, NULL if all its registers are ready (adding the forwarding paths used to forwards)
+static const StageSlot *FindBlockingProducer(const StageLayout *layout, const StageGroup *stages, const StageSlot *consumer,
+                                             uint64_t scoreboard, uint64_t forwards[3])
+{
+    uint64_t hazards = consumer->reads & scoreboard;
+    // the youngest older writer of a register is the one whose value is needed
+    for (int stage = layout->decodeLast + 1; stage <= layout->last && hazards != 0; stage++)
+    {
+        for (int k = stages[stage].count - 1; k >= 0; k--)
+        {
+            const StageSlot *producer = &stages[stage].slots[k];
+            uint64_t needed = hazards & producer->writes;
+            if (needed == 0)
+            {
+                continue;
+            }
+            uint8_t path = ForwardingPathFrom(layout, producer, stage);
+            if (path == 0)
+            {
+                return producer;
+            }
+            forwards[path == FORWARD_EX ? 0 : path == FORWARD_MEM ? 1 : 2] += __builtin_popcountll(needed);
+            hazards &= ~needed;
+        }
+    }
+    return NULL;
+}
+
+// Function to run the hazard unit for the instructions in the last decode stage, returning how many of them issue to execute
+static int IssueDecoded(const StageLayout *layout, const StageGroup *stages, StageStats *stats)
+{
+    const StageGroup *decoded = &stages[layout->decodeLast];
+    // the scoreboard: every register an instruction past decode is still going to write
+    uint64_t scoreboard = 0;
+    for (int stage = layout->decodeLast + 1; stage <= layout->last; stage++)
+    {
+        for (int k = 0; k < stages[stage].count; k++)
+        {
+            scoreboard |= stages[stage].slots[k].writes;
+        }
+    }
+
+    int issued = 0;
+    for (int k = 0; k < decoded->count; k++)
+    {
+        const StageSlot *slot = &decoded->slots[k];
+        if (k > 0)
+        {
+            // the second instruction of a pair goes along only if it is independent of the first and needs no second memory port
+            const StageSlot *first = &decoded->slots[0];
+            if ((slot->reads | slot->writes) & first->writes)
+            {
+                stats->dependenceSplits++;
+                break;
+            }
+            if (slot->memory && first->memory)
+            {
+                stats->memoryPortSplits++;
+                break;
+            }
+        }
+        uint64_t forwards[3] = {0, 0, 0};
+        const StageSlot *blocking = FindBlockingProducer(layout, stages, slot, scoreboard, forwards);
+        if (blocking != NULL)
+        {
+            if (k > 0)
+            {
+                stats->hazardSplits++;
+            }
+            else if (blocking->load)
+            {
+                stats->loadUseStalls++;
+            }
+            else
+            {
+                stats->rawStalls++;
+            }
+            break;
+        }
+        stats->forwardsEX += forwards[0];
+        stats->forwardsMEM += forwards[1];
+        stats->regfileBypasses += forwards[2];
+        issued++;
+    }
+    stats->dualIssues += issued == 2;
+    return issued;
+}
+
+// Function to find the row fetch continued with after the given instruction of the given stage
+static uint16_t NextFetched(const StageGroup *stages, int stage, int k, uint16_t fetchPC)
+{
+    if (k + 1 < stages[stage].count)
+    {
+        return stages[stage].slots[k + 1].address;
+    }
+    for (int younger = stage - 1; younger >= 0; younger--)
+    {
+        if (stages[younger].count != 0)
+        {
+            return stages[younger].slots[0].address;
+        }
+    }
+    return fetchPC;
+}
+
+// Function to throw away every instruction younger than the given instruction of the given stage, returning how many there were
+static uint64_t FlushYounger(StageGroup *stages, int stage, int k)
+{
+    uint64_t flushed = stages[stage].count - (k + 1);
+    stages[stage].count = (uint8_t)(k + 1);
+    for (int younger = 0; younger < stage; younger++)
+    {
+        flushed += stages[younger].count;
+        stages[younger].count = 0;
+    }
+    return flushed;
+}
+
+EngineResult RunStagedPipeline(CPU *cpu, const StageConfig *config, uint64_t maxInstructions, StageStats *stats)
+{
+    StageLayout layout;
+    layout.decodeLast = config->fetch + config->decode - 1;
+    layout.executeLast = layout.decodeLast + config->execute;
+    layout.memoryLast = layout.executeLast + config->memory;
+    layout.last = StageCount(config) - 1;
+    layout.forwarding = config->forwarding;
+
+    StageGroup stages[STAGES_MAX];
+    memset(stages, 0, sizeof(stages));
+    memset(stats, 0, sizeof(*stats));
+    EngineResult result = {0, false};
+    uint16_t fetchPC = cpu->pc;
+    bool fetching = true;
+    bool predicting = PredictorActive(cpu);
+    bool refetch = false;
+    for (;;)
+    {
+        // fetch reads up to width consecutive rows, a predicted taken branch ends the group
+        for (int k = 0; fetching && stages[0].count == k && k < config->width; k++)
+        {
+            uint16_t address = fetchPC;
+            if (ReadInstructionMemory(cpu, address) == -1)
+            {
+                break;
+            }
+            FillSlot(cpu, &stages[0].slots[k], address);
+            stages[0].count++;
+            fetchPC = predicting ? PredictNextPC(cpu, address) : address + 1;
+            if (fetchPC != address + 1)
+            {
+                break;
+            }
+        }
+        // the cycle after a flush fetches again, even when the branch went to an empty row
+        bool busy = refetch;
+        refetch = false;
+        for (int stage = 0; stage <= layout.last && !busy; stage++)
+        {
+            busy = stages[stage].count != 0;
+        }
+        if (!busy)
+        {
+            result.halted = true;
+            break;
+        }
+        stats->cycles++;
+
+        StageGroup *executing = &stages[layout.executeLast];
+        bool budgetReached = false;
+        for (int k = 0; k < executing->count && !budgetReached; k++)
+        {
+            uint16_t address = executing->slots[k].address;
+            Instruction ins = GetPredecodedInstruction(cpu, address);
+            bool branch = ins.opcode == 4 || ins.opcode == 7;
+            bool taken = ins.opcode == 7 || (ins.opcode == 4 && ReadRegister(cpu, ins.operand1) == 0);
+            StepResult step = StepInstruction(cpu);
+            result.instructions++;
+            cpu->retired++;
+            budgetReached = maxInstructions != 0 && result.instructions >= maxInstructions;
+            if (step == STEP_EXECUTED_AND_HALTED)
+            {
+                // a taken branch in the last two rows ends the program, the older instructions drain
+                stats->flushedSlots += FlushYounger(stages, layout.executeLast, k);
+                fetching = false;
+                break;
+            }
+            uint16_t fetched = NextFetched(stages, layout.executeLast, k, fetchPC);
+            bool wrong = branch && GetExecutePC(cpu, address) == address + 3
+                             ? TrainPredictor(cpu, ins, address, taken, cpu->pc, fetched)
+                             : fetched != cpu->pc;
+            if (wrong)
+            {
+                stats->flushes++;
+                stats->flushedSlots += FlushYounger(stages, layout.executeLast, k);
+                fetchPC = cpu->pc;
+                refetch = true;
+            }
+        }
+
+        // every stage advances, except decode and the stages before it when the hazard unit holds an instruction back
+        StageGroup *decoded = &stages[layout.decodeLast];
+        int issued = IssueDecoded(&layout, stages, stats);
+        bool stall = issued < decoded->count;
+        for (int stage = layout.last; stage > 0; stage--)
+        {
+            if (stage == layout.decodeLast + 1 && stall)
+            {
+                // the issued instructions go on (none is a bubble), the others wait in decode
+                stages[stage].count = (uint8_t)issued;
+                memcpy(stages[stage].slots, decoded->slots, issued * sizeof(StageSlot));
+                memmove(decoded->slots, decoded->slots + issued, (decoded->count - issued) * sizeof(StageSlot));
+                decoded->count = (uint8_t)(decoded->count - issued);
+                break;
+            }
+            stages[stage] = stages[stage - 1];
+        }
+        if (!stall)
+        {
+            stages[0].count = 0;
+        }
+
+        if (budgetReached)
+        {
+            result.halted = !fetching || ReadInstructionMemory(cpu, cpu->pc) == -1;
+            break;
+        }
+    }
+    stats->instructions = result.instructions;
+    cpu->clockcycles += (int)stats->cycles;
+    return result;
+}
+
+double RelativeClockPeriod(const StageConfig *config)
+{
+    // the logic of the 3 stage pipeline, spread evenly over the stages, plus one latch per stage
+    double logic = 3.0 * (1.0 - STAGES_LATCH_OVERHEAD);
+    return logic / StageCount(config) + STAGES_LATCH_OVERHEAD;
+}
+
+void PrintStageStats(const StageConfig *config, const StageStats *stats, FILE *out)
+{
+    const uint8_t counts[5] = {config->fetch, config->decode, config->execute, config->memory, config->writeback};
+    fprintf(out, "Pipeline Stages: \n");
+    fprintf(out, "-------------------------------------------------- \n");
+    fprintf(out, "%d stages%s:", StageCount(config), config->width > 1 ? ", dual-issue" : "");
+    for (int step = 0; step < 5; step++)
+    {
+        for (int stage = 1; stage <= counts[step]; stage++)
+        {
+            if (counts[step] == 1)
+            {
+                fprintf(out, " %s", stepNames[step]);
+            }
+            else
+            {
+                fprintf(out, " %s%d", stepNames[step], stage);
+            }
+        }
+    }
+    fprintf(out, "  forwarding:%s%s%s%s\n", config->forwarding == 0 ? " none" : "",
+            (config->forwarding & FORWARD_EX) ? " ex" : "", (config->forwarding & FORWARD_MEM) ? " mem" : "",
+            (config->forwarding & FORWARD_REGFILE) ? " regfile" : "");
+    double cpi = Ratio(stats->cycles, stats->instructions);
+    fprintf(out, "Cycles: %llu  Instructions: %llu  CPI: %.4f  IPC: %.4f\n", (unsigned long long)stats->cycles,
+            (unsigned long long)stats->instructions, cpi, Ratio(stats->instructions, stats->cycles));
+    if (config->width > 1)
+    {
+        fprintf(out, "Issue width %d: %llu cycles issued two, pairs split by dependence %llu, memory port %llu, hazard %llu\n",
+                config->width, (unsigned long long)stats->dualIssues, (unsigned long long)stats->dependenceSplits,
+                (unsigned long long)stats->memoryPortSplits, (unsigned long long)stats->hazardSplits);
+    }
+    fprintf(out, "Stall cycles: %llu RAW (CPI %.4f), %llu load-use (CPI %.4f)\n", (unsigned long long)stats->rawStalls,
+            Ratio(stats->rawStalls, stats->instructions), (unsigned long long)stats->loadUseStalls,
+            Ratio(stats->loadUseStalls, stats->instructions));
+    fprintf(out, "Flushes: %llu, %llu instructions thrown away\n", (unsigned long long)stats->flushes,
+            (unsigned long long)stats->flushedSlots);
+    fprintf(out, "Forwarded operands: %llu ex, %llu mem, %llu register file\n", (unsigned long long)stats->forwardsEX,
+            (unsigned long long)stats->forwardsMEM, (unsigned long long)stats->regfileBypasses);
+    double period = RelativeClockPeriod(config);
+    fprintf(out, "Clock period: %.3f of 3 stages  Time per instruction: %.4f 3 stage cycles\n", period, cpi * period);
+    fprintf(out, "-------------------------------------------------- \n");
+}
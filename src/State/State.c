@@ -0,0 +1,834 @@
+/**
+ * @file State.c
+ * @brief The final state of a processor and its differences from a reference, found from the dirty map
+ * and written as text, JSON or a binary state file with a single write.
+ */
+
+#include "../Headers/State.h"
+#include "../Headers/CPU.h"
+#include "../Headers/Checkpoint.h"
+#include "../Headers/Endian.h"
+#include "../Headers/Image.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Registers.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// PC, SREG, clockcycles, retired, then the three lists with every location listed
+#define STATE_MAX_BODY_BYTES (2 + 1 + 4 + 8 + 1 + 64 * 2 + 2 + 2048 * 3 + 2 + 1024 * 4)
+
+// a JSON state with every location listed ("2047": -128, for each byte) stays well below this
+#define STATE_MAX_JSON_BYTES 65536
+
+_Static_assert(sizeof(StateHeader) == 16, "the state header is 16 bytes");
+
+static const char *formatNames[] = {"text", "json", "binary"};
+static const char separator[] = "-------------------------------------------------- \n";
+
+/**
+ * @brief The output being collected before the single write.
+ */
+typedef struct {
+    char *bytes;
+    size_t used;
+    size_t size;
+} StateBuffer;
+
+/**
+ * @brief A location whose value differs from the reference (or from its reset value).
+ */
+typedef struct {
+    uint16_t location; /**< The register, address or row. */
+    int16_t before;    /**< The value of the reference, or the reset value. */
+    int16_t after;     /**< The value of the processor. */
+} StateChange;
+
+/**
+ * @brief Every location of a processor whose value differs, in increasing order.
+ */
+typedef struct {
+    int registerCount;
+    int dataCount;
+    int instructionCount;
+    StateChange registers[64];
+    StateChange data[2048];
+    StateChange instructions[1024];
+} StateChanges;
+
+void MarkDirtyRange(uint64_t *bits, size_t first, size_t count)
+{
+    for (size_t location = first; location < first + count; location++)
+    {
+        bits[location / 64] |= UINT64_C(1) << (location % 64);
+    }
+}
+
+void MarkLoadedRegisters(CPU *cpu)
+{
+    for (int reg = 0; reg < 64; reg++)
+    {
+        if (cpu->generalRegisters[reg] != 0)
+        {
+            MarkRegisterDirty(cpu, (uint8_t)reg);
+        }
+    }
+}
+
+bool ParseStateFormat(const char *name, StateFormat *format)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (strcmp(name, formatNames[i]) == 0)
+        {
+            *format = (StateFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to make room for more bytes at the end of the buffer
+static void Reserve(StateBuffer *buffer, size_t more)
+{
+    if (buffer->used + more <= buffer->size)
+    {
+        return;
+    }
+    size_t size = buffer->size == 0 ? 16384 : buffer->size;
+    while (size < buffer->used + more)
+    {
+        size *= 2;
+    }
+    char *bytes = realloc(buffer->bytes, size);
+    if (bytes == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    buffer->bytes = bytes;
+    buffer->size = size;
+}
+
+static void AppendBytes(StateBuffer *buffer, const void *bytes, size_t length)
+{
+    Reserve(buffer, length);
+    memcpy(buffer->bytes + buffer->used, bytes, length);
+    buffer->used += length;
+}
+
+static void AppendText(StateBuffer *buffer, const char *text)
+{
+    AppendBytes(buffer, text, strlen(text));
+}
+
+// Function to append a number in decimal, without going through printf
+static void AppendInt(StateBuffer *buffer, long value)
+{
+    char digits[24];
+    int count = 0;
+    unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+    do
+    {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    Reserve(buffer, (size_t)count + 1);
+    if (value < 0)
+    {
+        buffer->bytes[buffer->used++] = '-';
+    }
+    while (count > 0)
+    {
+        buffer->bytes[buffer->used++] = digits[--count];
+    }
+}
+
+// Function to write the collected output with one fwrite and free it
+static void FlushBuffer(StateBuffer *buffer, FILE *out)
+{
+    fwrite(buffer->bytes, 1, buffer->used, out);
+    free(buffer->bytes);
+}
+
+// Function to list the locations marked in either dirty map whose values differ; reference NULL compares with the reset values
+static void CollectChanges(const CPU *cpu, const CPU *reference, StateChanges *changes)
+{
+    changes->registerCount = 0;
+    changes->dataCount = 0;
+    changes->instructionCount = 0;
+
+    uint64_t bits = cpu->dirty.registers | (reference != NULL ? reference->dirty.registers : 0);
+    while (bits != 0)
+    {
+        int reg = __builtin_ctzll(bits);
+        bits &= bits - 1;
+        int8_t before = reference != NULL ? reference->generalRegisters[reg] : 0;
+        if (cpu->generalRegisters[reg] != before)
+        {
+            changes->registers[changes->registerCount++] = (StateChange){(uint16_t)reg, before, cpu->generalRegisters[reg]};
+        }
+    }
+
+    for (int word = 0; word < 2048 / 64; word++)
+    {
+        bits = cpu->dirty.data[word] | (reference != NULL ? reference->dirty.data[word] : 0);
+        while (bits != 0)
+        {
+            uint16_t address = (uint16_t)(word * 64 + __builtin_ctzll(bits));
+            bits &= bits - 1;
+            int8_t before = reference != NULL ? PageReadData(reference, address) : 0;
+            int8_t after = PageReadData(cpu, address);
+            if (after != before)
+            {
+                changes->data[changes->dataCount++] = (StateChange){address, before, after};
+            }
+        }
+    }
+
+    for (int word = 0; word < 1024 / 64; word++)
+    {
+        bits = cpu->dirty.instructions[word] | (reference != NULL ? reference->dirty.instructions[word] : 0);
+        while (bits != 0)
+        {
+            uint16_t address = (uint16_t)(word * 64 + __builtin_ctzll(bits));
+            bits &= bits - 1;
+            int16_t before = reference != NULL ? PageReadInstruction(reference, address) : -1;
+            int16_t after = PageReadInstruction(cpu, address);
+            if (after != before)
+            {
+                changes->instructions[changes->instructionCount++] = (StateChange){address, before, after};
+            }
+        }
+    }
+}
+
+// Function to append the listing of PrintAllRegisters, PrintAllDataMemory and PrintAllInstructionMemory
+static void AppendTextState(StateBuffer *buffer, const CPU *cpu, const StateChanges *changes)
+{
+    static const char *flagNames[8] = {"C: ", "V: ", "N: ", "S: ", "Z: ", "6: ", "7: ", "8: "};
+
+    AppendText(buffer, "Final State of Registers:\n");
+    AppendText(buffer, separator);
+    AppendText(buffer, "General Registers:\n");
+    for (int reg = 0; reg < 64; reg++)
+    {
+        AppendText(buffer, "Register ");
+        AppendInt(buffer, reg);
+        AppendText(buffer, ": ");
+        AppendInt(buffer, cpu->generalRegisters[reg]);
+        AppendText(buffer, "\n");
+        AppendText(buffer, separator);
+    }
+    AppendText(buffer, separator);
+    uint8_t sreg = ReadStatusRegister(cpu);
+    AppendText(buffer, "Status Register:\n");
+    for (int bit = 0; bit < 8; bit++)
+    {
+        AppendText(buffer, flagNames[bit]);
+        AppendInt(buffer, (sreg >> bit) & 1);
+        AppendText(buffer, "\n");
+    }
+
+    AppendText(buffer, "Final State of Data Memory: \n");
+    AppendText(buffer, separator);
+    for (int i = 0; i < changes->dataCount; i++)
+    {
+        AppendText(buffer, "Address:");
+        AppendInt(buffer, changes->data[i].location);
+        AppendText(buffer, " DataMemory Data: ");
+        AppendInt(buffer, changes->data[i].after);
+        AppendText(buffer, "\n");
+    }
+    AppendText(buffer, separator);
+
+    AppendText(buffer, "Final State of Instruction Memory: \n");
+    AppendText(buffer, separator);
+    for (int i = 0; i < changes->instructionCount; i++)
+    {
+        int16_t instruction = changes->instructions[i].after; // never -1, the reset value
+        uint8_t opcode = GetOpcode(instruction);
+        AppendText(buffer, "Instruction ");
+        AppendInt(buffer, changes->instructions[i].location);
+        AppendText(buffer, ": Opcode:");
+        AppendInt(buffer, opcode);
+        AppendText(buffer, "  Register:");
+        AppendInt(buffer, GetOperand1(instruction));
+        AppendText(buffer, "  Reg/IMM:");
+        AppendInt(buffer, GetValue2(instruction));
+        AppendText(buffer, "  Type:");
+        char type[2] = {GetOpcodeType(opcode), '\0'};
+        AppendText(buffer, type);
+        AppendText(buffer, "\n");
+        AppendText(buffer, separator);
+    }
+}
+
+// Function to append one text line of a difference: "<label><location><middle><before> -> <after>"
+static void AppendTextChange(StateBuffer *buffer, const char *label, long location, const char *middle, long before,
+                             long after)
+{
+    AppendText(buffer, label);
+    if (location >= 0)
+    {
+        AppendInt(buffer, location);
+    }
+    AppendText(buffer, middle);
+    AppendInt(buffer, before);
+    AppendText(buffer, " -> ");
+    AppendInt(buffer, after);
+    AppendText(buffer, "\n");
+}
+
+// Function to check whether the clock cycles differ, a state without clock cycles matches any
+static bool CyclesDiffer(const CPU *cpu, const CPU *reference)
+{
+    return cpu->clockcycles != STATE_CYCLES_UNKNOWN && reference->clockcycles != STATE_CYCLES_UNKNOWN &&
+           cpu->clockcycles != reference->clockcycles;
+}
+
+// Function to count the scalars and the locations that differ from the reference
+static int CountDifferences(const CPU *cpu, const CPU *reference, const StateChanges *changes)
+{
+    return (cpu->pc != reference->pc) + (ReadStatusRegister(cpu) != ReadStatusRegister(reference)) +
+           CyclesDiffer(cpu, reference) + changes->registerCount + changes->dataCount +
+           changes->instructionCount;
+}
+
+// Function to append the differences as text, one line each
+static void AppendTextDiff(StateBuffer *buffer, const CPU *cpu, const CPU *reference, const StateChanges *changes)
+{
+    uint8_t sreg = ReadStatusRegister(cpu);
+    uint8_t referenceSreg = ReadStatusRegister(reference);
+    AppendText(buffer, "Differences from the reference: ");
+    AppendInt(buffer, CountDifferences(cpu, reference, changes));
+    AppendText(buffer, "\n");
+    AppendText(buffer, separator);
+    if (cpu->pc != reference->pc)
+    {
+        AppendTextChange(buffer, "PC", -1, ": ", reference->pc, cpu->pc);
+    }
+    if (sreg != referenceSreg)
+    {
+        AppendTextChange(buffer, "SREG", -1, ": ", referenceSreg, sreg);
+    }
+    if (CyclesDiffer(cpu, reference))
+    {
+        AppendTextChange(buffer, "Clock cycles", -1, ": ", reference->clockcycles - 1, cpu->clockcycles - 1);
+    }
+    for (int i = 0; i < changes->registerCount; i++)
+    {
+        const StateChange *change = &changes->registers[i];
+        AppendTextChange(buffer, "Register ", change->location, ": ", change->before, change->after);
+    }
+    for (int i = 0; i < changes->dataCount; i++)
+    {
+        const StateChange *change = &changes->data[i];
+        AppendTextChange(buffer, "Address:", change->location, " DataMemory Data: ", change->before, change->after);
+    }
+    for (int i = 0; i < changes->instructionCount; i++)
+    {
+        const StateChange *change = &changes->instructions[i];
+        AppendTextChange(buffer, "Instruction ", change->location, ": ", change->before, change->after);
+    }
+    AppendText(buffer, separator);
+}
+
+// Function to append a JSON member holding a number, or [reference, value] in a diff
+static void AppendJSONValue(StateBuffer *buffer, const char *name, long before, long after, bool diff)
+{
+    AppendText(buffer, "  \"");
+    AppendText(buffer, name);
+    AppendText(buffer, "\": ");
+    if (diff)
+    {
+        AppendText(buffer, "[");
+        AppendInt(buffer, before);
+        AppendText(buffer, ", ");
+        AppendInt(buffer, after);
+        AppendText(buffer, "]");
+    }
+    else
+    {
+        AppendInt(buffer, after);
+    }
+    AppendText(buffer, ",\n");
+}
+
+// Function to append a JSON object of changes keyed by location
+static void AppendJSONChanges(StateBuffer *buffer, const char *name, const StateChange *changes, int count, bool diff,
+                              bool last)
+{
+    AppendText(buffer, "  \"");
+    AppendText(buffer, name);
+    AppendText(buffer, "\": {");
+    for (int i = 0; i < count; i++)
+    {
+        AppendText(buffer, i == 0 ? "\"" : ", \"");
+        AppendInt(buffer, changes[i].location);
+        AppendText(buffer, "\": ");
+        if (diff)
+        {
+            AppendText(buffer, "[");
+            AppendInt(buffer, changes[i].before);
+            AppendText(buffer, ", ");
+            AppendInt(buffer, changes[i].after);
+            AppendText(buffer, "]");
+        }
+        else
+        {
+            AppendInt(buffer, changes[i].after);
+        }
+    }
+    AppendText(buffer, last ? "}\n" : "},\n");
+}
+
+// Function to append the state (reference NULL) or the differences as one JSON object
+static void AppendJSON(StateBuffer *buffer, const CPU *cpu, const CPU *reference, const StateChanges *changes)
+{
+    bool diff = reference != NULL;
+    uint8_t sreg = ReadStatusRegister(cpu);
+    AppendText(buffer, "{\n");
+    if (!diff)
+    {
+        AppendJSONValue(buffer, "pc", 0, cpu->pc, false);
+        AppendJSONValue(buffer, "sreg", 0, sreg, false);
+        if (cpu->clockcycles != STATE_CYCLES_UNKNOWN)
+        {
+            AppendJSONValue(buffer, "cycles", 0, cpu->clockcycles - 1, false); // elapsed, the counter starts at 1
+        }
+        if (cpu->retired != STATE_RETIRED_UNKNOWN)
+        {
+            AppendJSONValue(buffer, "retired", 0, (long)cpu->retired, false);
+        }
+    }
+    else
+    {
+        uint8_t referenceSreg = ReadStatusRegister(reference);
+        if (cpu->pc != reference->pc)
+        {
+            AppendJSONValue(buffer, "pc", reference->pc, cpu->pc, true);
+        }
+        if (sreg != referenceSreg)
+        {
+            AppendJSONValue(buffer, "sreg", referenceSreg, sreg, true);
+        }
+        if (CyclesDiffer(cpu, reference))
+        {
+            AppendJSONValue(buffer, "cycles", reference->clockcycles - 1, cpu->clockcycles - 1, true);
+        }
+    }
+    AppendJSONChanges(buffer, "registers", changes->registers, changes->registerCount, diff, false);
+    AppendJSONChanges(buffer, "data_memory", changes->data, changes->dataCount, diff, false);
+    AppendJSONChanges(buffer, "instruction_memory", changes->instructions, changes->instructionCount, diff, true);
+    AppendText(buffer, "}\n");
+}
+
+// Function to append a binary state file (see StateHeader)
+static void AppendBinary(StateBuffer *buffer, const CPU *cpu, const StateChanges *changes, bool diff)
+{
+    Reserve(buffer, sizeof(StateHeader) + STATE_MAX_BODY_BYTES);
+    uint8_t *p = (uint8_t *)buffer->bytes + sizeof(StateHeader);
+    PutU16(&p, cpu->pc);
+    PutU8(&p, ReadStatusRegister(cpu));
+    PutU32(&p, (uint32_t)cpu->clockcycles);
+    PutU64(&p, cpu->retired);
+    PutU8(&p, (uint8_t)changes->registerCount);
+    for (int i = 0; i < changes->registerCount; i++)
+    {
+        PutU8(&p, (uint8_t)changes->registers[i].location);
+        PutU8(&p, (uint8_t)changes->registers[i].after);
+    }
+    PutU16(&p, (uint16_t)changes->dataCount);
+    for (int i = 0; i < changes->dataCount; i++)
+    {
+        PutU16(&p, changes->data[i].location);
+        PutU8(&p, (uint8_t)changes->data[i].after);
+    }
+    PutU16(&p, (uint16_t)changes->instructionCount);
+    for (int i = 0; i < changes->instructionCount; i++)
+    {
+        PutU16(&p, changes->instructions[i].location);
+        PutU16(&p, (uint16_t)changes->instructions[i].after);
+    }
+
+    buffer->used = (size_t)(p - (uint8_t *)buffer->bytes);
+    StateHeader header;
+    memcpy(header.magic, STATE_MAGIC, 4);
+    header.version = STATE_VERSION;
+    header.flags = diff ? STATE_FLAG_DIFF : 0;
+    header.length = (uint32_t)(buffer->used - sizeof(StateHeader));
+    header.checksum = ImageChecksum(buffer->bytes + sizeof(StateHeader), header.length);
+    memcpy(buffer->bytes, &header, sizeof(header));
+}
+
+void WriteState(const CPU *cpu, StateFormat format, FILE *out)
+{
+    StateChanges *changes = malloc(sizeof(StateChanges));
+    if (changes == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    CollectChanges(cpu, NULL, changes);
+    StateBuffer buffer = {NULL, 0, 0};
+    switch (format)
+    {
+    case STATE_FORMAT_TEXT:
+        AppendTextState(&buffer, cpu, changes);
+        break;
+    case STATE_FORMAT_JSON:
+        AppendJSON(&buffer, cpu, NULL, changes);
+        break;
+    case STATE_FORMAT_BINARY:
+        AppendBinary(&buffer, cpu, changes, false);
+        break;
+    }
+    free(changes);
+    FlushBuffer(&buffer, out);
+}
+
+void WriteStateDiff(const CPU *cpu, const CPU *reference, StateFormat format, FILE *out)
+{
+    StateChanges *changes = malloc(sizeof(StateChanges));
+    if (changes == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    CollectChanges(cpu, reference, changes);
+    StateBuffer buffer = {NULL, 0, 0};
+    switch (format)
+    {
+    case STATE_FORMAT_TEXT:
+        AppendTextDiff(&buffer, cpu, reference, changes);
+        break;
+    case STATE_FORMAT_JSON:
+        AppendJSON(&buffer, cpu, reference, changes);
+        break;
+    case STATE_FORMAT_BINARY:
+        AppendBinary(&buffer, cpu, changes, true);
+        break;
+    }
+    free(changes);
+    FlushBuffer(&buffer, out);
+}
+
+int CountStateDifferences(const CPU *cpu, const CPU *reference)
+{
+    StateChanges *changes = malloc(sizeof(StateChanges));
+    if (changes == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    CollectChanges(cpu, reference, changes);
+    int differences = CountDifferences(cpu, reference, changes);
+    free(changes);
+    return differences;
+}
+
+// Function to report a state file that cannot be loaded; always returns false
+static bool StateError(AssemblerError *error, int line, const char *message)
+{
+    if (error != NULL)
+    {
+        error->line = line;
+        error->column = 0;
+        snprintf(error->message, sizeof(error->message), "%s", message);
+    }
+    return false;
+}
+
+/**
+ * @brief A position in the text of a JSON state file.
+ */
+typedef struct {
+    const char *p;   /**< The next character. */
+    const char *end; /**< The end of the text. */
+} JSONCursor;
+
+// Function to skip white space
+static void SkipSpace(JSONCursor *cursor)
+{
+    while (cursor->p < cursor->end && (*cursor->p == ' ' || *cursor->p == '\n' || *cursor->p == '\r' || *cursor->p == '\t'))
+    {
+        cursor->p++;
+    }
+}
+
+// Function to consume a character after white space; false if another one comes
+static bool ExpectChar(JSONCursor *cursor, char c)
+{
+    SkipSpace(cursor);
+    if (cursor->p < cursor->end && *cursor->p == c)
+    {
+        cursor->p++;
+        return true;
+    }
+    return false;
+}
+
+// Function to tell whether the next character after white space is c, without consuming it
+static bool PeekChar(JSONCursor *cursor, char c)
+{
+    SkipSpace(cursor);
+    return cursor->p < cursor->end && *cursor->p == c;
+}
+
+// Function to read a quoted key and the colon after it
+static bool ParseKey(JSONCursor *cursor, char *key, size_t size)
+{
+    if (!ExpectChar(cursor, '"'))
+    {
+        return false;
+    }
+    size_t length = 0;
+    while (cursor->p < cursor->end && *cursor->p != '"')
+    {
+        if (length + 1 >= size)
+        {
+            return false;
+        }
+        key[length++] = *cursor->p++;
+    }
+    key[length] = '\0';
+    return ExpectChar(cursor, '"') && ExpectChar(cursor, ':');
+}
+
+// Function to read an integer within [min, max]
+static bool ParseInteger(JSONCursor *cursor, long min, long max, long *value)
+{
+    SkipSpace(cursor);
+    char digits[24];
+    size_t length = 0;
+    while (cursor->p < cursor->end && length + 1 < sizeof(digits) &&
+           (*cursor->p == '-' || (*cursor->p >= '0' && *cursor->p <= '9')))
+    {
+        digits[length++] = *cursor->p++;
+    }
+    digits[length] = '\0';
+    char *end;
+    *value = strtol(digits, &end, 10);
+    return length > 0 && *end == '\0' && *value >= min && *value <= max;
+}
+
+// Function to read a {"location": value, ...} list into a processor; kind 0 registers, 1 data memory, 2 instruction memory
+static bool ParseLocations(JSONCursor *cursor, CPU *cpu, int kind)
+{
+    static const long lastLocation[] = {63, 2047, 1023};
+    static const long minValue[] = {-128, -128, -32768};
+    static const long maxValue[] = {127, 127, 32767};
+    if (!ExpectChar(cursor, '{'))
+    {
+        return false;
+    }
+    if (ExpectChar(cursor, '}'))
+    {
+        return true;
+    }
+    do
+    {
+        char key[8];
+        char *end;
+        long value;
+        if (!ParseKey(cursor, key, sizeof(key)) || !ParseInteger(cursor, minValue[kind], maxValue[kind], &value))
+        {
+            return false;
+        }
+        long location = strtol(key, &end, 10);
+        if (key[0] == '\0' || *end != '\0' || location < 0 || location > lastLocation[kind])
+        {
+            return false;
+        }
+        if (kind == 0)
+        {
+            cpu->generalRegisters[location] = (int8_t)value;
+            MarkRegisterDirty(cpu, (uint8_t)location);
+        }
+        else if (kind == 1)
+        {
+            PageWriteData(cpu, (uint16_t)location, (int8_t)value);
+        }
+        else
+        {
+            PageWriteInstruction(cpu, (uint16_t)location, (int16_t)value);
+        }
+    } while (ExpectChar(cursor, ','));
+    return ExpectChar(cursor, '}');
+}
+
+// Function to load a JSON state written by WriteState; the processor is reset first and again on failure
+static bool LoadJSONState(CPU *cpu, const char *text, size_t length, AssemblerError *error)
+{
+    static const char *lists[] = {"registers", "data_memory", "instruction_memory"};
+    JSONCursor cursor = {text, text + length};
+    ResetCPU(cpu);
+    cpu->clockcycles = STATE_CYCLES_UNKNOWN; // until a "cycles" key says otherwise
+    bool ok = ExpectChar(&cursor, '{');
+    if (ok && !ExpectChar(&cursor, '}'))
+    {
+        do
+        {
+            char key[24];
+            long value;
+            if (!ParseKey(&cursor, key, sizeof(key)))
+            {
+                ok = false;
+                break;
+            }
+            if (PeekChar(&cursor, '['))
+            {
+                ResetCPU(cpu);
+                return StateError(error, -1, "a state diff cannot be a reference");
+            }
+            int list = -1;
+            for (int i = 0; i < 3; i++)
+            {
+                list = strcmp(key, lists[i]) == 0 ? i : list;
+            }
+            if (list >= 0)
+            {
+                ok = ParseLocations(&cursor, cpu, list);
+            }
+            else if (strcmp(key, "pc") == 0 && (ok = ParseInteger(&cursor, 0, UINT16_MAX, &value)))
+            {
+                cpu->pc = (uint16_t)value;
+            }
+            else if (strcmp(key, "sreg") == 0 && (ok = ParseInteger(&cursor, 0, UINT8_MAX, &value)))
+            {
+                WriteStatusRegister(cpu, (uint8_t)value);
+            }
+            else if (strcmp(key, "cycles") == 0 && (ok = ParseInteger(&cursor, 0, INT32_MAX - 1, &value)))
+            {
+                cpu->clockcycles = (int)value + 1;
+            }
+            else if (strcmp(key, "retired") == 0 && (ok = ParseInteger(&cursor, 0, LONG_MAX, &value)))
+            {
+                cpu->retired = (uint64_t)value;
+            }
+            else
+            {
+                ok = false;
+            }
+        } while (ok && ExpectChar(&cursor, ','));
+        ok = ok && ExpectChar(&cursor, '}');
+    }
+    SkipSpace(&cursor);
+    if (!ok || cursor.p != cursor.end)
+    {
+        ResetCPU(cpu);
+        return StateError(error, -1, "damaged JSON state file");
+    }
+    return true;
+}
+
+// Function to load the bytes of a state file, a JSON state or (through its file) a checkpoint
+static bool LoadStateBytes(CPU *cpu, const char *file_name, const uint8_t *file, size_t length, AssemblerError *error)
+{
+    if (IsCheckpoint(file, length))
+    {
+        return LoadCheckpoint(cpu, file_name, error);
+    }
+    size_t first = 0;
+    while (first < length && (file[first] == ' ' || file[first] == '\n' || file[first] == '\r' || file[first] == '\t'))
+    {
+        first++;
+    }
+    if (first < length && file[first] == '{')
+    {
+        if (length > STATE_MAX_JSON_BYTES)
+        {
+            return StateError(error, -1, "JSON state file too large");
+        }
+        return LoadJSONState(cpu, (const char *)file, length, error);
+    }
+    if (length < sizeof(StateHeader) || memcmp(file, STATE_MAGIC, 4) != 0)
+    {
+        return StateError(error, -1, "neither a state file nor a checkpoint");
+    }
+    if (length > sizeof(StateHeader) + STATE_MAX_BODY_BYTES)
+    {
+        return StateError(error, -1, "truncated or damaged state file");
+    }
+    StateHeader header;
+    memcpy(&header, file, sizeof(header));
+    if (header.version != STATE_VERSION)
+    {
+        return StateError(error, -1, "unsupported state file version");
+    }
+    if (header.flags & STATE_FLAG_DIFF)
+    {
+        return StateError(error, -1, "a state diff cannot be a reference");
+    }
+    const uint8_t *p = file + sizeof(header);
+    if (header.length != length - sizeof(header) || ImageChecksum(p, header.length) != header.checksum)
+    {
+        return StateError(error, -1, "truncated or damaged state file");
+    }
+
+    // check that the three lists fill the body exactly before anything is written
+    size_t size = header.length;
+    size_t offset = 15;
+    size_t registerCount = offset < size ? p[offset] : 0;
+    offset += 1 + registerCount * 2;
+    size_t dataCount = offset + 2 <= size ? LoadLE16(p + offset) : 0;
+    offset += 2 + dataCount * 3;
+    size_t instructionCount = offset + 2 <= size ? LoadLE16(p + offset) : 0;
+    offset += 2 + instructionCount * 4;
+    if (offset != size)
+    {
+        return StateError(error, -1, "truncated or damaged state file");
+    }
+
+    ResetCPU(cpu);
+    cpu->pc = GetU16(&p);
+    WriteStatusRegister(cpu, GetU8(&p));
+    cpu->clockcycles = (int)GetU32(&p);
+    cpu->retired = GetU64(&p);
+    p++;
+    for (size_t i = 0; i < registerCount; i++)
+    {
+        uint8_t reg = GetU8(&p);
+        cpu->generalRegisters[reg & 63] = (int8_t)GetU8(&p);
+        MarkRegisterDirty(cpu, reg);
+    }
+    p += 2;
+    for (size_t i = 0; i < dataCount; i++)
+    {
+        uint16_t address = GetU16(&p);
+        PageWriteData(cpu, address & 2047, (int8_t)GetU8(&p));
+    }
+    p += 2;
+    for (size_t i = 0; i < instructionCount; i++)
+    {
+        uint16_t address = GetU16(&p);
+        PageWriteInstruction(cpu, address & 1023, (int16_t)GetU16(&p));
+    }
+    return true;
+}
+
+bool LoadStateReference(CPU *cpu, const char *file_name, AssemblerError *error)
+{
+    FILE *stream = fopen(file_name, "rb");
+    if (stream == NULL)
+    {
+        return StateError(error, 0, "could not open the file");
+    }
+    uint8_t *buffer = malloc(STATE_MAX_JSON_BYTES + 1);
+    if (buffer == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    size_t length = fread(buffer, 1, STATE_MAX_JSON_BYTES + 1, stream);
+    fclose(stream);
+    bool loaded = LoadStateBytes(cpu, file_name, buffer, length, error);
+    free(buffer);
+    return loaded;
+}
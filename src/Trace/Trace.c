@@ -0,0 +1,92 @@
+/**
+ * @file Trace.c
+ * @brief Trace level/sink state and the console text format of trace events.
+ */
+
+#include "../Headers/Trace.h"
+
+#include <stdio.h>
+
+TraceLevel traceLevel = TRACE_LEVEL_FLAGS; // full output unless asked otherwise
+TraceSink traceSink = TraceConsoleSink;    // sink every event goes to
+void *traceSinkContext = NULL;             // context handed to the sink
+uint32_t traceCycle = 1;                   // cycle stamped on new events
+
+// Names used by the "<Name> Flag Updated" lines, indexed by SREG bit
+static const char *flagNames[] = {"Carry", "Overflow", "Negative", "Sign", "Zero"};
+
+void TraceSetLevel(TraceLevel level)
+{
+    traceLevel = level;
+}
+
+void TraceSetSink(TraceSink sink, void *context)
+{
+    if (sink == NULL)
+    {
+        traceSink = TraceConsoleSink;
+        traceSinkContext = NULL;
+        return;
+    }
+    traceSink = sink;
+    traceSinkContext = context;
+}
+
+// Function to format a trace event exactly like the original printf output of the simulator
+int TraceFormatEvent(const TraceEvent *event, char *buffer, size_t size)
+{
+    switch (event->kind)
+    {
+    case TRACE_CYCLE_BEGIN:
+        return snprintf(buffer, size, "Cycle: %i \n", (int)event->cycle);
+    case TRACE_CYCLE_END:
+        return snprintf(buffer, size, "-------------------------------------------------- \n");
+    case TRACE_STAGE:
+        switch (event->index)
+        {
+        case TRACE_STAGE_FETCH:
+            if (!event->occupied)
+            {
+                return snprintf(buffer, size, "No more Instructions\n");
+            }
+            return snprintf(buffer, size, "Fetched Instruction %d: Opcode:%d  Register:%d Reg/IMM:%d Type:%c\n",
+                            event->address, event->opcode, event->operand1, event->value2, event->type);
+        case TRACE_STAGE_DECODE:
+            if (!event->occupied)
+            {
+                return snprintf(buffer, size, "No instruction to be decoded \n");
+            }
+            return snprintf(buffer, size, "Decoded Instruction %d : Opcode:%d  Register:%d Reg/IMM:%d Type:%c\n",
+                            event->address, event->opcode, event->operand1, event->value2, event->type);
+        default:
+            if (!event->occupied)
+            {
+                return snprintf(buffer, size, "No instruction to be executed\n");
+            }
+            return snprintf(buffer, size, "Executed Instruction %d: Opcode:%d  Register:%d Reg/IMM:%d Type:%c\n",
+                            event->address, event->opcode, event->operand1, event->value2, event->type);
+        }
+    case TRACE_REGISTER_WRITE:
+        return snprintf(buffer, size, "Updated: R%d: %d\n", event->index, event->value);
+    case TRACE_FLAG_UPDATE:
+        return snprintf(buffer, size, "%s Flag Updated: %d\n",
+                        event->index < 5 ? flagNames[event->index] : "Unknown", event->value);
+    case TRACE_MEMORY_WRITE:
+        return snprintf(buffer, size, "Update DataMemory Address:%d DataMemory Data: %d\n", event->address, event->value);
+    case TRACE_PC_WRITE:
+        return snprintf(buffer, size, "Updated: PC: %d\n", event->address);
+    default:
+        return snprintf(buffer, size, "Unknown trace event %d\n", event->kind);
+    }
+}
+
+void TraceConsoleSink(void *context, const TraceEvent *event)
+{
+    FILE *out = context != NULL ? (FILE *)context : stdout;
+    char line[128];
+    int length = TraceFormatEvent(event, line, sizeof(line));
+    if (length > 0)
+    {
+        fwrite(line, 1, (size_t)length < sizeof(line) ? (size_t)length : sizeof(line) - 1, out);
+    }
+}
@@ -0,0 +1,743 @@
+/**
+ * @file TraceFile.c
+ * @brief The compact binary trace: delta-encoded cycle records with periodic keyframes and an index,
+ * encoded by the trace writer thread and decoded back into TraceEvents by the replay tool.
+ */
+
+#include "../Headers/TraceFile.h"
+#include "../Headers/Endian.h"
+#include "../Headers/InstructionMemory.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Registers.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_FILE_TRAILER_BYTES 16
+#define TRACE_FILE_INDEX_ENTRY_BYTES 12
+
+// Function to write an LEB128 varint
+static void PutVarint(uint8_t **p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        PutU8(p, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    PutU8(p, (uint8_t)value);
+}
+
+/**
+ * @brief A bounds-checked position in the bytes of a trace.
+ */
+typedef struct {
+    const uint8_t *p;   /**< The next byte. */
+    const uint8_t *end; /**< The end of the bytes that may be read. */
+    bool ok;            /**< false once a read went past end. */
+} TraceCursor;
+
+// Function to take the next bytes at the cursor; past the end it returns NULL and clears ok
+static const uint8_t *Take(TraceCursor *cursor, size_t bytes)
+{
+    if ((size_t)(cursor->end - cursor->p) < bytes)
+    {
+        cursor->p = cursor->end;
+        cursor->ok = false;
+        return NULL;
+    }
+    const uint8_t *p = cursor->p;
+    cursor->p += bytes;
+    return p;
+}
+
+// Functions to read little-endian fields at the cursor; past the end they return 0 and clear ok
+static uint8_t ReadU8(TraceCursor *cursor)
+{
+    const uint8_t *p = Take(cursor, 1);
+    return p == NULL ? 0 : *p;
+}
+
+static uint16_t ReadU16(TraceCursor *cursor)
+{
+    const uint8_t *p = Take(cursor, 2);
+    return p == NULL ? 0 : LoadLE16(p);
+}
+
+static uint32_t ReadU32(TraceCursor *cursor)
+{
+    const uint8_t *p = Take(cursor, 4);
+    return p == NULL ? 0 : LoadLE32(p);
+}
+
+static uint64_t ReadU64(TraceCursor *cursor)
+{
+    const uint8_t *p = Take(cursor, 8);
+    return p == NULL ? 0 : LoadLE64(p);
+}
+
+static uint64_t GetVarint(TraceCursor *cursor)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t byte = ReadU8(cursor);
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+    cursor->ok = false;
+    return 0;
+}
+
+// Function to fill the stage events each instruction memory row produces, as fetchPipeline and decodePipeline report them
+static void BuildRowTable(TraceRowTable *rows, const int16_t *instructions)
+{
+    memset(rows, 0, sizeof(*rows));
+    for (int row = 0; row < 1024; row++)
+    {
+        if (instructions[row] == -1)
+        {
+            continue;
+        }
+        Instruction ins = decode((uint16_t)instructions[row]);
+        TraceEvent event = {
+            .kind = TRACE_STAGE,
+            .address = (uint16_t)row,
+            .occupied = 1,
+            .opcode = ins.opcode,
+            .operand1 = ins.operand1,
+            .value2 = (int8_t)ins.operand2,
+            .type = ins.type,
+        };
+        rows->fetch[row] = event;
+        event.value2 = ins.value2;
+        rows->decoded[row] = event;
+    }
+}
+
+// Function to tell whether two stage events report the same instruction
+static bool SameStage(const TraceEvent *a, const TraceEvent *b)
+{
+    return a->occupied == b->occupied && a->address == b->address && a->opcode == b->opcode &&
+           a->operand1 == b->operand1 && a->value2 == b->value2 && a->type == b->type;
+}
+
+// Function to find the row a stage is predicted to hold from the stages of the previous cycle; false if there is none
+static bool PredictRow(const TraceMachineState *state, uint8_t stage, uint16_t *row)
+{
+    const TraceEvent *source = &state->previous[stage == TRACE_STAGE_EXECUTE ? TRACE_STAGE_DECODE : TRACE_STAGE_FETCH];
+    if (stage > TRACE_STAGE_EXECUTE || !source->occupied)
+    {
+        return false;
+    }
+    *row = (uint16_t)(source->address + (stage == TRACE_STAGE_FETCH));
+    return true;
+}
+
+// Function to look up what a stage reports for a row; NULL past the instruction memory
+static const TraceEvent *RowEvent(const TraceRowTable *rows, uint8_t stage, uint16_t row)
+{
+    if (row >= 1024)
+    {
+        return NULL;
+    }
+    return stage == TRACE_STAGE_FETCH ? &rows->fetch[row] : &rows->decoded[row];
+}
+
+// Function to apply an event to the reconstructed state, the same way on both sides of the file
+static void ApplyEvent(TraceMachineState *state, const TraceEvent *event)
+{
+    switch (event->kind)
+    {
+    case TRACE_CYCLE_BEGIN:
+        state->cycle = event->cycle;
+        memcpy(state->previous, state->stages, sizeof(state->previous));
+        break;
+    case TRACE_STAGE:
+        if (event->index <= TRACE_STAGE_EXECUTE)
+        {
+            state->stages[event->index] = *event;
+        }
+        if (event->index == TRACE_STAGE_FETCH && event->occupied)
+        {
+            state->pc = (uint16_t)(event->address + 1);
+        }
+        break;
+    case TRACE_REGISTER_WRITE:
+        state->registers[event->index & 63] = event->value;
+        break;
+    case TRACE_FLAG_UPDATE:
+        if (event->value)
+        {
+            state->sreg |= (uint8_t)(1u << (event->index & 7));
+        }
+        else
+        {
+            state->sreg &= (uint8_t) ~(1u << (event->index & 7));
+        }
+        break;
+    case TRACE_MEMORY_WRITE:
+        state->data[event->address & 2047] = event->value;
+        break;
+    case TRACE_PC_WRITE:
+        state->pc = event->address;
+        break;
+    default:
+        break;
+    }
+}
+
+// Function to empty the stages, so nothing is predicted from before a keyframe
+static void ClearStages(TraceMachineState *state)
+{
+    memset(state->stages, 0, sizeof(state->stages));
+    memset(state->previous, 0, sizeof(state->previous));
+    for (int stage = 0; stage < 3; stage++)
+    {
+        state->stages[stage].kind = TRACE_STAGE;
+        state->stages[stage].index = (uint8_t)stage;
+        state->previous[stage] = state->stages[stage];
+    }
+}
+
+void TraceEncoderInit(TraceEncoder *encoder, const CPU *cpu, uint32_t keyframeInterval)
+{
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->keyframeInterval = keyframeInterval == 0 ? TRACE_FILE_KEYFRAME_INTERVAL : keyframeInterval;
+    if (cpu != NULL)
+    {
+        memcpy(encoder->state.registers, cpu->generalRegisters, 64);
+        encoder->state.sreg = ReadStatusRegister(cpu);
+        encoder->state.pc = cpu->pc;
+        ReadDataMemoryBlock(cpu, 0, encoder->state.data, 2048);
+        ReadInstructionMemoryBlock(cpu, 0, encoder->instructions, 1024);
+    }
+    else
+    {
+        memset(encoder->instructions, 0xff, sizeof(encoder->instructions));
+    }
+    BuildRowTable(&encoder->rows, encoder->instructions);
+    ClearStages(&encoder->state);
+}
+
+// Function to write the file header and the instruction memory
+static void EncodeHeader(const TraceEncoder *encoder, uint8_t **p)
+{
+    TraceFileHeader header = {.version = TRACE_FILE_VERSION, .keyframeInterval = encoder->keyframeInterval};
+    memcpy(header.magic, TRACE_FILE_MAGIC, 4);
+    memcpy(*p, &header, sizeof(header));
+    *p += sizeof(header);
+    uint16_t count = 0;
+    for (int row = 0; row < 1024; row++)
+    {
+        count += encoder->instructions[row] != -1;
+    }
+    PutU16(p, count);
+    for (int row = 0; row < 1024; row++)
+    {
+        if (encoder->instructions[row] != -1)
+        {
+            PutU16(p, (uint16_t)row);
+            PutU16(p, (uint16_t)encoder->instructions[row]);
+        }
+    }
+}
+
+// Function to write a keyframe of the current state and add it to the index
+static void EncodeKeyframe(TraceEncoder *encoder, uint64_t offset, uint8_t **p)
+{
+    if (encoder->indexCount == encoder->indexCapacity)
+    {
+        size_t capacity = encoder->indexCapacity == 0 ? 64 : encoder->indexCapacity * 2;
+        TraceIndexEntry *index = realloc(encoder->index, capacity * sizeof(TraceIndexEntry));
+        if (index == NULL)
+        {
+            printf("Error: out of memory\n");
+            exit(1);
+        }
+        encoder->index = index;
+        encoder->indexCapacity = capacity;
+    }
+    const TraceMachineState *state = &encoder->state;
+    encoder->index[encoder->indexCount++] = (TraceIndexEntry){state->cycle, offset};
+
+    PutU8(p, TRACE_OP_KEYFRAME << 5);
+    PutU32(p, state->cycle);
+    PutU16(p, state->pc);
+    PutU8(p, state->sreg);
+    memcpy(*p, state->registers, 64);
+    *p += 64;
+    uint8_t *count = *p;
+    *p += 2;
+    uint16_t written = 0;
+    for (int address = 0; address < 2048; address++)
+    {
+        if (state->data[address] != 0)
+        {
+            PutU16(p, (uint16_t)address);
+            PutU8(p, (uint8_t)state->data[address]);
+            written++;
+        }
+    }
+    PutU16(&count, written);
+    ClearStages(&encoder->state);
+}
+
+// Function to write a stage record, naming the row and the operands only when they cannot be predicted
+static void EncodeStage(const TraceEncoder *encoder, const TraceEvent *event, uint8_t **p)
+{
+    uint8_t stage = event->index & 3;
+    if (!event->occupied && event->address == 0 && event->opcode == 0 && event->operand1 == 0 && event->value2 == 0 &&
+        event->type == 0)
+    {
+        PutU8(p, (uint8_t)(TRACE_OP_STAGE << 5 | TRACE_STAGE_EMPTY << 2 | stage));
+        return;
+    }
+    const TraceEvent *known = RowEvent(&encoder->rows, stage, event->address);
+    if (known != NULL && SameStage(event, known))
+    {
+        uint16_t predicted;
+        if (PredictRow(&encoder->state, stage, &predicted) && predicted == event->address)
+        {
+            PutU8(p, (uint8_t)(TRACE_OP_STAGE << 5 | TRACE_STAGE_PREDICTED << 2 | stage));
+            return;
+        }
+        PutU8(p, (uint8_t)(TRACE_OP_STAGE << 5 | TRACE_STAGE_ROW << 2 | stage));
+        PutVarint(p, event->address);
+        return;
+    }
+    PutU8(p, (uint8_t)(TRACE_OP_STAGE << 5 | TRACE_STAGE_EXPLICIT << 2 | stage));
+    PutVarint(p, event->address);
+    PutU8(p, event->occupied);
+    PutU8(p, event->opcode);
+    PutU8(p, event->operand1);
+    PutU8(p, (uint8_t)event->value2);
+    PutU8(p, (uint8_t)event->type);
+}
+
+size_t TraceEncodeEvent(TraceEncoder *encoder, const TraceEvent *event, uint64_t offset, uint8_t *out)
+{
+    uint8_t *p = out;
+    TraceMachineState *state = &encoder->state;
+    if (!encoder->started)
+    {
+        encoder->started = true;
+        state->cycle = event->kind == TRACE_CYCLE_BEGIN ? event->cycle - 1 : event->cycle;
+        encoder->nextKeyframe = state->cycle + 1 + encoder->keyframeInterval;
+        EncodeHeader(encoder, &p);
+        EncodeKeyframe(encoder, offset + (uint64_t)(p - out), &p);
+    }
+    switch (event->kind)
+    {
+    case TRACE_CYCLE_BEGIN:
+        if (event->cycle >= encoder->nextKeyframe)
+        {
+            encoder->nextKeyframe = event->cycle + encoder->keyframeInterval;
+            EncodeKeyframe(encoder, offset + (uint64_t)(p - out), &p);
+        }
+        if (event->cycle == state->cycle + 1)
+        {
+            PutU8(&p, TRACE_OP_BEGIN << 5);
+        }
+        else
+        {
+            // zigzag, so a cycle counter that went back stays short
+            int64_t step = (int64_t)event->cycle - (int64_t)state->cycle;
+            PutU8(&p, TRACE_OP_BEGIN << 5 | 1);
+            PutVarint(&p, (uint64_t)(step * 2) ^ (uint64_t)(step >> 63));
+        }
+        break;
+    case TRACE_CYCLE_END:
+        PutU8(&p, TRACE_OP_END << 5);
+        break;
+    case TRACE_STAGE:
+        EncodeStage(encoder, event, &p);
+        break;
+    case TRACE_REGISTER_WRITE:
+        PutU8(&p, TRACE_OP_REGISTER << 5);
+        PutU8(&p, event->index);
+        PutU8(&p, (uint8_t)event->value);
+        break;
+    case TRACE_FLAG_UPDATE:
+        if (event->index < 8 && (event->value == 0 || event->value == 1))
+        {
+            PutU8(&p, (uint8_t)(TRACE_OP_FLAG << 5 | event->value << 3 | event->index));
+        }
+        else
+        {
+            // bit 4: the flag and the value follow as bytes
+            PutU8(&p, TRACE_OP_FLAG << 5 | 0x10);
+            PutU8(&p, event->index);
+            PutU8(&p, (uint8_t)event->value);
+        }
+        break;
+    case TRACE_MEMORY_WRITE:
+        PutU8(&p, TRACE_OP_MEMORY << 5);
+        PutU16(&p, event->address);
+        PutU8(&p, (uint8_t)event->value);
+        break;
+    case TRACE_PC_WRITE:
+        PutU8(&p, TRACE_OP_PC << 5);
+        PutU16(&p, event->address);
+        break;
+    default:
+        // unknown kinds have no record; they are not produced by the simulator
+        return (size_t)(p - out);
+    }
+    ApplyEvent(state, event);
+    return (size_t)(p - out);
+}
+
+uint8_t *TraceEncodeIndex(TraceEncoder *encoder, uint64_t offset, size_t *length)
+{
+    // a trace without events still gets its header and the state it started from
+    size_t start = encoder->started ? 0 : TRACE_FILE_MAX_RECORD;
+    uint8_t *bytes = malloc(start + (encoder->indexCount + 1) * TRACE_FILE_INDEX_ENTRY_BYTES + TRACE_FILE_TRAILER_BYTES);
+    if (bytes == NULL)
+    {
+        return NULL;
+    }
+    uint8_t *p = bytes;
+    if (!encoder->started)
+    {
+        encoder->started = true;
+        EncodeHeader(encoder, &p);
+        EncodeKeyframe(encoder, offset + (uint64_t)(p - bytes), &p);
+        offset += (uint64_t)(p - bytes);
+    }
+    for (size_t i = 0; i < encoder->indexCount; i++)
+    {
+        PutU32(&p, encoder->index[i].cycle);
+        PutU64(&p, encoder->index[i].offset);
+    }
+    memcpy(p, TRACE_FILE_INDEX_MAGIC, 4);
+    p += 4;
+    PutU32(&p, (uint32_t)encoder->indexCount);
+    PutU64(&p, offset);
+    *length = (size_t)(p - bytes);
+    return bytes;
+}
+
+void TraceEncoderFree(TraceEncoder *encoder)
+{
+    free(encoder->index);
+    encoder->index = NULL;
+    encoder->indexCount = 0;
+    encoder->indexCapacity = 0;
+}
+
+// Function to fill an AssemblerError (when one was given) and fail
+static bool TraceFileError(AssemblerError *error, int line, const char *message)
+{
+    if (error != NULL)
+    {
+        error->line = line;
+        error->column = 0;
+        snprintf(error->message, sizeof(error->message), "%s", message);
+    }
+    return false;
+}
+
+// Function to read a whole file into memory
+static uint8_t *ReadWholeFile(const char *file_name, size_t *size)
+{
+    FILE *stream = fopen(file_name, "rb");
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+    size_t capacity = 1 << 16;
+    size_t length = 0;
+    uint8_t *bytes = malloc(capacity);
+    while (bytes != NULL)
+    {
+        length += fread(bytes + length, 1, capacity - length, stream);
+        if (length < capacity)
+        {
+            break;
+        }
+        uint8_t *grown = realloc(bytes, capacity * 2);
+        if (grown == NULL)
+        {
+            free(bytes);
+            bytes = NULL;
+            break;
+        }
+        bytes = grown;
+        capacity *= 2;
+    }
+    fclose(stream);
+    *size = length;
+    return bytes;
+}
+
+// Function to read the index at the end of a trace; false leaves the reader without one
+static bool ReadIndex(TraceReader *reader)
+{
+    if (reader->size < reader->streamStart + TRACE_FILE_TRAILER_BYTES)
+    {
+        return false;
+    }
+    const uint8_t *trailer = reader->bytes + reader->size - TRACE_FILE_TRAILER_BYTES;
+    if (memcmp(trailer, TRACE_FILE_INDEX_MAGIC, 4) != 0)
+    {
+        return false;
+    }
+    TraceCursor cursor = {trailer + 4, trailer + TRACE_FILE_TRAILER_BYTES, true};
+    uint64_t count = ReadU32(&cursor);
+    uint64_t offset = ReadU64(&cursor);
+    if (offset < reader->streamStart || offset > reader->size ||
+        offset + count * TRACE_FILE_INDEX_ENTRY_BYTES + TRACE_FILE_TRAILER_BYTES != reader->size)
+    {
+        return false;
+    }
+    reader->index = malloc((count == 0 ? 1 : count) * sizeof(TraceIndexEntry));
+    if (reader->index == NULL)
+    {
+        return false;
+    }
+    cursor = (TraceCursor){reader->bytes + offset, trailer, true};
+    for (uint64_t i = 0; i < count; i++)
+    {
+        reader->index[i].cycle = ReadU32(&cursor);
+        reader->index[i].offset = ReadU64(&cursor);
+        if (reader->index[i].offset < reader->streamStart || reader->index[i].offset >= offset)
+        {
+            free(reader->index);
+            reader->index = NULL;
+            return false;
+        }
+    }
+    reader->indexCount = (size_t)count;
+    reader->streamEnd = (size_t)offset;
+    return true;
+}
+
+bool TraceReaderOpen(TraceReader *reader, const char *file_name, AssemblerError *error)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->bytes = ReadWholeFile(file_name, &reader->size);
+    if (reader->bytes == NULL)
+    {
+        return TraceFileError(error, 0, "could not read the file");
+    }
+    TraceFileHeader header;
+    if (reader->size < sizeof(header) || memcmp(reader->bytes, TRACE_FILE_MAGIC, 4) != 0)
+    {
+        TraceReaderClose(reader);
+        return TraceFileError(error, -1, "not a compact trace");
+    }
+    memcpy(&header, reader->bytes, sizeof(header));
+    if (header.version != TRACE_FILE_VERSION)
+    {
+        TraceReaderClose(reader);
+        return TraceFileError(error, -1, "unsupported compact trace version");
+    }
+    reader->keyframeInterval = header.keyframeInterval;
+
+    TraceCursor cursor = {reader->bytes + sizeof(header), reader->bytes + reader->size, true};
+    memset(reader->instructions, 0xff, sizeof(reader->instructions));
+    uint16_t count = ReadU16(&cursor);
+    for (uint16_t i = 0; i < count && cursor.ok; i++)
+    {
+        uint16_t row = ReadU16(&cursor);
+        reader->instructions[row & 1023] = (int16_t)ReadU16(&cursor);
+    }
+    if (!cursor.ok)
+    {
+        TraceReaderClose(reader);
+        return TraceFileError(error, -1, "truncated compact trace");
+    }
+    BuildRowTable(&reader->rows, reader->instructions);
+    reader->streamStart = (size_t)(cursor.p - reader->bytes);
+    reader->streamEnd = reader->size;
+    ReadIndex(reader);
+    TraceReaderSeek(reader, 0);
+    return true;
+}
+
+void TraceReaderSeek(TraceReader *reader, uint32_t cycle)
+{
+    reader->position = reader->streamStart;
+    reader->damaged = false;
+    // the last keyframe taken before the cycle began
+    size_t low = 0;
+    size_t high = reader->indexCount;
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (reader->index[middle].cycle < cycle)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low > 0)
+    {
+        reader->position = (size_t)reader->index[low - 1].offset;
+    }
+    memset(&reader->state, 0, sizeof(reader->state));
+    ClearStages(&reader->state);
+}
+
+// Function to load the state of a keyframe record
+static void DecodeKeyframe(TraceReader *reader, TraceCursor *cursor)
+{
+    TraceMachineState *state = &reader->state;
+    state->cycle = ReadU32(cursor);
+    state->pc = ReadU16(cursor);
+    state->sreg = ReadU8(cursor);
+    for (int reg = 0; reg < 64; reg++)
+    {
+        state->registers[reg] = (int8_t)ReadU8(cursor);
+    }
+    memset(state->data, 0, sizeof(state->data));
+    uint16_t count = ReadU16(cursor);
+    for (uint16_t i = 0; i < count && cursor->ok; i++)
+    {
+        uint16_t address = ReadU16(cursor);
+        state->data[address & 2047] = (int8_t)ReadU8(cursor);
+    }
+    ClearStages(state);
+}
+
+// Function to decode a stage record against the predictions
+static void DecodeStage(const TraceReader *reader, uint8_t op, TraceCursor *cursor, TraceEvent *event)
+{
+    uint8_t stage = op & 3;
+    uint8_t encoding = (op >> 2) & 3;
+    event->index = stage;
+    if (encoding == TRACE_STAGE_EMPTY)
+    {
+        return;
+    }
+    uint16_t row = 0;
+    if (encoding == TRACE_STAGE_PREDICTED)
+    {
+        if (!PredictRow(&reader->state, stage, &row))
+        {
+            cursor->ok = false;
+            return;
+        }
+    }
+    else
+    {
+        row = (uint16_t)GetVarint(cursor);
+    }
+    if (encoding == TRACE_STAGE_EXPLICIT)
+    {
+        event->address = row;
+        event->occupied = ReadU8(cursor);
+        event->opcode = ReadU8(cursor);
+        event->operand1 = ReadU8(cursor);
+        event->value2 = (int8_t)ReadU8(cursor);
+        event->type = (char)ReadU8(cursor);
+        return;
+    }
+    const TraceEvent *known = RowEvent(&reader->rows, stage, row);
+    if (known == NULL || !known->occupied)
+    {
+        cursor->ok = false;
+        return;
+    }
+    *event = *known;
+    event->index = stage;
+}
+
+bool TraceReaderNext(TraceReader *reader, TraceEvent *event)
+{
+    TraceCursor cursor = {reader->bytes + reader->position, reader->bytes + reader->streamEnd, true};
+    while (!reader->damaged && cursor.p < cursor.end)
+    {
+        uint8_t op = ReadU8(&cursor);
+        memset(event, 0, sizeof(*event));
+        event->cycle = reader->state.cycle;
+        switch (op >> 5)
+        {
+        case TRACE_OP_KEYFRAME:
+            DecodeKeyframe(reader, &cursor);
+            if (cursor.ok)
+            {
+                reader->position = (size_t)(cursor.p - reader->bytes);
+                continue;
+            }
+            break;
+        case TRACE_OP_BEGIN:
+            event->kind = TRACE_CYCLE_BEGIN;
+            if (op & 1)
+            {
+                uint64_t zigzag = GetVarint(&cursor);
+                int64_t step = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+                event->cycle = (uint32_t)((int64_t)reader->state.cycle + step);
+            }
+            else
+            {
+                event->cycle = reader->state.cycle + 1;
+            }
+            break;
+        case TRACE_OP_END:
+            event->kind = TRACE_CYCLE_END;
+            break;
+        case TRACE_OP_STAGE:
+            event->kind = TRACE_STAGE;
+            DecodeStage(reader, op, &cursor, event);
+            break;
+        case TRACE_OP_REGISTER:
+            event->kind = TRACE_REGISTER_WRITE;
+            event->index = ReadU8(&cursor);
+            event->value = (int8_t)ReadU8(&cursor);
+            break;
+        case TRACE_OP_FLAG:
+            event->kind = TRACE_FLAG_UPDATE;
+            if (op & 0x10)
+            {
+                event->index = ReadU8(&cursor);
+                event->value = (int8_t)ReadU8(&cursor);
+            }
+            else
+            {
+                event->index = op & 7;
+                event->value = (op >> 3) & 1;
+            }
+            break;
+        case TRACE_OP_MEMORY:
+            event->kind = TRACE_MEMORY_WRITE;
+            event->address = ReadU16(&cursor);
+            event->value = (int8_t)ReadU8(&cursor);
+            break;
+        default:
+            event->kind = TRACE_PC_WRITE;
+            event->address = ReadU16(&cursor);
+            break;
+        }
+        if (!cursor.ok)
+        {
+            break;
+        }
+        reader->position = (size_t)(cursor.p - reader->bytes);
+        ApplyEvent(&reader->state, event);
+        return true;
+    }
+    if (!cursor.ok)
+    {
+        reader->damaged = true;
+    }
+    return false;
+}
+
+void TraceReaderClose(TraceReader *reader)
+{
+    free(reader->bytes);
+    free(reader->index);
+    reader->bytes = NULL;
+    reader->index = NULL;
+    reader->indexCount = 0;
+}
@@ -0,0 +1,342 @@
+/**
+ * @file TraceTool.c
+ * @brief Replays a compact trace (--trace-compact) offline: renders it in the console text format,
+ * filtered by cycle range, instruction row, register or data memory address, and rebuilds the
+ * machine state at any cycle from the nearest keyframe.
+ */
+
+#include "../Headers/CPU.h"
+#include "../Headers/Pages.h"
+#include "../Headers/Registers.h"
+#include "../Headers/Report.h"
+#include "../Headers/State.h"
+#include "../Headers/Trace.h"
+#include "../Headers/TraceFile.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief What a cycle has to contain to be printed; a negative field is not checked.
+ */
+typedef struct {
+    uint32_t from;   /**< The first cycle printed. */
+    uint32_t to;     /**< The last cycle printed. */
+    long row;        /**< A stage held the instruction of this row. */
+    long reg;        /**< This register was written. */
+    long address;    /**< This data memory address was written. */
+} TraceFilter;
+
+/**
+ * @brief The events of one cycle, from its TRACE_CYCLE_BEGIN to its TRACE_CYCLE_END.
+ */
+typedef struct {
+    TraceEvent *events; /**< The events. */
+    size_t count;       /**< Events in the cycle. */
+    size_t capacity;    /**< Events allocated. */
+} CycleEvents;
+
+// Function to print the command line usage and exit
+static void PrintUsage(const char *program)
+{
+    printf("Usage: %s [--from <cycle>] [--to <cycle>] [--pc <row>] [--register <n>] [--address <a>] <trace file>\n", program);
+    printf("       %s --state <cycle> [--state-format <text|json|binary>] <trace file>\n", program);
+    printf("       %s --info <trace file>\n", program);
+    printf("  <trace file>    a trace written with --trace-file <file> --trace-compact\n");
+    printf("  --from, --to    only print the cycles in this range, starting from the nearest keyframe\n");
+    printf("  --pc            only print the cycles in which a stage held the instruction of this row\n");
+    printf("  --register      only print the cycles that wrote this register\n");
+    printf("  --address       only print the cycles that wrote this data memory address\n");
+    printf("  --state         print the state rebuilt at the end of this cycle: the stages, then the registers and memories like the final state\n");
+    printf("  --state-format  text (default), json or a binary state file (see --diff-against of the simulator)\n");
+    printf("  --info          print the size, the cycles, the events and the keyframes of the trace\n");
+    exit(1);
+}
+
+// Function to parse a decimal option value or print the usage
+static unsigned long ParseNumber(const char *program, const char *text, unsigned long max)
+{
+    char *end;
+    unsigned long value = strtoul(text, &end, 10);
+    if (*end != '\0' || end == text || value > max)
+    {
+        PrintUsage(program);
+    }
+    return value;
+}
+
+// Function to add an event to the cycle being collected
+static void AddEvent(CycleEvents *cycle, const TraceEvent *event)
+{
+    if (cycle->count == cycle->capacity)
+    {
+        cycle->capacity = cycle->capacity == 0 ? 64 : cycle->capacity * 2;
+        cycle->events = realloc(cycle->events, cycle->capacity * sizeof(TraceEvent));
+        if (cycle->events == NULL)
+        {
+            printf("Error: out of memory\n");
+            exit(1);
+        }
+    }
+    cycle->events[cycle->count++] = *event;
+}
+
+// Function to tell whether a cycle matches the row, register and address of the filter
+static bool CycleMatches(const CycleEvents *cycle, const TraceFilter *filter)
+{
+    bool row = filter->row < 0;
+    bool reg = filter->reg < 0;
+    bool address = filter->address < 0;
+    for (size_t i = 0; i < cycle->count; i++)
+    {
+        const TraceEvent *event = &cycle->events[i];
+        row |= event->kind == TRACE_STAGE && event->occupied && event->address == filter->row;
+        reg |= event->kind == TRACE_REGISTER_WRITE && event->index == filter->reg;
+        address |= event->kind == TRACE_MEMORY_WRITE && event->address == filter->address;
+    }
+    return row && reg && address;
+}
+
+// Function to print the events of a cycle in the console text format and forget them
+static void FlushCycle(CycleEvents *cycle, const TraceFilter *filter)
+{
+    if (cycle->count > 0 && cycle->events[0].cycle >= filter->from && CycleMatches(cycle, filter))
+    {
+        char line[128];
+        for (size_t i = 0; i < cycle->count; i++)
+        {
+            int length = TraceFormatEvent(&cycle->events[i], line, sizeof(line));
+            fwrite(line, 1, (size_t)length < sizeof(line) ? (size_t)length : sizeof(line) - 1, stdout);
+        }
+    }
+    cycle->count = 0;
+}
+
+// Function to print the cycles of the trace that pass the filter
+static void PrintCycles(TraceReader *reader, const TraceFilter *filter)
+{
+    CycleEvents cycle = {NULL, 0, 0};
+    TraceEvent event;
+    TraceReaderSeek(reader, filter->from);
+    while (TraceReaderNext(reader, &event))
+    {
+        if (event.kind == TRACE_CYCLE_BEGIN)
+        {
+            FlushCycle(&cycle, filter);
+            if (event.cycle > filter->to)
+            {
+                break;
+            }
+        }
+        AddEvent(&cycle, &event);
+        if (event.kind == TRACE_CYCLE_END)
+        {
+            FlushCycle(&cycle, filter);
+        }
+    }
+    FlushCycle(&cycle, filter);
+    free(cycle.events);
+}
+
+// Function to print the state rebuilt at the end of a cycle, in the format of the final state
+static void PrintStateAt(TraceReader *reader, uint32_t target, StateFormat format)
+{
+    TraceEvent event;
+    bool reached = false;
+    TraceReaderSeek(reader, target);
+    for (;;)
+    {
+        uint32_t cycle = reader->state.cycle;
+        if (!TraceReaderNext(reader, &event))
+        {
+            break;
+        }
+        if (event.kind == TRACE_CYCLE_BEGIN && event.cycle > target)
+        {
+            // a cycle begin only moves the cycle number, the rest of the state is the one at the end of the target
+            reader->state.cycle = cycle;
+            reached = true;
+            break;
+        }
+        reached |= reader->state.cycle == target;
+    }
+    if (!reached)
+    {
+        printf("Error: cycle %u is not in the trace (it ends at cycle %u)\n", target, reader->state.cycle);
+        exit(1);
+    }
+
+    const TraceMachineState *state = &reader->state;
+    CPU *cpu = CreateCPU();
+    if (cpu == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    memcpy(cpu->generalRegisters, state->registers, 64);
+    MarkLoadedRegisters(cpu);
+    WriteStatusRegister(cpu, state->sreg);
+    cpu->pc = state->pc;
+    // the simulator's counter has moved on to the next cycle at the end of this one; the trace does not count retirements
+    cpu->clockcycles = (int)state->cycle + 1;
+    cpu->retired = STATE_RETIRED_UNKNOWN;
+    WriteDataMemoryBlock(cpu, 0, state->data, 2048);
+    WriteInstructionMemoryBlock(cpu, 0, reader->instructions, 1024);
+    if (format == STATE_FORMAT_TEXT)
+    {
+        char line[128];
+        TraceEvent begin = {.cycle = state->cycle, .kind = TRACE_CYCLE_BEGIN};
+        TraceFormatEvent(&begin, line, sizeof(line));
+        fputs(line, stdout);
+        for (int stage = 0; stage < 3; stage++)
+        {
+            TraceFormatEvent(&state->stages[stage], line, sizeof(line));
+            fputs(line, stdout);
+        }
+        printf("PC: %d\n", state->pc);
+        fflush(stdout);
+    }
+    WriteState(cpu, format, stdout);
+    DestroyCPU(cpu);
+}
+
+// Function to print the size, the cycles and the events of the trace
+static void PrintInfo(TraceReader *reader, const char *file_name)
+{
+    TraceEvent event;
+    uint64_t events = 0;
+    uint64_t cycles = 0;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    TraceReaderSeek(reader, 0);
+    while (TraceReaderNext(reader, &event))
+    {
+        events++;
+        if (event.kind == TRACE_CYCLE_BEGIN)
+        {
+            first = cycles == 0 ? event.cycle : first;
+            last = event.cycle;
+            cycles++;
+        }
+    }
+    printf("Trace: %s\n", file_name);
+    printf("Bytes: %zu (%zu of records)\n", reader->size, reader->streamEnd - reader->streamStart);
+    printf("Cycles: %llu (%u to %u)\n", (unsigned long long)cycles, first, last);
+    printf("Events: %llu\n", (unsigned long long)events);
+    printf("Bytes per cycle: %.2f\n", Ratio(reader->streamEnd - reader->streamStart, cycles));
+    printf("Keyframes: %zu indexed, every %u cycles\n", reader->indexCount, reader->keyframeInterval);
+    if (reader->index == NULL)
+    {
+        printf("Index: missing (the run did not close the trace), cycles are found from the start\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    TraceFilter filter = {0, UINT32_MAX, -1, -1, -1};
+    StateFormat format = STATE_FORMAT_TEXT;
+    const char *file_name = NULL;
+    bool info = false;
+    bool state = false;
+    bool filtered = false;
+    uint32_t state_cycle = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--from") == 0 && i + 1 < argc)
+        {
+            filter.from = (uint32_t)ParseNumber(argv[0], argv[++i], UINT32_MAX);
+            filtered = true;
+        }
+        else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc)
+        {
+            filter.to = (uint32_t)ParseNumber(argv[0], argv[++i], UINT32_MAX);
+            filtered = true;
+        }
+        else if (strcmp(argv[i], "--pc") == 0 && i + 1 < argc)
+        {
+            filter.row = (long)ParseNumber(argv[0], argv[++i], 1023);
+            filtered = true;
+        }
+        else if (strcmp(argv[i], "--register") == 0 && i + 1 < argc)
+        {
+            const char *reg = argv[++i];
+            filter.reg = (long)ParseNumber(argv[0], reg[0] == 'R' ? reg + 1 : reg, 63);
+            filtered = true;
+        }
+        else if (strcmp(argv[i], "--address") == 0 && i + 1 < argc)
+        {
+            filter.address = (long)ParseNumber(argv[0], argv[++i], 2047);
+            filtered = true;
+        }
+        else if (strcmp(argv[i], "--state") == 0 && i + 1 < argc)
+        {
+            state_cycle = (uint32_t)ParseNumber(argv[0], argv[++i], UINT32_MAX);
+            state = true;
+        }
+        else if (strcmp(argv[i], "--state-format") == 0 && i + 1 < argc)
+        {
+            if (!ParseStateFormat(argv[++i], &format))
+            {
+                PrintUsage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], "--info") == 0)
+        {
+            info = true;
+        }
+        else if (argv[i][0] == '-' || file_name != NULL)
+        {
+            PrintUsage(argv[0]);
+        }
+        else
+        {
+            file_name = argv[i];
+        }
+    }
+    if (file_name == NULL || (info && state) || ((info || state) && filtered) || filter.from > filter.to)
+    {
+        PrintUsage(argv[0]);
+    }
+
+    // the reader is large (the instruction table and the state), so it lives on the heap
+    TraceReader *reader = malloc(sizeof(TraceReader));
+    AssemblerError error;
+    if (reader == NULL)
+    {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    if (!TraceReaderOpen(reader, file_name, &error))
+    {
+        printf("Error: %s: %s\n", file_name, error.message);
+        printf("Exiting...\n");
+        exit(1);
+    }
+    static char output[1 << 20];
+    setvbuf(stdout, output, _IOFBF, sizeof(output));
+    if (info)
+    {
+        PrintInfo(reader, file_name);
+    }
+    else if (state)
+    {
+        PrintStateAt(reader, state_cycle, format);
+    }
+    else
+    {
+        PrintCycles(reader, &filter);
+    }
+    fflush(stdout);
+    bool damaged = reader->damaged;
+    TraceReaderClose(reader);
+    free(reader);
+    if (damaged)
+    {
+        fprintf(stderr, "Error: %s is damaged after the events printed\n", file_name);
+        return 1;
+    }
+    return 0;
+}
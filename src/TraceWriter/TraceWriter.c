@@ -0,0 +1,294 @@
+/**
+ * @file TraceWriter.c
+ * @brief Asynchronous trace output: the simulator pushes fixed-size records into a
+ * lock-free SPSC ring and a writer thread formats them and writes them in large blocks.
+ */
+
+#include "../Headers/TraceWriter.h"
+#include "../Headers/TraceFile.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_WRITER_BLOCK_SIZE (256 * 1024) // bytes collected before a write() is issued
+#define TRACE_WRITER_CACHE_LINE 64
+
+struct TraceWriter {
+    // Producer side, only written by the simulator thread
+    _Alignas(TRACE_WRITER_CACHE_LINE) _Atomic size_t head;
+    uint64_t stalls;
+    uint64_t dropped;
+    const CPU *watched; // copied into the encoder at the first event, then cleared
+
+    // Consumer side, only written by the writer thread
+    _Alignas(TRACE_WRITER_CACHE_LINE) _Atomic size_t tail;
+    uint64_t events;
+    uint64_t bytes;
+    uint64_t writes;
+
+    // Shared, read-mostly
+    _Alignas(TRACE_WRITER_CACHE_LINE) _Atomic bool stopping;
+    TraceEvent *ring;
+    size_t mask;
+    int fd;
+    bool closeFd;
+    TraceWriterFormat format;
+    TraceWriterPolicy policy;
+    pthread_t thread;
+    char *block;
+    size_t blockUsed;
+    TraceEncoder *encoder; // TRACE_WRITER_COMPACT only
+};
+
+// Function to write the collected block to the output, retrying short writes
+static void FlushBlock(TraceWriter *writer)
+{
+    size_t done = 0;
+    while (done < writer->blockUsed)
+    {
+        ssize_t written = write(writer->fd, writer->block + done, writer->blockUsed - done);
+        if (written <= 0)
+        {
+            perror("Trace writer");
+            break;
+        }
+        done += (size_t)written;
+    }
+    writer->bytes += done;
+    writer->writes++;
+    writer->blockUsed = 0;
+}
+
+// Function to append one record to the block in the configured format
+static void AppendEvent(TraceWriter *writer, const TraceEvent *event)
+{
+    if (writer->format == TRACE_WRITER_RAW)
+    {
+        memcpy(writer->block + writer->blockUsed, event, sizeof(TraceEvent));
+        writer->blockUsed += sizeof(TraceEvent);
+    }
+    else if (writer->format == TRACE_WRITER_COMPACT)
+    {
+        writer->blockUsed += TraceEncodeEvent(writer->encoder, event, writer->bytes + writer->blockUsed,
+                                              (uint8_t *)writer->block + writer->blockUsed);
+    }
+    else
+    {
+        int length = TraceFormatEvent(event, writer->block + writer->blockUsed, TRACE_WRITER_BLOCK_SIZE - writer->blockUsed);
+        writer->blockUsed += (size_t)length;
+    }
+    writer->events++;
+}
+
+// Function to append the index that closes a compact trace, block by block
+static void AppendIndex(TraceWriter *writer)
+{
+    size_t length;
+    uint8_t *index = TraceEncodeIndex(writer->encoder, writer->bytes + writer->blockUsed, &length);
+    if (index == NULL)
+    {
+        return;
+    }
+    size_t done = 0;
+    while (done < length)
+    {
+        if (writer->blockUsed == TRACE_WRITER_BLOCK_SIZE)
+        {
+            FlushBlock(writer);
+        }
+        size_t chunk = TRACE_WRITER_BLOCK_SIZE - writer->blockUsed < length - done ? TRACE_WRITER_BLOCK_SIZE - writer->blockUsed : length - done;
+        memcpy(writer->block + writer->blockUsed, index + done, chunk);
+        writer->blockUsed += chunk;
+        done += chunk;
+    }
+    free(index);
+}
+
+// Writer thread: drains the ring into the block buffer and writes full blocks
+static void *WriterThread(void *argument)
+{
+    TraceWriter *writer = argument;
+    struct timespec idle = {0, 50 * 1000};
+    // a text line is never longer than 128 bytes, a raw record is 16
+    size_t room = writer->format == TRACE_WRITER_COMPACT ? TRACE_FILE_MAX_RECORD : 128;
+    for (;;)
+    {
+        size_t tail = atomic_load_explicit(&writer->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&writer->head, memory_order_acquire);
+        if (tail == head)
+        {
+            if (atomic_load_explicit(&writer->stopping, memory_order_acquire))
+            {
+                // re-check after seeing the stop flag so no record pushed before it is lost
+                if (atomic_load_explicit(&writer->head, memory_order_acquire) == tail)
+                {
+                    break;
+                }
+                continue;
+            }
+            // nothing to do: hand partial blocks to the OS so readers see progress
+            if (writer->blockUsed > 0)
+            {
+                FlushBlock(writer);
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        while (tail != head)
+        {
+            if (TRACE_WRITER_BLOCK_SIZE - writer->blockUsed < room)
+            {
+                // the records of the block are copied out of the ring: free their slots before the write
+                atomic_store_explicit(&writer->tail, tail, memory_order_release);
+                FlushBlock(writer);
+            }
+            AppendEvent(writer, &writer->ring[tail & writer->mask]);
+            tail++;
+        }
+        atomic_store_explicit(&writer->tail, tail, memory_order_release);
+    }
+    if (writer->format == TRACE_WRITER_COMPACT)
+    {
+        AppendIndex(writer);
+    }
+    if (writer->blockUsed > 0)
+    {
+        FlushBlock(writer);
+    }
+    return NULL;
+}
+
+TraceWriter *TraceWriterStart(const char *path, TraceWriterFormat format, TraceWriterPolicy policy, size_t capacity)
+{
+    size_t size = 1024;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    TraceWriter *writer = aligned_alloc(TRACE_WRITER_CACHE_LINE, sizeof(TraceWriter));
+    if (writer == NULL)
+    {
+        return NULL;
+    }
+    memset(writer, 0, sizeof(TraceWriter));
+    writer->ring = malloc(size * sizeof(TraceEvent));
+    writer->block = malloc(TRACE_WRITER_BLOCK_SIZE);
+    if (format == TRACE_WRITER_COMPACT)
+    {
+        writer->encoder = malloc(sizeof(TraceEncoder));
+        if (writer->encoder != NULL)
+        {
+            TraceEncoderInit(writer->encoder, NULL, TRACE_FILE_KEYFRAME_INTERVAL);
+        }
+    }
+    writer->mask = size - 1;
+    writer->format = format;
+    writer->policy = policy;
+    atomic_init(&writer->head, 0);
+    atomic_init(&writer->tail, 0);
+    atomic_init(&writer->stopping, false);
+
+    if (strcmp(path, "-") == 0)
+    {
+        fflush(stdout);
+        writer->fd = STDOUT_FILENO;
+        writer->closeFd = false;
+    }
+    else
+    {
+        writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        writer->closeFd = true;
+    }
+    if (writer->ring == NULL || writer->block == NULL || (format == TRACE_WRITER_COMPACT && writer->encoder == NULL) ||
+        writer->fd < 0 || pthread_create(&writer->thread, NULL, WriterThread, writer) != 0)
+    {
+        if (writer->closeFd && writer->fd >= 0)
+        {
+            close(writer->fd);
+        }
+        free(writer->ring);
+        free(writer->block);
+        free(writer->encoder);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+void TraceWriterWatchCPU(TraceWriter *writer, const CPU *cpu)
+{
+    if (writer->format == TRACE_WRITER_COMPACT)
+    {
+        writer->watched = cpu;
+    }
+}
+
+void TraceWriterSink(void *context, const TraceEvent *event)
+{
+    TraceWriter *writer = context;
+    if (writer->watched != NULL)
+    {
+        // the writer thread only reads the encoder after it sees this event, published by the head store below
+        TraceEncoderInit(writer->encoder, writer->watched, TRACE_FILE_KEYFRAME_INTERVAL);
+        writer->watched = NULL;
+    }
+    size_t head = atomic_load_explicit(&writer->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&writer->tail, memory_order_acquire) > writer->mask)
+    {
+        if (writer->policy == TRACE_WRITER_DROP)
+        {
+            writer->dropped++;
+            return;
+        }
+        // back-pressure: wait for the writer thread to make room
+        writer->stalls++;
+        while (head - atomic_load_explicit(&writer->tail, memory_order_acquire) > writer->mask)
+        {
+            sched_yield();
+        }
+    }
+    writer->ring[head & writer->mask] = *event;
+    atomic_store_explicit(&writer->head, head + 1, memory_order_release);
+}
+
+TraceWriterStats TraceWriterStop(TraceWriter *writer)
+{
+    if (writer->watched != NULL)
+    {
+        // nothing was traced: the empty trace starts from the state the run ended in
+        TraceEncoderInit(writer->encoder, writer->watched, TRACE_FILE_KEYFRAME_INTERVAL);
+        writer->watched = NULL;
+    }
+    atomic_store_explicit(&writer->stopping, true, memory_order_release);
+    pthread_join(writer->thread, NULL);
+    if (writer->closeFd)
+    {
+        close(writer->fd);
+    }
+
+    TraceWriterStats stats = {
+        .events = writer->events,
+        .bytes = writer->bytes,
+        .stalls = writer->stalls,
+        .dropped = writer->dropped,
+        .writes = writer->writes,
+    };
+    if (writer->encoder != NULL)
+    {
+        TraceEncoderFree(writer->encoder);
+    }
+    free(writer->ring);
+    free(writer->block);
+    free(writer->encoder);
+    free(writer);
+    return stats;
+}